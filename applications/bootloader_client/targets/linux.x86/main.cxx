@@ -38,6 +38,7 @@
 #include <unistd.h>
 
 #include <memory>
+#include <vector>
 
 #include "os/os.h"
 #include "utils/constants.hxx"
@@ -51,7 +52,7 @@
 
 #include "openlcb/IfCan.hxx"
 #include "openlcb/DatagramCan.hxx"
-#include "openlcb/BootloaderClient.hxx"
+#include "openlcb/BootloaderOrchestrator.hxx"
 #include "openlcb/If.hxx"
 #include "openlcb/AliasAllocator.hxx"
 #include "openlcb/DefaultNode.hxx"
@@ -67,9 +68,9 @@ CanHubFlow can_hub0(&g_service);
 
 static const openlcb::NodeID NODE_ID = 0x05010101181FULL;
 
-openlcb::IfCan g_if_can(&g_executor, &can_hub0, 3, 3, 2);
+openlcb::IfCan g_if_can(&g_executor, &can_hub0, 3, 256, 2);
 openlcb::InitializeFlow g_init_flow{&g_service};
-openlcb::CanDatagramService g_datagram_can(&g_if_can, 10, 2);
+openlcb::CanDatagramService g_datagram_can(&g_if_can, 10, 16);
 static openlcb::AddAliasAllocator g_alias_allocator(NODE_ID, &g_if_can);
 openlcb::DefaultNode g_node(&g_if_can, NODE_ID);
 
@@ -84,7 +85,7 @@ const char *host = "localhost";
 const char *device_path = nullptr;
 const char *filename = nullptr;
 const char *dump_filename = nullptr;
-uint64_t destination_nodeid = 0;
+std::vector<uint64_t> destination_nodeids;
 uint64_t destination_alias = 0;
 int memory_space_id = openlcb::MemoryConfigDefs::SPACE_FIRMWARE;
 const char *checksum_algorithm = nullptr;
@@ -92,14 +93,17 @@ bool request_reboot = false;
 bool request_reboot_after = true;
 bool skip_pip = false;
 long long stream_timeout_nsec = 3000;
+unsigned parallelism = 8;
+uint32_t bandwidth_budget = 0;
+unsigned max_retries = 2;
 
 void usage(const char *e)
 {
     fprintf(stderr,
         "Usage: %s ([-i destination_host] [-p port] | [-d device_path]) [-s "
         "memory_space_id] [-c csum_algo] [-r] [-t] [-x] [-w dg_timeout] [-W "
-        "stream_timeout] [-D dump_filename] (-n nodeid | -a alias) -f "
-        "filename\n",
+        "stream_timeout] [-D dump_filename] [-j parallelism] [-B bytes_per_sec] "
+        "[-R retries] (-n nodeid [-n nodeid ...] | -a alias) -f filename\n",
         e);
     fprintf(stderr, "Connects to an openlcb bus and performs the "
                     "bootloader protocol on openlcb node with id nodeid with "
@@ -113,6 +117,14 @@ void usage(const char *e)
     fprintf(stderr, "The default target is localhost:12021.\n");
     fprintf(stderr, "nodeid should be a 12-char hex string with 0x prefix and "
                     "no separators, like '-b 0x05010101141F'\n");
+    fprintf(stderr, "-n may be given multiple times or with a comma-separated "
+                    "list of node IDs to update multiple nodes.\n");
+    fprintf(stderr, "-j parallelism sets how many nodes to update at the same "
+                    "time. Default is 8.\n");
+    fprintf(stderr, "-B bytes_per_sec limits the total data rate of the "
+                    "updates. Default is unlimited.\n");
+    fprintf(stderr, "-R retries sets how many times to retry a failed node. "
+                    "Default is 2.\n");
     fprintf(stderr, "alias should be a 3-char hex string with 0x prefix and no "
                     "separators, like '-a 0x3F9'\n");
     fprintf(stderr, "memory_space_id defines which memory space to write the "
@@ -134,7 +146,7 @@ void usage(const char *e)
 void parse_args(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "hp:i:rtd:n:a:s:f:c:xw:W:D:")) >= 0)
+    while ((opt = getopt(argc, argv, "hp:i:rtd:n:a:s:f:c:xw:W:D:j:B:R:")) >= 0)
     {
         switch (opt)
         {
@@ -157,7 +169,31 @@ void parse_args(int argc, char *argv[])
                 dump_filename = optarg;
                 break;
             case 'n':
-                destination_nodeid = strtoll(optarg, nullptr, 16);
+            {
+                char *p = optarg;
+                while (*p)
+                {
+                    destination_nodeids.push_back(strtoll(p, &p, 16));
+                    if (*p == ',')
+                    {
+                        ++p;
+                    }
+                    else if (*p)
+                    {
+                        fprintf(stderr, "Invalid node ID list %s\n", optarg);
+                        usage(argv[0]);
+                    }
+                }
+                break;
+            }
+            case 'j':
+                parallelism = atoi(optarg);
+                break;
+            case 'B':
+                bandwidth_budget = strtoul(optarg, nullptr, 10);
+                break;
+            case 'R':
+                max_retries = atoi(optarg);
                 break;
             case 'a':
                 destination_alias = strtoul(optarg, nullptr, 16);
@@ -188,16 +224,14 @@ void parse_args(int argc, char *argv[])
                 usage(argv[0]);
         }
     }
-    if (!filename || (!destination_nodeid && !destination_alias && !dump_filename))
+    if (!filename ||
+        (destination_nodeids.empty() && !destination_alias && !dump_filename) ||
+        !parallelism)
     {
         usage(argv[0]);
     }
 }
 
-openlcb::BootloaderClient bootloader_client(
-    &g_node, &g_datagram_can, &g_if_can);
-openlcb::BootloaderResponse response;
-
 void maybe_checksum(string *firmware)
 {
     if (!checksum_algorithm)
@@ -329,35 +363,52 @@ int appl_main(int argc, char *argv[])
     usleep(400000);
 
     SyncNotifiable n;
-    BarrierNotifiable bn(&n);
-    Buffer<openlcb::BootloaderRequest> *b;
-    mainBufferPool->alloc(&b);
-
-    b->set_done(&bn);
-    b->data()->dst.alias = destination_alias;
-    b->data()->dst.id = destination_nodeid;
-    b->data()->memory_space = memory_space_id;
-    b->data()->offset = 0;
-    b->data()->response = &response;
-    b->data()->request_reboot = request_reboot ? 1 : 0;
-    b->data()->request_reboot_after = request_reboot_after ? 1 : 0;
-    b->data()->skip_pip = skip_pip ? 1 : 0;
-    b->data()->data = read_file_to_string(filename);
+    openlcb::BootloaderRequest request;
+    request.memory_space = memory_space_id;
+    request.offset = 0;
+    request.request_reboot = request_reboot ? 1 : 0;
+    request.request_reboot_after = request_reboot_after ? 1 : 0;
+    request.skip_pip = skip_pip ? 1 : 0;
+    request.data = read_file_to_string(filename);
 
     printf("Read %" PRIdPTR
            " bytes from file %s. Writing to memory space 0x%02x\n",
-        b->data()->data.size(), filename, memory_space_id);
-    maybe_checksum(&b->data()->data);
+        request.data.size(), filename, memory_space_id);
+    maybe_checksum(&request.data);
 
     if (dump_filename) {
-        write_string_to_file(dump_filename, b->data()->data);
+        write_string_to_file(dump_filename, request.data);
         exit(0);
     }
-    
-    bootloader_client.send(b);
+
+    openlcb::BootloaderOrchestrator orchestrator(&g_node, &g_datagram_can,
+        &g_if_can, parallelism, bandwidth_budget, max_retries);
+    if (destination_nodeids.empty())
+    {
+        openlcb::NodeHandle dst;
+        dst.alias = destination_alias;
+        orchestrator.add_target(dst);
+    }
+    for (uint64_t id : destination_nodeids)
+    {
+        openlcb::NodeHandle dst;
+        dst.id = id;
+        dst.alias = destination_nodeids.size() == 1 ? destination_alias : 0;
+        orchestrator.add_target(dst);
+    }
+    orchestrator.start(request, &n);
     n.wait_for_notification();
-    printf("Result: %04x  %s\n", response.error_code,
-        response.error_details.c_str());
+    for (const auto &r : orchestrator.results())
+    {
+        printf("%012" PRIx64 " (alias %03x): result %04x  %s  (%u attempts)\n",
+            r.dst.id, r.dst.alias, r.response.error_code,
+            r.response.error_details.c_str(), r.attempts);
+    }
+    printf("Image crc %04x %04x %04x. %u of %u nodes failed. Throughput %.0f "
+           "bytes/sec.\n",
+        orchestrator.image_crc()[0], orchestrator.image_crc()[1],
+        orchestrator.image_crc()[2], orchestrator.num_failed(),
+        (unsigned)orchestrator.results().size(), orchestrator.throughput());
 
-    return 0;
+    return orchestrator.num_failed() ? 1 : 0;
 }
@@ -43,6 +43,7 @@
 #include "utils/constants.hxx"
 #include "utils/Hub.hxx"
 #include "utils/GcTcpHub.hxx"
+#include "utils/HubCapture.hxx"
 #include "utils/ClientConnection.hxx"
 #include "executor/Executor.hxx"
 #include "executor/Service.hxx"
@@ -63,11 +64,14 @@ const char *upstream_host = nullptr;
 bool timestamped = false;
 bool export_mdns = false;
 const char* mdns_name = "openmrn_hub";
+const char *capture_path = nullptr;
+bool capture_pcapng = false;
 
 void usage(const char *e)
 {
     fprintf(stderr, "Usage: %s [-p port] [-d device_path] [-u upstream_host] "
-                    "[-q upstream_port] [-m] [-n mdns_name] [-t]\n\n",
+                    "[-q upstream_port] [-m] [-n mdns_name] [-t] "
+                    "[-c capture_file] [-C]\n\n",
             e);
     fprintf(stderr, "GridConnect CAN HUB.\nListens to a specific TCP port, "
                     "reads CAN packets from the incoming connections using "
@@ -85,6 +89,11 @@ void usage(const char *e)
             "\t-q upstream_port   is the port number for the upstream hub.\n");
     fprintf(stderr,
             "\t-t prints timestamps for each packet.\n");
+    fprintf(stderr,
+            "\t-c capture_file   records all traffic with timestamps into "
+            "capture_file in the native binary capture format.\n");
+    fprintf(stderr,
+            "\t-C writes the capture file in pcapng format instead.\n");
 #ifdef HAVE_AVAHI_CLIENT
     fprintf(stderr,
             "\t-m exports the current service on mDNS.\n");
@@ -97,7 +106,7 @@ void usage(const char *e)
 void parse_args(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "hp:d:u:q:tmn:")) >= 0)
+    while ((opt = getopt(argc, argv, "hp:d:u:q:tmn:c:C")) >= 0)
     {
         switch (opt)
         {
@@ -119,6 +128,12 @@ void parse_args(int argc, char *argv[])
             case 't':
                 timestamped = true;
                 break;
+            case 'c':
+                capture_path = optarg;
+                break;
+            case 'C':
+                capture_pcapng = true;
+                break;
             case 'm':
                 export_mdns = true;
                 break;
@@ -144,6 +159,19 @@ int appl_main(int argc, char *argv[])
     GcPacketPrinter packet_printer(&can_hub0, timestamped);
     GcTcpHub hub(&can_hub0, port);
     vector<std::unique_ptr<ConnectionClient>> connections;
+    std::unique_ptr<CanHubCapture> capture;
+    if (capture_path)
+    {
+        int fd = ::open(capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            perror("open capture file");
+            exit(1);
+        }
+        capture.reset(new CanHubCapture(&can_hub0, fd,
+            capture_pcapng ? CanHubCapture::FORMAT_PCAPNG
+                           : CanHubCapture::FORMAT_BINARY));
+    }
 
 #ifdef HAVE_AVAHI_CLIENT
     void mdns_client_start();
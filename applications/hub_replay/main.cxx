@@ -0,0 +1,247 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file main.cxx
+ *
+ * An application that replays a recorded CAN trace into a hub (local or over
+ * TCP) and reports the achieved frame rate and end-to-end latency.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "os/os.h"
+#include "utils/constants.hxx"
+#include "utils/FileUtils.hxx"
+#include "utils/GcTcpHub.hxx"
+#include "utils/GridConnectHub.hxx"
+#include "utils/Hub.hxx"
+#include "utils/HubReplay.hxx"
+#include "utils/socket_listener.hxx"
+#include "executor/Executor.hxx"
+#include "executor/Service.hxx"
+
+Executor<1> g_executor("g_executor", 0, 1024);
+Service g_service(&g_executor);
+/// Frames are injected here.
+CanHubFlow can_hub0(&g_service);
+/// Frames coming back from the remote hub arrive here.
+CanHubFlow observe_hub(&g_service);
+
+OVERRIDE_CONST(gc_generate_newlines, 1);
+
+const char *trace_file = nullptr;
+int port = -1;
+int upstream_port = 12021;
+const char *upstream_host = nullptr;
+bool measure_latency = false;
+int start_delay_sec = 0;
+CanTraceReplay::Options replay_options;
+
+void usage(const char *e)
+{
+    fprintf(stderr,
+        "Usage: %s -f trace_file [-u upstream_host] [-q upstream_port] "
+        "[-p port] [-s speed] [-a alias_offset] [-r repeat] [-w window] "
+        "[-D delay] [-l]\n\n",
+        e);
+    fprintf(stderr,
+        "Replays a recorded CAN trace for load testing. The trace is a "
+        "GridConnect text log (optionally with the timestamps printed by "
+        "hub -t) or a binary capture written by hub -c.\n\nArguments:\n");
+    fprintf(stderr, "\t-f trace_file   is the recorded trace to play.\n");
+    fprintf(stderr,
+        "\t-u upstream_host   is the host name of a hub to send the "
+        "frames to over TCP.\n");
+    fprintf(stderr,
+        "\t-q upstream_port   is the port number for the upstream hub.\n");
+    fprintf(stderr,
+        "\t-p port   without -u, opens a local hub listening on this port "
+        "and plays the trace into it.\n");
+    fprintf(stderr,
+        "\t-s speed   playback speed relative to the recording; 1 is the "
+        "original timing, 0 is as fast as possible. Default 1.\n");
+    fprintf(stderr,
+        "\t-a alias_offset   shifts all aliases in the trace by this much, "
+        "so that multiple copies can run at once.\n");
+    fprintf(stderr, "\t-r repeat   plays the trace this many times.\n");
+    fprintf(stderr,
+        "\t-w window   maximum number of frames in flight. Default 32.\n");
+    fprintf(stderr,
+        "\t-D delay   waits this many seconds before starting the "
+        "replay.\n");
+    fprintf(stderr,
+        "\t-l measures end-to-end latency. With -u, opens a second "
+        "connection to the upstream hub and matches the frames arriving "
+        "there.\n");
+    exit(1);
+}
+
+void parse_args(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "hf:u:q:p:s:a:r:w:D:l")) >= 0)
+    {
+        switch (opt)
+        {
+            case 'h':
+                usage(argv[0]);
+                break;
+            case 'f':
+                trace_file = optarg;
+                break;
+            case 'u':
+                upstream_host = optarg;
+                break;
+            case 'q':
+                upstream_port = atoi(optarg);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 's':
+                replay_options.speed = atof(optarg);
+                break;
+            case 'a':
+                replay_options.alias_offset = strtoul(optarg, nullptr, 0);
+                break;
+            case 'r':
+                replay_options.repeat = atoi(optarg);
+                break;
+            case 'w':
+                replay_options.window = atoi(optarg);
+                break;
+            case 'D':
+                start_delay_sec = atoi(optarg);
+                break;
+            case 'l':
+                measure_latency = true;
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                usage(argv[0]);
+        }
+    }
+    if (!trace_file)
+    {
+        usage(argv[0]);
+    }
+}
+
+/// Opens a GridConnect connection to the upstream hub and attaches it to a
+/// local hub.
+/// @param hub local hub to attach the connection to.
+void connect_upstream(CanHubFlow *hub)
+{
+    int fd = ConnectSocket(upstream_host, upstream_port);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to connect to %s:%d\n", upstream_host,
+            upstream_port);
+        exit(1);
+    }
+    create_gc_port_for_can_hub(hub, fd);
+}
+
+/** Entry point to application.
+ * @param argc number of command line arguments
+ * @param argv array of command line arguments
+ * @return 0 on success
+ */
+int appl_main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    if (access(trace_file, R_OK) != 0)
+    {
+        perror(trace_file);
+        return 1;
+    }
+    std::vector<CanTraceFrame> trace;
+    int skipped = parse_can_trace(read_file_to_string(trace_file), &trace);
+    if (skipped < 0)
+    {
+        fprintf(stderr, "%s: unsupported capture file.\n", trace_file);
+        return 1;
+    }
+    fprintf(stderr, "Loaded %u frames (%d malformed).\n",
+        (unsigned)trace.size(), skipped);
+
+    std::unique_ptr<GcTcpHub> tcp_hub;
+    CanHubFlow *observer = nullptr;
+    if (upstream_host)
+    {
+        connect_upstream(&can_hub0);
+        if (measure_latency)
+        {
+            connect_upstream(&observe_hub);
+            observer = &observe_hub;
+        }
+    }
+    else
+    {
+        if (port >= 0)
+        {
+            tcp_hub.reset(new GcTcpHub(&can_hub0, port));
+        }
+        if (measure_latency)
+        {
+            observer = &can_hub0;
+        }
+    }
+    sleep(start_delay_sec);
+
+    CanTraceReplay replay(&can_hub0, &trace, replay_options);
+    if (observer)
+    {
+        replay.set_observer(observer);
+    }
+    SyncNotifiable n;
+    replay.start(&n);
+    n.wait_for_notification();
+    g_executor.sync_run([]() {});
+
+    CanTraceReplay::Stats s = replay.stats();
+    printf("frames sent: %u\n", s.frames_sent);
+    printf("elapsed: %.3f sec\n", s.elapsed_nsec / 1e9);
+    printf("rate: %.1f frames/sec\n", s.frames_per_sec);
+    if (observer)
+    {
+        printf("frames observed: %u (unmatched %u, lost %u)\n",
+            s.frames_observed, s.frames_unmatched, s.frames_lost);
+        printf("latency usec: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f "
+               "max %.1f\n",
+            s.latency_p50 / 1e3, s.latency_p90 / 1e3, s.latency_p99 / 1e3,
+            s.latency_p999 / 1e3, s.latency_max / 1e3);
+    }
+    return 0;
+}
@@ -89,13 +89,14 @@ static uint64_t destination_alias = 0;
 static int memory_space_id = openlcb::MemoryConfigDefs::SPACE_CONFIG;
 static bool do_read = false;
 static bool do_write = false;
+static unsigned window = 1;
 
 void usage(const char *e)
 {
     fprintf(stderr,
         "Usage: %s ([-i destination_host] [-p port] | [-d device_path]) [-s "
-        "memory_space_id] [-c csum_algo] (-r|-w)  (-n nodeid | -a "
-        "alias) -f filename\n",
+        "memory_space_id] [-c csum_algo] [-W window] (-r|-w)  (-n nodeid | "
+        "-a alias) -f filename\n",
         e);
     fprintf(stderr, "Connects to an openlcb bus and performs the "
                     "bootloader protocol on openlcb node with id nodeid with "
@@ -114,13 +115,16 @@ void usage(const char *e)
     fprintf(stderr, "memory_space_id defines which memory space to use "
                     "data into. Default is '-s 0xF0'.\n");
     fprintf(stderr, "-r or -w  defines whether to read or write.\n");
+    fprintf(stderr, "window is the number of datagrams to keep in flight "
+                    "(1..%u). Default is '-W 1'.\n",
+        openlcb::MemoryConfigClient::MAX_WINDOW);
     exit(1);
 }
 
 void parse_args(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "hp:d:n:a:s:f:rw")) >= 0)
+    while ((opt = getopt(argc, argv, "hp:d:n:a:s:f:rwW:")) >= 0)
     {
         switch (opt)
         {
@@ -154,6 +158,9 @@ void parse_args(int argc, char *argv[])
             case 'w':
                 do_write = true;
                 break;
+            case 'W':
+                window = atoi(optarg);
+                break;
             default:
                 fprintf(stderr, "Unknown option %c\n", opt);
                 usage(argv[0]);
@@ -201,7 +208,18 @@ int appl_main(int argc, char *argv[])
     dst.alias = destination_alias;
     dst.id = destination_nodeid;
     HASSERT(do_read);
-    auto b = invoke_flow(&g_memcfg_cli, openlcb::MemoryConfigClientRequest::READ, dst, memory_space_id);
+    SyncNotifiable n;
+    BufferPtr<openlcb::MemoryConfigClientRequest> b(g_memcfg_cli.alloc());
+    b->data()->reset(
+        openlcb::MemoryConfigClientRequest::READ, dst, memory_space_id);
+    b->data()->window = window;
+    b->data()->progress = [](unsigned bytes) {
+        fprintf(stderr, "\r%u bytes", bytes);
+    };
+    b->data()->done.reset(&n);
+    g_memcfg_cli.send(b->ref());
+    n.wait_for_notification();
+    fprintf(stderr, "\n");
 
     if (0 && do_write)
     {
@@ -57,6 +57,11 @@
 #include "utils/constants.hxx"
 #include "utils/socket_listener.hxx"
 
+// The proxy creates a virtual node for every train it is asked for, so it
+// keeps a few aliases reserved ahead.
+OVERRIDE_CONST(alias_reservation_parallel, 4);
+OVERRIDE_CONST(reserved_alias_count, 4);
+
 NO_THREAD nt;
 Executor<1> g_executor(nt);
 Service g_service(&g_executor);
@@ -201,7 +206,7 @@ int appl_main(int argc, char *argv[])
 
     g_if_can.add_addressed_message_support();
     // Bootstraps the alias allocation process.
-    g_if_can.alias_allocator()->send(g_if_can.alias_allocator()->alloc());
+    g_if_can.alias_allocator()->bootstrap();
 
     g_executor.thread_body();
     return 0;
@@ -121,6 +121,12 @@ DECLARE_CONST(local_alias_cache_size);
 /** Maximum number of local nodes */
 DECLARE_CONST(local_nodes_count);
 
+/** How many alias reservations an AliasAllocator runs concurrently. */
+DECLARE_CONST(alias_reservation_parallel);
+
+/** How many reserved aliases the stack keeps ready for new virtual nodes. */
+DECLARE_CONST(reserved_alias_count);
+
 /** Number of datagram registry entries. This is how many datagram handlers can
  * be registered (e.g. memory config protocol is one). */
 DECLARE_CONST(num_datagram_registry_entries);
@@ -142,5 +148,29 @@ DECLARE_CONST(enable_all_memory_space);
  * standard. */
 DECLARE_CONST(node_init_identify);
 
+/** Bus budget of the node initialization in messages per second. Zero means
+ * unlimited. */
+DECLARE_CONST(node_init_messages_per_sec);
+
+/** How many node initialization messages may be sent back-to-back before the
+ * node_init_messages_per_sec budget applies. */
+DECLARE_CONST(node_init_burst_messages);
+
+/** Number of multi-frame addressed messages that an IfCan can reassemble at
+ * the same time. When all are in use, the oldest open message is evicted. */
+DECLARE_CONST(can_addressed_reassembly_slots);
+
+/** Number of multi-frame datagrams that an IfCan can reassemble at the same
+ * time. */
+DECLARE_CONST(can_datagram_reassembly_slots);
+
+/** How long (in msec) a partially received multi-frame CAN message waits for
+ * its next frame before it is dropped. */
+DECLARE_CONST(can_reassembly_timeout_msec);
+
+/** Largest config file (in bytes) that the ConfigUpdateFlow reads into memory
+ * for the config update listeners. Larger files are read field by field. */
+DECLARE_CONST(update_snapshot_max_size);
+
 
 #endif /* _nmranet_config_h_ */
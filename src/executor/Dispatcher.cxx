@@ -0,0 +1,364 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file Dispatcher.cxx
+ *
+ * Non-templated parts of the message dispatcher.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "executor/Dispatcher.hxx"
+
+#include <algorithm>
+
+constexpr size_t DispatchIndex::END;
+
+/// Do not bother with classification below this many registrations.
+static constexpr unsigned MIN_INDEXED_HANDLERS = 4;
+/// Maximum number of distinct masks for which pairwise intersections are
+/// also tried as key masks.
+static constexpr unsigned MAX_PAIRWISE_MASKS = 16;
+/// Upper bound on the bucket table size, log2.
+static constexpr unsigned MAX_BUCKET_BITS = 6;
+
+DispatchIndex::DispatchIndex()
+    : keyMask_(0)
+    , bucketBits_(0)
+{
+    bucketStart_.resize(2, 0);
+}
+
+unsigned DispatchIndex::evaluate(
+    const std::vector<DispatchHandlerInfo> &handlers, ID key_mask)
+{
+    unsigned num_keyed = 0;
+    for (const auto &h : handlers)
+    {
+        if (h.handler && (h.mask & key_mask) == key_mask)
+        {
+            ++num_keyed;
+        }
+    }
+    bucketBits_ = 0;
+    while (key_mask && (1u << bucketBits_) < num_keyed &&
+        bucketBits_ < MAX_BUCKET_BITS)
+    {
+        ++bucketBits_;
+    }
+    keyMask_ = key_mask;
+    unsigned num_buckets = 1u << bucketBits_;
+    bucketStart_.assign(num_buckets + 1, 0);
+    wildcard_.clear();
+    for (unsigned i = 0; i < handlers.size(); ++i)
+    {
+        const auto &h = handlers[i];
+        if (!h.handler)
+        {
+            continue;
+        }
+        if ((h.mask & key_mask) == key_mask)
+        {
+            ++bucketStart_[bucket_of(h.id & key_mask) + 1];
+        }
+        else
+        {
+            wildcard_.push_back(i);
+        }
+    }
+    // The expected number of candidates for a message hitting a random
+    // registered key is the wildcard count plus the weighted average bucket
+    // size. Kept scaled by num_keyed to stay in integers.
+    unsigned sumsq = 0;
+    for (unsigned b = 1; b <= num_buckets; ++b)
+    {
+        sumsq += bucketStart_[b] * bucketStart_[b];
+    }
+    if (!num_keyed)
+    {
+        return wildcard_.size();
+    }
+    return wildcard_.size() + (sumsq + num_keyed - 1) / num_keyed;
+}
+
+void DispatchIndex::rebuild(
+    const std::vector<DispatchHandlerInfo> &handlers, bool linear)
+{
+    HASSERT(handlers.size() < 0xffffu);
+    ID best_mask = 0;
+    unsigned num_handlers = 0;
+    std::vector<ID> masks;
+    for (const auto &h : handlers)
+    {
+        if (!h.handler)
+        {
+            continue;
+        }
+        ++num_handlers;
+        if (h.mask &&
+            std::find(masks.begin(), masks.end(), h.mask) == masks.end())
+        {
+            masks.push_back(h.mask);
+        }
+    }
+    if (!linear && num_handlers >= MIN_INDEXED_HANDLERS)
+    {
+        // Candidate key masks are the registered masks and, if there are
+        // not too many of them, their pairwise intersections.
+        if (masks.size() <= MAX_PAIRWISE_MASKS)
+        {
+            unsigned num_masks = masks.size();
+            for (unsigned i = 0; i < num_masks; ++i)
+            {
+                for (unsigned j = i + 1; j < num_masks; ++j)
+                {
+                    ID m = masks[i] & masks[j];
+                    if (m &&
+                        std::find(masks.begin(), masks.end(), m) ==
+                            masks.end())
+                    {
+                        masks.push_back(m);
+                    }
+                }
+            }
+        }
+        unsigned best_cost = num_handlers;
+        for (ID m : masks)
+        {
+            unsigned cost = evaluate(handlers, m);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_mask = m;
+            }
+        }
+    }
+    evaluate(handlers, best_mask);
+    // Turns the bucket sizes into bucket start offsets and fills in the
+    // entries in increasing slot order.
+    unsigned num_buckets = 1u << bucketBits_;
+    for (unsigned b = 1; b <= num_buckets; ++b)
+    {
+        bucketStart_[b] += bucketStart_[b - 1];
+    }
+    entries_.resize(bucketStart_[num_buckets]);
+    std::vector<uint16_t> fill(bucketStart_.begin(), bucketStart_.end() - 1);
+    for (unsigned i = 0; i < handlers.size(); ++i)
+    {
+        const auto &h = handlers[i];
+        if (h.handler && (h.mask & keyMask_) == keyMask_)
+        {
+            entries_[fill[bucket_of(h.id & keyMask_)]++] = i;
+        }
+    }
+}
+
+void DispatchIndex::begin(ID id, size_t from, Cursor *c) const
+{
+    unsigned b = bucket_of(id & keyMask_);
+    const uint16_t *base = entries_.data();
+    c->bucket_ = std::lower_bound(
+        base + bucketStart_[b], base + bucketStart_[b + 1], from);
+    c->bucketEnd_ = base + bucketStart_[b + 1];
+    c->wildcard_ =
+        std::lower_bound(wildcard_.data(), wildcard_.data() + wildcard_.size(),
+            from);
+    c->wildcardEnd_ = wildcard_.data() + wildcard_.size();
+}
+
+DispatchHandlerTable::DispatchHandlerTable()
+    : lock_(true)
+    , epoch_(0)
+    , inCall_(false)
+    , callThread_(os_thread_self())
+    , linear_(false)
+    , dirty_(false)
+    , current_(new Snapshot)
+    , inUse_(nullptr)
+    , hasRetired_(false)
+{
+}
+
+DispatchHandlerTable::~DispatchHandlerTable()
+{
+    HASSERT(!inUse_.load());
+    delete current_.load();
+    for (Snapshot *s : retired_)
+    {
+        delete s;
+    }
+}
+
+size_t DispatchHandlerTable::size()
+{
+    OSMutexLock h(&lock_);
+    size_t ret = 0;
+    for (auto &h : handlers_)
+    {
+        if (h.handler)
+        {
+            ++ret;
+        }
+    }
+    return ret;
+}
+
+void DispatchHandlerTable::add(void *handler, ID id, ID mask, bool linear)
+{
+    OSMutexLock h(&lock_);
+    size_t idx = 0;
+    while (idx < handlers_.size() && handlers_[idx].handler)
+    {
+        ++idx;
+    }
+    if (idx >= handlers_.size())
+    {
+        handlers_.resize(handlers_.size() + 1);
+    }
+    handlers_[idx].handler = handler;
+    handlers_[idx].id = id;
+    handlers_[idx].mask = mask;
+    changed(linear);
+}
+
+void DispatchHandlerTable::remove(void *handler, ID id, ID mask, bool linear)
+{
+    {
+        OSMutexLock h(&lock_);
+        size_t idx = 0;
+        while (idx < handlers_.size() &&
+            !handlers_[idx].Equals(id, mask, handler))
+        {
+            ++idx;
+        }
+        // Checks that we found the thing to unregister.
+        HASSERT(idx < handlers_.size() &&
+                "Tried to unregister a handler not previously registered.");
+        handlers_[idx].handler = nullptr;
+        if (idx == handlers_.size() - 1)
+        {
+            handlers_.resize(handlers_.size() - 1);
+        }
+        changed(linear);
+    }
+    wait_for_reader();
+}
+
+void DispatchHandlerTable::remove_all(void *handler, bool linear)
+{
+    {
+        OSMutexLock h(&lock_);
+        for (size_t i = 0; i < handlers_.size(); ++i)
+        {
+            if (handlers_[i].handler == handler)
+            {
+                handlers_[i].handler = nullptr;
+            }
+        }
+        while (!handlers_.empty() && handlers_.back().handler == nullptr)
+        {
+            handlers_.pop_back();
+        }
+        changed(linear);
+    }
+    wait_for_reader();
+}
+
+void DispatchHandlerTable::wait_for_reader()
+{
+    // The epoch was bumped before this load. A reader announcing a call after
+    // that sees the new epoch and checks the registrations again.
+    while (inCall_.load() && callThread_.load() != os_thread_self())
+    {
+        usleep(100);
+    }
+}
+
+bool DispatchHandlerTable::begin_call(
+    void *handler, ID id, ID mask, uint32_t epoch)
+{
+    callThread_.store(os_thread_self());
+    while (true)
+    {
+        inCall_.store(true);
+        if (epoch_.load() == epoch)
+        {
+            return true;
+        }
+        // The registrations changed since the handler was picked. Looks for
+        // the same registration in the latest snapshot, then checks again
+        // that no change happened in the meantime.
+        inCall_.store(false);
+        const Snapshot *s = acquire();
+        bool found = false;
+        for (const auto &h : s->handlers)
+        {
+            if (h.Equals(id, mask, handler))
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+        epoch = s->epoch;
+    }
+}
+
+void DispatchHandlerTable::publish()
+{
+    dirty_.store(false);
+    Snapshot *s = new Snapshot;
+    s->handlers = handlers_;
+    s->index.rebuild(s->handlers, linear_);
+    s->epoch = epoch_.load();
+    retired_.push_back(current_.load());
+    current_.store(s);
+    hasRetired_.store(true);
+    reclaim();
+}
+
+void DispatchHandlerTable::reclaim()
+{
+    Snapshot *in_use = inUse_.load();
+    size_t kept = 0;
+    for (Snapshot *s : retired_)
+    {
+        if (s == in_use)
+        {
+            retired_[kept++] = s;
+        }
+        else
+        {
+            delete s;
+        }
+    }
+    retired_.resize(kept);
+    hasRetired_.store(kept > 0);
+}
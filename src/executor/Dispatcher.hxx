@@ -35,11 +35,324 @@
 #ifndef _EXECUTOR_DISPATCHER_HXX_
 #define _EXECUTOR_DISPATCHER_HXX_
 
+#include <atomic>
 #include <vector>
 
 #include "executor/Notifiable.hxx"
 #include "executor/StateFlow.hxx"
 
+/// Internal information we store about each handler registered to a
+/// dispatcher: identifier, mask, handler pointer.
+struct DispatchHandlerInfo
+{
+    /// Maskable identifier type (same as DispatchFlowBase::ID).
+    typedef uint32_t ID;
+
+    DispatchHandlerInfo() : handler(nullptr)
+    {
+    }
+    ID id; ///< Bits that this handler is registered for.
+    ID mask; ///< Mask that should be applied for the bits check.
+    /// Handler to call. NULL if the handler has been removed.
+    void *handler;
+
+    /// Equality comparison function on the handlers. Used for remove()
+    /// calls.
+    ///
+    /// @param id desired id to unregister
+    /// @param mask desired mask to unregister
+    /// @param handler desired handler to unregister
+    ///
+    /// @return true if this is the instance to be removed.
+    ///
+    bool Equals(ID id, ID mask, void *handler) const
+    {
+        return (this->id == id && this->mask == mask &&
+                this->handler == handler);
+    }
+};
+
+/// Precomputed classification structure over the id/mask pairs registered to
+/// a dispatcher. Instead of evaluating every registration for every incoming
+/// message, the index picks a key mask that is covered by most registrations
+/// and hashes the handlers on the key bits into a small bucket table. The
+/// registrations whose mask does not cover the key (e.g. catch-all handlers)
+/// are kept in a separate wildcard list. For an incoming message only the
+/// handlers in the matching bucket and the wildcard list have to be looked
+/// at. Candidates are returned in increasing slot order, therefore the
+/// registration order semantics of the linear scan are retained.
+///
+/// The candidates are a superset of the matching handlers (hash collisions
+/// are possible); the caller still has to do the full match check.
+class DispatchIndex
+{
+public:
+    /// Maskable identifier type.
+    typedef DispatchHandlerInfo::ID ID;
+
+    /// Returned by Cursor::next() when there are no more candidates.
+    static constexpr size_t END = ~(size_t)0;
+
+    DispatchIndex();
+
+    /// Recomputes the index. Must be called every time the handler table is
+    /// changed.
+    ///
+    /// @param handlers the registered handler slots. Empty slots
+    /// (handler==nullptr) are allowed and will be skipped.
+    /// @param linear if true, no classification will be done, all non-empty
+    /// slots will be reported as candidates for every message.
+    void rebuild(const std::vector<DispatchHandlerInfo> &handlers,
+        bool linear);
+
+    /// @return the bits of the incoming message ID that the index is keyed
+    /// on. Zero if the index degenerated to a linear scan.
+    ID key_mask()
+    {
+        return keyMask_;
+    }
+
+    /// Enumerates the candidate slots for a given incoming message ID in
+    /// increasing order by merging the bucket of the key with the wildcard
+    /// list.
+    class Cursor
+    {
+    public:
+        /// @return the next candidate slot index or END if the enumeration
+        /// is complete.
+        size_t next()
+        {
+            size_t b = bucket_ < bucketEnd_ ? *bucket_ : END;
+            size_t w = wildcard_ < wildcardEnd_ ? *wildcard_ : END;
+            if (b < w)
+            {
+                ++bucket_;
+                return b;
+            }
+            if (w != END)
+            {
+                ++wildcard_;
+            }
+            return w;
+        }
+
+    private:
+        friend class DispatchIndex;
+        /// Next entry in the bucket of the current key.
+        const uint16_t *bucket_;
+        /// End of the bucket of the current key.
+        const uint16_t *bucketEnd_;
+        /// Next entry in the wildcard list.
+        const uint16_t *wildcard_;
+        /// End of the wildcard list.
+        const uint16_t *wildcardEnd_;
+    };
+
+    /// Starts enumerating candidates for a message.
+    ///
+    /// @param id the identifier of the incoming message.
+    /// @param from the first slot index to report; used to resume an
+    /// enumeration after the index was rebuilt.
+    /// @param c the cursor to initialize.
+    void begin(ID id, size_t from, Cursor *c) const;
+
+private:
+    /// @return the bucket number for a given key.
+    /// @param key the incoming ID masked with the key mask.
+    unsigned bucket_of(ID key) const
+    {
+        if (!bucketBits_)
+        {
+            return 0;
+        }
+        return (key * 0x9E3779B1u) >> (32 - bucketBits_);
+    }
+
+    /// Computes the bucket table for a given key mask.
+    /// @param handlers the registered handler slots.
+    /// @param key_mask the key bits to classify on.
+    /// @return the expected number of candidates per message for this key.
+    unsigned evaluate(const std::vector<DispatchHandlerInfo> &handlers,
+        ID key_mask);
+
+    /// Bits of the incoming ID that select the bucket.
+    ID keyMask_;
+    /// log2 of the number of buckets.
+    uint8_t bucketBits_;
+    /// bucketStart_[i]..bucketStart_[i+1] is the range in entries_ holding
+    /// bucket i.
+    std::vector<uint16_t> bucketStart_;
+    /// Slot indices per bucket, each bucket in increasing order.
+    std::vector<uint16_t> entries_;
+    /// Slot indices of the handlers whose mask does not cover keyMask_, in
+    /// increasing order.
+    std::vector<uint16_t> wildcard_;
+};
+
+/// Copy-on-write storage of the handler registrations of a dispatcher.
+///
+/// Registrations are rare, whereas lookups happen for every message. Writers
+/// (register / unregister) serialize on a mutex, modify a private master copy
+/// of the table and mark it dirty. The reader (the dispatch flow, which
+/// processes one message at a time) builds an immutable Snapshot (handler
+/// slots plus the classification index) from the master copy when it finds
+/// the table dirty, so a burst of registrations costs only one rebuild. In
+/// the common case the reader only does atomic loads and stores: it announces
+/// the snapshot it is using in a hazard pointer, and retired snapshots are
+/// not deleted as long as the reader is holding them.
+///
+/// Every change of the master copy bumps an epoch. Before calling a handler
+/// picked from a snapshot, the reader announces the call and checks that the
+/// handler is still registered with the same id and mask (trivially true if
+/// the epoch did not change). Unregistering waits for an announced call to
+/// finish, so a handler is never called after unregistering it returned. The
+/// reader takes the mutex only to build a snapshot after the registrations
+/// changed and to delete the retired snapshots.
+class DispatchHandlerTable
+{
+public:
+    /// Maskable identifier type.
+    typedef DispatchHandlerInfo::ID ID;
+
+    /// Immutable view of the registered handlers.
+    struct Snapshot
+    {
+        /// Handler slots. Slot indexes are stable across snapshots; removed
+        /// handlers leave an empty slot.
+        std::vector<DispatchHandlerInfo> handlers;
+        /// Classification index over handlers.
+        DispatchIndex index;
+        /// Value of the table's epoch when this snapshot was built.
+        uint32_t epoch = 0;
+    };
+
+    DispatchHandlerTable();
+    ~DispatchHandlerTable();
+
+    /// Adds a registration. Reuses the first empty slot.
+    /// @param handler handler pointer.
+    /// @param id bits to register the handler for.
+    /// @param mask mask to register the handler for.
+    /// @param linear if true, no classification index will be built.
+    void add(void *handler, ID id, ID mask, bool linear);
+
+    /// Removes a specific registration. It is an error to remove an entry
+    /// that was not registered.
+    /// @param handler handler pointer.
+    /// @param id bits the handler was registered for.
+    /// @param mask mask the handler was registered for.
+    /// @param linear if true, no classification index will be built.
+    void remove(void *handler, ID id, ID mask, bool linear);
+
+    /// Removes all registrations of a handler.
+    /// @param handler handler pointer.
+    /// @param linear if true, no classification index will be built.
+    void remove_all(void *handler, bool linear);
+
+    /// @return the number of registrations.
+    size_t size();
+
+    /// Called by the reader to get the latest snapshot. The returned snapshot
+    /// (and only that) stays valid until the next call to acquire() or
+    /// release(). Lock-free unless the registrations changed.
+    const Snapshot *acquire()
+    {
+        if (dirty_.load())
+        {
+            OSMutexLock l(&lock_);
+            if (dirty_.load())
+            {
+                publish();
+            }
+        }
+        Snapshot *s;
+        do
+        {
+            s = current_.load();
+            inUse_.store(s);
+            // If a writer published a new snapshot between our load and the
+            // hazard pointer store, it might not have seen our claim.
+        } while (current_.load() != s);
+        return s;
+    }
+
+    /// Called by the reader when the iteration is done.
+    void release()
+    {
+        inUse_.store(nullptr);
+        if (hasRetired_.load())
+        {
+            OSMutexLock l(&lock_);
+            reclaim();
+        }
+    }
+
+    /// Called by the reader before calling a handler. Announces the call and
+    /// checks that the registration is still present. Lock-free unless the
+    /// registrations changed since the snapshot the handler was taken from.
+    /// If this returns true, the caller must call end_call() after being done
+    /// with the handler.
+    /// @param handler a handler taken from a snapshot.
+    /// @param id the id the handler was registered with.
+    /// @param mask the mask the handler was registered with.
+    /// @param epoch the epoch of the snapshot handler was taken from.
+    /// @return true if handler is registered; false if it got unregistered
+    /// (in this case no call is announced).
+    bool begin_call(void *handler, ID id, ID mask, uint32_t epoch);
+
+    /// Ends the call announced by a successful begin_call().
+    void end_call()
+    {
+        inCall_.store(false);
+    }
+
+private:
+    /// Builds and publishes a new snapshot from handlers_. Requires lock_.
+    void publish();
+
+    /// Records a change in handlers_. Requires lock_.
+    /// @param linear if true, no classification index will be built.
+    void changed(bool linear)
+    {
+        epoch_.fetch_add(1);
+        linear_ = linear;
+        dirty_.store(true);
+    }
+
+    /// Waits until the reader is not calling a handler taken from a snapshot
+    /// older than the current epoch. Must be called without lock_ held.
+    void wait_for_reader();
+
+    /// Deletes the retired snapshots that the reader is not using. Requires
+    /// lock_.
+    void reclaim();
+
+    /// Serializes writers and snapshot building. Protects handlers_ and
+    /// retired_.
+    OSMutex lock_;
+    /// Master copy of the handler slots.
+    std::vector<DispatchHandlerInfo> handlers_;
+    /// Incremented on every change of handlers_.
+    std::atomic<uint32_t> epoch_;
+    /// True while the reader is calling a handler.
+    std::atomic<bool> inCall_;
+    /// Thread of the reader's last call. A handler may unregister itself
+    /// while being called, which must not wait for the call to finish.
+    std::atomic<os_thread_t> callThread_;
+    /// True if no classification index should be built.
+    bool linear_;
+    /// True if handlers_ changed since the last published snapshot.
+    std::atomic<bool> dirty_;
+    /// Latest published snapshot.
+    std::atomic<Snapshot *> current_;
+    /// Hazard pointer: the snapshot the reader is using, or nullptr.
+    std::atomic<Snapshot *> inUse_;
+    /// Snapshots that were replaced but not yet deleted.
+    std::vector<Snapshot *> retired_;
+    /// True if retired_ is not empty.
+    std::atomic<bool> hasRetired_;
+};
+
 /**
    This class takes registrations of StateFlows for incoming messages. When a
    message shows up, all the Flows that match that message will be
@@ -101,6 +414,28 @@ protected:
     /// Returns the current message's ID.
     virtual ID get_message_id() = 0;
 
+    /// Announces a call to lastHandlerToCall_ and checks that it is still
+    /// registered. Clears lastHandlerToCall_ if not.
+    /// @return true if lastHandlerToCall_ may be used; then exit_handler()
+    /// must be called when done with it.
+    bool enter_handler()
+    {
+        if (lastHandlerToCall_ &&
+            handlers_.begin_call(
+                lastHandlerToCall_, handlerId_, handlerMask_, handlerEpoch_))
+        {
+            return true;
+        }
+        lastHandlerToCall_ = nullptr;
+        return false;
+    }
+
+    /// Ends the call announced by enter_handler().
+    void exit_handler()
+    {
+        handlers_.end_call();
+    }
+
     /** Allocates an entry from lastHandlerToCall_, invoking clone() when done:
      *  return allocate_and_call(lastHandlerToCall_, STATE(clone));
      */
@@ -146,44 +481,46 @@ private:
 
     /// Internal information we store about each registered handler:
     /// identifier, mask, handler pointer.
-    struct HandlerInfo
+    typedef DispatchHandlerInfo HandlerInfo;
+
+    /// @return true if the message with a given ID should be sent to a
+    /// handler slot.
+    /// @param h handler slot
+    /// @param id identifier of the current message
+    bool matches(const HandlerInfo &h, ID id)
     {
-        HandlerInfo() : handler(nullptr)
-        {
-        }
-        ID id; ///< Bits that this handler is registered for.
-        ID mask; ///< Mask that should be applied for the bits check.
-        /// Handler to call. NULL if the handler has been removed.
-        UntypedHandler *handler;
-
-        /// Equality comparison function on the handlers. Used for remove()
-        /// calls.
-        ///
-        /// @param id desired id to unregister
-        /// @param mask desired mask to unregister
-        /// @param handler desired handler to unregister
-        ///
-        /// @return true if this is the instance to be removed.
-        ///
-        bool Equals(ID id, ID mask, UntypedHandler *handler)
-        {
-            return (this->id == id && this->mask == mask &&
-                    this->handler == handler);
-        }
-    };
+        return h.handler &&
+            (((id & h.mask) == (h.id & h.mask)) != negateMatch_);
+    }
 
-    /// Registered handlers.
-    vector<HandlerInfo> handlers_;
+    /// Registered handlers. Lookups are lock-free.
+    DispatchHandlerTable handlers_;
 
     /// Index of the next handler to look at.
     size_t currentIndex_;
+    /// Epoch of the snapshot lastHandlerToCall_ was taken from.
+    uint32_t handlerEpoch_;
+    /// Registration id of lastHandlerToCall_.
+    ID handlerId_;
+    /// Registration mask of lastHandlerToCall_.
+    ID handlerMask_;
+
+    /// Remembers the handler of a slot as the next one to call.
+    /// @param s the snapshot the slot is in.
+    /// @param slot index of the slot.
+    void set_last_handler(const DispatchHandlerTable::Snapshot *s, size_t slot)
+    {
+        const HandlerInfo &h = s->handlers[slot];
+        lastHandlerToCall_ = h.handler;
+        handlerId_ = h.id;
+        handlerMask_ = h.mask;
+        handlerEpoch_ = s->epoch;
+    }
 
 protected:
-    /// If non-NULL we still need to call this handler.
+    /// If non-NULL we still need to call this handler. Only accessed by the
+    /// dispatch flow; must be validated with enter_handler() before use.
     UntypedHandler *lastHandlerToCall_;
-private:
-    /// Protects handler add / remove against iteration.
-    OSMutex lock_;
 };
 
 
@@ -268,19 +605,21 @@ protected:
 
     /// Requests allocating a new buffer for sending off a clone.
     Action allocate_and_clone() OVERRIDE {
-        if (!this->lastHandlerToCall_) {
+        if (!this->enter_handler()) {
             // got unregistered.
             return call_immediately(STATE(clone_done));
         }
         HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
-        return allocate_and_call(h, STATE(clone));
+        Action a = allocate_and_call(h, STATE(clone));
+        this->exit_handler();
+        return a;
     }
 
     /// Takes the allocated new buffer, copies the message into it and sends
     /// off to the clone target. @return next action.
     Action clone() {
         HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
-        if (!this->lastHandlerToCall_) {  // got unregistered
+        if (!this->enter_handler()) {  // got unregistered
             BufferBase* b;
             this->cast_allocation_result(&b);
             if (b) this->get_allocation_result(h)->unref();
@@ -290,11 +629,12 @@ protected:
         copy->set_done(this->message()->new_child());
         *copy->data() = *this->message()->data();
         h->send(copy);
+        this->exit_handler();
         return call_immediately(STATE(clone_done));
     }
 
     /// Takes the existing buffer and sends off to the target flow. Only used
-    /// as the last action. Requires: lastHandlerToCall != nullptr.
+    /// as the last action. Requires: enter_handler() succeeded.
     void send_transfer() OVERRIDE {
         HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
         h->send(this->transfer_message());
@@ -308,6 +648,9 @@ template <int NUM_PRIO>
 DispatchFlowBase<NUM_PRIO>::DispatchFlowBase(Service *service)
     : UntypedStateFlow<QList<NUM_PRIO>>(service)
     , negateMatch_(false)
+    , handlerEpoch_(0)
+    , handlerId_(0)
+    , handlerMask_(0)
     , lastHandlerToCall_(nullptr)
 {
 }
@@ -321,35 +664,14 @@ DispatchFlowBase<NUM_PRIO>::~DispatchFlowBase()
 template<int NUM_PRIO>
 size_t DispatchFlowBase<NUM_PRIO>::size()
 {
-    OSMutexLock h(&lock_);
-    size_t ret = 0;
-    for (auto &h : handlers_)
-    {
-        if (h.handler)
-        {
-            ++ret;
-        }
-    }
-    return ret;
+    return handlers_.size();
 }
 
 template<int NUM_PRIO>
 void DispatchFlowBase<NUM_PRIO>::register_handler(UntypedHandler *handler,
                                                   ID id, ID mask)
 {
-    OSMutexLock h(&lock_);
-    size_t idx = 0;
-    while (idx < handlers_.size() && handlers_[idx].handler)
-    {
-        ++idx;
-    }
-    if (idx >= handlers_.size())
-    {
-        handlers_.resize(handlers_.size() + 1);
-    }
-    handlers_[idx].handler = handler;
-    handlers_[idx].id = id;
-    handlers_[idx].mask = mask;
+    handlers_.add(handler, id, mask, negateMatch_);
 }
 
 template<int NUM_PRIO>
@@ -357,42 +679,14 @@ void
 DispatchFlowBase<NUM_PRIO>::unregister_handler(UntypedHandler *handler,
                                                ID id, ID mask)
 {
-    OSMutexLock h(&lock_);
-    /// @todo(balazs.racz) optimize by looking at the current index - 1.
-    size_t idx = 0;
-    while (idx < handlers_.size() && !handlers_[idx].Equals(id, mask, handler))
-    {
-        ++idx;
-    }
-    // Checks that we found the thing to unregister.
-    HASSERT(idx < handlers_.size() &&
-            "Tried to unregister a handler not previously registered.");
-    if (lastHandlerToCall_ == handlers_[idx].handler) {
-        lastHandlerToCall_ = nullptr;
-    }
-    handlers_[idx].handler = nullptr;
-    if (idx == handlers_.size() - 1)
-    {
-        handlers_.resize(handlers_.size() - 1);
-    }
+    handlers_.remove(handler, id, mask, negateMatch_);
 }
 
 template<int NUM_PRIO>
 void DispatchFlowBase<NUM_PRIO>::unregister_handler_all(
     UntypedHandler *handler)
 {
-    OSMutexLock h(&lock_);
-    for (size_t i = 0; i < handlers_.size(); ++i)
-    {
-        if (handlers_[i].handler == handler)
-        {
-            handlers_[i].handler = nullptr;
-        }
-    }
-    while (!handlers_.empty() && handlers_.back().handler == nullptr)
-    {
-        handlers_.pop_back();
-    }
+    handlers_.remove_all(handler, negateMatch_);
 }
 
 template<int NUM_PRIO>
@@ -407,36 +701,29 @@ template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
 {
     ID id = get_message_id();
+    // We pick up the latest registrations every time we get here, because we
+    // might have been waiting for a buffer allocation.
+    const DispatchHandlerTable::Snapshot *s = handlers_.acquire();
+    size_t num_slots = s->handlers.size();
+    DispatchIndex::Cursor c;
+    s->index.begin(id, currentIndex_, &c);
+    for (currentIndex_ = c.next(); currentIndex_ < num_slots;
+         currentIndex_ = c.next())
     {
-        // @todo(balazs.racz) make the registered handlers structure for the
-        // dispatcher lock-free. This mutex here is very expensive.
-        OSMutexLock l(&lock_);
-        for (; currentIndex_ < handlers_.size(); ++currentIndex_)
+        if (!matches(s->handlers[currentIndex_], id))
         {
-            auto &h = handlers_[currentIndex_];
-            if (!h.handler)
-            {
-                continue;
-            }
-            if (negateMatch_ && (id & h.mask) == (h.id & h.mask))
-            {
-                continue;
-            }
-            if ((!negateMatch_) && (id & h.mask) != (h.id & h.mask))
-            {
-                continue;
-            }
-            // At this point: we have another handler.
-            if (!lastHandlerToCall_)
-            {
-                // This was the first we found.
-                lastHandlerToCall_ = handlers_[currentIndex_].handler;
-                continue;
-            }            
-            break;
+            continue;
+        }
+        // At this point: we have another handler.
+        if (!lastHandlerToCall_)
+        {
+            // This was the first we found.
+            set_last_handler(s, currentIndex_);
+            continue;
         }
+        break;
     }
-    if (currentIndex_ >= handlers_.size())
+    if (currentIndex_ >= num_slots)
     {
         return iteration_done();
     }
@@ -448,7 +735,17 @@ StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::clone_done()
 {
-    lastHandlerToCall_ = handlers_[currentIndex_].handler;
+    const DispatchHandlerTable::Snapshot *s = handlers_.acquire();
+    if (currentIndex_ < s->handlers.size() &&
+        matches(s->handlers[currentIndex_], get_message_id()))
+    {
+        set_last_handler(s, currentIndex_);
+    }
+    else
+    {
+        // got unregistered while we were cloning.
+        lastHandlerToCall_ = nullptr;
+    }
     ++currentIndex_;
     return call_immediately(STATE(iterate));
 }
@@ -456,10 +753,12 @@ StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::clone_done()
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iteration_done()
 {
-    if (lastHandlerToCall_)
+    if (enter_handler())
     {
         send_transfer();
+        exit_handler();
     }
+    handlers_.release();
     return release_and_exit();
 }
 
@@ -33,6 +33,10 @@
  */
 
 #include "openlcb/AliasAllocator.hxx"
+
+#include <algorithm>
+
+#include "nmranet_config.h"
 #include "openlcb/CanDefs.hxx"
 
 namespace openlcb
@@ -42,11 +46,11 @@ size_t g_alias_test_conflicts = 0;
 
 AliasAllocator::AliasAllocator(NodeID if_id, IfCan *if_can)
     : StateFlow<Buffer<AliasInfo>, QList<1>>(if_can)
-    , conflictHandler_(this)
-    , timer_(this)
     , if_id_(if_id)
-    , cid_frame_sequence_(0)
-    , conflict_detected_(0)
+    , maxParallel_(std::max(1, (int)config_alias_reservation_parallel()))
+    , activeReservations_(0)
+    , reservedTarget_(0)
+    , waitingForReservation_(0)
 {
     reinit_seed();
     // Moves all the allocated alias buffers over to the input queue for
@@ -104,15 +108,99 @@ AliasAllocator::~AliasAllocator()
 {
 }
 
+void AliasAllocator::bootstrap()
+{
+    unsigned count = std::max(1, (int)config_reserved_alias_count());
+    for (unsigned i = 0; i < count; ++i)
+    {
+        send(alloc());
+    }
+    if (reservedTarget_ < count)
+    {
+        reservedTarget_ = count;
+    }
+}
+
+void AliasAllocator::set_reserved_target(unsigned count)
+{
+    while (reservedTarget_ < count)
+    {
+        send(alloc());
+        ++reservedTarget_;
+    }
+}
+
 StateFlowBase::Action AliasAllocator::entry()
+{
+    HASSERT(message()->data()->state == AliasInfo::STATE_EMPTY);
+    for (auto &r : reservations_)
+    {
+        if (r->is_idle())
+        {
+            start_reservation(r.get());
+            return exit();
+        }
+    }
+    if (reservations_.size() < maxParallel_)
+    {
+        reservations_.emplace_back(new Reservation(this));
+        start_reservation(reservations_.back().get());
+        return exit();
+    }
+    // All reservations are busy. Comes back when one finishes.
+    waitingForReservation_ = 1;
+    return wait_and_call(STATE(entry));
+}
+
+void AliasAllocator::start_reservation(Reservation *r)
+{
+    {
+        AtomicHolder h(this);
+        ++activeReservations_;
+    }
+    r->start(transfer_message());
+}
+
+void AliasAllocator::reservation_done()
+{
+    {
+        AtomicHolder h(this);
+        --activeReservations_;
+    }
+    if (waitingForReservation_)
+    {
+        waitingForReservation_ = 0;
+        notify();
+    }
+}
+
+AliasAllocator::Reservation::Reservation(AliasAllocator *parent)
+    : StateFlowBase(parent->service())
+    , conflictHandler_(this)
+    , parent_(parent)
+    , pending_(nullptr)
+    , timer_(this)
+    , cid_frame_sequence_(0)
+    , conflict_detected_(0)
+{
+}
+
+void AliasAllocator::Reservation::start(Buffer<AliasInfo> *b)
+{
+    HASSERT(!pending_);
+    pending_ = b;
+    start_flow(STATE(entry));
+}
+
+StateFlowBase::Action AliasAllocator::Reservation::entry()
 {
     cid_frame_sequence_ = 7;
     conflict_detected_ = 0;
     HASSERT(pending_alias()->state == AliasInfo::STATE_EMPTY);
     while (!pending_alias()->alias)
     {
-        pending_alias()->alias = seed_;
-        next_seed();
+        pending_alias()->alias = parent_->seed_;
+        parent_->next_seed();
         // TODO(balazs.racz): check if the alias is already known about.
     }
     // Registers ourselves as a handler for incoming CAN frames to detect
@@ -142,7 +230,7 @@ void AliasAllocator::next_seed()
     seed_ += offset;
 }
 
-StateFlowBase::Action AliasAllocator::handle_allocate_for_cid_frame()
+StateFlowBase::Action AliasAllocator::Reservation::handle_allocate_for_cid_frame()
 {
     if (cid_frame_sequence_ >= 4)
     {
@@ -156,7 +244,7 @@ StateFlowBase::Action AliasAllocator::handle_allocate_for_cid_frame()
     }
 }
 
-StateFlowBase::Action AliasAllocator::send_cid_frame()
+StateFlowBase::Action AliasAllocator::Reservation::send_cid_frame()
 {
     LOG(VERBOSE, "Sending CID frame %d for alias %03x", cid_frame_sequence_,
         pending_alias()->alias);
@@ -168,15 +256,15 @@ StateFlowBase::Action AliasAllocator::send_cid_frame()
         return call_immediately(STATE(handle_alias_conflict));
     }
     CanDefs::control_init(*f, pending_alias()->alias,
-                        (if_id_ >> (12 * (cid_frame_sequence_ - 4))) & 0xfff,
-                        cid_frame_sequence_);
+        (parent_->if_id_ >> (12 * (cid_frame_sequence_ - 4))) & 0xfff,
+        cid_frame_sequence_);
     b->set_done(n_.reset(this));
     if_can()->frame_write_flow()->send(b);
     --cid_frame_sequence_;
     return wait_and_call(STATE(handle_allocate_for_cid_frame));
 }
 
-StateFlowBase::Action AliasAllocator::handle_alias_conflict()
+StateFlowBase::Action AliasAllocator::Reservation::handle_alias_conflict()
 {
     // Marks that we are no longer interested in frames from this alias.
     if_can()->frame_dispatcher()->unregister_handler(
@@ -189,7 +277,7 @@ StateFlowBase::Action AliasAllocator::handle_alias_conflict()
     return call_immediately(STATE(entry));
 }
 
-StateFlowBase::Action AliasAllocator::wait_done()
+StateFlowBase::Action AliasAllocator::Reservation::wait_done()
 {
     if (conflict_detected_)
     {
@@ -200,7 +288,7 @@ StateFlowBase::Action AliasAllocator::wait_done()
                              STATE(send_rid_frame));
 }
 
-StateFlowBase::Action AliasAllocator::send_rid_frame()
+StateFlowBase::Action AliasAllocator::Reservation::send_rid_frame()
 {
     LOG(VERBOSE, "Sending RID frame for alias %03x", pending_alias()->alias);
     auto *b = get_allocation_result(if_can()->frame_write_flow());
@@ -218,12 +306,14 @@ StateFlowBase::Action AliasAllocator::send_rid_frame()
         &conflictHandler_, pending_alias()->alias, ~0x1FFFF000U);
     if_can()->local_aliases()->add(AliasCache::RESERVED_ALIAS_NODE_ID,
                                    pending_alias()->alias);
-    reserved_alias_pool_.insert(transfer_message());
-    return release_and_exit();
+    parent_->reserved_alias_pool_.insert(pending_);
+    pending_ = nullptr;
+    parent_->reservation_done();
+    return exit();
 }
 
-void AliasAllocator::ConflictHandler::send(Buffer<CanMessageData> *message,
-                                                unsigned priority)
+void AliasAllocator::Reservation::ConflictHandler::send(
+    Buffer<CanMessageData> *message, unsigned priority)
 {
     if (parent_->conflict_detected_) {
         message->unref();
@@ -231,7 +321,9 @@ void AliasAllocator::ConflictHandler::send(Buffer<CanMessageData> *message,
     }
     parent_->conflict_detected_ = 1;
     g_alias_test_conflicts++;
-    if (parent_->is_state(static_cast<StateFlowBase::Callback>(&AliasAllocator::wait_done))) {
+    if (parent_->is_state(static_cast<StateFlowBase::Callback>(
+            &AliasAllocator::Reservation::wait_done)))
+    {
         /* Wakes up the actual flow to not have to wait all the 200 ms of
          * sleep. This will request the timer callback to be issued
          * immediately, which avoids race condition between the trigger and the
@@ -241,12 +333,21 @@ void AliasAllocator::ConflictHandler::send(Buffer<CanMessageData> *message,
     message->unref();
 }
 
-void AliasAllocator::TEST_finish_pending_allocation() {
-    if (is_state(STATE(wait_done))) {
+void AliasAllocator::Reservation::finish_pending_allocation()
+{
+    if (is_state(STATE(wait_done)))
+    {
         timer_.trigger();
     }
 }
 
+void AliasAllocator::TEST_finish_pending_allocation() {
+    for (auto &r : reservations_)
+    {
+        r->finish_pending_allocation();
+    }
+}
+
 void AliasAllocator::TEST_add_allocated_alias(NodeAlias alias, bool repeat)
 {
     Buffer<AliasInfo> *a;
@@ -35,6 +35,9 @@
 #ifndef _OPENLCB_ALIASALLOCATOR_HXX_
 #define _OPENLCB_ALIASALLOCATOR_HXX_
 
+#include <memory>
+#include <vector>
+
 #include "openlcb/IfCan.hxx"
 #include "openlcb/Defs.hxx"
 #include "executor/StateFlow.hxx"
@@ -91,6 +94,12 @@ struct AliasInfo
  *
  * Users who need an allocated alias should get it from the queue in
  * reserved_aliases().
+ *
+ * Each reservation takes at least 200 msec. To reserve many aliases quickly
+ * (e.g. for a command station with hundreds of virtual train nodes), several
+ * reservations can run concurrently, see set_max_parallel(), and a number of
+ * reserved aliases can be kept ready in the background, see
+ * set_reserved_target().
  */
 class AliasAllocator : public StateFlow<Buffer<AliasInfo>, QList<1>>
 {
@@ -122,10 +131,45 @@ public:
         return &reserved_alias_pool_;
     }
 
+    /// @return true if there are no alias buffers to process and no
+    /// reservation is in progress. Hides StateFlowWithQueue::is_waiting(),
+    /// which only knows about the input queue.
+    bool is_waiting()
+    {
+        AtomicHolder h(this);
+        return activeReservations_ == 0 &&
+            StateFlow<Buffer<AliasInfo>, QList<1>>::is_waiting();
+    }
+
     /** Releases a given alias. Sends out an AMR frame and puts the alias into
      * the reserved aliases queue. */
     void return_alias(NodeID id, NodeAlias alias);
 
+    /** Kicks off the alias reservations at stack start or restart. Queues
+     * config_reserved_alias_count() alias buffers (at least one) for
+     * reservation, and keeps that many reserved from then on, see
+     * set_reserved_target(). */
+    void bootstrap();
+
+    /** Sets how many alias reservations may be in progress at the same
+     * time. Each one has its own CID/RID sequence and conflict detection. The
+     * default is config_alias_reservation_parallel(). Must be called on the
+     * interface executor.
+     * @param count maximum number of concurrent reservations. */
+    void set_max_parallel(unsigned count)
+    {
+        maxParallel_ = count ? count : 1;
+    }
+
+    /** Makes the allocator keep (at least) a given number of aliases
+     * reserved. Adds alias buffers to the allocator until count buffers were
+     * added through this call. Since aliases taken from reserved_aliases()
+     * by the interface are sent back for reallocation, the queue is refilled
+     * in the background as aliases are used up. The target can not be
+     * lowered. Must be called on the interface executor.
+     * @param count number of aliases to keep reserved. */
+    void set_reserved_target(unsigned count);
+
     /** If there is a pending alias allocation waiting for the timer to expire,
      * finishes it immediately. Needed in test destructors. */
     void TEST_finish_pending_allocation();
@@ -136,33 +180,91 @@ public:
     void TEST_add_allocated_alias(NodeAlias alias, bool repeat=false);
     
 private:
-    /** Listens to incoming CAN frames and handles alias conflicts. */
-    class ConflictHandler : public IncomingFrameHandler
+    /** Runs the reservation of one alias: sends the four CID frames, waits
+     * 200 msec, then sends the RID frame. Starts over with a new alias if a
+     * conflicting frame arrives. */
+    class Reservation : public StateFlowBase
     {
     public:
-        ConflictHandler(AliasAllocator *parent) : parent_(parent)
+        /// Constructor. @param parent the owning allocator.
+        Reservation(AliasAllocator *parent);
+
+        /// Starts reserving an alias. Must be idle.
+        /// @param b the alias buffer to fill; ownership is transferred.
+        void start(Buffer<AliasInfo> *b);
+
+        /// @return true if no reservation is in progress.
+        bool is_idle()
         {
+            return is_terminated();
         }
-        void send(Buffer<CanMessageData> *message, unsigned priority) override;
+
+        /// Cuts short the 200 msec wait if we are in it.
+        void finish_pending_allocation();
 
     private:
+        /** Listens to incoming CAN frames and handles alias conflicts. */
+        class ConflictHandler : public IncomingFrameHandler
+        {
+        public:
+            ConflictHandler(Reservation *parent) : parent_(parent)
+            {
+            }
+            void send(Buffer<CanMessageData> *message,
+                unsigned priority) override;
+
+        private:
+            Reservation *parent_;
+        } conflictHandler_;
+
+        friend class ConflictHandler;
+
+        AliasInfo *pending_alias()
+        {
+            return pending_->data();
+        }
+
+        /** Physical interface for sending packets and assigning handlers to
+         * received packets. */
+        IfCan *if_can()
+        {
+            return parent_->if_can();
+        }
+
+        Action entry();
+        Action handle_allocate_for_cid_frame();
+        Action send_cid_frame();
+        Action wait_done();
+        Action send_rid_frame();
+
+        Action handle_alias_conflict();
+
+        /// Owning allocator.
         AliasAllocator *parent_;
-    } conflictHandler_;
+        /// Alias being reserved. We own this buffer while not idle.
+        Buffer<AliasInfo> *pending_;
 
-    friend class ConflictHandler;
+        StateFlowTimer timer_;
 
-    AliasInfo *pending_alias()
-    {
-        return message()->data();
-    }
+        /// Which CID frame are we trying to send out. Valid values: 7..4
+        unsigned cid_frame_sequence_ : 3;
+        /// Set to 1 if an incoming frame signals an alias conflict.
+        unsigned conflict_detected_ : 1;
+
+        /// Notifiable used for tracking outgoing frames.
+        BarrierNotifiable n_;
+    };
+
+    friend class Reservation;
 
     Action entry() override;
-    Action handle_allocate_for_cid_frame();
-    Action send_cid_frame();
-    Action wait_done();
-    Action send_rid_frame();
 
-    Action handle_alias_conflict();
+    /// Hands the current message to an idle reservation.
+    /// @param r reservation to start
+    void start_reservation(Reservation *r);
+
+    /// Called by a reservation when it became idle.
+    void reservation_done();
 
     /// Generates the next alias to check in the seed_ variable.
     void next_seed();
@@ -170,13 +272,14 @@ private:
     friend class AsyncAliasAllocatorTest;
     friend class AsyncIfTest;
 
-    StateFlowTimer timer_;
-
     /** Freelist of reserved aliases that can be used by virtual nodes. The
         AliasAllocatorFlow will post successfully reserved aliases to this
         allocator. */
     QAsync reserved_alias_pool_;
 
+    /// Reservation flows, created on demand up to maxParallel_.
+    std::vector<std::unique_ptr<Reservation>> reservations_;
+
     /// 48-bit nodeID that we will use for alias reservations.
     NodeID if_id_;
 
@@ -187,19 +290,21 @@ private:
         return static_cast<IfCan *>(service());
     }
 
-    /// Which CID frame are we trying to send out. Valid values: 7..4
-    unsigned cid_frame_sequence_ : 3;
-    /// Set to 1 if an incoming frame signals an alias conflict.
-    unsigned conflict_detected_ : 1;
+    /// Maximum number of concurrent reservations.
+    unsigned maxParallel_;
+
+    /// Number of reservations in progress. Protected by the atomic of the
+    /// flow, since is_waiting() reads it from other threads.
+    unsigned activeReservations_;
+
+    /// How many buffers were added by set_reserved_target().
+    unsigned reservedTarget_;
 
     /// Seed for generating random-looking alias numbers.
     unsigned seed_ : 12;
 
-    /// Notifiable used for tracking outgoing frames.
-    BarrierNotifiable n_;
-
-    /// Timer needed for sleeping the control flow.
-    // SleepData sleep_helper_;
+    /// 1 if the incoming alias buffer is waiting for an idle reservation.
+    unsigned waitingForReservation_ : 1;
 };
 
 /** Create this object statically to add an alias allocator to an already
@@ -33,8 +33,6 @@
 
 #include "openlcb/AliasCache.hxx"
 
-#include "os/OS.hxx"
-
 namespace openlcb
 {
 
@@ -44,8 +42,11 @@ const NodeID AliasCache::RESERVED_ALIAS_NODE_ID = 1;
 
 void AliasCache::clear()
 {
-    idMap.clear();
-    aliasMap.clear();
+    for (unsigned i = 0; i <= tableMask; ++i)
+    {
+        aliasTable[i] = EMPTY_SLOT;
+        idTable[i] = EMPTY_SLOT;
+    }
     oldest = nullptr;
     newest = nullptr;
     freeList = nullptr;
@@ -69,11 +70,11 @@ void AliasCache::add(NodeID id, NodeAlias alias)
     
     Metadata *insert;
 
-    AliasMap::Iterator it = aliasMap.find(alias);
-    if (it != aliasMap.end())
+    unsigned slot = alias_slot(alias);
+    if (aliasTable[slot] != EMPTY_SLOT)
     {
         /* we already have a mapping for this alias, so lets remove it */
-        insert = (*it).second;
+        insert = pool + aliasTable[slot];
         remove(alias);
         
         if (removeCallback)
@@ -105,8 +106,12 @@ void AliasCache::add(NodeID id, NodeAlias alias)
         }
         oldest = oldest->newer;
 
-        aliasMap.erase(insert->alias);
-        idMap.erase(insert->id);
+        erase_slot(true, alias_slot(insert->alias));
+        unsigned id_pos = id_slot(insert->id);
+        if (idTable[id_pos] == insert - pool)
+        {
+            erase_slot(false, id_pos);
+        }
 
         if (removeCallback)
         {
@@ -115,12 +120,12 @@ void AliasCache::add(NodeID id, NodeAlias alias)
         }
     }
         
-    insert->timestamp = OSTime::get_monotonic();
     insert->id = id;
     insert->alias = alias;
 
-    aliasMap[alias] = insert;
-    idMap[id] = insert;
+    /* the slots may have moved due to the removals above */
+    aliasTable[alias_slot(alias)] = insert - pool;
+    idTable[id_slot(id)] = insert - pool;
 
     /* update the time based list */
     insert->newer = NULL;
@@ -150,13 +155,18 @@ void AliasCache::add(NodeID id, NodeAlias alias)
  */
 void AliasCache::remove(NodeAlias alias)
 {
-    AliasMap::Iterator it = aliasMap.find(alias);
+    unsigned slot = alias_slot(alias);
 
-    if (it != aliasMap.end())
+    if (aliasTable[slot] != EMPTY_SLOT)
     {
-        Metadata *metadata = (*it).second;
-        aliasMap.erase(it);
-        idMap.erase(metadata->id);
+        Metadata *metadata = pool + aliasTable[slot];
+        erase_slot(true, slot);
+        unsigned id_pos = id_slot(metadata->id);
+        if (idTable[id_pos] == metadata - pool)
+        {
+            /* another entry may have taken over this node ID */
+            erase_slot(false, id_pos);
+        }
         
         if (metadata->newer)
         {
@@ -199,13 +209,13 @@ NodeAlias AliasCache::lookup(NodeID id)
 {
     HASSERT(id != 0);
 
-    IdMap::Iterator it = idMap.find(id);
+    unsigned slot = id_slot(id);
 
-    if (it != idMap.end())
+    if (idTable[slot] != EMPTY_SLOT)
     {
-        Metadata *metadata = (*it).second;
+        Metadata *metadata = pool + idTable[slot];
         
-        /* update timestamp */
+        /* mark as most recently used */
         touch(metadata);
         return metadata->alias;
     }
@@ -222,13 +232,13 @@ NodeID AliasCache::lookup(NodeAlias alias)
 {
     HASSERT(alias != 0);
 
-    AliasMap::Iterator it = aliasMap.find(alias);
+    unsigned slot = alias_slot(alias);
 
-    if (it != aliasMap.end())
+    if (aliasTable[slot] != EMPTY_SLOT)
     {
-        Metadata *metadata = (*it).second;
+        Metadata *metadata = pool + aliasTable[slot];
         
-        /* update timestamp */
+        /* mark as most recently used */
         touch(metadata);
         return metadata->id;
     }
@@ -272,13 +282,40 @@ NodeAlias AliasCache::generate()
     return alias;
 }
 
-/** Update the time stamp for a given entry.
+/** Removes a slot from a hash table, moving later entries of the same
+ * probe sequence back so that lookups need no tombstones.
+ * @param by_alias true for aliasTable, false for idTable
+ * @param slot the slot to clear
+ */
+void AliasCache::erase_slot(bool by_alias, unsigned slot)
+{
+    uint16_t *table = by_alias ? aliasTable : idTable;
+    unsigned next = slot;
+    while (true)
+    {
+        next = (next + 1) & tableMask;
+        if (table[next] == EMPTY_SLOT)
+        {
+            break;
+        }
+        Metadata *m = pool + table[next];
+        unsigned home = by_alias ? alias_hash(m->alias) : id_hash(m->id);
+        /* the entry at next can fill the hole unless its home slot is
+         * cyclically in (slot, next] */
+        if (((next - home) & tableMask) >= ((next - slot) & tableMask))
+        {
+            table[slot] = table[next];
+            slot = next;
+        }
+    }
+    table[slot] = EMPTY_SLOT;
+}
+
+/** Mark an entry as the most recently used one.
  * @param  metadata metadata associated with the entry
  */
 void AliasCache::touch(Metadata* metadata)
 {
-    metadata->timestamp = OSTime::get_monotonic();
-
     if (metadata != newest)
     {
         if (metadata == oldest)
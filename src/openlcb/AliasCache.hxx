@@ -36,8 +36,6 @@
 
 #include "openlcb/Defs.hxx"
 #include "utils/macros.h"
-#include "utils/Map.hxx"
-#include "utils/RBTree.hxx"
 
 namespace openlcb
 {
@@ -48,8 +46,10 @@ namespace openlcb
  * is no mutual exclusion locking mechanism built into this class.  Mutual
  * exclusion must be handled by the user as needed.
  *
- * @todo the class uses RBTree, consider a version that is a linear search for
- * a small number of entries.
+ * Entries are found through two open-addressing hash tables (one keyed by
+ * alias, one by node ID) with linear probing. The tables hold 16-bit indexes
+ * into the entry pool and are sized to at most half full, so a lookup is
+ * typically one or two probes in a contiguous array.
  */
 class AliasCache
 {
@@ -66,8 +66,6 @@ public:
                void *context = NULL)
         : pool(new Metadata[_entries]),
           freeList(NULL),
-          aliasMap(_entries),
-          idMap(_entries),
           oldest(NULL),
           newest(NULL),
           seed(seed),
@@ -75,6 +73,15 @@ public:
           removeCallback(remove_callback),
           context(context)
     {
+        HASSERT(_entries < EMPTY_SLOT);
+        hashShift = 31;
+        while ((1u << (32 - hashShift)) < 2 * _entries)
+        {
+            --hashShift;
+        }
+        tableMask = (1u << (32 - hashShift)) - 1;
+        aliasTable = new uint16_t[2 * (tableMask + 1)];
+        idTable = aliasTable + tableMask + 1;
         clear();
     }
 
@@ -139,6 +146,7 @@ public:
     /** Default destructor */
     ~AliasCache()
     {
+        delete [] aliasTable;
         delete [] pool;
     }
 
@@ -149,7 +157,9 @@ private:
     enum
     {
         /** marks an unused mapping */
-        UNUSED_MASK = 0x10000000
+        UNUSED_MASK = 0x10000000,
+        /** marks an empty slot in the hash tables */
+        EMPTY_SLOT = 0xFFFF,
     };
 
     /** Interesting information about a given cache entry. */
@@ -157,7 +167,6 @@ private:
     {
         NodeID id = 0; /**< 48-bit NMRAnet Node ID */
         NodeAlias alias = 0; /**< NMRAnet alias */
-        long long timestamp; /**< time stamp of last usage */
         union
         {
             Metadata *prev; /**< unused */
@@ -176,17 +185,19 @@ private:
     /** list of unused mapping entries */
     Metadata *freeList;
     
-    /** Short hand for the alias Map type */
-    typedef Map <NodeAlias, Metadata*> AliasMap;
-    
-    /** Short hand for the ID Map type */
-    typedef Map <NodeID, Metadata*> IdMap;
+    /** Hash table of alias to pool index of the corresponding Metadata, or
+     * EMPTY_SLOT. */
+    uint16_t *aliasTable;
 
-    /** Map of alias to corresponding Metadata */
-    AliasMap aliasMap;
-    
-    /** Map of Node ID to corresponding Metadata */
-    IdMap idMap;
+    /** Hash table of Node ID to pool index of the corresponding Metadata, or
+     * EMPTY_SLOT. Shares the allocation with aliasTable. */
+    uint16_t *idTable;
+
+    /** Number of slots in each hash table minus one. */
+    unsigned tableMask;
+
+    /** 32 - log2(number of slots); shifts a 32-bit hash to a slot number. */
+    unsigned hashShift;
     
     /** oldest untouched entry */
     Metadata *oldest;
@@ -206,11 +217,56 @@ private:
     /** context pointer to pass in with remove_callback */
     void *context;
 
-    /** Update the time stamp for a given entry.
+    /** Mark an entry as the most recently used one.
      * @param  metadata metadata associated with the entry
      */
     void touch(Metadata* metadata);
 
+    /** @param alias alias to look for
+     * @return the slot in aliasTable that holds alias, or the empty slot
+     * where it would be inserted. */
+    unsigned alias_slot(NodeAlias alias)
+    {
+        unsigned slot = alias_hash(alias);
+        while (aliasTable[slot] != EMPTY_SLOT &&
+            pool[aliasTable[slot]].alias != alias)
+        {
+            slot = (slot + 1) & tableMask;
+        }
+        return slot;
+    }
+
+    /** @param id node ID to look for
+     * @return the slot in idTable that holds id, or the empty slot where it
+     * would be inserted. */
+    unsigned id_slot(NodeID id)
+    {
+        unsigned slot = id_hash(id);
+        while (idTable[slot] != EMPTY_SLOT && pool[idTable[slot]].id != id)
+        {
+            slot = (slot + 1) & tableMask;
+        }
+        return slot;
+    }
+
+    /** @return home slot of an alias in aliasTable. @param alias alias */
+    unsigned alias_hash(NodeAlias alias)
+    {
+        return (uint32_t(alias) * 0x9E3779B1u) >> hashShift;
+    }
+
+    /** @return home slot of a node ID in idTable. @param id node ID */
+    unsigned id_hash(NodeID id)
+    {
+        return (uint32_t(id ^ (id >> 29)) * 0x9E3779B1u) >> hashShift;
+    }
+
+    /** Removes a slot from a hash table, moving later entries of the same
+     * probe sequence back so that lookups need no tombstones.
+     * @param by_alias true for aliasTable, false for idTable
+     * @param slot the slot to clear */
+    void erase_slot(bool by_alias, unsigned slot);
+
     DISALLOW_COPY_AND_ASSIGN(AliasCache);
 };
 
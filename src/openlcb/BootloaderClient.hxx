@@ -33,12 +33,19 @@
  * @date 14 Dec 2014
  */
 
+#ifndef _OPENLCB_BOOTLOADERCLIENT_HXX_
+#define _OPENLCB_BOOTLOADERCLIENT_HXX_
+
 #include <time.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "openlcb/DatagramDefs.hxx"
 #include "openlcb/StreamDefs.hxx"
 #include "openlcb/PIPClient.hxx"
 #include "openlcb/CanDefs.hxx"
+#include "openlcb/IfCan.hxx"
 #include "openlcb/MemoryConfig.hxx"
 #include "utils/Ewma.hxx"
 
@@ -83,6 +90,131 @@ struct BootloaderRequest
 extern int g_bootloader_timeout_sec;
 int g_bootloader_timeout_sec = 3;
 
+class BootloaderClient;
+
+/// Shares a bus bandwidth budget between multiple BootloaderClient
+/// instances. The budget is accounted in payload bytes; each client reserves
+/// the bytes it is about to send and delays the sending by the returned time.
+///
+/// Not thread-safe: all clients using the same limiter have to run on the
+/// same executor.
+class BootloaderBandwidthLimiter
+{
+public:
+    /// Constructor.
+    /// @param bytes_per_sec how many payload bytes the clients may send in
+    /// total per second. Zero means unlimited.
+    BootloaderBandwidthLimiter(uint32_t bytes_per_sec)
+        : bytesPerSec_(bytes_per_sec)
+    {
+    }
+
+    /// Reserves bandwidth for sending some bytes.
+    /// @param bytes how many payload bytes the caller is about to send.
+    /// @return how many nanoseconds the caller has to wait before sending.
+    long long reserve(unsigned bytes)
+    {
+        if (!bytesPerSec_)
+        {
+            return 0;
+        }
+        long long now = os_get_time_monotonic();
+        if (nextFreeNsec_ < now)
+        {
+            nextFreeNsec_ = now;
+        }
+        long long delay = nextFreeNsec_ - now;
+        nextFreeNsec_ += SEC_TO_NSEC(1) * bytes / bytesPerSec_;
+        return delay;
+    }
+
+private:
+    /// Budget in bytes per second; 0 if unlimited.
+    uint32_t bytesPerSec_;
+    /// Time at which the already reserved bytes will have been sent at the
+    /// budgeted rate.
+    long long nextFreeNsec_{0};
+};
+
+/// Datagram handler that receives the write stream responses for all
+/// BootloaderClient instances of a node. Needed when several clients are
+/// running concurrently on the same node, because there can be only one
+/// datagram handler registered for the memory config datagrams of a node.
+///
+/// If the node has no MemoryConfigHandler, the router registers itself for
+/// the memory config datagrams for its entire lifetime. Otherwise the router
+/// is hooked into the handler as its client, which receives all the reply
+/// commands; a MemoryConfigClient cannot run on the node at the same time.
+class BootloaderResponseRouter : public DefaultDatagramHandler
+{
+public:
+    /// Constructor. Registers the router for the configuration datagrams.
+    /// @param node the local node the bootloader clients are running on.
+    /// @param if_datagram_service datagram service of the node's interface.
+    /// @param memcfg memory config handler of the node on the same datagram
+    /// service, or nullptr if the node does not have one.
+    BootloaderResponseRouter(Node *node, DatagramService *if_datagram_service,
+        MemoryConfigHandler *memcfg = nullptr)
+        : DefaultDatagramHandler(if_datagram_service)
+        , node_(node)
+        , memoryConfigHandler_(memcfg)
+    {
+        if (memoryConfigHandler_)
+        {
+            memoryConfigHandler_->set_client(this);
+        }
+        else
+        {
+            dg_service()->registry()->insert(
+                node_, DatagramDefs::CONFIGURATION, this);
+        }
+    }
+
+    ~BootloaderResponseRouter()
+    {
+        if (memoryConfigHandler_)
+        {
+            memoryConfigHandler_->clear_client(this);
+        }
+        else
+        {
+            dg_service()->registry()->erase(
+                node_, DatagramDefs::CONFIGURATION, this);
+        }
+    }
+
+    /// Starts routing the write stream responses to a client. Must be called
+    /// on the executor of the datagram service.
+    /// @param client the client that is waiting for a response.
+    void add(BootloaderClient *client)
+    {
+        clients_.push_back(client);
+    }
+
+    /// Stops routing the write stream responses to a client. Must be called
+    /// on the executor of the datagram service.
+    /// @param client the client that is not waiting for a response anymore.
+    void remove(BootloaderClient *client)
+    {
+        clients_.erase(std::remove(clients_.begin(), clients_.end(), client),
+            clients_.end());
+    }
+
+private:
+    Action entry() override;
+    Action ok_response_sent() override;
+
+    /// Local node we are registered for.
+    Node *node_;
+    /// Handler that forwards the replies to us; nullptr if we are registered
+    /// directly.
+    MemoryConfigHandler *memoryConfigHandler_;
+    /// Clients waiting for a write stream response.
+    std::vector<BootloaderClient *> clients_;
+    /// Client the current datagram will be handed to.
+    BootloaderClient *target_{nullptr};
+};
+
 /// StateFlow performing the bootloading process.
 ///
 /// 1) allocates a datagram handler
@@ -127,6 +259,24 @@ public:
         return message()->data()->dst;
     }
 
+    /// Sets a router that receives the write stream responses instead of this
+    /// client registering its own handler. Required when multiple clients
+    /// are running concurrently on the same node. Must be called while no
+    /// request is being processed.
+    /// @param router shared router of the node; nullptr to use an own handler.
+    void set_response_router(BootloaderResponseRouter *router)
+    {
+        router_ = router;
+    }
+
+    /// Makes the client limit its outgoing data rate to a shared budget. Must
+    /// be called while no request is being processed.
+    /// @param limiter shared limiter; nullptr for no limit.
+    void set_bandwidth_limiter(BootloaderBandwidthLimiter *limiter)
+    {
+        limiter_ = limiter;
+    }
+
     void response_datagram_arrived(Buffer<IncomingDatagram> *datagram)
     {
         if (responseDatagram_)
@@ -373,8 +523,15 @@ private:
 
     void register_write_response_handler()
     {
-        datagramService_->registry()->insert(
-            node_, DatagramDefs::CONFIGURATION, &writeResponseHandler_);
+        if (router_)
+        {
+            router_->add(this);
+        }
+        else
+        {
+            datagramService_->registry()->insert(
+                node_, DatagramDefs::CONFIGURATION, &writeResponseHandler_);
+        }
         writeResponseRegistered_ = true;
     }
 
@@ -383,9 +540,30 @@ private:
         if (writeResponseRegistered_)
         {
             writeResponseRegistered_ = false;
-            datagramService_->registry()->erase(
-                node_, DatagramDefs::CONFIGURATION, &writeResponseHandler_);
+            if (router_)
+            {
+                router_->remove(this);
+            }
+            else
+            {
+                datagramService_->registry()->erase(
+                    node_, DatagramDefs::CONFIGURATION, &writeResponseHandler_);
+            }
+        }
+    }
+
+    /// Reserves bandwidth from the limiter before sending data.
+    /// @param bytes how many payload bytes will be sent.
+    /// @param c state to continue at when the data may be sent.
+    Action throttle_and_call(unsigned bytes, Callback c)
+    {
+        long long delay = limiter_ ? limiter_->reserve(bytes) : 0;
+        if (delay > 0)
+        {
+            // sleeping_ stays false: incoming messages must not wake us up.
+            return sleep_and_call(&timer_, delay, c);
         }
+        return call_immediately(c);
     }
 
     Action initiate_stream()
@@ -468,6 +646,7 @@ private:
         }
         availableBufferSize_ = maxBufferSize_;
         bufferOffset_ = 0;
+        throttleCredit_ = 0;
         speed_ = 0;
         lastMeasurementOffset_ = 0;
         lastMeasurementTimeNsec_ = os_get_time_monotonic();
@@ -482,6 +661,18 @@ private:
         {
             return call_immediately(STATE(close_stream));
         }
+        if (limiter_ && !throttleCredit_)
+        {
+            throttleCredit_ = std::min(size_t(THROTTLE_CHUNK_BYTES),
+                message()->data()->data.size() - bufferOffset_);
+            return throttle_and_call(
+                throttleCredit_, STATE(allocate_stream_frame));
+        }
+        return call_immediately(STATE(allocate_stream_frame));
+    }
+
+    Action allocate_stream_frame()
+    {
         return allocate_and_call(
             ifCan_->frame_write_flow(), STATE(fill_outgoing_stream_frame));
     }
@@ -503,6 +694,11 @@ private:
         {
             len = availableBufferSize_;
         }
+        if (limiter_)
+        {
+            len = std::min(size_t(throttleCredit_), len);
+            throttleCredit_ -= len;
+        }
         frame->can_dlc = len + 1;
         frame->data[0] = remoteStreamId_;
         memcpy(&frame->data[1], &message()->data()->data[bufferOffset_], len);
@@ -634,6 +830,13 @@ private:
     }
 
     Action next_dg_write_datagram()
+    {
+        unsigned len = message()->data()->data.size() - bufferOffset_;
+        if (len > 64) len = 64;
+        return throttle_and_call(len, STATE(send_dg_write_datagram));
+    }
+
+    Action send_dg_write_datagram()
     {
         Buffer<GenMessage> *b;
         mainBufferPool->alloc(&b);
@@ -710,14 +913,37 @@ private:
 
     Action finish()
     {
+        uint32_t dg_result = dgClient_->result();
         datagramService_->client_allocator()->typed_insert(dgClient_);
+        // The bootloader checks the application header checksums of the
+        // image upon unfreeze, and rejects the command on a mismatch. A
+        // target that rebooted without acknowledging is not an error.
+        if ((dg_result &
+                (DatagramClient::PERMANENT_ERROR | DatagramClient::RESEND_OK)) &&
+            !(dg_result &
+                (DatagramClient::TIMEOUT | DatagramClient::DST_REBOOT)))
+        {
+            return return_error(dg_result & 0xffff,
+                "Target rejected the image upon unfreeze.");
+        }
         return return_error(0, "");
     }
 
 private:
+    /// How many bytes of stream data to reserve from the bandwidth limiter
+    /// at once. A multiple of the stream payload of a CAN frame.
+    static constexpr unsigned THROTTLE_CHUNK_BYTES = 7 * 9;
+
     Node *node_;
     DatagramService *datagramService_;
     IfCan *ifCan_;
+    /// If not null, receives the write stream responses for us.
+    BootloaderResponseRouter *router_{nullptr};
+    /// If not null, the shared bandwidth budget.
+    BootloaderBandwidthLimiter *limiter_{nullptr};
+    /// How many bytes of stream data may still be sent before reserving
+    /// again from the limiter.
+    unsigned throttleCredit_{0};
     DatagramClient *dgClient_ = nullptr;
     Buffer<IncomingDatagram> *responseDatagram_ = nullptr;
     uint8_t localStreamId_;
@@ -760,4 +986,45 @@ private:
     PIPClient pipClient_{ifCan_};
 };
 
+inline StateFlowBase::Action BootloaderResponseRouter::entry()
+{
+    IncomingDatagram *datagram = message()->data();
+    target_ = nullptr;
+    if (datagram->payload.size() >= 6 &&
+        datagram->payload[0] == DatagramDefs::CONFIGURATION &&
+        ((datagram->payload[1] & 0xF4) ==
+            MemoryConfigDefs::COMMAND_WRITE_STREAM_REPLY))
+    {
+        for (BootloaderClient *c : clients_)
+        {
+            if (datagram->dst == c->node() &&
+                c->node()->iface()->matching_node(c->dst(), datagram->src))
+            {
+                target_ = c;
+                break;
+            }
+        }
+    }
+    if (!target_)
+    {
+        // Uninteresting datagram.
+        return respond_reject(DatagramDefs::PERMANENT_ERROR);
+    }
+    return respond_ok(DatagramDefs::FLAGS_NONE);
+}
+
+inline StateFlowBase::Action BootloaderResponseRouter::ok_response_sent()
+{
+    if (std::find(clients_.begin(), clients_.end(), target_) ==
+        clients_.end())
+    {
+        // The client has given up waiting in the meantime.
+        return release_and_exit();
+    }
+    target_->response_datagram_arrived(transfer_message());
+    return exit();
+}
+
 } // namespace openlcb
+
+#endif // _OPENLCB_BOOTLOADERCLIENT_HXX_
@@ -0,0 +1,326 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file BootloaderOrchestrator.hxx
+ *
+ * Runs the bootloading process on many target nodes in parallel.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_BOOTLOADERORCHESTRATOR_HXX_
+#define _OPENLCB_BOOTLOADERORCHESTRATOR_HXX_
+
+#include <memory>
+#include <vector>
+
+#include "openlcb/BootloaderClient.hxx"
+#include "utils/Crc.hxx"
+
+namespace openlcb
+{
+
+/// Outcome of the bootloading process on one target node.
+struct BootloaderTargetResult
+{
+    /// Target node.
+    NodeHandle dst;
+    /// How many times the bootloading was started on this target.
+    unsigned attempts{0};
+    /// Response of the last attempt.
+    BootloaderResponse response;
+    /// How long the last attempt took.
+    long long durationNsec{0};
+};
+
+/// Writes the same firmware image into many target nodes, using a number of
+/// BootloaderClient instances concurrently. Each client uses streams or
+/// datagrams depending on what the target advertises.
+///
+/// - The clients share a bandwidth budget, so that the update does not starve
+///   the regular traffic of the bus.
+/// - Failed targets are put back to the end of the queue and retried up to a
+///   given number of times.
+/// - Each target verifies the image it received against the checksums in
+///   the application header when it is unfrozen, and rejects the unfreeze
+///   command on a mismatch. That fails the attempt for the target, with the
+///   error code the target reported. The CRC-16-IBM triple of the image is
+///   computed once and logged with the failures, so that it can be compared
+///   with the header of the image.
+///
+/// The write stream responses are routed through a BootloaderResponseRouter.
+/// If the node has a MemoryConfigHandler, it has to be passed to the
+/// constructor, and the node cannot run a MemoryConfigClient while the
+/// orchestrator exists. The datagram service should have at least as many
+/// clients as the parallelism, as the datagram-based transfers keep one for
+/// the entire transfer.
+///
+/// Usage: add_target() for every node, then start(). When the done
+/// notifiable is called, results() contains the outcome for every target.
+class BootloaderOrchestrator : private Executable
+{
+public:
+    /// Constructor.
+    /// @param node the local node to send the requests from.
+    /// @param if_datagram_service datagram service of the node's interface.
+    /// @param if_can CAN interface of the node.
+    /// @param parallelism how many targets to update concurrently.
+    /// @param bytes_per_sec total bandwidth budget of the data transfers in
+    /// payload bytes per second; zero for unlimited.
+    /// @param max_retries how many times to retry a failed target.
+    /// @param memcfg memory config handler of the node, if it has one.
+    BootloaderOrchestrator(Node *node, DatagramService *if_datagram_service,
+        IfCan *if_can, unsigned parallelism, uint32_t bytes_per_sec,
+        unsigned max_retries, MemoryConfigHandler *memcfg = nullptr)
+        : node_(node)
+        , maxRetries_(max_retries)
+        , router_(node, if_datagram_service, memcfg)
+        , limiter_(bytes_per_sec)
+    {
+        HASSERT(parallelism > 0);
+        for (unsigned i = 0; i < parallelism; ++i)
+        {
+            slots_.emplace_back(
+                new Slot(this, node, if_datagram_service, if_can));
+        }
+    }
+
+    /// Adds a target node. Must be called before start().
+    /// @param dst the node to bootload.
+    void add_target(NodeHandle dst)
+    {
+        results_.emplace_back();
+        results_.back().dst = dst;
+    }
+
+    /// Starts the bootloading of all targets. May be called from any thread.
+    /// @param request contains the image and the parameters of the
+    /// bootloading. The dst and response fields are ignored.
+    /// @param done will be notified when all targets are finished.
+    void start(const BootloaderRequest &request, Notifiable *done)
+    {
+        request_ = request;
+        request_.response = nullptr;
+        done_ = done;
+        imageCrc_.assign(3, 0);
+        crc3_crc16_ibm(
+            request_.data.data(), request_.data.size(), &imageCrc_[0]);
+        LOG(INFO, "Bootloading %u bytes (crc %04x %04x %04x) into %u nodes.",
+            (unsigned)request_.data.size(), imageCrc_[0], imageCrc_[1],
+            imageCrc_[2], (unsigned)results_.size());
+        node_->iface()->executor()->add(this);
+    }
+
+    /// @return the outcome for every target, in the order of add_target().
+    const std::vector<BootloaderTargetResult> &results()
+    {
+        return results_;
+    }
+
+    /// @return the three CRC-16-IBM checksums (all, even bytes, odd bytes)
+    /// of the image. Valid after start().
+    const std::vector<uint16_t> &image_crc()
+    {
+        return imageCrc_;
+    }
+
+    /// @return how many targets have failed (after all retries).
+    unsigned num_failed()
+    {
+        unsigned ret = 0;
+        for (const auto &r : results_)
+        {
+            if (r.response.error_code)
+            {
+                ++ret;
+            }
+        }
+        return ret;
+    }
+
+    /// @return the aggregate throughput of the successful targets in bytes
+    /// per second, counted from start() to the end of the last target.
+    float throughput()
+    {
+        long long elapsed = endTimeNsec_ - startTimeNsec_;
+        if (elapsed <= 0)
+        {
+            return 0;
+        }
+        float bytes = float(request_.data.size()) *
+            (results_.size() - num_failed());
+        return bytes * 1e9 / elapsed;
+    }
+
+private:
+    /// One BootloaderClient with the target it is working on.
+    struct Slot : public Notifiable
+    {
+        Slot(BootloaderOrchestrator *parent, Node *node,
+            DatagramService *if_datagram_service, IfCan *if_can)
+            : parent_(parent)
+            , client_(node, if_datagram_service, if_can)
+        {
+            client_.set_response_router(&parent->router_);
+            client_.set_bandwidth_limiter(&parent->limiter_);
+        }
+
+        /// Called when the client is done with the request.
+        void notify() override
+        {
+            parent_->slot_done(this);
+        }
+
+        BootloaderOrchestrator *parent_;
+        BootloaderClient client_;
+        /// Index of the target in results_.
+        unsigned target_;
+        /// When the current attempt was started.
+        long long startTimeNsec_;
+        /// Filled in by the client.
+        BootloaderResponse response_;
+        /// Calls notify() when the client releases the request.
+        BarrierNotifiable done_;
+    };
+
+    /// Starts the slots on the executor.
+    void run() override
+    {
+        startTimeNsec_ = os_get_time_monotonic();
+        for (unsigned i = 0; i < results_.size(); ++i)
+        {
+            pending_.push_back(i);
+        }
+        for (auto &s : slots_)
+        {
+            start_next(s.get());
+        }
+        maybe_done();
+    }
+
+    /// Gives the next pending target to a slot, if there is any.
+    /// @param s an idle slot.
+    void start_next(Slot *s)
+    {
+        if (nextPending_ >= pending_.size())
+        {
+            return;
+        }
+        s->target_ = pending_[nextPending_++];
+        BootloaderTargetResult *r = &results_[s->target_];
+        ++r->attempts;
+        ++running_;
+        s->startTimeNsec_ = os_get_time_monotonic();
+        s->response_ = BootloaderResponse();
+        Buffer<BootloaderRequest> *b;
+        mainBufferPool->alloc(&b);
+        *b->data() = request_;
+        b->data()->dst = r->dst;
+        b->data()->response = &s->response_;
+        b->set_done(s->done_.reset(s));
+        s->client_.send(b);
+    }
+
+    /// Called on the executor when a slot has finished an attempt.
+    /// @param s the slot.
+    void slot_done(Slot *s)
+    {
+        --running_;
+        BootloaderTargetResult *r = &results_[s->target_];
+        r->response = s->response_;
+        r->durationNsec = os_get_time_monotonic() - s->startTimeNsec_;
+        if (r->response.error_code)
+        {
+            LOG(WARNING,
+                "Bootloading %012" PRIx64 " (alias %03x) attempt %u failed: "
+                "%04x %s (image crc %04x %04x %04x)",
+                r->dst.id, r->dst.alias, r->attempts, r->response.error_code,
+                r->response.error_details.c_str(), imageCrc_[0], imageCrc_[1],
+                imageCrc_[2]);
+            if (r->attempts <= maxRetries_)
+            {
+                pending_.push_back(s->target_);
+            }
+        }
+        else
+        {
+            LOG(INFO, "Bootloading %012" PRIx64 " (alias %03x) done in %u msec.",
+                r->dst.id, r->dst.alias,
+                (unsigned)(r->durationNsec / 1000000));
+        }
+        start_next(s);
+        maybe_done();
+    }
+
+    /// Notifies the caller if all targets are finished.
+    void maybe_done()
+    {
+        if (running_ || nextPending_ < pending_.size() || !done_)
+        {
+            return;
+        }
+        endTimeNsec_ = os_get_time_monotonic();
+        LOG(INFO, "Bootloading finished: %u of %u nodes failed, %.0f bytes/sec.",
+            num_failed(), (unsigned)results_.size(), throughput());
+        Notifiable *d = done_;
+        done_ = nullptr;
+        d->notify();
+    }
+
+    /// Local node.
+    Node *node_;
+    /// How many times to retry a failed target.
+    unsigned maxRetries_;
+    /// Receives the write stream responses for all slots.
+    BootloaderResponseRouter router_;
+    /// Shared bandwidth budget of the slots.
+    BootloaderBandwidthLimiter limiter_;
+    /// Parameters and image of the bootloading.
+    BootloaderRequest request_;
+    /// Checksums of the image.
+    std::vector<uint16_t> imageCrc_;
+    /// Outcome of every target.
+    std::vector<BootloaderTargetResult> results_;
+    /// Queue of target indexes to work on. Retried targets are appended.
+    std::vector<unsigned> pending_;
+    /// Index in pending_ of the next target to start.
+    unsigned nextPending_{0};
+    /// How many slots are working.
+    unsigned running_{0};
+    /// Clients running the bootloading.
+    std::vector<std::unique_ptr<Slot>> slots_;
+    /// Notified when all targets are finished.
+    Notifiable *done_{nullptr};
+    /// When the bootloading started.
+    long long startTimeNsec_{0};
+    /// When the last target finished.
+    long long endTimeNsec_{0};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_BOOTLOADERORCHESTRATOR_HXX_
@@ -0,0 +1,375 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file CachedFileMemorySpace.cxx
+ *
+ * File-backed memory space with a write-back cache.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/CachedFileMemorySpace.hxx"
+
+#include <algorithm>
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) || defined(__MACH__)
+#include <sys/mman.h>
+#define HAVE_MMAP
+#endif
+
+#include "utils/logging.h"
+
+namespace openlcb
+{
+
+CachedFileMemorySpace::CachedFileMemorySpace(Service *service, int fd,
+    address_t len, Mode mode, unsigned block_size, unsigned block_count,
+    long long flush_delay_nsec)
+    : FileMemorySpace(fd, len)
+    , flushTimer_(this, service)
+    , flushDelay_(flush_delay_nsec)
+    , blockSize_(block_size)
+    , blockCount_(block_count)
+    , mode_(mode)
+    , mapDirty_(0)
+    , timerPending_(0)
+{
+    HASSERT(block_size > 0 && block_size <= UINT16_MAX);
+    HASSERT(block_count > 0 && block_count <= UINT8_MAX);
+}
+
+CachedFileMemorySpace::CachedFileMemorySpace(Service *service,
+    const char *name, address_t len, Mode mode, unsigned block_size,
+    unsigned block_count, long long flush_delay_nsec)
+    : FileMemorySpace(name, len)
+    , flushTimer_(this, service)
+    , flushDelay_(flush_delay_nsec)
+    , blockSize_(block_size)
+    , blockCount_(block_count)
+    , mode_(mode)
+    , mapDirty_(0)
+    , timerPending_(0)
+{
+    HASSERT(block_size > 0 && block_size <= UINT16_MAX);
+    HASSERT(block_count > 0 && block_count <= UINT8_MAX);
+}
+
+CachedFileMemorySpace::~CachedFileMemorySpace()
+{
+    if (timerPending_)
+    {
+        flushTimer_.cancel();
+    }
+    flush();
+#ifdef HAVE_MMAP
+    if (map_)
+    {
+        munmap(map_, mapSize_);
+    }
+#endif
+}
+
+bool CachedFileMemorySpace::ensure_cache()
+{
+    ensure_file_open();
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    if (map_ || blocks_)
+    {
+        return true;
+    }
+#ifdef HAVE_MMAP
+    if (mode_ == MMAP)
+    {
+        struct stat buf;
+        HASSERT(fstat(fd_, &buf) >= 0);
+        mapSize_ = std::min((address_t)buf.st_size, fileSize_);
+        void *m = MAP_FAILED;
+        if (mapSize_ > 0)
+        {
+            m = mmap(nullptr, mapSize_, read_only() ? PROT_READ
+                                                    : PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd_, 0);
+        }
+        if (m != MAP_FAILED)
+        {
+            map_ = (uint8_t *)m;
+            return true;
+        }
+        LOG(WARNING, "Cannot map config file of size %u: %s. Using block "
+                     "cache.", (unsigned)mapSize_, strerror(errno));
+        mapSize_ = 0;
+    }
+#endif
+    mode_ = BLOCK_CACHE;
+    data_.reset(new uint8_t[blockSize_ * blockCount_]);
+    blocks_.reset(new Block[blockCount_]);
+    for (unsigned i = 0; i < blockCount_; ++i)
+    {
+        blocks_[i].used = false;
+        blocks_[i].dirtyBegin = 0;
+        blocks_[i].dirtyEnd = 0;
+    }
+    return true;
+}
+
+CachedFileMemorySpace::Block *CachedFileMemorySpace::get_block(
+    address_t address, errorcode_t *error)
+{
+    address_t base = address - (address % blockSize_);
+    Block *victim = &blocks_[0];
+    for (unsigned i = 0; i < blockCount_; ++i)
+    {
+        Block *b = &blocks_[i];
+        if (b->used && b->base == base)
+        {
+            b->lastUse = ++useCounter_;
+            return b;
+        }
+        if (!b->used)
+        {
+            victim = b;
+        }
+        else if (victim->used && b->lastUse < victim->lastUse)
+        {
+            victim = b;
+        }
+    }
+    if (is_dirty(victim))
+    {
+        write_back(victim);
+    }
+    victim->used = false;
+    uint8_t *d = block_data(victim);
+    if (lseek(fd_, base, SEEK_SET) != (off_t)base)
+    {
+        *error = Defs::ERROR_PERMANENT;
+        return nullptr;
+    }
+    ssize_t ret = ::read(fd_, d, blockSize_);
+    if (ret < 0)
+    {
+        LOG(INFO, "Error reading from fd %d: %s", fd_, strerror(errno));
+        *error = Defs::ERROR_PERMANENT;
+        return nullptr;
+    }
+    // Bytes past the end of file read as zero once something is written
+    // after them.
+    memset(d + ret, 0, blockSize_ - ret);
+    victim->base = base;
+    victim->len = ret;
+    victim->dirtyBegin = 0;
+    victim->dirtyEnd = 0;
+    victim->used = true;
+    victim->lastUse = ++useCounter_;
+    return victim;
+}
+
+bool CachedFileMemorySpace::write_back(Block *b, bool seek)
+{
+    address_t start = b->base + b->dirtyBegin;
+    unsigned len = b->dirtyEnd - b->dirtyBegin;
+    uint8_t *data = block_data(b) + b->dirtyBegin;
+    b->dirtyBegin = 0;
+    b->dirtyEnd = 0;
+    if (seek && lseek(fd_, start, SEEK_SET) != (off_t)start)
+    {
+        LOG(WARNING, "Error seeking fd %d to %u: %s", fd_, (unsigned)start,
+            strerror(errno));
+        return false;
+    }
+    ssize_t ret = ::write(fd_, data, len);
+    if (ret != (ssize_t)len)
+    {
+        LOG(WARNING, "Error writing to fd %d: %s", fd_,
+            ret < 0 ? strerror(errno) : "short write");
+        return false;
+    }
+    return true;
+}
+
+size_t CachedFileMemorySpace::write(address_t destination,
+    const uint8_t *data, size_t len, errorcode_t *error, Notifiable *again)
+{
+    if (!ensure_cache())
+    {
+        *error = Defs::ERROR_PERMANENT;
+        return 0;
+    }
+    start_timer();
+    if (map_)
+    {
+        if (destination >= mapSize_)
+        {
+            *error = MemoryConfigDefs::ERROR_OUT_OF_BOUNDS;
+            return 0;
+        }
+        len = std::min(len, (size_t)(mapSize_ - destination));
+        memcpy(map_ + destination, data, len);
+        mapDirty_ = 1;
+        return len;
+    }
+    size_t done = 0;
+    while (done < len)
+    {
+        Block *b = get_block(destination + done, error);
+        if (!b)
+        {
+            return done;
+        }
+        unsigned ofs = destination + done - b->base;
+        unsigned count = std::min(len - done, (size_t)(blockSize_ - ofs));
+        memcpy(block_data(b) + ofs, data + done, count);
+        b->len = std::max((unsigned)b->len, ofs + count);
+        if (!is_dirty(b))
+        {
+            b->dirtyBegin = ofs;
+            b->dirtyEnd = ofs + count;
+        }
+        else
+        {
+            b->dirtyBegin = std::min((unsigned)b->dirtyBegin, ofs);
+            b->dirtyEnd = std::max((unsigned)b->dirtyEnd, ofs + count);
+        }
+        done += count;
+    }
+    return done;
+}
+
+size_t CachedFileMemorySpace::read(address_t source, uint8_t *dst,
+    size_t len, errorcode_t *error, Notifiable *again)
+{
+    if (!ensure_cache())
+    {
+        *error = Defs::ERROR_PERMANENT;
+        return 0;
+    }
+    address_t limit = map_ ? mapSize_ : fileSize_;
+    if (source >= limit)
+    {
+        *error = MemoryConfigDefs::ERROR_OUT_OF_BOUNDS;
+        return 0;
+    }
+    len = std::min(len, (size_t)(limit - source));
+    start_timer();
+    if (map_)
+    {
+        memcpy(dst, map_ + source, len);
+        return len;
+    }
+    size_t done = 0;
+    while (done < len)
+    {
+        Block *b = get_block(source + done, error);
+        if (!b)
+        {
+            return done;
+        }
+        unsigned ofs = source + done - b->base;
+        if (ofs >= b->len)
+        {
+            // End of file.
+            break;
+        }
+        unsigned count = std::min(len - done, (size_t)(b->len - ofs));
+        memcpy(dst + done, block_data(b) + ofs, count);
+        done += count;
+    }
+    return done;
+}
+
+void CachedFileMemorySpace::flush()
+{
+#ifdef HAVE_MMAP
+    if (map_)
+    {
+        if (mapDirty_)
+        {
+            mapDirty_ = 0;
+            if (msync(map_, mapSize_, MS_SYNC) != 0)
+            {
+                LOG(WARNING, "Error syncing config file: %s", strerror(errno));
+            }
+        }
+        return;
+    }
+#endif
+    if (!blocks_)
+    {
+        return;
+    }
+    // Writes the dirty ranges in increasing address order. Adjacent ranges
+    // go out as consecutive writes without seeking in between.
+    address_t file_pos = 0;
+    bool pos_known = false;
+    while (true)
+    {
+        Block *next = nullptr;
+        for (unsigned i = 0; i < blockCount_; ++i)
+        {
+            Block *b = &blocks_[i];
+            if (is_dirty(b) && (!next || b->base < next->base))
+            {
+                next = b;
+            }
+        }
+        if (!next)
+        {
+            break;
+        }
+        address_t start = next->base + next->dirtyBegin;
+        address_t end = next->base + next->dirtyEnd;
+        pos_known = write_back(next, !pos_known || file_pos != start);
+        file_pos = end;
+    }
+    for (unsigned i = 0; i < blockCount_; ++i)
+    {
+        blocks_[i].used = false;
+    }
+}
+
+void CachedFileMemorySpace::start_timer()
+{
+    if (!timerPending_)
+    {
+        timerPending_ = 1;
+        flushTimer_.start(flushDelay_);
+    }
+}
+
+void CachedFileMemorySpace::timeout()
+{
+    timerPending_ = 0;
+    flush();
+}
+
+} // namespace openlcb
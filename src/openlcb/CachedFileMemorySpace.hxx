@@ -0,0 +1,256 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file CachedFileMemorySpace.hxx
+ *
+ * File-backed memory space with a write-back cache.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_CACHEDFILEMEMORYSPACE_HXX_
+#define _OPENLCB_CACHEDFILEMEMORYSPACE_HXX_
+
+#include <memory>
+
+#include "executor/Service.hxx"
+#include "executor/Timer.hxx"
+#include "openlcb/MemoryConfig.hxx"
+
+namespace openlcb
+{
+
+/// FileMemorySpace that keeps the recently accessed parts of the file in
+/// memory. The memory config protocol accesses the space at most 64 bytes at a
+/// time; without a cache each of these turns into a seek and a read or write
+/// call on the file.
+///
+/// In BLOCK_CACHE mode the file is cached in aligned blocks. Reads and writes
+/// are served from the blocks; a block missing from the cache is read from the
+/// file in one call. Of each dirty block only the range between the first and
+/// the last written byte is written back, in address order, when the block is
+/// evicted, one flush delay after the first access following the previous
+/// flush, and when flush() is called. The memory config handler calls flush()
+/// upon the update complete command, before the config update listeners are
+/// called, and before it reboots the node. Cached blocks are dropped on
+/// flush, so changes made to the file through other file descriptors become
+/// visible within one flush delay. Such changes are not lost unless they
+/// overlap the written range of a dirty block; code that writes the file
+/// directly (e.g. a factory reset) has to call
+/// MemoryConfigHandler::flush_spaces() first.
+///
+/// In MMAP mode the file is mapped to memory and accessed with memcpy. The
+/// changes are visible to other file descriptors immediately; the flush only
+/// syncs the mapping to the disk. The memory space cannot grow the file in
+/// this mode. If mapping fails (or the platform does not support mmap), the
+/// BLOCK_CACHE mode is used.
+///
+/// The accesses and the flush timer must be on the same executor, which is
+/// normally the executor of the interface the memory config handler is on.
+///
+/// This is meant for files on a file system (Linux hosts, SD cards). Drivers
+/// that return short reads or writes to signal a retry are not supported.
+class CachedFileMemorySpace : public FileMemorySpace
+{
+public:
+    /// How the file is cached.
+    enum Mode
+    {
+        /// Cache aligned blocks of the file in memory.
+        BLOCK_CACHE,
+        /// Map the file to memory.
+        MMAP,
+    };
+
+    /// Default size of a cached block in bytes.
+    static constexpr unsigned DEFAULT_BLOCK_SIZE = 512;
+    /// Default number of cached blocks.
+    static constexpr unsigned DEFAULT_BLOCK_COUNT = 8;
+    /// Default time to hold dirty data in memory.
+    static constexpr long long DEFAULT_FLUSH_DELAY = SEC_TO_NSEC(1);
+
+    /** Creates a cached memory space based on an fd.
+     *
+     * @param service defines the executor of the flush timer.
+     * @param fd is an open file descriptor with the data.
+     * @param len tells how many bytes there are in the memory space. If
+     * specified as AUTO_LEN, then uses fstat to figure out the size of the
+     * file.
+     * @param mode how to cache the file.
+     * @param block_size size of a cached block in bytes.
+     * @param block_count how many blocks to cache.
+     * @param flush_delay_nsec how long the cached data is kept before it is
+     * written back to the file.
+     */
+    CachedFileMemorySpace(Service *service, int fd, address_t len = AUTO_LEN,
+        Mode mode = BLOCK_CACHE, unsigned block_size = DEFAULT_BLOCK_SIZE,
+        unsigned block_count = DEFAULT_BLOCK_COUNT,
+        long long flush_delay_nsec = DEFAULT_FLUSH_DELAY);
+
+    /** Creates a cached memory space based on a file name. Opens the file at
+     * the first use, and never closes it.
+     *
+     * @param service defines the executor of the flush timer.
+     * @param name is the file name to open. The pointer must stay alive so
+     * long as *this is around.
+     * @param len tells how many bytes there are in the memory space. If
+     * specified as AUTO_LEN, then uses fstat to figure out the size of the
+     * file.
+     * @param mode how to cache the file.
+     * @param block_size size of a cached block in bytes.
+     * @param block_count how many blocks to cache.
+     * @param flush_delay_nsec how long the cached data is kept before it is
+     * written back to the file.
+     */
+    CachedFileMemorySpace(Service *service, const char *name,
+        address_t len = AUTO_LEN, Mode mode = BLOCK_CACHE,
+        unsigned block_size = DEFAULT_BLOCK_SIZE,
+        unsigned block_count = DEFAULT_BLOCK_COUNT,
+        long long flush_delay_nsec = DEFAULT_FLUSH_DELAY);
+
+    /// Destructor. Writes back all dirty data.
+    ~CachedFileMemorySpace();
+
+    size_t write(address_t destination, const uint8_t *data, size_t len,
+        errorcode_t *error, Notifiable *again) override;
+
+    size_t read(address_t source, uint8_t *dst, size_t len, errorcode_t *error,
+        Notifiable *again) override;
+
+    void flush() override;
+
+    /// @return the mode actually in use. Valid after the first access.
+    Mode mode()
+    {
+        return mode_;
+    }
+
+private:
+    /// One cached block of the file.
+    struct Block
+    {
+        /// File offset of the first byte. Multiple of the block size.
+        address_t base;
+        /// Number of valid bytes: what was read from the file plus what was
+        /// written past that. Zero for an unused block.
+        uint16_t len;
+        /// Offset of the first byte written since the block was loaded.
+        uint16_t dirtyBegin;
+        /// Offset after the last byte written since the block was loaded.
+        /// Equal to dirtyBegin if the block is clean.
+        uint16_t dirtyEnd;
+        /// True if the block holds data.
+        bool used;
+        /// Value of useCounter_ at the last access, for LRU eviction.
+        uint32_t lastUse;
+    };
+
+    /// Sets up the mapping or the blocks upon the first access. @return false
+    /// if the file could not be opened.
+    bool ensure_cache();
+
+    /// Finds or loads the block containing an address.
+    /// @param address file offset.
+    /// @param error set if the file could not be read.
+    /// @return the block, or nullptr on error.
+    Block *get_block(address_t address, errorcode_t *error);
+
+    /// @return the cached bytes of a block.
+    uint8_t *block_data(Block *b)
+    {
+        return data_.get() + (b - blocks_.get()) * blockSize_;
+    }
+
+    /// @return true if the block has data that is not in the file yet.
+    /// @param b block.
+    static bool is_dirty(const Block *b)
+    {
+        return b->dirtyEnd > b->dirtyBegin;
+    }
+
+    /// Writes the dirty range of a block to the file. @param b block.
+    /// @param seek false if the file offset is known to be at the start of
+    /// the dirty range.
+    /// @return true if the data was written.
+    bool write_back(Block *b, bool seek = true);
+
+    /// Starts the flush timer if it is not running.
+    void start_timer();
+
+    /// Callback from the timer.
+    void timeout();
+
+    /// Timer that flushes the cache some time after the first access.
+    class FlushTimer : public ::Timer
+    {
+    public:
+        /// Constructor. @param parent what to call when expiring.
+        /// @param service defines the executor.
+        FlushTimer(CachedFileMemorySpace *parent, Service *service)
+            : Timer(service->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            parent_->timeout();
+            return NONE;
+        }
+
+    private:
+        CachedFileMemorySpace *parent_; ///< what to notify upon timeout.
+    } flushTimer_;
+
+    /// Cached bytes of the blocks.
+    std::unique_ptr<uint8_t[]> data_;
+    /// Block descriptors.
+    std::unique_ptr<Block[]> blocks_;
+    /// Mapped file contents in MMAP mode.
+    uint8_t *map_ {nullptr};
+    /// Number of bytes mapped.
+    address_t mapSize_ {0};
+    /// How long after the first access to flush.
+    long long flushDelay_;
+    /// Incremented at every access.
+    uint32_t useCounter_ {0};
+    /// Size of a block in bytes.
+    uint16_t blockSize_;
+    /// Number of blocks.
+    uint8_t blockCount_;
+    /// How the file is cached.
+    Mode mode_;
+    /// True if there are changes in the mapping not yet synced.
+    unsigned mapDirty_ : 1;
+    /// 1 if the timer is running and there will be a timer callback coming in
+    /// the future.
+    unsigned timerPending_ : 1;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_CACHEDFILEMEMORYSPACE_HXX_
@@ -96,6 +96,7 @@ public:
         : reportHandler_(std::move(report_handler))
         , stateHandler_(std::move(state_handler))
         , node_(node)
+        , reentrant_(false)
     {
     }
 
@@ -127,6 +128,23 @@ public:
         return node_;
     }
 
+    /// Allows the event service to call this handler while other handler
+    /// calls are still outstanding. The callbacks are still invoked one at a
+    /// time on the interface's executor, but must not assume that the
+    /// previous call's done notifiable was notified. The identified messages
+    /// are sent in their own buffers instead of the shared
+    /// event_write_helper objects.
+    /// @param reentrant true to enable concurrent calls.
+    void set_reentrant(bool reentrant = true)
+    {
+        reentrant_ = reentrant;
+    }
+
+    bool is_reentrant() override
+    {
+        return reentrant_;
+    }
+
     void handle_event_report(const EventRegistryEntry &entry,
         EventReport *event, BarrierNotifiable *done) override
     {
@@ -171,6 +189,38 @@ public:
         done->notify();
     };
 
+    /// The state callback may change its answer at any time, so the
+    /// identified messages are not cached if there is one.
+    bool is_advertisement_volatile() override
+    {
+        return static_cast<bool>(stateHandler_);
+    }
+
+    bool get_identified(const EventRegistryEntry &registry_entry,
+        EventReport *event, std::vector<EventIdentified> *out) override
+    {
+        // Like handle_identify_global, answers addressed identify messages
+        // regardless of the destination node.
+        if (!(registry_entry.user_arg & (IS_PRODUCER | IS_CONSUMER)))
+        {
+            return true;
+        }
+        EventState state = stateHandler_
+            ? stateHandler_(registry_entry, event)
+            : EventState::UNKNOWN;
+        if (registry_entry.user_arg & IS_PRODUCER)
+        {
+            out->push_back({node_, Defs::MTI_PRODUCER_IDENTIFIED_VALID + state,
+                registry_entry.event});
+        }
+        if (registry_entry.user_arg & IS_CONSUMER)
+        {
+            out->push_back({node_, Defs::MTI_CONSUMER_IDENTIFIED_VALID + state,
+                registry_entry.event});
+        }
+        return true;
+    }
+
 protected:
     /// Helper function for implementations.
     void send_producer_identified(const EventRegistryEntry &entry,
@@ -179,6 +229,11 @@ protected:
         EventState state =
             stateHandler_ ? stateHandler_(entry, event) : EventState::UNKNOWN;
         Defs::MTI mti = Defs::MTI_PRODUCER_IDENTIFIED_VALID + state;
+        if (reentrant_)
+        {
+            send_event_message(node_, mti, entry.event, done);
+            return;
+        }
         event_write_helper1.WriteAsync(node_, mti, WriteHelper::global(),
             eventid_to_buffer(entry.event), done->new_child());
     }
@@ -190,6 +245,11 @@ protected:
         EventState state =
             stateHandler_ ? stateHandler_(entry, event) : EventState::UNKNOWN;
         Defs::MTI mti = Defs::MTI_CONSUMER_IDENTIFIED_VALID + state;
+        if (reentrant_)
+        {
+            send_event_message(node_, mti, entry.event, done);
+            return;
+        }
         event_write_helper3.WriteAsync(node_, mti, WriteHelper::global(),
             eventid_to_buffer(entry.event), done->new_child());
     }
@@ -202,6 +262,8 @@ private:
     EventStateHandlerFn stateHandler_;
     /// Node on which we are registered.
     Node *node_;
+    /// True if the handler may be called concurrently.
+    bool reentrant_;
 };
 
 } // namespace openlcb
@@ -0,0 +1,255 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file CanReassembly.cxx
+ *
+ * Fixed-capacity table for reassembling multi-frame messages arriving on a
+ * CAN bus.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/CanReassembly.hxx"
+
+#include <string.h>
+
+#include "os/os.h"
+#include "utils/logging.h"
+
+namespace openlcb
+{
+
+CanReassemblyTable::CanReassemblyTable(ActiveTimers *timers, unsigned slots,
+    unsigned slot_bytes, long long timeout_nsec)
+    : ::Timer(timers)
+    , timeoutNsec_(timeout_nsec)
+    , numSlots_(slots)
+    , slotBytes_(slot_bytes)
+    , size_(0)
+    , timerRunning_(false)
+{
+    HASSERT(slots > 0 && slots < EMPTY_SLOT);
+    HASSERT(slot_bytes <= UINT16_MAX);
+    hashShift_ = 31;
+    while ((1u << (32 - hashShift_)) < 2 * slots)
+    {
+        --hashShift_;
+    }
+    tableMask_ = (1u << (32 - hashShift_)) - 1;
+    entries_ = new Entry[slots];
+    table_ = new uint8_t[tableMask_ + 1];
+    memset(table_, EMPTY_SLOT, tableMask_ + 1);
+    for (unsigned i = 0; i < slots; ++i)
+    {
+        entries_[i].payload = nullptr;
+        entries_[i].used = false;
+    }
+}
+
+CanReassemblyTable::~CanReassemblyTable()
+{
+    if (timerRunning_)
+    {
+        cancel();
+    }
+    for (unsigned i = 0; i < numSlots_; ++i)
+    {
+        delete[] entries_[i].payload;
+    }
+    delete[] table_;
+    delete[] entries_;
+}
+
+unsigned CanReassemblyTable::start(uint64_t key)
+{
+    unsigned pos = hash_slot(key);
+    unsigned slot;
+    if (table_[pos] != EMPTY_SLOT)
+    {
+        // Restarting a message that was not finished.
+        ++stats_.outOfOrder;
+        slot = table_[pos];
+    }
+    else
+    {
+        if (size_ == numSlots_)
+        {
+            unsigned oldest = 0;
+            for (unsigned i = 1; i < numSlots_; ++i)
+            {
+                if (entries_[i].deadline < entries_[oldest].deadline)
+                {
+                    oldest = i;
+                }
+            }
+            ++stats_.evicted;
+            LOG(WARNING,
+                "CAN reassembly: all %u slots in use, evicting message "
+                "%012llx (%u evictions so far)",
+                numSlots_, (unsigned long long)entries_[oldest].key,
+                stats_.evicted);
+            release(oldest);
+            pos = hash_slot(key);
+        }
+        // The lowest free slot, so that the slots that already have a payload
+        // buffer are reused first.
+        slot = 0;
+        while (entries_[slot].used)
+        {
+            ++slot;
+        }
+        if (!entries_[slot].payload)
+        {
+            entries_[slot].payload = new uint8_t[slotBytes_];
+        }
+        table_[pos] = slot;
+        entries_[slot].used = true;
+        entries_[slot].key = key;
+        ++size_;
+    }
+    ++stats_.started;
+    entries_[slot].length = 0;
+    entries_[slot].deadline = os_get_time_monotonic() + timeoutNsec_;
+    if (!timerRunning_)
+    {
+        timerRunning_ = true;
+        ::Timer::start(timeoutNsec_);
+    }
+    return slot;
+}
+
+int CanReassemblyTable::find(uint64_t key)
+{
+    unsigned pos = hash_slot(key);
+    if (table_[pos] == EMPTY_SLOT)
+    {
+        return -1;
+    }
+    return table_[pos];
+}
+
+bool CanReassemblyTable::append(unsigned slot, const void *data, unsigned len)
+{
+    Entry *e = entries_ + slot;
+    HASSERT(e->used);
+    if (e->length + len > slotBytes_)
+    {
+        LOG(WARNING, "CAN reassembly: message %012llx is longer than %u bytes",
+            (unsigned long long)e->key, slotBytes_);
+        ++stats_.overflow;
+        release(slot);
+        return false;
+    }
+    memcpy(e->payload + e->length, data, len);
+    e->length += len;
+    e->deadline = os_get_time_monotonic() + timeoutNsec_;
+    return true;
+}
+
+void CanReassemblyTable::finish(unsigned slot, Payload *out)
+{
+    HASSERT(entries_[slot].used);
+    out->assign((const char *)entries_[slot].payload, entries_[slot].length);
+    ++stats_.completed;
+    release(slot);
+}
+
+void CanReassemblyTable::erase(unsigned slot)
+{
+    HASSERT(entries_[slot].used);
+    release(slot);
+}
+
+unsigned CanReassemblyTable::expire(long long now)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < numSlots_ && size_; ++i)
+    {
+        if (entries_[i].used && entries_[i].deadline <= now)
+        {
+            LOG(INFO, "CAN reassembly: timeout on message %012llx",
+                (unsigned long long)entries_[i].key);
+            release(i);
+            ++count;
+        }
+    }
+    stats_.timedOut += count;
+    return count;
+}
+
+long long CanReassemblyTable::timeout()
+{
+    long long now = os_get_time_monotonic();
+    expire(now);
+    if (!size_)
+    {
+        timerRunning_ = false;
+        return NONE;
+    }
+    long long next = INT64_MAX;
+    for (unsigned i = 0; i < numSlots_; ++i)
+    {
+        if (entries_[i].used && entries_[i].deadline < next)
+        {
+            next = entries_[i].deadline;
+        }
+    }
+    next -= now;
+    // Small values would be mistaken for RESTART.
+    return next > RESTART ? next : RESTART + 1;
+}
+
+void CanReassemblyTable::release(unsigned slot)
+{
+    erase_hash_slot(hash_slot(entries_[slot].key));
+    entries_[slot].used = false;
+    --size_;
+}
+
+void CanReassemblyTable::erase_hash_slot(unsigned pos)
+{
+    unsigned next = pos;
+    while (true)
+    {
+        next = (next + 1) & tableMask_;
+        if (table_[next] == EMPTY_SLOT)
+        {
+            break;
+        }
+        unsigned home = key_hash(entries_[table_[next]].key);
+        // The entry at next can fill the hole unless its home position is
+        // cyclically in (pos, next].
+        if (((next - home) & tableMask_) >= ((next - pos) & tableMask_))
+        {
+            table_[pos] = table_[next];
+            pos = next;
+        }
+    }
+    table_[pos] = EMPTY_SLOT;
+}
+
+} // namespace openlcb
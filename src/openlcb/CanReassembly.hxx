@@ -0,0 +1,246 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file CanReassembly.hxx
+ *
+ * Fixed-capacity table for reassembling multi-frame messages arriving on a
+ * CAN bus.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_CANREASSEMBLY_HXX_
+#define _OPENLCB_CANREASSEMBLY_HXX_
+
+#include <stdint.h>
+
+#include "executor/Timer.hxx"
+#include "openlcb/Payload.hxx"
+#include "utils/macros.h"
+
+namespace openlcb
+{
+
+/// Holds the partially received multi-frame messages of a CAN frame parser
+/// (addressed messages or datagrams).
+///
+/// The number of concurrently open messages and the payload size of each are
+/// fixed at construction. The payload buffer of a slot is allocated when the
+/// slot is first used and kept for the following messages, so the memory in
+/// use follows the largest number of messages that were ever open at the
+/// same time, not the slot count. Open messages are found by key through an
+/// open-addressing hash table. Every message has a deadline that is pushed out on each incoming
+/// frame; a timer drops the messages whose last frame never arrived. When
+/// the table is full, starting a new message evicts the one that has been
+/// waiting for the longest.
+///
+/// There is no locking: all calls must be made on the executor given at
+/// construction (the same one the parser flow runs on).
+class CanReassemblyTable : private ::Timer
+{
+public:
+    /// Counters about the reassembly activity. They never reset.
+    struct Stats
+    {
+        /// Multi-frame messages started.
+        unsigned started = 0;
+        /// Multi-frame messages completed.
+        unsigned completed = 0;
+        /// Open messages dropped because the table was full.
+        unsigned evicted = 0;
+        /// Open messages dropped because no frame arrived before their
+        /// deadline.
+        unsigned timedOut = 0;
+        /// Frames that did not fit the sequence: a middle or last frame with
+        /// no open message, or a first frame for a key that already had an
+        /// open message.
+        unsigned outOfOrder = 0;
+        /// Messages dropped because they did not fit in a slot.
+        unsigned overflow = 0;
+    };
+
+    /// Constructor.
+    /// @param timers is the timer list of the executor of the parser flow.
+    /// @param slots how many messages may be open at the same time (at most
+    /// 254).
+    /// @param slot_bytes maximum payload length of a message.
+    /// @param timeout_nsec how long an open message may wait for its next
+    /// frame.
+    CanReassemblyTable(ActiveTimers *timers, unsigned slots,
+        unsigned slot_bytes, long long timeout_nsec);
+
+    ~CanReassemblyTable();
+
+    /// Opens a new message. If there is already an open message with the
+    /// same key, it is discarded and counted as out of order. If the table is
+    /// full, the oldest message is evicted.
+    /// @param key identifies the message (e.g. source and destination
+    /// alias).
+    /// @return the slot of the new (empty) message.
+    unsigned start(uint64_t key);
+
+    /// @param key identifies the message.
+    /// @return the slot of the open message with key, or -1 if there is
+    /// none.
+    int find(uint64_t key);
+
+    /// Appends payload bytes to an open message and extends its deadline. If
+    /// the payload does not fit, the message is dropped.
+    /// @param slot returned by start() or find().
+    /// @param data payload bytes.
+    /// @param len number of bytes in data.
+    /// @return true if the bytes were appended, false if the message was
+    /// dropped because it became too long.
+    bool append(unsigned slot, const void *data, unsigned len);
+
+    /// Copies the payload of a completed message and frees its slot.
+    /// @param slot returned by start() or find().
+    /// @param out will be overwritten with the payload.
+    void finish(unsigned slot, Payload *out);
+
+    /// Drops an open message.
+    /// @param slot returned by start() or find().
+    void erase(unsigned slot);
+
+    /// Drops all messages whose deadline has passed. Called by the timer;
+    /// visible for testing.
+    /// @param now current monotonic time in nanoseconds.
+    /// @return number of messages dropped.
+    unsigned expire(long long now);
+
+    /// @param slot returned by start() or find().
+    /// @return the number of payload bytes received so far.
+    unsigned length(unsigned slot)
+    {
+        return entries_[slot].length;
+    }
+
+    /// @return the number of open messages.
+    unsigned size()
+    {
+        return size_;
+    }
+
+    /// @return the maximum payload length of a message.
+    unsigned slot_bytes()
+    {
+        return slotBytes_;
+    }
+
+    /// @return the activity counters.
+    const Stats &stats()
+    {
+        return stats_;
+    }
+
+    /// Records a frame that did not belong to any open message.
+    void count_out_of_order()
+    {
+        ++stats_.outOfOrder;
+    }
+
+private:
+    enum
+    {
+        /// Marks an empty slot in the hash table, and an unused entry.
+        EMPTY_SLOT = 0xFF,
+    };
+
+    /// One open (or unused) message.
+    struct Entry
+    {
+        /// Message key.
+        uint64_t key;
+        /// Monotonic time when the message is dropped unless another frame
+        /// arrives.
+        long long deadline;
+        /// Payload storage of slotBytes_ bytes, or nullptr if the slot was
+        /// never used.
+        uint8_t *payload;
+        /// Number of payload bytes in payload.
+        uint16_t length;
+        /// True if the entry holds an open message.
+        bool used;
+    };
+
+    /// Timer callback. Drops the expired messages and re-arms for the next
+    /// deadline.
+    long long timeout() override;
+
+    /// Frees an entry and its hash table position. @param slot entry index
+    void release(unsigned slot);
+
+    /// @return position of key in the hash table, or the empty position
+    /// where it would be inserted. @param key message key
+    unsigned hash_slot(uint64_t key)
+    {
+        unsigned pos = key_hash(key);
+        while (table_[pos] != EMPTY_SLOT && entries_[table_[pos]].key != key)
+        {
+            pos = (pos + 1) & tableMask_;
+        }
+        return pos;
+    }
+
+    /// @return home position of a key in the hash table. @param key key
+    unsigned key_hash(uint64_t key)
+    {
+        return (uint32_t(key ^ (key >> 29)) * 0x9E3779B1u) >> hashShift_;
+    }
+
+    /// Removes a position from the hash table, moving later entries of the
+    /// same probe sequence back so that lookups need no tombstones.
+    /// @param pos position to clear
+    void erase_hash_slot(unsigned pos);
+
+    /// Message metadata, one per slot.
+    Entry *entries_;
+    /// Hash table of entry indexes, or EMPTY_SLOT.
+    uint8_t *table_;
+    /// How long a message may wait for its next frame.
+    long long timeoutNsec_;
+    /// Number of entries.
+    unsigned numSlots_;
+    /// Maximum payload length of a message.
+    unsigned slotBytes_;
+    /// Number of positions in the hash table minus one.
+    unsigned tableMask_;
+    /// 32 - log2(number of positions in the hash table).
+    unsigned hashShift_;
+    /// Number of open messages.
+    unsigned size_;
+    /// True while the timer is scheduled.
+    bool timerRunning_;
+    /// Activity counters.
+    Stats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(CanReassemblyTable);
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_CANREASSEMBLY_HXX_
@@ -34,15 +34,116 @@
 
 #include "openlcb/ConfigEntry.hxx"
 
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+
+#include <algorithm>
+
+#include "os/OS.hxx"
 #include "utils/logging.h"
 
 namespace openlcb
 {
 
+std::atomic<ConfigFileSnapshot *> ConfigFileSnapshot::current_{nullptr};
+
+/// Protects ConfigFileSnapshot::current_ and the data of the active snapshot.
+static OSMutex g_snapshot_lock;
+
+ConfigFileSnapshot::ConfigFileSnapshot(int fd, size_t max_size)
+    : fd_(fd)
+    , owner_(os_thread_self())
+{
+    if (current_.load())
+    {
+        // Another snapshot is already active; keeps using that.
+        return;
+    }
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || buf.st_size <= 0 ||
+        (size_t)buf.st_size > max_size)
+    {
+        return;
+    }
+    if (lseek(fd, 0, SEEK_SET) != 0)
+    {
+        return;
+    }
+    std::unique_ptr<uint8_t[]> data(new uint8_t[buf.st_size]);
+    size_t len = 0;
+    while (len < (size_t)buf.st_size)
+    {
+        ssize_t ret = ::read(fd, data.get() + len, buf.st_size - len);
+        if (ret <= 0)
+        {
+            return;
+        }
+        len += ret;
+    }
+    OSMutexLock h(&g_snapshot_lock);
+    if (current_.load())
+    {
+        // Another snapshot was created in the meantime.
+        return;
+    }
+    size_ = len;
+    data_ = std::move(data);
+    current_.store(this);
+}
+
+ConfigFileSnapshot::~ConfigFileSnapshot()
+{
+    OSMutexLock h(&g_snapshot_lock);
+    if (current_.load() == this)
+    {
+        current_.store(nullptr);
+    }
+}
+
+bool ConfigFileSnapshot::matches(int fd)
+{
+    return fd_ == fd && owner_ == os_thread_self();
+}
+
+bool ConfigFileSnapshot::read(int fd, size_t offset, void *buf, size_t size)
+{
+    if (!current_.load())
+    {
+        return false;
+    }
+    OSMutexLock h(&g_snapshot_lock);
+    ConfigFileSnapshot *s = current_.load();
+    if (!s || !s->matches(fd) || offset + size > s->size_)
+    {
+        return false;
+    }
+    memcpy(buf, s->data_.get() + offset, size);
+    return true;
+}
+
+void ConfigFileSnapshot::write(
+    int fd, size_t offset, const void *buf, size_t size)
+{
+    if (!current_.load())
+    {
+        return;
+    }
+    OSMutexLock h(&g_snapshot_lock);
+    ConfigFileSnapshot *s = current_.load();
+    if (s && s->matches(fd) && offset < s->size_)
+    {
+        memcpy(s->data_.get() + offset, buf, std::min(size, s->size_ - offset));
+    }
+}
+
 void ConfigEntryBase::repeated_read(int fd, void *buf, size_t size) const
 {
+    if (ConfigFileSnapshot::read(fd, offset_, buf, size))
+    {
+        return;
+    }
     int ret = lseek(fd, offset_, SEEK_SET);
     ERRNOCHECK("seek_config", ret);
     uint8_t *dst = static_cast<uint8_t *>(buf);
@@ -61,6 +162,7 @@ void ConfigEntryBase::repeated_read(int fd, void *buf, size_t size) const
 
 void ConfigEntryBase::repeated_write(int fd, const void *buf, size_t size) const
 {
+    ConfigFileSnapshot::write(fd, offset_, buf, size);
     int ret = lseek(fd, offset_, SEEK_SET);
     ERRNOCHECK("seek_config", ret);
     const uint8_t *dst = static_cast<const uint8_t *>(buf);
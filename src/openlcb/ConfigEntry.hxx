@@ -39,13 +39,85 @@
 #include <stdint.h>
 #include <endian.h>
 
+#include <atomic>
 #include <functional>
+#include <memory>
 
 #include "openlcb/ConfigRenderer.hxx"
+#include "os/os.h"
 
 namespace openlcb
 {
 
+/// In-memory copy of the configuration file. While a snapshot is alive, the
+/// ConfigEntry reads from the same fd on the thread that created the snapshot
+/// are served from memory instead of a seek and a read call each. Writes
+/// through ConfigEntry go to the file as well as to the snapshot. Reads on
+/// other threads and other file descriptors are not affected.
+///
+/// At most one snapshot is active at a time; a snapshot created while
+/// another one is active stays inactive. The active snapshot is accessed
+/// under a lock, so it may be destroyed on any thread.
+///
+/// The ConfigUpdateFlow holds a snapshot while calling the config update
+/// listeners.
+class ConfigFileSnapshot
+{
+public:
+    /// Reads the contents of a file into memory. If the file cannot be read
+    /// or it is larger than max_size, the snapshot stays inactive.
+    ///
+    /// @param fd the configuration file.
+    /// @param max_size largest file (in bytes) to load.
+    ConfigFileSnapshot(int fd, size_t max_size);
+
+    ~ConfigFileSnapshot();
+
+    /// @return true if the snapshot is serving reads.
+    bool active() const
+    {
+        return data_ != nullptr;
+    }
+
+private:
+    friend class ConfigEntryBase;
+
+    /// Copies data from the active snapshot.
+    /// @param fd the configuration file.
+    /// @param offset where to read from.
+    /// @param buf where to copy the data.
+    /// @param size how many bytes to copy.
+    /// @return false if there is no active snapshot of fd on the current
+    /// thread covering the range.
+    static bool read(int fd, size_t offset, void *buf, size_t size);
+
+    /// Updates the active snapshot with data written to the file.
+    /// @param fd the configuration file.
+    /// @param offset where the data was written.
+    /// @param buf the written data.
+    /// @param size how many bytes were written.
+    static void write(int fd, size_t offset, const void *buf, size_t size);
+
+    /// @return true if this is the active snapshot for a file on the current
+    /// thread. Must be called with the lock held. @param fd the configuration
+    /// file.
+    bool matches(int fd);
+
+    /// The snapshot that ConfigEntry reads are served from. Changed with the
+    /// lock held; read without the lock only to skip taking the lock when
+    /// there is no snapshot.
+    static std::atomic<ConfigFileSnapshot *> current_;
+
+    /// File descriptor of the snapshotted file.
+    int fd_;
+    /// Thread that created the snapshot.
+    os_thread_t owner_;
+    /// Number of bytes in data_.
+    size_t size_ {0};
+    /// Contents of the file.
+    std::unique_ptr<uint8_t[]> data_;
+};
+
 /// Class representing a particular location in the configuration space. All
 /// typed configuration objects (atoms as well as groups) will be subclasses of
 /// this.
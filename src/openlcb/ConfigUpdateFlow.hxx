@@ -37,6 +37,8 @@
 #ifndef _OPENLCB_CONFIGUPDATEFLOW_HXX_
 #define _OPENLCB_CONFIGUPDATEFLOW_HXX_
 
+#include "nmranet_config.h"
+#include "openlcb/ConfigEntry.hxx"
 #include "utils/ConfigUpdateListener.hxx"
 #include "utils/ConfigUpdateService.hxx"
 #include "openlcb/NodeInitializeFlow.hxx"
@@ -56,6 +58,10 @@ namespace openlcb
 /// to the registered ConfigUpdateListener descendants. This flow also handles
 /// any necessary action such as reboot or factory reset. This flow keeps the
 /// file descriptor for the config file that's currently open.
+///
+/// During a pass over the listeners the config file is held in a
+/// ConfigFileSnapshot, so that the listeners' ConfigEntry reads do not each
+/// turn into a seek and a read call.
 class ConfigUpdateFlow : public StateFlowBase,
                          public ConfigUpdateService,
                          private Atomic
@@ -64,6 +70,9 @@ public:
     ConfigUpdateFlow(If *iface)
         : StateFlowBase(iface)
         , nextRefresh_(listeners_.begin())
+        , needsReboot_(0)
+        , needsReInit_(0)
+        , snapshotStale_(0)
         , fd_(-1)
     {
     }
@@ -87,6 +96,8 @@ public:
         nextRefresh_ = listeners_.begin();
         needsReboot_ = 0;
         needsReInit_ = 0;
+        // The file has changed since the snapshot was taken.
+        snapshotStale_ = 1;
         if (is_state(exit().next_state()))
         {
             start_flow(STATE(call_next_listener));
@@ -118,6 +129,13 @@ private:
             DIE("CONFIG_FILENAME not specified, or init() was not called, but "
                 "there are configuration listeners.");
         }
+        if (!snapshot_ || snapshotStale_)
+        {
+            snapshotStale_ = 0;
+            snapshot_.reset();
+            snapshot_.reset(
+                new ConfigFileSnapshot(fd_, config_update_snapshot_max_size()));
+        }
         ConfigUpdateListener::UpdateAction action =
             l->apply_configuration(fd_, is_initial, n_.reset(this));
         switch (action)
@@ -159,6 +177,7 @@ private:
 
     Action apply_action()
     {
+        snapshot_.reset();
         /// TODO(balazs.racz) apply the changes reported.
         if (needsReboot_)
         {
@@ -186,7 +205,11 @@ private:
     unsigned needsReboot_ : 1;
     /// did anybody request a node reinit to happen?
     unsigned needsReInit_ : 1;
+    /// 1 if the config file may have changed since snapshot_ was taken.
+    unsigned snapshotStale_ : 1;
     int fd_;
+    /// Contents of the config file for the current pass over the listeners.
+    std::unique_ptr<ConfigFileSnapshot> snapshot_;
     BarrierNotifiable n_;
 };
 
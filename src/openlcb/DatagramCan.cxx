@@ -34,6 +34,7 @@
 
 #include "openlcb/DatagramCan.hxx"
 
+#include "openlcb/DatagramClientImpl.hxx"
 #include "openlcb/DatagramDefs.hxx"
 #include "openlcb/IfCanImpl.hxx"
 
@@ -46,21 +47,19 @@ long long DATAGRAM_RESPONSE_TIMEOUT_NSEC = SEC_TO_NSEC(3);
 
 /// Datagram client implementation for CANbus-based datagram protocol.
 ///
-/// This flow is responsible for the outgoing CAN datagram framing, and listens
-/// for incoming datagram response messages.
+/// This flow is responsible for the outgoing CAN datagram framing. The
+/// response handling is in DatagramClientImpl.
 ///
 /// The base class of AddressedCanMessageWriteFlow is responsible for the
 /// discovery and address resolution of the destination node.
-class CanDatagramClient : public DatagramClient,
-                          public AddressedCanMessageWriteFlow,
-                          public LinkedObject<CanDatagramClient>
+class CanDatagramClient : public DatagramClientImpl,
+                          public AddressedCanMessageWriteFlow
 {
 public:
     CanDatagramClient(IfCan *iface)
-        : AddressedCanMessageWriteFlow(iface)
-        , listener_(this)
+        : DatagramClientImpl(iface)
+        , AddressedCanMessageWriteFlow(iface)
         , isSleeping_(0)
-        , sendPending_(0)
     {
         /** This flow does not use the incoming queue that we inherited from
          * AddressedCanMessageWriteFlow. We skip the wait state.
@@ -80,30 +79,23 @@ public:
         HASSERT(b->data()->mti == Defs::MTI_DATAGRAM);
         result_ = OPERATION_PENDING;
         reset_message(b, priority);
-        start_flow(STATE(acquire_srcdst_lock));
+        start_flow(STATE(acquire_lock));
     }
 
-    Action acquire_srcdst_lock()
+    /// Waits until no other client is sending to the same destination.
+    Action acquire_lock()
     {
-        // First check if there is another datagram client sending a datagram
-        // to the same target node.
+        if (!acquire_srcdst_lock(this))
         {
-            AtomicHolder h(LinkedObject<CanDatagramClient>::head_mu());
-            for (CanDatagramClient* c = LinkedObject<CanDatagramClient>::head_;
-                 c;
-                 c = c->LinkedObject<CanDatagramClient>::link_next()) {
-                // this will catch c == this.
-                if (!c->sendPending_) continue;
-                if (c->nmsg()->src.id != nmsg()->src.id) continue; 
-                if (!async_if()->matching_node(c->nmsg()->dst, nmsg()->dst))
-                    continue;
-                // Now: there is another datagram client sending a datagram to
-                // this destination. We need to wait for that transaction to
-                // complete.
-                c->waitingClients_.push_front(this);
-                return wait();
-            }
+            return wait_and_call(STATE(lock_acquired));
         }
+        return call_immediately(STATE(lock_acquired));
+    }
+
+    /// Called when this client has exclusive access to the src/dst pair.
+    Action lock_acquired()
+    {
+        isSleeping_ = 0;
         register_handlers();
         /// @TODO(balazs.racz) this will not work for loopback messages because
         /// it calls transfer_message().
@@ -134,28 +126,9 @@ public:
     }
 
 private:
-    enum
+    GenMessage *datagram() override
     {
-        MTI_1a = Defs::MTI_TERMINATE_DUE_TO_ERROR,
-        MTI_1b = Defs::MTI_OPTIONAL_INTERACTION_REJECTED,
-        MASK_1 = ~(MTI_1a ^ MTI_1b),
-        MTI_1 = MTI_1a,
-        MTI_2a = Defs::MTI_DATAGRAM_OK,
-        MTI_2b = Defs::MTI_DATAGRAM_REJECTED,
-        MASK_2 = ~(MTI_2a ^ MTI_2b),
-        MTI_2 = MTI_2a,
-        MTI_3 = Defs::MTI_INITIALIZATION_COMPLETE,
-        MASK_3 = Defs::MTI_EXACT,
-    };
-
-    void register_handlers()
-    {
-        hasResponse_ = 0;
-        isSleeping_ = 0;
-        sendPending_ = 1;
-        if_can()->dispatcher()->register_handler(&listener_, MTI_1, MASK_1);
-        if_can()->dispatcher()->register_handler(&listener_, MTI_2, MASK_2);
-        if_can()->dispatcher()->register_handler(&listener_, MTI_3, MASK_3);
+        return nmsg();
     }
 
     Action fill_can_frame_buffer() OVERRIDE
@@ -247,79 +220,24 @@ private:
         return call_immediately(STATE(datagram_finalize));
     }
 
-    void unregister_response_handler()
-    {
-        if_can()->dispatcher()->unregister_handler(&listener_, MTI_1, MASK_1);
-        if_can()->dispatcher()->unregister_handler(&listener_, MTI_2, MASK_2);
-        if_can()->dispatcher()->unregister_handler(&listener_, MTI_3, MASK_3);
-        sendPending_ = 0;
-        if (!waitingClients_.empty()) {
-            CanDatagramClient* c = static_cast<CanDatagramClient*>(waitingClients_.pop_front());
-            // Hands off all waiting clients to c.
-            HASSERT(c->waitingClients_.empty());
-            std::swap(waitingClients_, c->waitingClients_);
-            c->notify();
-        }
-    }
-
     Action datagram_finalize()
     {
-        HASSERT(!sendPending_);
         HASSERT(result_ & OPERATION_PENDING);
         result_ &= ~OPERATION_PENDING;
         release();
         return set_terminated();
     }
 
-    /** This object is registered to receive response messages at the interface
-     * level. Then it forwards the call to the parent CanDatagramClient. */
-    class ReplyListener : public MessageHandler
-    {
-    public:
-        ReplyListener(CanDatagramClient *parent) : parent_(parent)
-        {
-        }
-
-        void send(message_type *buffer, unsigned priority = UINT_MAX) OVERRIDE
-        {
-            parent_->handle_response(buffer->data());
-            buffer->unref();
-        }
-
-    private:
-        CanDatagramClient *parent_;
-    };
-
-    /// Callback when a matching response comes in on the bus.
-    void handle_response(GenMessage *message)
+    /// Matches the response by alias if the node IDs are not known.
+    bool is_response_to_datagram(GenMessage *message) override
     {
-        //LOG(INFO, "%p: Incoming response to datagram: mti %x from %x", this,
-        //    (int)message->mti, (int)message->src.alias);
-
-        // Check for reboot (unaddressed message) first.
-        if (message->mti == Defs::MTI_INITIALIZATION_COMPLETE) {
-            if (message->payload.size() != 6) {
-                // Malformed message inbound.
-                return;
-            }
-            NodeHandle rebooted(message->src);
-            rebooted.id = buffer_to_node_id(message->payload);
-            if (if_can()->matching_node(nmsg()->dst, rebooted))
-            {
-                // Destination node has rebooted. Kill datagram flow.
-                result_ |= DST_REBOOT;
-                return stop_waiting_for_response();
-            }
-            return; // everything else below is for addressed message
-        }
-
         // First we check that the response is for this source node.
         if (message->dst.id)
         {
             if (message->dst.id != nmsg()->src.id)
             {
                 LOG(VERBOSE, "wrong dst");
-                return;
+                return false;
             }
         }
         else if (message->dst.alias != srcAlias_)
@@ -327,7 +245,7 @@ private:
             LOG(VERBOSE, "wrong dst alias");
             /* Here we hope that the source alias was not released by the time
              * the response comes in. */
-            return;
+            return false;
         }
         // We also check that the source of the response is our destination.
         if (message->src.id && nmsg()->dst.id)
@@ -335,7 +253,7 @@ private:
             if (message->src.id != nmsg()->dst.id)
             {
                 LOG(VERBOSE, "wrong src");
-                return;
+                return false;
             }
         }
         else if (message->src.alias)
@@ -345,7 +263,7 @@ private:
             {
                 LOG(VERBOSE, "wrong src alias %x %x", (int)message->src.alias,
                     (int)dstAlias_);
-                return;
+                return false;
             }
         }
         else
@@ -353,76 +271,13 @@ private:
             /// @TODO(balazs.racz): we should initiate an alias lookup here.
             HASSERT(0); // Don't know how to match the response source.
         }
+        return true;
+    }
 
-        uint16_t error_code = 0;
-        uint8_t payload_length = 0;
-        const uint8_t *payload = nullptr;
-        if (!message->payload.empty())
-        {
-            payload =
-                reinterpret_cast<const uint8_t *>(message->payload.data());
-            payload_length = message->payload.size();
-        }
-        if (payload_length >= 2)
-        {
-            error_code = (((uint16_t)payload[0]) << 8) | payload[1];
-        }
-
-        switch (message->mti)
-        {
-            case Defs::MTI_TERMINATE_DUE_TO_ERROR:
-            case Defs::MTI_OPTIONAL_INTERACTION_REJECTED:
-            {
-                if (payload_length >= 4)
-                {
-                    uint16_t return_mti = payload[2];
-                    return_mti <<= 8;
-                    return_mti |= payload[3];
-                    if (return_mti != Defs::MTI_DATAGRAM)
-                    {
-                        // This must be a rejection of some other
-                        // message. Ignore.
-                        LOG(VERBOSE, "wrong rejection mti");
-                        return;
-                    }
-                }
-            } // fall through
-            case Defs::MTI_DATAGRAM_REJECTED:
-            {
-                result_ &= ~0xffff;
-                result_ |= error_code;
-                // Ensures that an error response is visible in the flags.
-                if (!(result_ & (PERMANENT_ERROR | RESEND_OK)))
-                {
-                    result_ |= PERMANENT_ERROR;
-                }
-                break;
-            }
-            case Defs::MTI_DATAGRAM_OK:
-            {
-                if (payload_length)
-                {
-                    result_ &= ~(0xff << RESPONSE_FLAGS_SHIFT);
-                    result_ |= payload[0] << RESPONSE_FLAGS_SHIFT;
-                }
-                result_ |= OPERATION_SUCCESS;
-                break;
-            }
-            default:
-                // Ignore message.
-                LOG(VERBOSE, "unknown mti");
-                return;
-        } // switch response MTI
-        stop_waiting_for_response();
-    } // handle_message
-
-    /// To be called from the handler. Wakes up main flow and terminates it
-    /// (with whatever is in the result_ code right now).
-    void stop_waiting_for_response()
+    /// Wakes up main flow and terminates it (with whatever is in the result_
+    /// code right now).
+    void response_arrived() override
     {
-        // Avoids duplicate wakeups on the timer.
-        unregister_response_handler();
-        hasResponse_ = 1;
         if (isSleeping_) {
             // Stops waiting for response and notifies the current flow.
             timer_.trigger();
@@ -434,18 +289,9 @@ private:
         reset_flow(STATE(datagram_finalize));
     }
 
-    ReplyListener listener_;
-    /// List of other datagram clients that are trying to send to the same
-    /// target node. We need to wake up one of this list when we are done
-    /// sending.
-    TypedQueue<Executable> waitingClients_;
     /// 1 when we are in the sleep call waiting for the datagram Ack or Reject
     /// message.
     unsigned isSleeping_ : 1;
-    unsigned hasResponse_ : 1;
-    /// 1 when we have the handlers registered. During this time we have
-    /// exclusive lock on the specific src/dst node pair.
-    unsigned sendPending_ : 1;
 };
 
 /** Frame handler that assembles incoming datagram fragments into a single
@@ -498,7 +344,10 @@ public:
             return release_and_exit();
         }
 
-        DatagramPayload *buf = nullptr;
+        CanReassemblyTable *table = if_can()->datagram_reassembly();
+        // Slot of the multi-frame datagram in the reassembly table, or -1
+        // for a single-frame datagram.
+        int slot = -1;
         bool last_frame = true;
 
         switch (can_frame_type)
@@ -508,27 +357,22 @@ public:
                 // it.
                 localBuffer_.clear();
                 localBuffer_.reserve(f->can_dlc);
-                buf = &localBuffer_;
                 break;
             case 3:
             {
                 // Datagram first frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                int old = table->find(buffer_key);
+                if (old >= 0)
                 {
-                    pendingBuffers_.erase(it);
+                    table->erase(old);
+                    table->count_out_of_order();
                     /** Frames came out of order or more than one datagram is
                      * being sent to the same dst. */
                     errorCode_ = DatagramClient::RESEND_OK |
                                  DatagramClient::OUT_OF_ORDER;
                     break;
                 }
-
-                buf = &pendingBuffers_[buffer_key];
-                buf->clear();
-
-                // Datagram first frame. Get a full buffer.
-                buf->reserve(72);
+                slot = table->start(buffer_key);
                 last_frame = false;
                 break;
             }
@@ -539,19 +383,12 @@ public:
             case 5:
             {
                 // Datagram last frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                slot = table->find(buffer_key);
+                if (slot < 0)
                 {
-                    buf = &it->second;
-                    if (last_frame)
-                    {
-                        localBuffer_.clear();
-                        // Moves ownership of the allocated data to the local
-                        // buffer.
-                        localBuffer_.swap(*buf);
-                        buf = &localBuffer_;
-                        pendingBuffers_.erase(it);
-                    }
+                    table->count_out_of_order();
+                    errorCode_ =
+                        DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
                 }
                 break;
             }
@@ -560,22 +397,26 @@ public:
                 return release_and_exit();
         }
 
-        if (!buf)
+        if (!errorCode_)
         {
-            errorCode_ =
-                DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
-        }
-        else if (buf->size() + f->can_dlc > DatagramDefs::MAX_SIZE)
-        {
-            // Too long datagram arrived.
-            LOG(WARNING, "AsyncDatagramCan: too long incoming datagram arrived."
-                         " Size: %d",
-                (int)(buf->size() + f->can_dlc));
-            errorCode_ = DatagramClient::PERMANENT_ERROR;
-            // Since we reject the datagram, let's not keep the buffer
-            // around. This call should not crash if the buffer was already
-            // deleted.
-            pendingBuffers_.erase(buffer_key);
+            if (slot < 0)
+            {
+                localBuffer_.append(
+                    reinterpret_cast<const char *>(&f->data[0]), f->can_dlc);
+            }
+            else if (!table->append(slot, &f->data[0], f->can_dlc))
+            {
+                // Too long datagram arrived. The table has dropped the
+                // buffer.
+                LOG(WARNING, "AsyncDatagramCan: too long incoming datagram "
+                             "arrived.");
+                errorCode_ = DatagramClient::PERMANENT_ERROR;
+            }
+            else if (last_frame)
+            {
+                // Moves the data to the local buffer and frees the slot.
+                table->finish(slot, &localBuffer_);
+            }
         }
 
         if (errorCode_)
@@ -586,12 +427,9 @@ public:
                                      STATE(send_rejection));
         }
 
-        // Copies new data into buf.
-        buf->append(reinterpret_cast<const char *>(&f->data[0]), f->can_dlc);
         release();
         if (last_frame)
         {
-            HASSERT(buf == &localBuffer_);
             // Datagram is complete; let's send it to higher level If.
             return allocate_and_call(if_can()->dispatcher(),
                                      STATE(datagram_complete));
@@ -645,7 +483,7 @@ public:
 
 private:
     /// A local buffer that owns the datagram payload bytes after we took the
-    /// entry from the pending buffers map.
+    /// entry from the reassembly table.
     DatagramPayload localBuffer_;
 
     Node *dstNode_;
@@ -655,12 +493,6 @@ private:
     /// be forwarded to the upper layer in this case.
     uint16_t errorCode_;
 
-    /** Open datagram buffers. Keyed by (dstid | srcid), value is a datagram
-     * payload. When a payload is finished, it should be moved into the final
-     * datagram message using swap() to avoid memory copies.
-     * @TODO(balazs.racz) we need some kind of timeout-based release mechanism
-     * in here. */
-    StlMap<uint64_t, DatagramPayload> pendingBuffers_;
 };
 CanDatagramService::CanDatagramService(IfCan *iface,
                                        int num_registry_entries,
@@ -0,0 +1,205 @@
+/** \copyright
+ * Copyright (c) 2014, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file DatagramClientImpl.cxx
+ *
+ * Parts of the datagram client shared by the CAN and TCP implementations.
+ *
+ * @author Balazs Racz
+ * @date 27 Jan 2013
+ */
+
+#include "openlcb/DatagramClientImpl.hxx"
+
+namespace openlcb
+{
+
+DatagramClientImpl::DatagramClientImpl(If *iface)
+    : iface_(iface)
+    , listener_(this)
+    , hasResponse_(0)
+    , sendPending_(0)
+{
+}
+
+DatagramClientImpl::~DatagramClientImpl()
+{
+}
+
+bool DatagramClientImpl::acquire_srcdst_lock(Notifiable *flow)
+{
+    AtomicHolder h(LinkedObject<DatagramClientImpl>::head_mu());
+    for (DatagramClientImpl *c = LinkedObject<DatagramClientImpl>::head_; c;
+         c = c->LinkedObject<DatagramClientImpl>::link_next())
+    {
+        if (!c->sendPending_ || c->iface_ != iface_)
+            continue;
+        if (c->datagram()->src.id != datagram()->src.id)
+            continue;
+        if (!iface_->matching_node(c->datagram()->dst, datagram()->dst))
+            continue;
+        // Now: there is another datagram client sending a datagram to this
+        // destination. We need to wait for that transaction to complete.
+        lockWaiter_ = flow;
+        c->waitingClients_.push_front(this);
+        return false;
+    }
+    sendPending_ = 1;
+    return true;
+}
+
+void DatagramClientImpl::register_handlers()
+{
+    HASSERT(sendPending_);
+    hasResponse_ = 0;
+    iface_->dispatcher()->register_handler(&listener_, MTI_1, MASK_1);
+    iface_->dispatcher()->register_handler(&listener_, MTI_2, MASK_2);
+    iface_->dispatcher()->register_handler(&listener_, MTI_3, MASK_3);
+}
+
+void DatagramClientImpl::unregister_response_handler()
+{
+    iface_->dispatcher()->unregister_handler(&listener_, MTI_1, MASK_1);
+    iface_->dispatcher()->unregister_handler(&listener_, MTI_2, MASK_2);
+    iface_->dispatcher()->unregister_handler(&listener_, MTI_3, MASK_3);
+    Notifiable *next = nullptr;
+    {
+        AtomicHolder h(LinkedObject<DatagramClientImpl>::head_mu());
+        sendPending_ = 0;
+        if (!waitingClients_.empty())
+        {
+            DatagramClientImpl *c =
+                static_cast<DatagramClientImpl *>(waitingClients_.pop_front());
+            // Hands off all waiting clients to c.
+            HASSERT(c->waitingClients_.empty());
+            std::swap(waitingClients_, c->waitingClients_);
+            // The lock is transferred directly so that no other client can
+            // take it in the meantime.
+            c->sendPending_ = 1;
+            next = c->lockWaiter_;
+        }
+    }
+    if (next)
+    {
+        next->notify();
+    }
+}
+
+bool DatagramClientImpl::is_response_to_datagram(GenMessage *message)
+{
+    return message->dst.id == datagram()->src.id &&
+        message->src.id == datagram()->dst.id;
+}
+
+void DatagramClientImpl::handle_response(GenMessage *message)
+{
+    // Check for reboot (unaddressed message) first.
+    if (message->mti == Defs::MTI_INITIALIZATION_COMPLETE)
+    {
+        if (message->payload.size() != 6)
+        {
+            // Malformed message inbound.
+            return;
+        }
+        NodeHandle rebooted(message->src);
+        rebooted.id = buffer_to_node_id(message->payload);
+        if (iface_->matching_node(datagram()->dst, rebooted))
+        {
+            // Destination node has rebooted. Kill datagram flow.
+            result_ |= DST_REBOOT;
+            unregister_response_handler();
+            hasResponse_ = 1;
+            response_arrived();
+        }
+        return; // everything else below is for addressed message
+    }
+
+    if (!is_response_to_datagram(message))
+    {
+        return;
+    }
+
+    uint16_t error_code = 0;
+    uint8_t payload_length = message->payload.size();
+    const uint8_t *payload =
+        reinterpret_cast<const uint8_t *>(message->payload.data());
+    if (payload_length >= 2)
+    {
+        error_code = (((uint16_t)payload[0]) << 8) | payload[1];
+    }
+
+    switch (message->mti)
+    {
+        case Defs::MTI_TERMINATE_DUE_TO_ERROR:
+        case Defs::MTI_OPTIONAL_INTERACTION_REJECTED:
+        {
+            if (payload_length >= 4)
+            {
+                uint16_t return_mti = payload[2];
+                return_mti <<= 8;
+                return_mti |= payload[3];
+                if (return_mti != Defs::MTI_DATAGRAM)
+                {
+                    // This must be a rejection of some other
+                    // message. Ignore.
+                    LOG(VERBOSE, "wrong rejection mti");
+                    return;
+                }
+            }
+        } // fall through
+        case Defs::MTI_DATAGRAM_REJECTED:
+        {
+            result_ &= ~0xffff;
+            result_ |= error_code;
+            // Ensures that an error response is visible in the flags.
+            if (!(result_ & (PERMANENT_ERROR | RESEND_OK)))
+            {
+                result_ |= PERMANENT_ERROR;
+            }
+            break;
+        }
+        case Defs::MTI_DATAGRAM_OK:
+        {
+            if (payload_length)
+            {
+                result_ &= ~(0xff << RESPONSE_FLAGS_SHIFT);
+                result_ |= payload[0] << RESPONSE_FLAGS_SHIFT;
+            }
+            result_ |= OPERATION_SUCCESS;
+            break;
+        }
+        default:
+            // Ignore message.
+            LOG(VERBOSE, "unknown mti");
+            return;
+    } // switch response MTI
+    // Avoids duplicate wakeups on the timer.
+    unregister_response_handler();
+    hasResponse_ = 1;
+    response_arrived();
+}
+
+} // namespace openlcb
@@ -0,0 +1,158 @@
+/** \copyright
+ * Copyright (c) 2014, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file DatagramClientImpl.hxx
+ *
+ * Parts of the datagram client shared by the CAN and TCP implementations.
+ *
+ * @author Balazs Racz
+ * @date 27 Jan 2013
+ */
+
+#ifndef _OPENLCB_DATAGRAMCLIENTIMPL_HXX_
+#define _OPENLCB_DATAGRAMCLIENTIMPL_HXX_
+
+#include "openlcb/Datagram.hxx"
+#include "utils/LinkedObject.hxx"
+
+namespace openlcb
+{
+
+/// Base class of the transport-specific datagram clients. Implements the
+/// parts that do not depend on how the datagram travels:
+///
+/// - Clients sending from the same source to the same destination node are
+///   serialized, since the responses carry no datagram identifier.
+/// - The response messages (Datagram OK, Datagram Rejected, Terminate Due To
+///   Error, Optional Interaction Rejected and the destination's
+///   Initialization Complete) are listened to and decoded into result_.
+///
+/// The subclass is the state flow that sends the datagram and waits for the
+/// response with a timeout.
+class DatagramClientImpl : public DatagramClient,
+                           public LinkedObject<DatagramClientImpl>
+{
+protected:
+    /// Constructor. @param iface is the interface the datagrams are sent
+    /// on.
+    DatagramClientImpl(If *iface);
+
+    ~DatagramClientImpl();
+
+    /// @return the datagram being sent. Called only between
+    /// acquire_srcdst_lock() and the end of the send.
+    virtual GenMessage *datagram() = 0;
+
+    /// Called when a response arrived. By then result_ is updated, the
+    /// response handlers are unregistered and the src/dst lock is released.
+    /// The subclass should wake up its flow and finish.
+    virtual void response_arrived() = 0;
+
+    /// Checks the source and destination of an addressed response message.
+    /// The default implementation compares the full node IDs. @param message
+    /// is the incoming response. @return true if the message is a response
+    /// to the datagram being sent.
+    virtual bool is_response_to_datagram(GenMessage *message);
+
+    /// Takes exclusive access to the source and destination node pair of the
+    /// datagram. @param flow will be notified when the access is granted, if
+    /// another client holds it now. @return true if the access was granted
+    /// immediately; false if flow will be notified.
+    bool acquire_srcdst_lock(Notifiable *flow);
+
+    /// Starts listening to the response messages. The caller must hold the
+    /// src/dst lock.
+    void register_handlers();
+
+    /// Stops listening to the response messages, and passes the src/dst lock
+    /// to the next client waiting for it.
+    void unregister_response_handler();
+
+    /// @return true if a response arrived since register_handlers().
+    bool has_response()
+    {
+        return hasResponse_;
+    }
+
+private:
+    enum
+    {
+        MTI_1a = Defs::MTI_TERMINATE_DUE_TO_ERROR,
+        MTI_1b = Defs::MTI_OPTIONAL_INTERACTION_REJECTED,
+        MASK_1 = ~(MTI_1a ^ MTI_1b),
+        MTI_1 = MTI_1a,
+        MTI_2a = Defs::MTI_DATAGRAM_OK,
+        MTI_2b = Defs::MTI_DATAGRAM_REJECTED,
+        MASK_2 = ~(MTI_2a ^ MTI_2b),
+        MTI_2 = MTI_2a,
+        MTI_3 = Defs::MTI_INITIALIZATION_COMPLETE,
+        MASK_3 = Defs::MTI_EXACT,
+    };
+
+    /** This object is registered to receive response messages at the
+     * interface level. Then it forwards the call to the parent client. */
+    class ReplyListener : public MessageHandler
+    {
+    public:
+        /// Constructor. @param parent owning client.
+        ReplyListener(DatagramClientImpl *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(message_type *buffer, unsigned priority = UINT_MAX) override
+        {
+            parent_->handle_response(buffer->data());
+            buffer->unref();
+        }
+
+    private:
+        /// Owning client.
+        DatagramClientImpl *parent_;
+    };
+
+    /// Callback when a matching response comes in on the interface.
+    /// @param message the incoming message.
+    void handle_response(GenMessage *message);
+
+    /// Interface to send on.
+    If *iface_;
+    /// Receives the response messages.
+    ReplyListener listener_;
+    /// List of other datagram clients that are trying to send to the same
+    /// target node. One of them gets the lock when we are done sending.
+    TypedQueue<DatagramClient> waitingClients_;
+    /// Notified when this client gets the src/dst lock from another one.
+    Notifiable *lockWaiter_ = nullptr;
+    /// 1 when a response arrived.
+    unsigned hasResponse_ : 1;
+    /// 1 when we have exclusive lock on the specific src/dst node pair.
+    unsigned sendPending_ : 1;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_DATAGRAMCLIENTIMPL_HXX_
@@ -0,0 +1,179 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file DatagramTcp.cxx
+ *
+ * Datagram service for the OpenLCB-TCP interface.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+
+#include "openlcb/DatagramTcp.hxx"
+
+#include "openlcb/DatagramClientImpl.hxx"
+
+namespace openlcb
+{
+
+/// Datagram client implementation for the OpenLCB-TCP interface.
+///
+/// Sends the datagram as a single addressed message through the interface's
+/// addressed write flow, then waits for the datagram response messages.
+class TcpDatagramClient : public DatagramClientImpl, public StateFlowBase
+{
+public:
+    /// Constructor. @param iface is the interface to send datagrams on.
+    TcpDatagramClient(IfTcp *iface)
+        : DatagramClientImpl(iface)
+        , StateFlowBase(iface)
+        , isSleeping_(0)
+    {
+    }
+
+    void write_datagram(Buffer<GenMessage> *b, unsigned priority) override
+    {
+        if (!b->data()->mti)
+        {
+            b->data()->mti = Defs::MTI_DATAGRAM;
+        }
+        HASSERT(b->data()->mti == Defs::MTI_DATAGRAM);
+        result_ = OPERATION_PENDING;
+        message_ = b;
+        priority_ = priority;
+        start_flow(STATE(acquire_lock));
+    }
+
+    /** Requests cancelling the datagram send operation. Will notify the done
+     * callback when the canceling is completed. */
+    void cancel() override
+    {
+        DIE("Canceling datagram send operation is not yet implemented.");
+    }
+
+private:
+    /// @return the interface.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(service());
+    }
+
+    GenMessage *datagram() override
+    {
+        return message_->data();
+    }
+
+    /// Waits until no other client is sending to the same destination.
+    Action acquire_lock()
+    {
+        if (!acquire_srcdst_lock(this))
+        {
+            return wait_and_call(STATE(lock_acquired));
+        }
+        return call_immediately(STATE(lock_acquired));
+    }
+
+    /// Called when this client has exclusive access to the src/dst pair.
+    Action lock_acquired()
+    {
+        return allocate_and_call(if_tcp()->addressed_message_write_flow(),
+                                 STATE(send_datagram));
+    }
+
+    /// Hands the datagram to the interface and starts waiting for the
+    /// response.
+    Action send_datagram()
+    {
+        auto *b =
+            get_allocation_result(if_tcp()->addressed_message_write_flow());
+        b->data()->reset(Defs::MTI_DATAGRAM, datagram()->src.id,
+                         datagram()->dst, datagram()->payload);
+        register_handlers();
+        if_tcp()->addressed_message_write_flow()->send(b, priority_);
+        isSleeping_ = 1;
+        return sleep_and_call(&timer_, DATAGRAM_RESPONSE_TIMEOUT_NSEC,
+                              STATE(response_or_timeout));
+    }
+
+    /// Wakes up after the response arrived or the timeout expired.
+    Action response_or_timeout()
+    {
+        isSleeping_ = 0;
+        if (!has_response())
+        {
+            LOG(INFO, "TcpDatagramClient: No datagram response arrived from "
+                      "destination %012" PRIx64 ".",
+                datagram()->dst.id);
+            unregister_response_handler();
+            result_ |= PERMANENT_ERROR | TIMEOUT;
+        }
+        HASSERT(result_ & OPERATION_PENDING);
+        result_ &= ~OPERATION_PENDING;
+        auto *b = message_;
+        message_ = nullptr;
+        b->unref();
+        return exit();
+    }
+
+    void response_arrived() override
+    {
+        if (isSleeping_)
+        {
+            timer_.trigger();
+            isSleeping_ = 0;
+        }
+    }
+
+    /// Datagram being sent.
+    Buffer<GenMessage> *message_ = nullptr;
+    /// Executor priority of the send.
+    unsigned priority_ = UINT_MAX;
+    /// Wakes up the flow on timeout.
+    StateFlowTimer timer_{this};
+    /// 1 when we are in the sleep call waiting for the datagram Ack or Reject
+    /// message.
+    unsigned isSleeping_ : 1;
+};
+
+TcpDatagramService::TcpDatagramService(IfTcp *iface,
+                                       int num_registry_entries,
+                                       int num_clients)
+    : DatagramService(iface, num_registry_entries)
+{
+    for (int i = 0; i < num_clients; ++i)
+    {
+        auto *client_flow = new TcpDatagramClient(if_tcp());
+        if_tcp()->add_owned_flow(client_flow);
+        client_allocator()->insert(static_cast<DatagramClient *>(client_flow));
+    }
+}
+
+TcpDatagramService::~TcpDatagramService()
+{
+}
+
+} // namespace openlcb
@@ -0,0 +1,291 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file EventAdvertisementTable.cxx
+ *
+ * Keeps the Producer/Consumer Identified messages of the registered event
+ * handlers, so that identify messages are answered without calling every
+ * handler.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/EventAdvertisementTable.hxx"
+
+#include <algorithm>
+
+#include "openlcb/EventHandlerContainer.hxx"
+
+namespace openlcb
+{
+
+/// Fills in an event report that stands for an identify message.
+/// @param rep report to fill @param dst_node destination node or nullptr.
+static void init_identify_report(EventReport *rep, Node *dst_node)
+{
+    rep->event = 0;
+    rep->mask = 0xFFFFFFFFFFFFFFFFULL;
+    rep->src_node = NodeHandle();
+    rep->dst_node = dst_node;
+    rep->state = EventState::UNKNOWN;
+}
+
+/// @return true if a sorted list of handlers contains a given handler.
+/// @param v sorted list @param h handler to look for.
+static bool contains(const std::vector<EventHandler *> &v, EventHandler *h)
+{
+    return std::binary_search(v.begin(), v.end(), h);
+}
+
+/// Removes a handler from a sorted list. @param v sorted list @param h
+/// handler to remove.
+static void erase_sorted(std::vector<EventHandler *> *v, EventHandler *h)
+{
+    auto it = std::lower_bound(v->begin(), v->end(), h);
+    if (it != v->end() && *it == h)
+    {
+        v->erase(it);
+    }
+}
+
+/// Adds a handler to a sorted list. @param v sorted list @param h handler to
+/// add.
+static void insert_sorted(std::vector<EventHandler *> *v, EventHandler *h)
+{
+    auto it = std::lower_bound(v->begin(), v->end(), h);
+    if (it == v->end() || *it != h)
+    {
+        v->insert(it, h);
+    }
+}
+
+EventAdvertisementTable::EventAdvertisementTable(EventRegistry *registry)
+    : registry_(registry)
+    , lock_(true)
+{
+}
+
+EventAdvertisementTable::~EventAdvertisementTable()
+{
+}
+
+void EventAdvertisementTable::remove(EventHandler *handler)
+{
+    OSMutexLock h(&lock_);
+    pending_.erase(
+        std::remove(pending_.begin(), pending_.end(), handler), pending_.end());
+    erase_sorted(&volatile_, handler);
+    erase_sorted(&unsupported_, handler);
+    remove_messages({handler});
+}
+
+void EventAdvertisementTable::invalidate(EventHandler *handler)
+{
+    OSMutexLock h(&lock_);
+    if (std::find(pending_.begin(), pending_.end(), handler) == pending_.end())
+    {
+        pending_.push_back(handler);
+    }
+}
+
+void EventAdvertisementTable::remove_messages(
+    const std::vector<EventHandler *> &handlers)
+{
+    for (auto &t : nodes_)
+    {
+        size_t dst = 0;
+        for (size_t i = 0; i < t.messages.size(); ++i)
+        {
+            if (!contains(handlers, t.owners[i]))
+            {
+                t.messages[dst] = t.messages[i];
+                t.owners[dst] = t.owners[i];
+                ++dst;
+            }
+        }
+        t.messages.resize(dst);
+        t.owners.resize(dst);
+    }
+}
+
+EventAdvertisementTable::NodeTable *EventAdvertisementTable::table_for(
+    Node *node)
+{
+    for (auto &t : nodes_)
+    {
+        if (t.node == node)
+        {
+            return &t;
+        }
+    }
+    nodes_.emplace_back();
+    nodes_.back().node = node;
+    return &nodes_.back();
+}
+
+void EventAdvertisementTable::ask(const std::vector<EventHandler *> &handlers,
+    EventReport *rep, std::vector<EventIdentified> *out,
+    std::vector<EventHandler *> *owners,
+    std::vector<EventHandler *> *unsupported)
+{
+    if (!iterator_)
+    {
+        iterator_.reset(registry_->create_iterator());
+    }
+    EventReport all;
+    init_identify_report(&all, nullptr);
+    iterator_->init_iteration(&all);
+    while (const EventRegistryEntry *e = iterator_->next_entry())
+    {
+        if (!contains(handlers, e->handler))
+        {
+            continue;
+        }
+        size_t begin = out->size();
+        if (e->handler->get_identified(*e, rep, out))
+        {
+            if (owners)
+            {
+                owners->resize(out->size(), e->handler);
+            }
+            continue;
+        }
+        out->resize(begin);
+        if (unsupported)
+        {
+            insert_sorted(unsupported, e->handler);
+        }
+    }
+    iterator_->clear_iteration();
+}
+
+void EventAdvertisementTable::update_pending()
+{
+    if (pending_.empty())
+    {
+        return;
+    }
+    // Handlers might call invalidate() while we ask them; those go to the
+    // next round.
+    std::vector<EventHandler *> todo;
+    todo.swap(pending_);
+    std::sort(todo.begin(), todo.end());
+    remove_messages(todo);
+    std::vector<EventHandler *> ask_now;
+    for (EventHandler *h : todo)
+    {
+        erase_sorted(&unsupported_, h);
+        if (h->is_advertisement_volatile())
+        {
+            insert_sorted(&volatile_, h);
+        }
+        else
+        {
+            erase_sorted(&volatile_, h);
+            ask_now.push_back(h);
+        }
+    }
+    EventReport rep;
+    init_identify_report(&rep, nullptr);
+    std::vector<EventIdentified> messages;
+    std::vector<EventHandler *> owners;
+    std::vector<EventHandler *> unsupported;
+    ask(ask_now, &rep, &messages, &owners, &unsupported);
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        if (contains(unsupported, owners[i]))
+        {
+            // All registrations of the handler are called with
+            // handle_identify_global() then.
+            continue;
+        }
+        NodeTable *t = table_for(messages[i].node);
+        t->messages.push_back(messages[i]);
+        t->owners.push_back(owners[i]);
+    }
+    for (EventHandler *h : unsupported)
+    {
+        insert_sorted(&unsupported_, h);
+    }
+}
+
+bool EventAdvertisementTable::get(
+    Node *dst_node, std::vector<EventIdentified> *out)
+{
+    OSMutexLock h(&lock_);
+    update_pending();
+    for (const auto &t : nodes_)
+    {
+        if (!dst_node || t.node == dst_node)
+        {
+            out->insert(out->end(), t.messages.begin(), t.messages.end());
+        }
+    }
+    if (!volatile_.empty())
+    {
+        EventReport rep;
+        init_identify_report(&rep, dst_node);
+        size_t begin = out->size();
+        ask(volatile_, &rep, out, nullptr, nullptr);
+        if (dst_node)
+        {
+            out->erase(std::remove_if(out->begin() + begin, out->end(),
+                           [dst_node](const EventIdentified &m) {
+                               return m.node != dst_node;
+                           }),
+                out->end());
+        }
+    }
+    return unsupported_.empty();
+}
+
+size_t EventAdvertisementTable::count(Node *dst_node)
+{
+    OSMutexLock h(&lock_);
+    update_pending();
+    for (const auto &t : nodes_)
+    {
+        if (t.node == dst_node)
+        {
+            return t.messages.size();
+        }
+    }
+    return 0;
+}
+
+size_t EventAdvertisementTable::size()
+{
+    OSMutexLock h(&lock_);
+    size_t ret = 0;
+    for (const auto &t : nodes_)
+    {
+        ret += t.messages.size();
+    }
+    return ret;
+}
+
+} // namespace openlcb
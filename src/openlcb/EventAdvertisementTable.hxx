@@ -0,0 +1,162 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file EventAdvertisementTable.hxx
+ *
+ * Keeps the Producer/Consumer Identified messages of the registered event
+ * handlers, so that identify messages are answered without calling every
+ * handler.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_EVENTADVERTISEMENTTABLE_HXX_
+#define _OPENLCB_EVENTADVERTISEMENTTABLE_HXX_
+
+#include <memory>
+#include <vector>
+
+#include "openlcb/EventHandler.hxx"
+#include "os/OS.hxx"
+
+namespace openlcb
+{
+
+/// Table of the messages that the registered event handlers advertise in
+/// response to identify global and addressed identify messages.
+///
+/// The table only stores the messages and the handlers they belong to; the
+/// registrations are taken from the event registry when a handler needs to
+/// be asked. A handler is asked for its messages
+/// (EventHandler::get_identified()) at the first query after it was
+/// registered, and again only after it reported a change with
+/// EventRegistry::advertisement_changed(). Handlers that are volatile
+/// (EventHandler::is_advertisement_volatile()) are asked at every query.
+///
+/// The handler calls happen with the table's lock held, from the thread that
+/// performs the query (normally the event service). Since remove() takes the
+/// same lock, a handler is never called after it was unregistered.
+class EventAdvertisementTable
+{
+public:
+    /// Constructor. @param registry is the registry whose handlers are in
+    /// this table.
+    EventAdvertisementTable(EventRegistry *registry);
+    ~EventAdvertisementTable();
+
+    /// Tells the table that a handler has new registrations. Must be called
+    /// after the registry was updated, without holding the registry's lock.
+    /// @param handler the handler that was registered.
+    void add(EventHandler *handler)
+    {
+        invalidate(handler);
+    }
+
+    /// Removes the messages of a handler. Blocks until the queries calling
+    /// handlers are done. Must be called before the registry is updated,
+    /// without holding the registry's lock. @param handler handler being
+    /// unregistered.
+    void remove(EventHandler *handler);
+
+    /// Marks the messages of a handler as stale; they will be asked from the
+    /// handler again at the next query. @param handler whose state changed.
+    void invalidate(EventHandler *handler);
+
+    /// Collects the messages advertised by a node or all nodes.
+    /// @param dst_node is the node to query, or nullptr for all nodes.
+    /// @param out the messages are appended here.
+    /// @return false if some registered handlers do not implement
+    /// get_identified(); their messages are missing from out.
+    bool get(Node *dst_node, std::vector<EventIdentified> *out);
+
+    /// Counts the messages advertised by a node without copying them. The
+    /// handlers that are volatile or do not implement get_identified() are
+    /// not counted.
+    /// @param dst_node is the node to query.
+    /// @return the number of messages.
+    size_t count(Node *dst_node);
+
+    /// @return the number of messages currently stored in the table.
+    size_t size();
+
+private:
+    /// Messages advertised by one node.
+    struct NodeTable
+    {
+        /// The node.
+        Node *node;
+        /// The messages, contiguous for copying into a response.
+        std::vector<EventIdentified> messages;
+        /// Handler that produced each message of messages.
+        std::vector<EventHandler *> owners;
+    };
+
+    /// Asks the pending handlers for their messages. Must be called with the
+    /// lock held.
+    void update_pending();
+
+    /// Calls get_identified() for all registrations of some handlers. Must be
+    /// called with the lock held.
+    /// @param handlers sorted list of the handlers to ask.
+    /// @param rep the identify message to answer.
+    /// @param out the messages are appended here.
+    /// @param owners if not null, the handler of each message is appended
+    /// here.
+    /// @param unsupported if not null, the handlers that do not implement
+    /// get_identified() are appended here.
+    void ask(const std::vector<EventHandler *> &handlers, EventReport *rep,
+        std::vector<EventIdentified> *out, std::vector<EventHandler *> *owners,
+        std::vector<EventHandler *> *unsupported);
+
+    /// Removes the stored messages of some handlers. Must be called with the
+    /// lock held. @param handlers sorted list of the handlers.
+    void remove_messages(const std::vector<EventHandler *> &handlers);
+
+    /// @return the table of a node, created if needed. Must be called with
+    /// the lock held. @param node the node.
+    NodeTable *table_for(Node *node);
+
+    /// Registry to take the registrations from.
+    EventRegistry *registry_;
+    /// Iterator over registry_. Created at the first use.
+    std::unique_ptr<EventIterator> iterator_;
+    /// Protects the table and serializes the handler calls. Recursive, so
+    /// that handlers may call advertisement_changed() from get_identified().
+    OSMutex lock_;
+    /// Tables of the nodes that advertise anything.
+    std::vector<NodeTable> nodes_;
+    /// Handlers to ask at the next query.
+    std::vector<EventHandler *> pending_;
+    /// Handlers asked at every query. Sorted.
+    std::vector<EventHandler *> volatile_;
+    /// Handlers that do not implement get_identified(). Sorted.
+    std::vector<EventHandler *> unsupported_;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_EVENTADVERTISEMENTTABLE_HXX_
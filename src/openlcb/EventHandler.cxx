@@ -32,6 +32,7 @@
  */
 
 #include "openlcb/EventHandler.hxx"
+#include "openlcb/EventAdvertisementTable.hxx"
 #include "openlcb/WriteHelper.hxx"
 
 namespace openlcb
@@ -44,6 +45,20 @@ WriteHelper event_write_helper3;
 WriteHelper event_write_helper4;
 BarrierNotifiable event_barrier;
 
+void send_event_message(
+    Node *node, Defs::MTI mti, EventId event, BarrierNotifiable *done)
+{
+    if (!node || !node->is_initialized())
+    {
+        return;
+    }
+    auto *f = node->iface()->global_message_write_flow();
+    Buffer<GenMessage> *b = f->alloc();
+    b->data()->reset(mti, node->node_id(), eventid_to_buffer(event));
+    b->set_done(done->new_child());
+    f->send(b, b->data()->priority());
+}
+
 EventRegistry::EventRegistry()
 {
 }
@@ -52,6 +67,15 @@ EventRegistry::~EventRegistry()
 {
 }
 
+void EventRegistry::advertisement_changed(EventHandler *handler)
+{
+    EventAdvertisementTable *t = advertisements();
+    if (t)
+    {
+        t->invalidate(handler);
+    }
+}
+
 // static
 unsigned EventRegistry::align_mask(EventId *event, unsigned size)
 {
@@ -35,6 +35,7 @@
 #define _OPENLCB_EVENTHANDLER_HXX_
 
 #include <stdint.h>
+#include <vector>
 
 #include "executor/Notifiable.hxx"
 #include "utils/AsyncMutex.hxx"
@@ -115,6 +116,33 @@ extern WriteHelper event_write_helper2;
 extern WriteHelper event_write_helper3;
 extern WriteHelper event_write_helper4;
 
+/// Sends a message with an event ID payload (e.g. an event report or a
+/// producer/consumer identified message) from a node, in a freshly allocated
+/// buffer. This is the replacement of the event_write_helper objects for
+/// reentrant event handlers (see EventHandler::is_reentrant()).
+/// @param node is the originating node. Nothing is sent if the node is not
+/// initialized.
+/// @param mti is the message to send.
+/// @param event is the event ID to put into the payload.
+/// @param done a child of this barrier will be notified when the message is
+/// enqueued to the physical layer.
+void send_event_message(
+    Node *node, Defs::MTI mti, EventId event, BarrierNotifiable *done);
+
+/// One Producer or Consumer Identified message (single event or range) that a
+/// node answers an identify events message with. See
+/// EventHandler::get_identified().
+struct EventIdentified
+{
+    /// Node sending the message.
+    Node *node;
+    /// One of the MTI_PRODUCER_IDENTIFIED_* or MTI_CONSUMER_IDENTIFIED_*
+    /// values.
+    Defs::MTI mti;
+    /// Event ID payload (for ranges, the encoded range).
+    EventId event;
+};
+
 /// Abstract base class for all event handlers. Instances of this class can
 /// get registered with the event service to receive notifications of incoming
 /// event messages from the bus.
@@ -129,6 +157,19 @@ public:
     {
     }
 
+    /// Returns true if this handler may be called while other handler calls
+    /// (including calls to itself) have not completed yet. Reentrant handlers
+    /// are called without taking the global event handler lock and without
+    /// waiting for the previous call's done notifiable. The calls themselves
+    /// still happen one at a time, on the executor of the interface (see
+    /// EventService::register_interface()). They must not use the event_write_helper
+    /// objects; send_event_message() allocates a buffer for each message
+    /// instead. The registry_entry argument is only valid during the call.
+    virtual bool is_reentrant()
+    {
+        return false;
+    }
+
     /// Called on incoming EventReport messages. @param event stores
     /// information about the incoming message. Filled: src_node, event. Mask
     /// is always 1 (filled in). state is not filled in. @param registry_entry
@@ -198,6 +239,34 @@ public:
                                       EventReport *event,
                                       BarrierNotifiable *done) = 0;
 
+    /// Lists the messages that handle_identify_global would send, without
+    /// sending them. The event service then answers the identify message for
+    /// all such handlers in one batch (see EventService::IdentifyOptions). The
+    /// answer is cached in the EventAdvertisementTable, and the call may
+    /// come from any thread that queries that table, thus it must not send
+    /// anything or use the event_write_helper objects. Subclasses
+    /// that override handle_identify_global must override this function as
+    /// well. @param registry_entry gives the registry entry for which the
+    /// current handler is being called. @param event is the identify message
+    /// (might have destination node id). @param out the messages are appended
+    /// here. @return false if the handler does not support this call; then
+    /// handle_identify_global will be called instead.
+    virtual bool get_identified(const EventRegistryEntry &registry_entry,
+        EventReport *event, std::vector<EventIdentified> *out)
+    {
+        return false;
+    }
+
+    /// @return true if the messages returned by get_identified() may change
+    /// without the handler calling EventRegistry::advertisement_changed(),
+    /// e.g. because the state of the events is computed by a callback. The
+    /// answer of such handlers is not cached; they are asked at every
+    /// identify message.
+    virtual bool is_advertisement_volatile()
+    {
+        return false;
+    }
+
     /// Called on another node sending IdentifyConsumer. @param event stores
     /// information about the incoming message. Filled: src_node, event,
     /// mask=1. Not filled: state. @param registry_entry gives the registry
@@ -222,6 +291,7 @@ typedef void (EventHandler::*EventHandlerFunction)(
     BarrierNotifiable *done);
 
 class EventIterator;
+class EventAdvertisementTable;
 
 /// Global static object for registering event handlers.
 ///
@@ -252,6 +322,21 @@ public:
     /// Creates a new event iterator. Caller takes ownership of object.
     virtual EventIterator *create_iterator() = 0;
 
+    /// @return the table of the messages advertised by the registered
+    /// handlers, or nullptr if this registry implementation does not keep
+    /// one (then identify messages are answered by iterating over all
+    /// handlers).
+    virtual EventAdvertisementTable *advertisements()
+    {
+        return nullptr;
+    }
+
+    /// Tells the registry that the answer of a handler to identify messages
+    /// changed, e.g. the state of one of its events. Handlers whose
+    /// get_identified() output depends on such state must call this at every
+    /// change, unless they are volatile. @param handler the handler.
+    void advertisement_changed(EventHandler *handler);
+
     /// Returns a monotonically increasing number that will change every time
     /// the set of registered event handlers change. Whenever this number
     /// changes, the iterators are invalidated and must be cleared.
@@ -39,114 +39,547 @@
 namespace openlcb
 {
 
+constexpr uint32_t TreeEventHandlers::NO_ENTRY;
+
+TreeEventHandlers::TreeEventHandlers()
+    : current_(new Index)
+    , pending_(nullptr)
+    , advertisements_(this)
+{
+}
+
+TreeEventHandlers::~TreeEventHandlers()
+{
+    // All iterators must be deleted by now.
+    HASSERT(!current_ || current_->refCount == 1);
+    delete current_;
+    delete pending_;
+}
+
 void TreeEventHandlers::register_handler(const EventRegistryEntry &entry,
                                          unsigned mask)
 {
-    AtomicHolder h(this);
-    LOG(VERBOSE, "%p: register %p", this, entry.handler);
-    set_dirty();
-    handlers_[mask].insert(EventRegistryEntry(entry));
+    {
+        OSMutexLock l(&lock_);
+        LOG(VERBOSE, "%p: register %p", this, entry.handler);
+        Index *idx = writable();
+        if (mask >= 64)
+        {
+            idx->global.push_back(entry);
+        }
+        else if (mask > 0)
+        {
+            idx->ranges.emplace_back(entry, mask);
+        }
+        else
+        {
+            idx->exact.push_back(entry);
+        }
+        AtomicHolder h(this);
+        set_dirty();
+    }
+    // The table calls back into the registry, so this must happen outside
+    // the lock.
+    advertisements_.add(entry.handler);
 }
 
 void TreeEventHandlers::unregister_handler(EventHandler *handler)
 {
-    AtomicHolder h(this);
-    set_dirty();
+    // Waits for the table to finish calling the handler.
+    advertisements_.remove(handler);
+    OSMutexLock l(&lock_);
     LOG(VERBOSE, "%p: unregister %p", this, handler);
+    Index *idx = writable();
+    auto by_handler = [handler](const EventRegistryEntry &reg) {
+        return reg.handler == handler;
+    };
     bool found = false;
-    for (auto r = handlers_.begin(); r != handlers_.end(); ++r)
-    {
-        auto begin_it = r->second.begin();
-        auto end_it = r->second.end();
-        auto erase_it = std::remove_if(
-            begin_it, end_it, [handler](const EventRegistryEntry &reg) {
-                return reg.handler == handler;
-            });
-        if (erase_it != end_it)
-        {
-            r->second.erase(erase_it, end_it);
-            found = true;
-        }
+    auto exact_it =
+        std::remove_if(idx->exact.begin(), idx->exact.end(), by_handler);
+    if (exact_it != idx->exact.end())
+    {
+        idx->exact.erase(exact_it, idx->exact.end());
+        found = true;
+    }
+    auto range_it = std::remove_if(idx->ranges.begin(), idx->ranges.end(),
+        [handler](const Range &r) { return r.entry.handler == handler; });
+    if (range_it != idx->ranges.end())
+    {
+        idx->ranges.erase(range_it, idx->ranges.end());
+        found = true;
+    }
+    auto global_it =
+        std::remove_if(idx->global.begin(), idx->global.end(), by_handler);
+    if (global_it != idx->global.end())
+    {
+        idx->global.erase(global_it, idx->global.end());
+        found = true;
     }
     if (found)
     {
+        AtomicHolder h(this);
+        set_dirty();
         return;
     }
     DIE("tried to unregister a handler that was not registered");
 }
 
-/// Class representing the iteration state on the binary tree-based event
-/// handler registry.
+TreeEventHandlers::Index *TreeEventHandlers::writable()
+{
+    if (pending_)
+    {
+        return pending_;
+    }
+    {
+        AtomicHolder h(this);
+        if (current_->refCount == 1)
+        {
+            // No iteration is using the current index, so we can change it
+            // in place; it will be rebuilt before the next iteration.
+            pending_ = current_;
+            current_ = nullptr;
+            return pending_;
+        }
+    }
+    // Only the holder of lock_ replaces current_, and a published index is
+    // not modified, so it can be copied without the atomic section.
+    Index *idx = new Index;
+    idx->exact = current_->exact;
+    idx->ranges = current_->ranges;
+    idx->global = current_->global;
+    AtomicHolder h(this);
+    pending_ = idx;
+    return idx;
+}
+
+TreeEventHandlers::Index *TreeEventHandlers::acquire()
+{
+    {
+        AtomicHolder h(this);
+        if (!pending_)
+        {
+            ++current_->refCount;
+            return current_;
+        }
+    }
+    // There are changes to index. Building the index is too expensive for the
+    // atomic section, so it happens under lock_, which keeps the writers off
+    // pending_.
+    OSMutexLock l(&lock_);
+    if (pending_)
+    {
+        pending_->build();
+    }
+    Index *unused = nullptr;
+    Index *ret;
+    {
+        AtomicHolder h(this);
+        if (pending_)
+        {
+            if (current_ && --current_->refCount == 0)
+            {
+                unused = current_;
+            }
+            current_ = pending_;
+            pending_ = nullptr;
+        }
+        ret = current_;
+        ++ret->refCount;
+    }
+    delete unused;
+    return ret;
+}
+
+void TreeEventHandlers::release(Index *index)
+{
+    if (!index)
+    {
+        return;
+    }
+    bool unused;
+    {
+        AtomicHolder h(this);
+        unused = --index->refCount == 0;
+    }
+    if (unused)
+    {
+        delete index;
+    }
+}
+
+void TreeEventHandlers::Index::build()
+{
+    size_t n = 16;
+    unsigned shift = 60;
+    while (n < exact.size())
+    {
+        n <<= 1;
+        --shift;
+    }
+    bucketShift = shift;
+    buckets.assign(n, NO_ENTRY);
+    exactNext.assign(exact.size(), NO_ENTRY);
+    // Goes backwards so that every chain is in registration order.
+    for (uint32_t i = exact.size(); i-- > 0;)
+    {
+        uint32_t *head = &buckets[bucket_of(exact[i].event)];
+        exactNext[i] = *head;
+        *head = i;
+    }
+
+    exactSorted.resize(exact.size());
+    for (uint32_t i = 0; i < exact.size(); ++i)
+    {
+        exactSorted[i] = i;
+    }
+    std::stable_sort(exactSorted.begin(), exactSorted.end(),
+        [this](uint32_t a, uint32_t b) {
+            return exact[a].event < exact[b].event;
+        });
+
+    std::stable_sort(ranges.begin(), ranges.end(),
+        [](const Range &a, const Range &b) {
+            return a.entry.event < b.entry.event;
+        });
+    build_range_tree(0, ranges.size());
+}
+
+EventId TreeEventHandlers::Index::build_range_tree(
+    unsigned begin, unsigned end)
+{
+    if (begin >= end)
+    {
+        return 0;
+    }
+    unsigned mid = begin + (end - begin) / 2;
+    EventId m = ranges[mid].last;
+    m = std::max(m, build_range_tree(begin, mid));
+    m = std::max(m, build_range_tree(mid + 1, end));
+    ranges[mid].subtree_max = m;
+    return m;
+}
+
+/// Class representing the iteration state on the indexed event handler
+/// registry. Produces the matching single event registrations first, then the
+/// ranges, then the registrations for all events.
 class TreeEventHandlers::Iterator : public EventIterator
 {
 public:
     Iterator(TreeEventHandlers *parent)
         : parent_(parent)
+        , index_(nullptr)
+        , live_(nullptr)
+        , lastEntry_(nullptr)
     {
-        AtomicHolder h(parent_);
-        parent->handlers_[0];
         clear_iteration();
     }
 
+    ~Iterator()
+    {
+        parent_->release(index_);
+        parent_->release(live_);
+    }
+
     EventRegistryEntry *next_entry() OVERRIDE
     {
-        AtomicHolder h(parent_);
-        while (maskIterator_ != parent_->handlers_.end())
+        EventRegistryEntry *e;
+        do
+        {
+            e = next_snapshot_entry();
+        } while (e && live_ && !is_live(e, phase_));
+        lastEntry_ = e;
+        lastPhase_ = phase_;
+        return e;
+    }
+
+    void clear_iteration() OVERRIDE
+    {
+        phase_ = DONE;
+        lastEntry_ = nullptr;
+        parent_->release(index_);
+        index_ = nullptr;
+        parent_->release(live_);
+        live_ = nullptr;
+    }
+
+    bool resume_iteration() OVERRIDE
+    {
+        // Keeps walking the old snapshot, which determines what was returned
+        // already, and uses the current one to filter the rest.
+        Index *previous = live_;
+        live_ = parent_->acquire();
+        parent_->release(previous);
+        return lastEntry_ && is_live(lastEntry_, lastPhase_);
+    }
+
+    void init_iteration(EventReport *r) OVERRIDE
+    {
+        Index *previous = index_;
+        index_ = parent_->acquire();
+        parent_->release(previous);
+        parent_->release(live_);
+        live_ = nullptr;
+        lastEntry_ = nullptr;
+        first_ = r->event;
+        last_ = r->event + r->mask;
+        if (last_ < first_)
+        {
+            last_ = 0xFFFFFFFFFFFFFFFFULL;
+        }
+        if (index_->exact.empty())
+        {
+            start_ranges();
+        }
+        else if (r->mask == 0)
+        {
+            phase_ = EXACT_PROBE;
+            next_ = chain_head(first_);
+        }
+        else
+        {
+            phase_ = EXACT_SORTED;
+            auto &sorted = index_->exactSorted;
+            auto &exact = index_->exact;
+            next_ = std::lower_bound(sorted.begin(), sorted.end(), first_,
+                        [&exact](uint32_t idx, EventId ev) {
+                            return exact[idx].event < ev;
+                        }) -
+                sorted.begin();
+        }
+    }
+
+private:
+    /// Iteration phases.
+    enum Phase
+    {
+        /// Walks the hash chain of the (single event) report.
+        EXACT_PROBE,
+        /// Walks the sorted single event registrations in the report range.
+        EXACT_SORTED,
+        /// Traverses the range tree.
+        RANGES,
+        /// Produces the registrations for all events.
+        GLOBAL,
+        /// Iteration is over.
+        DONE
+    };
+
+    /// Maximum height of the range tree (for 2^32 ranges).
+    static constexpr unsigned MAX_DEPTH = 32;
+
+    /// @return true if two registrations are the same. @param a @param b
+    /// registrations to compare
+    static bool same(const EventRegistryEntry &a, const EventRegistryEntry &b)
+    {
+        return a.handler == b.handler && a.event == b.event &&
+            a.user_arg == b.user_arg;
+    }
+
+    /// @return true if an entry of the iterated snapshot is still present in
+    /// live_. @param e entry of index_ @param phase phase in which e was
+    /// returned, which tells the kind of the registration.
+    bool is_live(const EventRegistryEntry *e, Phase phase)
+    {
+        switch (phase)
         {
-            if (it_ == end_)
+            case EXACT_PROBE:
+            case EXACT_SORTED:
+            {
+                if (live_->exact.empty())
+                {
+                    return false;
+                }
+                for (uint32_t i = live_->buckets[live_->bucket_of(e->event)];
+                     i != NO_ENTRY; i = live_->exactNext[i])
+                {
+                    if (same(live_->exact[i], *e))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            case RANGES:
             {
-                maskIterator_++;
-                if (maskIterator_ != parent_->handlers_.end())
+                auto it = std::lower_bound(live_->ranges.begin(),
+                    live_->ranges.end(), e->event,
+                    [](const Range &r, EventId ev) {
+                        return r.entry.event < ev;
+                    });
+                for (; it != live_->ranges.end() && it->entry.event == e->event;
+                     ++it)
                 {
-                    setup_current_mask();
+                    if (same(it->entry, *e))
+                    {
+                        return true;
+                    }
                 }
-                continue;
+                return false;
             }
-            else
+            case GLOBAL:
+                for (const auto &g : live_->global)
+                {
+                    if (same(g, *e))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            default:
+                return false;
+        }
+    }
+
+    /// Steps the iteration on the snapshot. @return the next matching entry
+    /// of index_ or nullptr when done.
+    EventRegistryEntry *next_snapshot_entry()
+    {
+        while (true)
+        {
+            switch (phase_)
             {
-                EventRegistryEntry *e = &*it_;
-                it_++;
-                return e;
+                case EXACT_PROBE:
+                {
+                    while (next_ != NO_ENTRY)
+                    {
+                        EventRegistryEntry *e = &index_->exact[next_];
+                        next_ = index_->exactNext[next_];
+                        if (e->event == first_)
+                        {
+                            return e;
+                        }
+                    }
+                    start_ranges();
+                    break;
+                }
+                case EXACT_SORTED:
+                {
+                    if (next_ < index_->exactSorted.size())
+                    {
+                        EventRegistryEntry *e =
+                            &index_->exact[index_->exactSorted[next_++]];
+                        if (e->event <= last_)
+                        {
+                            return e;
+                        }
+                    }
+                    start_ranges();
+                    break;
+                }
+                case RANGES:
+                {
+                    if (EventRegistryEntry *e = next_range())
+                    {
+                        return e;
+                    }
+                    phase_ = GLOBAL;
+                    next_ = 0;
+                    break;
+                }
+                case GLOBAL:
+                {
+                    if (next_ < index_->global.size())
+                    {
+                        return &index_->global[next_++];
+                    }
+                    phase_ = DONE;
+                    break;
+                }
+                case DONE:
+                    // Entries returned earlier are not used anymore.
+                    parent_->release(index_);
+                    index_ = nullptr;
+                    parent_->release(live_);
+                    live_ = nullptr;
+                    return nullptr;
             }
         }
-        return nullptr;
     }
 
-    void clear_iteration() OVERRIDE
+    /// @return the first exact index in the hash chain of an event.
+    /// @param event event ID
+    uint32_t chain_head(EventId event)
     {
-        AtomicHolder h(parent_);
-        maskIterator_ = parent_->handlers_.end();
+        return index_->buckets[index_->bucket_of(event)];
     }
-    void init_iteration(EventReport *r) OVERRIDE
+
+    /// Starts iterating the range registrations.
+    void start_ranges()
     {
-        AtomicHolder h(parent_);
-        currentReport_ = r;
-        maskIterator_ = parent_->handlers_.begin();
-        setup_current_mask();
+        phase_ = RANGES;
+        depth_ = 0;
+        descend(0, index_->ranges.size());
     }
 
-private:
-    void setup_current_mask()
+    /// Pushes the left spine of a subtree onto the stack, skipping subtrees
+    /// that end before the first event of the report. @param begin first
+    /// index of the subtree @param end one past the last index
+    void descend(unsigned begin, unsigned end)
     {
-        if (maskIterator_->first == 64)
+        while (begin < end)
         {
-            // 64 bits -> all events go to everyone.
-            it_ = maskIterator_->second.begin();
-            end_ = maskIterator_->second.end();
-            return;
+            unsigned mid = begin + (end - begin) / 2;
+            if (index_->ranges[mid].subtree_max < first_)
+            {
+                return;
+            }
+            HASSERT(depth_ < MAX_DEPTH);
+            stackMid_[depth_] = mid;
+            stackEnd_[depth_] = end;
+            ++depth_;
+            end = mid;
         }
-        unsigned mask_log = maskIterator_->first;
-        uint64_t current_mask = (1ULL << mask_log) - 1;
-        uint64_t eventid_key = currentReport_->event & (~current_mask);
-        it_ = maskIterator_->second.lower_bound(eventid_key);
-        eventid_key = currentReport_->event + currentReport_->mask;
-        end_ = maskIterator_->second.upper_bound(eventid_key);
     }
+
+    /// @return the next range registration overlapping the report, or
+    /// nullptr if there are no more.
+    EventRegistryEntry *next_range()
+    {
+        while (depth_ > 0)
+        {
+            --depth_;
+            unsigned mid = stackMid_[depth_];
+            Range *r = &index_->ranges[mid];
+            if (r->entry.event > last_)
+            {
+                // Everything after this starts beyond the report as well.
+                depth_ = 0;
+                return nullptr;
+            }
+            descend(mid + 1, stackEnd_[depth_]);
+            if (r->last >= first_)
+            {
+                return &r->entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Registry we are iterating.
     TreeEventHandlers *parent_;
-    EventReport *currentReport_;
-    MaskLookupMap::iterator maskIterator_;
-    OneMaskMap::iterator it_;
-    OneMaskMap::iterator end_;
+    /// Snapshot of the registry for the current iteration, or nullptr.
+    Index *index_;
+    /// Snapshot of the registry taken by resume_iteration(), or nullptr. The
+    /// entries of index_ missing from this one are skipped.
+    Index *live_;
+    /// Entry last returned by next_entry(), or nullptr.
+    EventRegistryEntry *lastEntry_;
+    /// Phase in which lastEntry_ was returned.
+    Phase lastPhase_;
+    /// Current phase of the iteration.
+    Phase phase_;
+    /// First event of the report.
+    EventId first_;
+    /// Last event of the report.
+    EventId last_;
+    /// Chain position in EXACT_PROBE, index in EXACT_SORTED and GLOBAL.
+    uint32_t next_;
+    /// Number of entries in the range tree stack.
+    unsigned depth_;
+    /// Range tree stack: subtree root index.
+    unsigned stackMid_[MAX_DEPTH];
+    /// Range tree stack: one past the last index of the subtree.
+    unsigned stackEnd_[MAX_DEPTH];
 };
 
 EventIterator *TreeEventHandlers::create_iterator()
@@ -154,8 +587,4 @@ EventIterator *TreeEventHandlers::create_iterator()
     return new Iterator(this);
 }
 
-TreeEventHandlers::TreeEventHandlers()
-{
-}
-
 } // namespace openlcb
@@ -46,9 +46,10 @@
 //#define LOGLEVEL VERBOSE
 #endif
 
+#include "os/OS.hxx"
 #include "utils/Atomic.hxx"
 #include "utils/logging.h"
-#include "utils/SortedListMap.hxx"
+#include "openlcb/EventAdvertisementTable.hxx"
 #include "openlcb/EventHandler.hxx"
 #include "openlcb/EventHandlerTemplates.hxx"
 
@@ -79,6 +80,14 @@ public:
 
     /** Stops iteration and resets iteration variables. */
     virtual void clear_iteration() = 0;
+
+    /** Continues the iteration after the set of registered handlers changed
+     * (the registry epoch was bumped). The entries returned so far are not
+     * returned again, and the ones unregistered in the meantime are skipped.
+     *
+     * @returns true if the entry last returned by next_entry() is still
+     * registered. If false, that entry must not be used anymore. */
+    virtual bool resume_iteration() = 0;
 };
 
 /// EventIterator that produces every single entry in a given container (which
@@ -93,6 +102,8 @@ public:
         if (it_ == container_->end()) return nullptr;
         EventRegistryEntry* h = &*it_;
         ++it_;
+        last_ = h;
+        lastEntry_ = *h;
         return h;
     }
     void clear_iteration() OVERRIDE {
@@ -100,11 +111,36 @@ public:
     }
     void init_iteration(EventReport*) OVERRIDE {
         it_ = container_->begin();
+        last_ = nullptr;
+    }
+    bool resume_iteration() OVERRIDE {
+        if (!last_) {
+            it_ = container_->begin();
+            return false;
+        }
+        // The container iterators might be invalid; looks up the last
+        // returned entry (by value, because it may have been freed).
+        for (it_ = container_->begin(); it_ != container_->end(); ++it_) {
+            if (it_->handler == lastEntry_.handler &&
+                it_->event == lastEntry_.event &&
+                it_->user_arg == lastEntry_.user_arg) {
+                ++it_;
+                return true;
+            }
+        }
+        // The last entry is gone, so we cannot tell which entries were
+        // returned already. Ends the iteration instead of calling some
+        // handlers twice.
+        return false;
     }
 
 private:
     typename C::iterator it_;
     C* container_;
+    /// Entry last returned by next_entry, or nullptr.
+    EventRegistryEntry* last_{nullptr};
+    /// Copy of *last_.
+    EventRegistryEntry lastEntry_{nullptr, 0};
 };
 
 /// EventRegistry implementation that keeps all event handlers in a vector and
@@ -148,45 +184,140 @@ class VectorEventHandlers : public EventRegistry {
   HandlersList handlers_;
 };
 
-/// EventRegistry implementation that keeps event handlers in a SortedListMap
-/// and filters the event handler calls based on the registered event handler
-/// arguments (id/mask).
+/// EventRegistry implementation that indexes the event handlers by their
+/// registered arguments (id/mask) and calls only the matching ones.
+///
+/// Single event registrations (mask 0) are kept in a chained hash index, so
+/// an event report finds its handlers in O(1 + matches) independent of the
+/// registry size. Range reports (e.g. identify global) use a sorted index of
+/// the same registrations. Range registrations are kept in an array sorted by the
+/// first event, with an implicit balanced tree of the maximum last event over
+/// it, so that a lookup costs O(log(ranges) + matches). Registrations
+/// covering all events (mask 64) are called for everything.
+///
+/// Each iteration works on an immutable snapshot of the registrations, so
+/// next_entry() runs without locking, on any thread. Register/unregister
+/// calls modify a copy of the registrations (or the current one if no
+/// iteration is using it), which is indexed once, by the first iteration after
+/// the change. Copying and indexing happen under a mutex; the atomic section
+/// (which disables interrupts on FreeRTOS) only covers publishing the index
+/// pointer, the reference counts and the epoch. Iterators keep
+/// returning entries of the old snapshot until they are re-initialized; users
+/// detect the change via get_epoch(), just like with the previous
+/// implementations. After resume_iteration() the rest of the old snapshot is
+/// checked against the current registrations, so that the iteration continues
+/// where it was without producing unregistered handlers.
 class TreeEventHandlers : public EventRegistry, private Atomic {
 public:
     TreeEventHandlers();
+    ~TreeEventHandlers();
 
     EventIterator* create_iterator() OVERRIDE;
     void register_handler(const EventRegistryEntry &entry,
                           unsigned mask) OVERRIDE;
     void unregister_handler(EventHandler* handler) OVERRIDE;
+    EventAdvertisementTable *advertisements() OVERRIDE
+    {
+        return &advertisements_;
+    }
 
 private:
     class Iterator;
     friend class Iterator;
 
-    /// Comparison operator for event registry entries.
-    struct cmpop
+    /// Marks the end of a hash chain.
+    static constexpr uint32_t NO_ENTRY = 0xFFFFFFFFu;
+
+    /// A range registration.
+    struct Range
     {
-        bool operator()(const EventRegistryEntry &d, uint64_t k)
+        /// @param e registration @param mask log2 of the range size.
+        Range(const EventRegistryEntry &e, unsigned mask)
+            : entry(e)
+            , last(e.event | ((1ULL << mask) - 1))
+            , subtree_max(last)
         {
-            return d.event < k;
         }
-        bool operator()(uint64_t k, const EventRegistryEntry &d)
+        /// The registration. entry.event is the first event of the range.
+        EventRegistryEntry entry;
+        /// Last event covered by the range.
+        EventId last;
+        /// Largest last event in the implicit subtree rooted at this index.
+        EventId subtree_max;
+    };
+
+    /// A set of registrations with their lookup structures. Once published
+    /// for iteration, an Index is not modified anymore.
+    struct Index
+    {
+        Index()
+            : bucketShift(64)
+            , refCount(1)
         {
-            return k < d.event;
         }
-        bool operator()(const EventRegistryEntry &a, const EventRegistryEntry &b)
+
+        /// @return the hash bucket of an event ID. @param event event ID
+        unsigned bucket_of(EventId event) const
         {
-            return a.event < b.event;
+            return (event * 0x9E3779B97F4A7C15ULL) >> bucketShift;
         }
+
+        /// Builds the hash chains, the sorted index and the range tree from
+        /// the registrations.
+        void build();
+
+        /// Computes the maximum tree of the range registrations.
+        /// @param begin first index of the subtree @param end one past the
+        /// last index of the subtree
+        /// @return the largest last event in the subtree.
+        EventId build_range_tree(unsigned begin, unsigned end);
+
+        /// Single event registrations, in registration order.
+        std::vector<EventRegistryEntry> exact;
+        /// For each entry of exact the index of the next entry in the same
+        /// hash bucket, or NO_ENTRY.
+        std::vector<uint32_t> exactNext;
+        /// Index of the first exact entry for each hash bucket, or NO_ENTRY.
+        /// The size is a power of two, at least the size of exact.
+        std::vector<uint32_t> buckets;
+        /// Indexes of exact, sorted by event.
+        std::vector<uint32_t> exactSorted;
+        /// 64 - log2(buckets.size()).
+        unsigned bucketShift;
+        /// Range registrations, sorted by the first event after build().
+        std::vector<Range> ranges;
+        /// Registrations that match every event.
+        std::vector<EventRegistryEntry> global;
+        /// Number of iterators using this index, plus one while it is the
+        /// registry's current_ or pending_. Guarded by the atomic section.
+        unsigned refCount;
     };
 
-    typedef SortedListSet<EventRegistryEntry, cmpop> OneMaskMap;
-    typedef std::map<uint8_t, OneMaskMap> MaskLookupMap;
-    /** The registered handlers. The offset in the first map tell us how many
-     * bits wide the registration is (it is the mask value in the register
-     * call).*/
-    MaskLookupMap handlers_;
+    /// @return the registrations to apply a change to. Must hold lock_.
+    Index *writable();
+
+    /// Indexes the pending changes if there are any, and takes a reference to
+    /// the current index. Must not hold lock_. @return the index to iterate
+    /// on.
+    Index *acquire();
+
+    /// Drops a reference taken by acquire(). @param index is the index to
+    /// release, may be nullptr.
+    void release(Index *index);
+
+    /// The last index built for iteration, or nullptr if pending_ took it
+    /// over.
+    Index *current_;
+    /// Registrations changed since current_ was built, not indexed yet; or
+    /// nullptr.
+    Index *pending_;
+    /// Serializes the changes of the registrations and the building of the
+    /// index. The atomic section only guards publishing the index pointers
+    /// and the reference counts.
+    OSMutex lock_;
+
+    /// Messages advertised by the registered handlers.
+    EventAdvertisementTable advertisements_;
 };
 
 }; /* namespace openlcb */
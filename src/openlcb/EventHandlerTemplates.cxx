@@ -276,6 +276,20 @@ void BitRangeEventPC::handle_identify_global(const EventRegistryEntry& entry, Ev
     done->maybe_done();
 }
 
+bool BitRangeEventPC::get_identified(const EventRegistryEntry &entry,
+                                     EventReport *event,
+                                     std::vector<EventIdentified> *out)
+{
+    if (event->dst_node && event->dst_node != node_)
+    {
+        return true;
+    }
+    uint64_t range = EncodeRange(event_base_, size_ * 2);
+    out->push_back({node_, Defs::MTI_PRODUCER_IDENTIFIED_RANGE, range});
+    out->push_back({node_, Defs::MTI_CONSUMER_IDENTIFIED_RANGE, range});
+    return true;
+}
+
 void BitRangeEventPC::SendIdentified(WriteHelper *writer,
                                      BarrierNotifiable *done)
 {
@@ -370,6 +384,19 @@ void ByteRangeEventC::handle_identify_global(const EventRegistryEntry& entry, Ev
     done->maybe_done();
 }
 
+bool ByteRangeEventC::get_identified(const EventRegistryEntry &entry,
+                                     EventReport *event,
+                                     std::vector<EventIdentified> *out)
+{
+    if (event->dst_node && event->dst_node != node_)
+    {
+        return true;
+    }
+    out->push_back({node_, Defs::MTI_CONSUMER_IDENTIFIED_RANGE,
+                    EncodeRange(event_base_, size_ * 256)});
+    return true;
+}
+
 void ByteRangeEventC::SendIdentified(WriteHelper *writer,
                                      BarrierNotifiable *done)
 {
@@ -436,6 +463,19 @@ void ByteRangeEventP::handle_identify_global(const EventRegistryEntry& entry, Ev
                                    eventid_to_buffer(range), done);
 }
 
+bool ByteRangeEventP::get_identified(const EventRegistryEntry &entry,
+                                     EventReport *event,
+                                     std::vector<EventIdentified> *out)
+{
+    if (event->dst_node && event->dst_node != node_)
+    {
+        return true;
+    }
+    out->push_back({node_, Defs::MTI_PRODUCER_IDENTIFIED_RANGE,
+                    EncodeRange(event_base_, size_ * 256)});
+    return true;
+}
+
 void ByteRangeEventP::SendIdentified(WriteHelper *writer,
                                      BarrierNotifiable *done)
 {
@@ -581,6 +621,23 @@ void BitEventHandler::SendConsumerIdentified(BarrierNotifiable *done)
                                    done->new_child());
 }
 
+void BitEventHandler::AppendIdentified(const EventRegistryEntry &entry,
+                                       Defs::MTI mti_valid,
+                                       std::vector<EventIdentified> *out)
+{
+    EventState state = bit_->get_current_state();
+    // A registration entry covers either one or both of the events.
+    if (!(entry.user_arg & EVENT_OFF))
+    {
+        out->push_back({bit_->node(), mti_valid + state, bit_->event_on()});
+    }
+    if (!(entry.user_arg & EVENT_ON))
+    {
+        out->push_back({bit_->node(), mti_valid + invert_event_state(state),
+                        bit_->event_off()});
+    }
+}
+
 void BitEventHandler::SendEventReport(WriteHelper *writer, Notifiable *done)
 {
     EventState value = bit_->get_requested_state();
@@ -697,6 +754,17 @@ void BitEventProducer::handle_identify_global(const EventRegistryEntry& entry, E
     done->maybe_done();
 }
 
+bool BitEventProducer::get_identified(const EventRegistryEntry &entry,
+                                      EventReport *event,
+                                      std::vector<EventIdentified> *out)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AppendIdentified(entry, Defs::MTI_PRODUCER_IDENTIFIED_VALID, out);
+    }
+    return true;
+}
+
 void BitEventProducer::handle_identify_producer(const EventRegistryEntry& entry, EventReport *event,
                                               BarrierNotifiable *done)
 {
@@ -726,6 +794,17 @@ void BitEventConsumer::handle_identify_global(const EventRegistryEntry& entry, E
     done->maybe_done();
 }
 
+bool BitEventConsumer::get_identified(const EventRegistryEntry &entry,
+                                      EventReport *event,
+                                      std::vector<EventIdentified> *out)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AppendIdentified(entry, Defs::MTI_CONSUMER_IDENTIFIED_VALID, out);
+    }
+    return true;
+}
+
 void BitEventPC::SendQueryConsumer(WriteHelper *writer, BarrierNotifiable *done)
 {
     writer->WriteAsync(bit_->node(), Defs::MTI_CONSUMER_IDENTIFY,
@@ -745,6 +824,18 @@ void BitEventPC::handle_identify_global(const EventRegistryEntry& entry, EventRe
     done->maybe_done();
 }
 
+bool BitEventPC::get_identified(const EventRegistryEntry &entry,
+                                EventReport *event,
+                                std::vector<EventIdentified> *out)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AppendIdentified(entry, Defs::MTI_PRODUCER_IDENTIFIED_VALID, out);
+        AppendIdentified(entry, Defs::MTI_CONSUMER_IDENTIFIED_VALID, out);
+    }
+    return true;
+}
+
 void BitEventPC::handle_consumer_identified(const EventRegistryEntry& entry, EventReport *event,
                                                 BarrierNotifiable *done)
 {
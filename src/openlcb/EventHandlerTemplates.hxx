@@ -156,6 +156,17 @@ public:
             WriteHelper::global(), openlcb::eventid_to_buffer(EVENT_ID), done);
     }
 
+    bool get_identified(const EventRegistryEntry &registry_entry,
+        EventReport *event, std::vector<EventIdentified> *out) OVERRIDE
+    {
+        if (!event->dst_node || event->dst_node == node_)
+        {
+            out->push_back({node_, Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN,
+                EVENT_ID});
+        }
+        return true;
+    }
+
     void handle_identify_producer(const EventRegistryEntry &registry_entry, EventReport *event, BarrierNotifiable *done)
         OVERRIDE
     {
@@ -488,6 +499,13 @@ public:
     /// be invoked inline and potentially block the calling thread.
     void SendEventReport(WriteHelper *writer, Notifiable *done);
 
+    /// The bit may change without the handler knowing about it (e.g. an input
+    /// pin), so the identified messages are not cached.
+    bool is_advertisement_volatile() override
+    {
+        return true;
+    }
+
 protected:
     /// Registers this event handler with the global event manager. Call this
     /// from the constructor of the derived class.
@@ -521,6 +539,14 @@ protected:
     void HandlePCIdentify(Defs::MTI mti_valid, EventReport *event,
                           BarrierNotifiable *done);
 
+    /// Appends the {Producer|Consumer}Identified{Valid|Invalid} messages
+    /// describing the events of one registration entry to a batched identify
+    /// response. @param entry is the registration entry. @param mti_valid is
+    /// the Valid variant of the MTI to send. @param out is the output list.
+    void AppendIdentified(const EventRegistryEntry &entry,
+                          Defs::MTI mti_valid,
+                          std::vector<EventIdentified> *out);
+
     BitEventInterface *bit_;
 
 private:
@@ -588,6 +614,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
     void handle_identify_producer(const EventRegistryEntry &entry,
                                 EventReport *event,
                                 BarrierNotifiable *done) override;
@@ -628,6 +656,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
     void handle_identify_consumer(const EventRegistryEntry &entry,
                                 EventReport *event,
                                 BarrierNotifiable *done) override;
@@ -671,6 +701,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
     void handle_consumer_identified(const EventRegistryEntry &entry,
                                   EventReport *event,
                                   BarrierNotifiable *done) override;
@@ -725,6 +757,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
 
     /// @returns the number of bits maintained.
     unsigned size() { return size_; }
@@ -772,6 +806,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
 
 protected:
     /// takes an event ID and checks if we are responsible for it. Returns false
@@ -829,6 +865,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identified(const EventRegistryEntry &entry, EventReport *event,
+                        std::vector<EventIdentified> *out) override;
     // Responses to possible queries.
     void handle_consumer_identified(const EventRegistryEntry &entry,
                                   EventReport *event,
@@ -2,17 +2,20 @@
 #include "utils/logging.h"
 
 #include <algorithm>
+#include <tuple>
 #include <vector>
 #include <endian.h>
 
 #include "openlcb/EventService.hxx"
 
 #include "openlcb/EventServiceImpl.hxx"
+#include "openlcb/EventAdvertisementTable.hxx"
 #include "openlcb/EventHandler.hxx"
 #include "openlcb/EventHandlerTemplates.hxx"
 #include "openlcb/EventHandlerContainer.hxx"
 #include "openlcb/Defs.hxx"
 #include "openlcb/EndianHelper.hxx"
+#include "openlcb/Node.hxx"
 
 namespace openlcb
 {
@@ -55,7 +58,40 @@ void EventService::register_interface(If *iface)
         EventService::Impl::MTI_MASK_ADDRESSED_ALL));
 }
 
-EventService::Impl::Impl(EventService *service) : callerFlow_(service)
+void EventService::register_interface(If *iface, unsigned num_flows)
+{
+    if (num_flows <= 1)
+    {
+        register_interface(iface);
+        return;
+    }
+    std::vector<EventIteratorFlow *> flows;
+    for (unsigned i = 0; i < num_flows; ++i)
+    {
+        // All flows share the interface's executor, which keeps the handler
+        // calls serialized.
+        auto *f = new InlineEventIteratorFlow(iface, this);
+        impl()->ownedFlows_.emplace_back(f);
+        flows.push_back(f);
+    }
+    impl()->distributors_.emplace_back(
+        new EventDistributor(iface, std::move(flows)));
+    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
+        iface, this, EventService::Impl::MTI_VALUE_GLOBAL,
+        EventService::Impl::MTI_MASK_GLOBAL));
+    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
+        iface, this, EventService::Impl::MTI_VALUE_ADDRESSED_ALL,
+        EventService::Impl::MTI_MASK_ADDRESSED_ALL));
+}
+
+void EventService::set_identify_options(const IdentifyOptions &opts)
+{
+    impl()->identifyOptions_ = opts;
+}
+
+EventService::Impl::Impl(EventService *service)
+    : callerFlow_(service)
+    , identifyReplyFlow_(service)
 {
 #ifdef TARGET_LPC11Cxx
     registry.reset(new VectorEventHandlers());
@@ -94,22 +130,65 @@ StateFlowBase::Action EventCallerFlow::call_done()
 
 EventIteratorFlow::EventIteratorFlow(If *async_if, EventService *event_service,
                                      unsigned mti_value, unsigned mti_mask)
-    : IncomingMessageStateFlow(async_if)
+    : MessageStateFlowBase(async_if)
+    , iface_(async_if)
     , eventService_(event_service)
     , iterator_(event_service->impl()->registry->create_iterator())
 #ifdef DEBUG_EVENT_PERFORMANCE
     , mtiValue_(mti_value)
 #endif
 {
-    iface()->dispatcher()->register_handler(this, mti_value, mti_mask);
+    iface_->dispatcher()->register_handler(this, mti_value, mti_mask);
+}
+
+EventIteratorFlow::EventIteratorFlow(
+    Service *service, EventService *event_service)
+    : MessageStateFlowBase(service)
+    , iface_(nullptr)
+    , eventService_(event_service)
+    , iterator_(event_service->impl()->registry->create_iterator())
+#ifdef DEBUG_EVENT_PERFORMANCE
+    , mtiValue_(Defs::MTI_EVENT_MASK)
+#endif
+{
 }
 
 EventIteratorFlow::~EventIteratorFlow()
 {
-    iface()->dispatcher()->unregister_handler_all(this);
+    if (iface_)
+    {
+        iface_->dispatcher()->unregister_handler_all(this);
+    }
     delete iterator_;
 }
 
+EventDistributor::EventDistributor(
+    If *iface, std::vector<EventIteratorFlow *> flows)
+    : iface_(iface)
+    , flows_(std::move(flows))
+{
+    iface_->dispatcher()->register_handler(this,
+        EventService::Impl::MTI_VALUE_EVENT,
+        EventService::Impl::MTI_MASK_EVENT);
+}
+
+EventDistributor::~EventDistributor()
+{
+    iface_->dispatcher()->unregister_handler_all(this);
+}
+
+void EventDistributor::send(Buffer<GenMessage> *message, unsigned priority)
+{
+    // Partitions by the source node, so that the messages of each producer
+    // are processed in the order they were sent. The alias goes first,
+    // because the node ID of a CAN source may or may not be known yet.
+    const NodeHandle &src = message->data()->src;
+    uint64_t key = src.alias ? src.alias : src.id;
+    // Mixes the bits so that consecutive node IDs spread over the flows.
+    key *= 0x9E3779B97F4A7C15ULL;
+    flows_[(key >> 32) % flows_.size()]->send(message, priority);
+}
+
 /// Returns true if there are outstanding events that are not yet handled.
 bool EventService::event_processing_pending()
 {
@@ -118,7 +197,7 @@ bool EventService::event_processing_pending()
         if (!f->is_waiting())
             return true;
     }
-    return false;
+    return !impl()->identifyReplyFlow_.is_waiting();
 }
 
 void DecodeRange(EventReport *r)
@@ -237,50 +316,192 @@ StateFlowBase::Action EventIteratorFlow::entry()
     incomingDone_ = message()->new_child();
     release();
 
+    if (fn_ == &EventHandler::handle_identify_global)
+    {
+        // The handlers' state must not change while we collect the answers.
+        return allocate_and_call(
+            STATE(identify_locked), &event_caller_mutex);
+    }
     eventRegistryEpoch_ = eventService_->impl()->registry->get_epoch();
-    iterator_->init_iteration(rep);
+    iterator_->init_iteration(&eventReport_);
     return yield_and_call(STATE(iterate_next));
 }
 
 StateFlowBase::Action EventIteratorFlow::iterate_next()
 {
-    if (eventRegistryEpoch_ != eventService_->impl()->registry->get_epoch())
-    {
-        // Iterators are invalidated. We need to start over. This may cause
-        // duplicate delivery of the same events.
-        iterator_->clear_iteration();
-        eventRegistryEpoch_ = eventService_->impl()->registry->get_epoch();
-        iterator_->init_iteration(&eventReport_);
-    }
+    registry_changed();
 
-    EventRegistryEntry *entry = iterator_->next_entry();
+    const EventRegistryEntry *entry = iterator_->next_entry();
     if (!entry)
     {
         no_more_matches();
-        if (incomingDone_)
+        return iteration_done();
+    }
+    if (entry->handler->is_reentrant())
+    {
+        call_reentrant(entry);
+        return call_immediately(STATE(iterate_next));
+    }
+    return dispatch_event(entry);
+}
+
+StateFlowBase::Action EventIteratorFlow::identify_locked()
+{
+    EventRegistry *registry = eventService_->impl()->registry.get();
+    eventRegistryEpoch_ = registry->get_epoch();
+    identified_.clear();
+    EventAdvertisementTable *table =
+        eventReport_.dst_node ? nullptr : registry->advertisements();
+    if (table)
+    {
+        if (table->get(nullptr, &identified_))
         {
-            incomingDone_->notify();
-            incomingDone_ = nullptr;
+            return identify_done();
         }
+        // Some handlers have to be called; the iteration keeps the order of
+        // their replies relative to the others.
+        identified_.clear();
+    }
+    iterator_->init_iteration(&eventReport_);
+    return call_immediately(STATE(identify_next));
+}
 
-#ifdef DEBUG_EVENT_PERFORMANCE
-        long long len = os_get_time_monotonic() - currentProcessStart_;
-        numProcessNsec_ += len;
-        countEvents_++;
-        if (countEvents_ >= REPORT_COUNT)
+StateFlowBase::Action EventIteratorFlow::identify_next()
+{
+    registry_changed();
+    const EventRegistryEntry *entry = iterator_->next_entry();
+    if (!entry)
+    {
+        return identify_done();
+    }
+    if (entry->handler->get_identified(*entry, &eventReport_, &identified_))
+    {
+        return call_immediately(STATE(identify_next));
+    }
+    identifyEntry_ = entry;
+    if (identified_.empty())
+    {
+        return identify_call();
+    }
+    // The answers collected so far have to go out before the ones of this
+    // handler. Lets the other handlers run while the batch is being sent.
+    n_.reset(this);
+    flush_identified(&n_);
+    event_caller_mutex.Unlock();
+    return wait_and_call(STATE(identify_flushed));
+}
+
+StateFlowBase::Action EventIteratorFlow::identify_flushed()
+{
+    return allocate_and_call(STATE(identify_call), &event_caller_mutex);
+}
+
+StateFlowBase::Action EventIteratorFlow::identify_call()
+{
+    if (registry_changed() && !lastEntryRegistered_)
+    {
+        // The handler was unregistered while we were waiting for the lock.
+        return call_immediately(STATE(identify_next));
+    }
+    n_.reset(this);
+    (identifyEntry_->handler->*(fn_))(*identifyEntry_, &eventReport_, &n_);
+    return wait_and_call(STATE(identify_next));
+}
+
+StateFlowBase::Action EventIteratorFlow::identify_done()
+{
+    event_caller_mutex.Unlock();
+    iterator_->clear_iteration();
+    flush_identified();
+    return all_calls_done();
+}
+
+bool EventIteratorFlow::registry_changed()
+{
+    unsigned epoch = eventService_->impl()->registry->get_epoch();
+    if (eventRegistryEpoch_ == epoch)
+    {
+        return false;
+    }
+    // Continues after the entries visited so far, so that no handler gets
+    // called twice for the same message.
+    eventRegistryEpoch_ = epoch;
+    lastEntryRegistered_ = iterator_->resume_iteration();
+    return true;
+}
+
+bool EventIteratorFlow::call_reentrant(const EventRegistryEntry *entry)
+{
+    if (registry_changed() && !lastEntryRegistered_)
+    {
+        // The handler was unregistered since the iteration returned it.
+        return false;
+    }
+    if (!parallelCalls_)
+    {
+        parallelDone_.reset(this);
+        parallelCalls_ = true;
+    }
+    // The handler notifies the barrier once when it is done, which consumes
+    // this child.
+    parallelDone_.new_child();
+    (entry->handler->*(fn_))(*entry, &eventReport_, &parallelDone_);
+    return true;
+}
+
+void EventIteratorFlow::flush_identified(BarrierNotifiable *done)
+{
+    if (identified_.empty())
+    {
+        return;
+    }
+    IdentifyReplyFlow *f = &eventService_->impl()->identifyReplyFlow_;
+    Buffer<IdentifyReplies> *b;
+    f->pool()->alloc(&b, nullptr);
+    HASSERT(b);
+    b->data()->messages.swap(identified_);
+    b->set_done(done);
+    f->send(b, priority());
+}
+
+StateFlowBase::Action EventIteratorFlow::iteration_done()
+{
+    if (parallelCalls_)
+    {
+        parallelCalls_ = false;
+        if (!parallelDone_.abort_if_almost_done())
         {
-            //long msec = numProcessNsec_ / 1000000;
-            //printf("event perf for mti %04x: %ld msec for %d events\n",
-            //       mtiValue_, msec, REPORT_COUNT);
-            countEvents_ = 0;
-            numProcessNsec_ = 0;
+            parallelDone_.notify();
+            return wait_and_call(STATE(all_calls_done));
         }
+    }
+    return all_calls_done();
+}
 
-#endif
+StateFlowBase::Action EventIteratorFlow::all_calls_done()
+{
+    if (incomingDone_)
+    {
+        incomingDone_->notify();
+        incomingDone_ = nullptr;
+    }
 
-        return exit();
+#ifdef DEBUG_EVENT_PERFORMANCE
+    long long len = os_get_time_monotonic() - currentProcessStart_;
+    numProcessNsec_ += len;
+    countEvents_++;
+    if (countEvents_ >= REPORT_COUNT)
+    {
+        //long msec = numProcessNsec_ / 1000000;
+        //printf("event perf for mti %04x: %ld msec for %d events\n",
+        //       mtiValue_, msec, REPORT_COUNT);
+        countEvents_ = 0;
+        numProcessNsec_ = 0;
     }
-    return dispatch_event(entry);
+
+#endif
+
+    return exit();
 }
 
 StateFlowBase::Action EventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
@@ -323,9 +544,9 @@ void InlineEventIteratorFlow::no_more_matches()
 
 StateFlowBase::Action InlineEventIteratorFlow::perform_call()
 {
-    if (eventRegistryEpoch_ != eventService_->impl()->registry->get_epoch())
+    if (registry_changed() && !lastEntryRegistered_)
     {
-        // Will restart iteration.
+        // The handler was unregistered while we were waiting for the lock.
         return call_immediately(STATE(iterate_next));
     }
     n_.reset(this);
@@ -344,4 +565,218 @@ StateFlowBase::Action InlineEventIteratorFlow::perform_call()
     }
 }
 
+IdentifyReplyFlow::IdentifyReplyFlow(EventService *service)
+    : StateFlow<Buffer<IdentifyReplies>, QList<1>>(service)
+    , eventService_(service)
+{
+}
+
+/// @return true if the message is a Producer Identified of any state.
+/// @param mti is the message type of a single event identified message.
+static bool is_producer_identified(Defs::MTI mti)
+{
+    switch (mti)
+    {
+        case Defs::MTI_PRODUCER_IDENTIFIED_VALID:
+        case Defs::MTI_PRODUCER_IDENTIFIED_INVALID:
+        case Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN:
+        case Defs::MTI_PRODUCER_IDENTIFIED_RESERVED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// @return true if an identified message may be represented as part of a
+/// range identified message. @param opts defines the merging rules.
+/// @param mti message type.
+static bool is_range_mergeable(
+    const EventService::IdentifyOptions &opts, Defs::MTI mti)
+{
+    switch (mti)
+    {
+        case Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN:
+        case Defs::MTI_CONSUMER_IDENTIFIED_UNKNOWN:
+            return true;
+        case Defs::MTI_CONSUMER_IDENTIFIED_VALID:
+        case Defs::MTI_CONSUMER_IDENTIFIED_INVALID:
+            return opts.merge_consumer_states;
+        default:
+            return false;
+    }
+}
+
+/// @return the range identified payload for an aligned block of events.
+/// @param base first event of the block, aligned to size. @param size is the
+/// number of events, a power of two and at least 2.
+static EventId encode_aligned_range(EventId base, uint64_t size)
+{
+    // The receiver takes the run of identical low bits as the mask, which is
+    // terminated by the first opposite bit.
+    return (base & size) ? base : (base | (size - 1));
+}
+
+// static
+void IdentifyReplyFlow::compact(const EventService::IdentifyOptions &opts,
+    std::vector<EventIdentified> *messages)
+{
+    if (!opts.min_range_size)
+    {
+        return;
+    }
+    uint64_t min_size = 2;
+    while (min_size < opts.min_range_size)
+    {
+        min_size <<= 1;
+    }
+    std::vector<EventIdentified> out;
+    std::vector<EventIdentified> singles;
+    for (const auto &m : *messages)
+    {
+        if (is_range_mergeable(opts, m.mti))
+        {
+            singles.push_back(m);
+        }
+        else
+        {
+            out.push_back(m);
+        }
+    }
+    if (singles.size() < min_size)
+    {
+        return;
+    }
+    auto key = [](const EventIdentified &m) {
+        return std::make_tuple((uintptr_t)m.node, is_producer_identified(m.mti),
+            m.event, (unsigned)m.mti);
+    };
+    std::sort(singles.begin(), singles.end(),
+        [&key](const EventIdentified &a, const EventIdentified &b) {
+            return key(a) < key(b);
+        });
+    singles.erase(std::unique(singles.begin(), singles.end(),
+                      [&key](const EventIdentified &a,
+                          const EventIdentified &b) { return key(a) == key(b); }),
+        singles.end());
+    // Index of the first message of each distinct (node, kind, event).
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < singles.size(); ++i)
+    {
+        if (i == 0 || singles[i].node != singles[i - 1].node ||
+            is_producer_identified(singles[i].mti) !=
+                is_producer_identified(singles[i - 1].mti) ||
+            singles[i].event != singles[i - 1].event)
+        {
+            starts.push_back(i);
+        }
+    }
+    starts.push_back(singles.size());
+    size_t num_events = starts.size() - 1;
+    size_t d = 0;
+    while (d < num_events)
+    {
+        const EventIdentified &first = singles[starts[d]];
+        bool producer = is_producer_identified(first.mti);
+        // Largest aligned block starting here that fits into the remaining
+        // events.
+        uint64_t size = 0;
+        if ((first.event & (min_size - 1)) == 0 && num_events - d >= min_size)
+        {
+            size = min_size;
+            while (size < (1ULL << 63) && (first.event & size) == 0 &&
+                size * 2 <= num_events - d)
+            {
+                size <<= 1;
+            }
+        }
+        for (; size >= min_size; size >>= 1)
+        {
+            // Events in a group are sorted and distinct, so the block is
+            // covered if its last event is at the right place.
+            const EventIdentified &last = singles[starts[d + size - 1]];
+            if (last.node == first.node &&
+                is_producer_identified(last.mti) == producer &&
+                last.event == first.event + size - 1)
+            {
+                break;
+            }
+        }
+        if (size >= min_size)
+        {
+            out.push_back({first.node,
+                producer ? Defs::MTI_PRODUCER_IDENTIFIED_RANGE
+                         : Defs::MTI_CONSUMER_IDENTIFIED_RANGE,
+                encode_aligned_range(first.event, size)});
+            d += size;
+        }
+        else
+        {
+            for (size_t i = starts[d]; i < starts[d + 1]; ++i)
+            {
+                out.push_back(singles[i]);
+            }
+            ++d;
+        }
+    }
+    messages->swap(out);
+}
+
+StateFlowBase::Action IdentifyReplyFlow::entry()
+{
+    opts_ = eventService_->impl()->identifyOptions_;
+    compact(opts_, &message()->data()->messages);
+    next_ = 0;
+    startTime_ = os_get_time_monotonic();
+    return call_immediately(STATE(send_next));
+}
+
+long long IdentifyReplyFlow::next_due()
+{
+    if (!opts_.max_messages_per_sec)
+    {
+        return 0;
+    }
+    long long due = startTime_ +
+        (long long)next_ * SEC_TO_NSEC(1) / opts_.max_messages_per_sec;
+    long long now = os_get_time_monotonic();
+    return due > now ? due - now : 0;
+}
+
+StateFlowBase::Action IdentifyReplyFlow::send_next()
+{
+    if (long long delay = next_due())
+    {
+        return sleep_and_call(&timer_, delay, STATE(send_next));
+    }
+    const auto &msgs = message()->data()->messages;
+    // Hands over a few messages at a time, and waits until the interface is
+    // done with them before allocating more.
+    batchDone_.reset(this);
+    for (unsigned count = 0;
+         count < BATCH_SIZE && next_ < msgs.size() && !next_due(); ++count)
+    {
+        const EventIdentified &m = msgs[next_++];
+        if (!m.node->is_initialized())
+        {
+            continue;
+        }
+        auto *f = m.node->iface()->global_message_write_flow();
+        Buffer<GenMessage> *b = f->alloc();
+        b->data()->reset(m.mti, m.node->node_id(), eventid_to_buffer(m.event));
+        b->set_done(batchDone_.new_child());
+        f->send(b, b->data()->priority());
+    }
+    batchDone_.notify();
+    return wait_and_call(STATE(batch_sent));
+}
+
+StateFlowBase::Action IdentifyReplyFlow::batch_sent()
+{
+    if (next_ < message()->data()->messages.size())
+    {
+        return call_immediately(STATE(send_next));
+    }
+    return release_and_exit();
+}
+
 } /* namespace openlcb */
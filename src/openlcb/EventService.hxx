@@ -47,6 +47,7 @@
 #define DEBUG_EVENT_PERFORMANCE
 
 #include <memory>
+#include <vector>
 
 #include "utils/macros.h"
 #include "executor/Service.hxx"
@@ -78,6 +79,45 @@ public:
      * will be undone in the destructor. */
     void register_interface(If *iface);
 
+    /** Registers this global event handler with an interface, using several
+     * flows to process the messages carrying an event ID (event reports,
+     * identify and identified messages) in parallel. Messages about the same
+     * event are still processed in order. Identify global messages use a
+     * single flow.
+     *
+     * All flows run on the executor of the interface, thus event handlers are
+     * never called from two threads at the same time. The flows only overlap
+     * while waiting for handlers to complete asynchronously: reentrant
+     * handlers (see EventHandler::is_reentrant()) may get a new call before
+     * the done notifiable of the previous one is notified; other handlers
+     * are called one at a time regardless.
+     * @param iface is the interface to register with.
+     * @param num_flows is the number of flows processing event messages. */
+    void register_interface(If *iface, unsigned num_flows);
+
+    /// Options for answering the identify global and addressed identify
+    /// events messages. Handlers that implement EventHandler::get_identified()
+    /// are answered in one batch, which is streamed out without waiting for
+    /// each message to be sent; these options apply to that batch.
+    struct IdentifyOptions
+    {
+        /// When nonzero, single events with an UNKNOWN state are merged into
+        /// range identified messages wherever they fill an aligned
+        /// power-of-two block of at least this many events. Rounded up to a
+        /// power of two, minimum 2.
+        unsigned min_range_size = 0;
+        /// If true, consumer identified messages are merged into ranges
+        /// regardless of their Valid/Invalid state.
+        bool merge_consumer_states = false;
+        /// Maximum number of identified messages sent per second. 0 means no
+        /// limit.
+        unsigned max_messages_per_sec = 0;
+    };
+
+    /** Sets the options for answering identify events messages.
+     * @param opts new options; take effect from the next identify message. */
+    void set_identify_options(const IdentifyOptions &opts);
+
     class Impl;
     Impl *impl()
     {
@@ -49,6 +49,7 @@ namespace openlcb
 class IncomingEventFlow;
 class GlobalIdentifyFlow;
 class EventHandler;
+class EventDistributor;
 
 /// Arguments structure for the EventCallerFlow. Each such buffer sent to @ref
 /// EventCallerFlow means calling one event handler's one specific function
@@ -88,6 +89,64 @@ private:
     BarrierNotifiable n_;
 };
 
+/// One batched answer to an identify events message, as collected from the
+/// event handlers' get_identified() calls.
+struct IdentifyReplies
+{
+    /// Messages to send, in order.
+    std::vector<EventIdentified> messages;
+};
+
+/// Sends the batched answers to identify events messages. Merges single
+/// events into ranges and limits the rate of the messages according to the
+/// EventService::IdentifyOptions. The messages are handed to the interface a
+/// few at a time; the next few are only allocated after the interface is done
+/// with the previous ones, so that the memory use stays bounded even without a
+/// rate limit.
+class IdentifyReplyFlow : public StateFlow<Buffer<IdentifyReplies>, QList<1>>
+{
+public:
+    /// Constructor. @param service is the owning event service.
+    IdentifyReplyFlow(EventService *service);
+
+    /// Merges the single event identified messages that can be represented
+    /// as range identified messages. Messages that are not eligible keep
+    /// their order and come first; the rest are sorted and duplicates are
+    /// removed.
+    /// @param opts defines which messages may be merged.
+    /// @param messages is the list to update in place.
+    static void compact(const EventService::IdentifyOptions &opts,
+        std::vector<EventIdentified> *messages);
+
+private:
+    /// How many messages to hand to the interface before waiting for them to
+    /// be sent.
+    static constexpr unsigned BATCH_SIZE = 16;
+
+    Action entry() override;
+    /// Sends the messages that are due according to the rate limit.
+    Action send_next();
+    /// Continues after the interface is done with a batch of messages.
+    Action batch_sent();
+
+    /// @return how many nanoseconds to wait before the next message may go
+    /// out according to the rate limit, or 0 if it is due.
+    long long next_due();
+
+    /// Owning event service.
+    EventService *eventService_;
+    /// Options in effect for the current batch.
+    EventService::IdentifyOptions opts_;
+    /// Index of the next message to send from the current batch.
+    size_t next_;
+    /// Time when the current batch started sending.
+    long long startTime_;
+    /// Helper for sleeping for the rate limit.
+    StateFlowTimer timer_{this};
+    /// Notified when the messages of the current batch are sent.
+    BarrierNotifiable batchDone_;
+};
+
 /// PImpl class for the EventService. This class creates and owns all
 /// components necessary to the correct operation of the EventService but does
 /// not need to appear on the application-facing API.
@@ -104,10 +163,20 @@ public:
     /// registered.
     std::vector<std::unique_ptr<StateFlowWithQueue>> ownedFlows_;
 
+    /// Distributors of the interfaces registered with parallel flows. Must be
+    /// destroyed before the flows they feed.
+    std::vector<std::unique_ptr<EventDistributor>> distributors_;
+
     /// This flow will serialize calls to NMRAnetEventHandler objects. All such
     /// calls need to be sent to this flow.
     EventCallerFlow callerFlow_;
 
+    /// Options for answering identify events messages.
+    EventService::IdentifyOptions identifyOptions_;
+
+    /// Sends the batched answers to identify events messages.
+    IdentifyReplyFlow identifyReplyFlow_;
+
     enum
     {
         // These address/mask should match all the messages carrying an event
@@ -124,25 +193,86 @@ public:
 /** Flow to receive incoming messages of event protocol, and dispatch them to
  * the registered event handler. This flow runs on the executor of the event
  * service (and not necessarily the interface). Its main job is to iterate
- * through the matching event handler and call each of them for that report. */
-class EventIteratorFlow : public IncomingMessageStateFlow
+ * through the matching event handler and call each of them for that report.
+ *
+ * Reentrant handlers (see EventHandler::is_reentrant()) are called right away
+ * and the iteration continues without waiting for them to finish; the
+ * incoming message is released when all of them are done.
+ *
+ * Identify events messages are processed holding the event handler lock.
+ * The handlers are asked to list their answers with
+ * EventHandler::get_identified() (or, for identify global, these are taken
+ * from the registry's advertisement table); these are sent in batches by the
+ * IdentifyReplyFlow. Handlers that do not support get_identified() are called
+ * with handle_identify_global() in their turn, after the batch collected
+ * before them was handed to the interface, so that the replies go out in
+ * registry order. */
+class EventIteratorFlow : public MessageStateFlowBase
 {
 public:
     EventIteratorFlow(If *iface, EventService *event_service,
                       unsigned mti_value, unsigned mti_mask);
+    /// Creates a flow that does not register with any interface. The
+    /// messages are sent to it by an EventDistributor.
+    /// @param service defines the executor to run on
+    /// @param event_service is the owning event service
+    EventIteratorFlow(Service *service, EventService *event_service);
     ~EventIteratorFlow();
 
 protected:
     Action entry() OVERRIDE;
     Action iterate_next();
+    /// Checks whether the set of event handlers changed since the iteration
+    /// started or was last resumed, and if so, resumes the iteration.
+    /// @return true if the registry changed; then lastEntryRegistered_ tells
+    /// whether the entry last returned by the iterator may still be called.
+    bool registry_changed();
+
+    /// @return the incoming message.
+    GenMessage *nmsg()
+    {
+        return message()->data();
+    }
 
 private:
+    /// Calls a reentrant handler without waiting for it to complete.
+    /// @param entry registry entry of the handler.
+    /// @return false if the call was skipped because the handler was
+    /// unregistered since the iteration returned it.
+    bool call_reentrant(const EventRegistryEntry *entry);
+    /// Waits for the outstanding reentrant handler calls, if any.
+    Action iteration_done();
+    /// Releases the incoming message after all handlers are done.
+    Action all_calls_done();
+    /// Starts processing an identify events message. Called with the event
+    /// handler lock held.
+    Action identify_locked();
+    /// Asks the next handler for its answer to an identify events message.
+    Action identify_next();
+    /// Takes the event handler lock again after the batched answers were
+    /// handed to the interface.
+    Action identify_flushed();
+    /// Calls identifyEntry_ with handle_identify_global.
+    Action identify_call();
+    /// Releases the event handler lock and the incoming message after an
+    /// identify events message.
+    Action identify_done();
+    /// Hands the messages collected from EventHandler::get_identified() in
+    /// the current iteration over to the identify reply flow.
+    /// @param done if not null, will be notified when all messages are handed
+    /// to the interface.
+    void flush_identified(BarrierNotifiable *done = nullptr);
+
     virtual Action dispatch_event(const EventRegistryEntry *entry);
     /// Called when there will be no more dispatch_event calls for this
     /// iteration.
     virtual void no_more_matches() {};
 
 protected:
+    /// Interface we are registered with, or nullptr if the messages come from
+    /// an EventDistributor.
+    If *iface_;
+
     EventService *eventService_;
 
     /// Statically allocated structure for calling the event handlers from the
@@ -158,10 +288,26 @@ protected:
     /// The epoch of the event registry at the start of the iteration. Used to
     /// recognize when the iterators are invalidated.
     unsigned eventRegistryEpoch_;
+    /// Set by registry_changed(): true if the entry last returned by the
+    /// iterator is still registered.
+    bool lastEntryRegistered_{true};
 
     BarrierNotifiable n_;
     EventHandlerFunction fn_;
 
+    /// Done notifiable for the reentrant handler calls of the current
+    /// iteration.
+    BarrierNotifiable parallelDone_;
+    /// True if parallelDone_ is in use in the current iteration.
+    bool parallelCalls_{false};
+
+    /// Answers collected from the event handlers for an identify events
+    /// message.
+    std::vector<EventIdentified> identified_;
+    /// Handler to call with handle_identify_global, because it does not
+    /// implement get_identified().
+    const EventRegistryEntry *identifyEntry_{nullptr};
+
 #ifdef DEBUG_EVENT_PERFORMANCE
     static const int REPORT_COUNT = 100;
     /// How many events' cost are accumulated so far.
@@ -187,6 +333,13 @@ public:
     {
     }
 
+    /// Creates a flow fed by an EventDistributor. @param service defines the
+    /// executor to run on @param event_service is the owning event service
+    InlineEventIteratorFlow(Service *service, EventService *event_service)
+        : EventIteratorFlow(service, event_service)
+    {
+    }
+
 private:
     Action dispatch_event(const EventRegistryEntry *entry) OVERRIDE;
     void no_more_matches() OVERRIDE;
@@ -199,6 +352,28 @@ private:
     const EventRegistryEntry *currentEntry_{nullptr};
 };
 
+/// Receives the messages carrying an event ID from an interface and hands
+/// each of them to one of several event iterator flows, so that independent
+/// events are processed in parallel. Messages from the same source node always
+/// go to the same flow, thus they are processed in the order of arrival.
+class EventDistributor : public MessageHandler
+{
+public:
+    /// Registers with the interface's dispatcher.
+    /// @param iface interface to receive messages from
+    /// @param flows the flows to distribute the messages to
+    EventDistributor(If *iface, std::vector<EventIteratorFlow *> flows);
+    ~EventDistributor();
+
+    void send(Buffer<GenMessage> *message, unsigned priority) OVERRIDE;
+
+private:
+    /// Interface we are registered with.
+    If *iface_;
+    /// Flows to send the messages to.
+    std::vector<EventIteratorFlow *> flows_;
+};
+
 } // namespace openlcb
 
 #endif // _OPENLCB_EVENTSERVICEIMPL_HXX_
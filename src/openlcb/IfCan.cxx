@@ -34,12 +34,13 @@
 
 #include "openlcb/IfCan.hxx"
 
-#include "utils/StlMap.hxx"
 #include "openlcb/AliasAllocator.hxx"
 #include "openlcb/IfImpl.hxx"
 #include "openlcb/IfCanImpl.hxx"
 #include "openlcb/CanDefs.hxx"
+#include "openlcb/DatagramDefs.hxx"
 #include "can_frame.h"
+#include "nmranet_config.h"
 
 namespace openlcb
 {
@@ -575,25 +576,40 @@ public:
             buffer_key |= CanDefs::get_src(id_);
             buffer_key <<= 12;
             buffer_key |= CanDefs::get_mti(id_);
-            /** @todo (balazs.racz): handle the error cases here, like when we
-             * get a middle frame out of the blue etc. */
-            Payload *mapped_buffer = &pendingBuffers_[buffer_key];
+            CanReassemblyTable *table = if_can()->addressed_reassembly();
+            int slot;
             if ((f->data[0] & CanDefs::NOT_FIRST_FRAME) == 0)
             {
-                // First frame. Make sure the pending buffer is empty.
-                if (!mapped_buffer->empty())
+                // First frame. Any pending message with the same key is
+                // dropped.
+                if (table->find(buffer_key) >= 0)
                 {
                     LOG(WARNING, "Received multi-frame message when a previous "
                                  "multi-frame message has not been flushed "
                                  "yet. frame ID=%08x, fddd=%02x%02x",
                         (unsigned)id_, f->data[0], f->data[1]);
                 }
-                mapped_buffer->clear();
+                slot = table->start(buffer_key);
             }
-            if (f->can_dlc > 2)
+            else
+            {
+                slot = table->find(buffer_key);
+                if (slot < 0)
+                {
+                    // Middle or last frame without a first frame (or after a
+                    // timeout). The message is incomplete; drop it.
+                    LOG(INFO, "Dropping addressed message frame without a "
+                              "first frame. frame ID=%08x, fddd=%02x%02x",
+                        (unsigned)id_, f->data[0], f->data[1]);
+                    table->count_out_of_order();
+                    return release_and_exit();
+                }
+            }
+            if (f->can_dlc > 2 &&
+                !table->append(slot, f->data + 2, f->can_dlc - 2))
             {
-                mapped_buffer->append(
-                    (const char *)(f->data + 2), f->can_dlc - 2);
+                // Too long; the table dropped the message.
+                return release_and_exit();
             }
             if (f->data[0] & CanDefs::NOT_LAST_FRAME)
             {
@@ -603,8 +619,7 @@ public:
             else
             {
                 // Frame complete.
-                mapped_buffer->swap(buf_);
-                pendingBuffers_.erase(buffer_key);
+                table->finish(slot, &buf_);
             }
         }
         else
@@ -651,10 +666,303 @@ private:
     uint32_t id_;
     string buf_;
     NodeHandle dstHandle_;
-    /// Reassembly buffers for multi-frame messages.
-    StlMap<uint32_t, Payload> pendingBuffers_;
 };
 
+/** Turns each incoming stream data frame into an MTI_STREAM_DATA message.
+ * The payload is the frame data: the destination stream ID followed by the
+ * stream bytes. */
+class FrameToStreamDataParser : public CanFrameStateFlow
+{
+public:
+    enum
+    {
+        CAN_FILTER = CanMessageData::CAN_EXT_FRAME_FILTER |
+            (CanDefs::STREAM_DATA << CanDefs::CAN_FRAME_TYPE_SHIFT) |
+            (CanDefs::NMRANET_MSG << CanDefs::FRAME_TYPE_SHIFT) |
+            (CanDefs::NORMAL_PRIORITY << CanDefs::PRIORITY_SHIFT),
+        CAN_MASK = CanMessageData::CAN_EXT_FRAME_MASK |
+            CanDefs::CAN_FRAME_TYPE_MASK | CanDefs::FRAME_TYPE_MASK |
+            CanDefs::PRIORITY_MASK
+    };
+
+    FrameToStreamDataParser(IfCan *service)
+        : CanFrameStateFlow(service)
+    {
+        if_can()->frame_dispatcher()->register_handler(
+            this, CAN_FILTER, CAN_MASK);
+    }
+
+    ~FrameToStreamDataParser()
+    {
+        if_can()->frame_dispatcher()->unregister_handler(
+            this, CAN_FILTER, CAN_MASK);
+    }
+
+    /// Handler entry for incoming messages.
+    Action entry() override
+    {
+        struct can_frame *f = message()->data();
+        if (f->can_dlc < 1)
+        {
+            // No stream ID.
+            return release_and_exit();
+        }
+        uint32_t id = GET_CAN_FRAME_ID_EFF(*f);
+        NodeAlias dst_alias = CanDefs::get_dst(id);
+        if (!if_can()->local_aliases()->lookup(dst_alias))
+        {
+            // Not destined for us.
+            return release_and_exit();
+        }
+        return allocate_and_call(if_can()->dispatcher(), STATE(send_to_if));
+    }
+
+    Action send_to_if()
+    {
+        auto *b = get_allocation_result(if_can()->dispatcher());
+        struct can_frame *f = message()->data();
+        uint32_t id = GET_CAN_FRAME_ID_EFF(*f);
+        GenMessage *m = b->data();
+        m->mti = Defs::MTI_STREAM_DATA;
+        m->payload.assign((const char *)f->data, f->can_dlc);
+        m->dst.alias = CanDefs::get_dst(id);
+        m->dst.id = if_can()->local_aliases()->lookup(m->dst.alias);
+        m->dstNode = if_can()->lookup_local_node(m->dst.id);
+        m->src.alias = CanDefs::get_src(id);
+        m->src.id = if_can()->remote_aliases()->lookup(m->src.alias);
+        if (!m->src.id)
+        {
+            m->src.id = if_can()->local_aliases()->lookup(m->src.alias);
+        }
+        release();
+        if_can()->dispatcher()->send(b, b->data()->priority());
+        return exit();
+    }
+};
+
+RemoteAliasResolver::~RemoteAliasResolver()
+{
+    unregister_handlers();
+    for (auto &e : pending_)
+    {
+        for (auto *b : e.messages)
+        {
+            b->unref();
+        }
+    }
+}
+
+void RemoteAliasResolver::park(Buffer<GenMessage> *b)
+{
+    NodeID dst = b->data()->dst.id;
+    Entry *e = find(dst);
+    bool is_new = !e;
+    if (is_new)
+    {
+        pending_.emplace_back();
+        e = &pending_.back();
+        e->dst = dst;
+        e->src = b->data()->src.id;
+        e->stage = STAGE_NEW;
+        e->deadline = 0;
+    }
+    e->messages.push_back(b);
+    if (is_terminated())
+    {
+        register_handlers();
+        start_flow(STATE(process));
+    }
+    else if (is_new)
+    {
+        // Wakes up the flow if it is sleeping until the next deadline.
+        timer_.ensure_triggered();
+    }
+}
+
+void RemoteAliasResolver::send(MessageType *message, unsigned priority)
+{
+    AutoReleaseBuffer<CanMessageData> rb(message);
+    struct can_frame *f = message->data();
+    if (f->can_dlc != 6)
+    {
+        // Not sending a node ID.
+        return;
+    }
+    NodeAlias alias = CanDefs::get_src(GET_CAN_FRAME_ID_EFF(*f));
+    if (!alias)
+    {
+        return;
+    }
+    NodeID id = data_to_node_id(f->data);
+    for (unsigned i = 0; i < pending_.size(); ++i)
+    {
+        if (pending_[i].dst != id)
+        {
+            continue;
+        }
+        if_can()->remote_aliases()->add(id, alias);
+        // Priority zero puts the parked messages ahead of newer traffic, so
+        // the order of messages to this destination is kept.
+        for (auto *b : pending_[i].messages)
+        {
+            target_->send(b, 0);
+        }
+        pending_.erase(pending_.begin() + i);
+        if (pending_.empty())
+        {
+            timer_.ensure_triggered();
+        }
+        return;
+    }
+}
+
+StateFlowBase::Action RemoteAliasResolver::process()
+{
+    long long now = os_get_time_monotonic();
+    long long next = 0;
+    for (unsigned i = 0; i < pending_.size();)
+    {
+        Entry &e = pending_[i];
+        if (e.stage == STAGE_NEW)
+        {
+            current_ = e.dst;
+            if (if_can()->local_aliases()->lookup(e.src))
+            {
+                return allocate_and_call(
+                    if_can()->frame_write_flow(), STATE(send_ame));
+            }
+            // No local alias -- we jump straight to the global verify
+            // node ID. That will allocate a new local alias.
+            return allocate_and_call(
+                if_can()->global_message_write_flow(), STATE(send_verify));
+        }
+        if (e.deadline <= now)
+        {
+            if (e.stage == STAGE_AME_SENT)
+            {
+                current_ = e.dst;
+                return allocate_and_call(
+                    if_can()->global_message_write_flow(), STATE(send_verify));
+            }
+            fail(i);
+            continue;
+        }
+        if (!next || e.deadline < next)
+        {
+            next = e.deadline;
+        }
+        ++i;
+    }
+    if (pending_.empty())
+    {
+        unregister_handlers();
+        return exit();
+    }
+    return sleep_and_call(&timer_, next - now, STATE(process));
+}
+
+StateFlowBase::Action RemoteAliasResolver::send_ame()
+{
+    auto *b = get_allocation_result(if_can()->frame_write_flow());
+    Entry *e = find(current_);
+    NodeAlias src_alias = e ? if_can()->local_aliases()->lookup(e->src) : 0;
+    if (!src_alias)
+    {
+        // Resolved in the meantime, or the source lost its alias. In the
+        // latter case process() will go for the global verify.
+        b->unref();
+        return call_immediately(STATE(process));
+    }
+    struct can_frame *f = b->data();
+    CanDefs::control_init(*f, src_alias, CanDefs::AME_FRAME, 0);
+    f->can_dlc = 6;
+    node_id_to_data(e->dst, f->data);
+    e->stage = STAGE_AME_SENT;
+    e->deadline =
+        os_get_time_monotonic() + ADDRESSED_MESSAGE_LOOKUP_TIMEOUT_NSEC;
+    if_can()->frame_write_flow()->send(b);
+    return call_immediately(STATE(process));
+}
+
+StateFlowBase::Action RemoteAliasResolver::send_verify()
+{
+    auto *b = get_allocation_result(if_can()->global_message_write_flow());
+    Entry *e = find(current_);
+    if (!e)
+    {
+        b->unref();
+        return call_immediately(STATE(process));
+    }
+    b->data()->reset(Defs::MTI_VERIFY_NODE_ID_GLOBAL, e->src,
+        node_id_to_buffer(e->dst));
+    e->stage = STAGE_VERIFY_SENT;
+    e->deadline =
+        os_get_time_monotonic() + ADDRESSED_MESSAGE_LOOKUP_TIMEOUT_NSEC;
+    if_can()->global_message_write_flow()->send(b);
+    return call_immediately(STATE(process));
+}
+
+RemoteAliasResolver::Entry *RemoteAliasResolver::find(NodeID dst)
+{
+    for (auto &e : pending_)
+    {
+        if (e.dst == dst)
+        {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+void RemoteAliasResolver::fail(unsigned index)
+{
+    Entry &e = pending_[index];
+    LOG(INFO,
+        "AddressedWriteFlow: Could not resolve destination address %012" PRIx64
+        " to an alias on the bus. Dropping %u packet(s).",
+        e.dst, (unsigned)e.messages.size());
+    if_can()->remote_aliases()->add(e.dst, NOT_RESPONDING);
+    for (auto *b : e.messages)
+    {
+        b->unref();
+    }
+    pending_.erase(pending_.begin() + index);
+}
+
+void RemoteAliasResolver::register_handlers()
+{
+    if (registered_)
+    {
+        return;
+    }
+    registered_ = true;
+    if_can()->frame_dispatcher()->register_handler(
+        this, CAN_FILTER1, CAN_MASK1);
+    if_can()->frame_dispatcher()->register_handler(
+        this, CAN_FILTER2, CAN_MASK2);
+    if_can()->frame_dispatcher()->register_handler(
+        this, CAN_FILTER3, CAN_MASK3);
+}
+
+void RemoteAliasResolver::unregister_handlers()
+{
+    if (!registered_)
+    {
+        return;
+    }
+    registered_ = false;
+    if_can()->frame_dispatcher()->unregister_handler(
+        this, CAN_FILTER1, CAN_MASK1);
+    if_can()->frame_dispatcher()->unregister_handler(
+        this, CAN_FILTER2, CAN_MASK2);
+    if_can()->frame_dispatcher()->unregister_handler(
+        this, CAN_FILTER3, CAN_MASK3);
+}
+
+/// Longest multi-frame addressed message that will be reassembled. The
+/// largest standard one is the SNIP reply with 253 bytes.
+static constexpr unsigned MAX_ADDRESSED_MESSAGE_LENGTH = 256;
+
 IfCan::IfCan(ExecutorBase *executor, CanHubFlow *device,
     int local_alias_cache_size, int remote_alias_cache_size,
     int local_nodes_count)
@@ -662,6 +970,13 @@ IfCan::IfCan(ExecutorBase *executor, CanHubFlow *device,
     , CanIf(this, device)
     , localAliases_(0, local_alias_cache_size)
     , remoteAliases_(0, remote_alias_cache_size)
+    , addressedReassembly_(executor->active_timers(),
+          config_can_addressed_reassembly_slots(),
+          MAX_ADDRESSED_MESSAGE_LENGTH,
+          MSEC_TO_NSEC(config_can_reassembly_timeout_msec()))
+    , datagramReassembly_(executor->active_timers(),
+          config_can_datagram_reassembly_slots(), DatagramDefs::MAX_SIZE,
+          MSEC_TO_NSEC(config_can_reassembly_timeout_msec()))
 {
     auto *gflow = new GlobalCanMessageWriteFlow(this);
     globalWriteFlow_ = gflow;
@@ -707,7 +1022,8 @@ void IfCan::add_addressed_message_support()
     if (addressedWriteFlow_)
         return;
     add_owned_flow(new FrameToAddressedMessageParser(this));
-    auto *f = new AddressedCanMessageWriteFlow(this);
+    add_owned_flow(new FrameToStreamDataParser(this));
+    auto *f = new NonBlockingAddressedCanMessageWriteFlow(this);
     addressedWriteFlow_ = f;
     add_owned_flow(f);
 }
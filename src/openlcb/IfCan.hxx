@@ -40,6 +40,7 @@
 #include "executor/StateFlow.hxx"
 #include "openlcb/If.hxx"
 #include "openlcb/AliasCache.hxx"
+#include "openlcb/CanReassembly.hxx"
 #include "openlcb/Defs.hxx"
 #include "utils/CanIf.hxx"
 
@@ -112,6 +113,20 @@ public:
         return aliasAllocator_.get();
     }
 
+    /// @return the table that holds the partially received multi-frame
+    /// addressed messages. Must only be accessed from the If's executor.
+    CanReassemblyTable *addressed_reassembly()
+    {
+        return &addressedReassembly_;
+    }
+
+    /// @return the table that holds the partially received multi-frame
+    /// datagrams. Must only be accessed from the If's executor.
+    CanReassemblyTable *datagram_reassembly()
+    {
+        return &datagramReassembly_;
+    }
+
     /// Sets the alias allocator for this If. Takes ownership of pointer.
     void set_alias_allocator(AliasAllocator *a);
 
@@ -137,6 +152,11 @@ private:
      */
     AliasCache remoteAliases_;
 
+    /// Reassembly buffers for incoming multi-frame addressed messages.
+    CanReassemblyTable addressedReassembly_;
+    /// Reassembly buffers for incoming multi-frame datagrams.
+    CanReassemblyTable datagramReassembly_;
+
     /// Various implementation control flows that this interface owns.
     std::vector<std::unique_ptr<Executable>> ownedFlows_;
 
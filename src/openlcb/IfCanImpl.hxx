@@ -35,6 +35,8 @@
 #ifndef _OPENLCB_IFCANIMPL_HXX_
 #define _OPENLCB_IFCANIMPL_HXX_
 
+#include <vector>
+
 #include "openlcb/CanDefs.hxx"
 #include "executor/StateFlow.hxx"
 #include "openlcb/IfImpl.hxx"
@@ -62,8 +64,8 @@ public:
 protected:
     unsigned srcAlias_ : 12;  ///< Source node alias.
     unsigned dstAlias_ : 12;  ///< Destination node alias.
-    unsigned dataOffset_ : 8; /**< for continuation frames: which offset in
-                                * the Buffer should we start the payload at. */
+    unsigned dataOffset_ : 16; /**< for continuation frames: which offset in
+                                 * the Buffer should we start the payload at. */
 
     Action send_to_hardware() override
     {
@@ -185,6 +187,10 @@ private:
         auto *b = get_allocation_result(if_can()->frame_write_flow());
         b->set_done(message()->new_child());
         struct can_frame *f = b->data()->mutable_frame();
+        if (nmsg()->mti == Defs::MTI_STREAM_DATA)
+        {
+            return fill_stream_data_frame(b);
+        }
         if (nmsg()->mti & (Defs::MTI_DATAGRAM_MASK | Defs::MTI_SPECIAL_MASK |
                            Defs::MTI_RESERVED_MASK))
         {
@@ -253,6 +259,38 @@ private:
             return call_immediately(STATE(send_finished));
         }
     }
+
+    /// Renders one stream data frame. The first payload byte is the
+    /// destination stream ID, which is repeated in every frame followed by
+    /// up to 7 data bytes.
+    /// @param b frame buffer to fill and send.
+    Action fill_stream_data_frame(Buffer<CanHubData> *b)
+    {
+        struct can_frame *f = b->data()->mutable_frame();
+        const string &data = nmsg()->payload;
+        HASSERT(!data.empty());
+        uint32_t can_id;
+        CanDefs::set_datagram_fields(
+            &can_id, srcAlias_, dstAlias_, CanDefs::STREAM_DATA);
+        SET_CAN_FRAME_ID_EFF(*f, can_id);
+        f->data[0] = data[0];
+        unsigned len = data.size() - 1 - dataOffset_;
+        bool need_more_frames = false;
+        if (len > 7)
+        {
+            len = 7;
+            need_more_frames = true;
+        }
+        memcpy(f->data + 1, data.data() + 1 + dataOffset_, len);
+        dataOffset_ += len;
+        f->can_dlc = 1 + len;
+        if_can()->frame_write_flow()->send(b);
+        if (need_more_frames)
+        {
+            return call_immediately(STATE(get_can_frame_buffer));
+        }
+        return call_immediately(STATE(send_finished));
+    }
 };
 
 /** The addressed write flow is responsible for sending addressed messages to
@@ -285,8 +323,11 @@ protected:
         {
             // We have limited space for counting offsets. In practice this
             // value will be max 10 for certain traction control protocol
-            // messages. Longer data usually travels via datagrams or streams.
-            HASSERT(nmsg()->payload.size() < 256);
+            // messages. Longer data usually travels via datagrams or streams;
+            // stream data messages carry up to a stream window.
+            HASSERT(nmsg()->payload.size() < 256 ||
+                (nmsg()->mti == Defs::MTI_STREAM_DATA &&
+                    nmsg()->payload.size() < 65536));
         }
         NodeHandle &dst_ = nmsg()->dst;
         HASSERT(dst_.id || dst_.alias); // We must have some kind of address.
@@ -336,10 +377,18 @@ protected:
         }
         else
         {
-            return call_immediately(STATE(find_remote_alias));
+            return remote_alias_unknown();
         }
     }
 
+    /** Called when the destination alias is not known. The default
+     * implementation looks up the alias on the bus, holding up this flow
+     * until the lookup completes or times out. */
+    virtual Action remote_alias_unknown()
+    {
+        return call_immediately(STATE(find_remote_alias));
+    }
+
     Action find_remote_alias()
     {
         aliasListener_.RegisterLocalHandler();
@@ -507,6 +556,147 @@ protected:
 
     StateFlowTimer timer_;
 };
+
+/** Looks up the aliases of remote destination nodes on behalf of the
+ * interface's addressed write flow, without holding up that flow. Messages
+ * whose destination alias is unknown are parked here per destination node.
+ * For each destination we send an AME (or a global Verify Node ID if the
+ * source node has no alias), then a global Verify Node ID after a
+ * timeout. When the alias mapping arrives, the parked messages are sent back
+ * to the write flow; after the second timeout they are dropped. */
+class RemoteAliasResolver : public StateFlowBase,
+                            private FlowInterface<Buffer<CanMessageData>>
+{
+public:
+    /// Constructor.
+    /// @param if_can the interface to look up aliases on.
+    /// @param target the write flow to send the parked messages to once the
+    /// destination alias is known.
+    RemoteAliasResolver(IfCan *if_can, MessageHandler *target)
+        : StateFlowBase(if_can)
+        , target_(target)
+        , timer_(this)
+    {
+    }
+
+    ~RemoteAliasResolver();
+
+    /// Takes ownership of a message whose destination alias is not
+    /// known. Must be called on the interface executor.
+    /// @param b the message to send once the destination alias is known.
+    void park(Buffer<GenMessage> *b);
+
+    /// @return the number of destination nodes being looked up.
+    size_t pending_count()
+    {
+        return pending_.size();
+    }
+
+    using MessageType = Buffer<CanMessageData>;
+
+private:
+    enum
+    {
+        // AMD frames
+        CAN_FILTER1 = CanMessageData::CAN_EXT_FRAME_FILTER | 0x10701000,
+        CAN_MASK1 = CanMessageData::CAN_EXT_FRAME_MASK | 0x1FFFF000,
+        // Initialization complete
+        CAN_FILTER2 = CanMessageData::CAN_EXT_FRAME_FILTER | 0x19100000,
+        CAN_MASK2 = CanMessageData::CAN_EXT_FRAME_MASK | 0x1FFFF000,
+        // Verified node ID number
+        CAN_FILTER3 = CanMessageData::CAN_EXT_FRAME_FILTER | 0x19170000,
+        CAN_MASK3 = CanMessageData::CAN_EXT_FRAME_MASK | 0x1FFFF000,
+    };
+
+    /// How far the lookup of a destination has progressed.
+    enum Stage : uint8_t
+    {
+        /// Nothing was sent yet.
+        STAGE_NEW,
+        /// Alias Mapping Enquiry was sent.
+        STAGE_AME_SENT,
+        /// Global Verify Node ID was sent.
+        STAGE_VERIFY_SENT,
+    };
+
+    /// Lookup state for one destination node.
+    struct Entry
+    {
+        /// Node being looked up.
+        NodeID dst;
+        /// Source node of the first parked message; the lookup frames are
+        /// sent in its name.
+        NodeID src;
+        /// Lookup progress.
+        Stage stage;
+        /// When the current stage times out (os_get_time_monotonic).
+        long long deadline;
+        /// Parked messages, in arrival order. We own one reference each.
+        std::vector<Buffer<GenMessage> *> messages;
+    };
+
+    IfCan *if_can()
+    {
+        return static_cast<IfCan *>(service());
+    }
+
+    /// Handler for incoming alias definition frames.
+    /// @param message incoming frame @param priority ignored
+    void send(MessageType *message, unsigned priority = UINT_MAX) override;
+
+    /// Sends lookup frames for new entries and handles timeouts.
+    Action process();
+    /// Sends the AME frame for current_.
+    Action send_ame();
+    /// Sends the global Verify Node ID message for current_.
+    Action send_verify();
+
+    /// @param dst destination node. @return the entry for dst or nullptr.
+    Entry *find(NodeID dst);
+    /// Drops the parked messages of an entry and removes it.
+    /// @param index which entry to remove.
+    void fail(unsigned index);
+    /// Starts listening to alias definition frames.
+    void register_handlers();
+    /// Stops listening to alias definition frames.
+    void unregister_handlers();
+
+    /// Where to send the messages once resolved.
+    MessageHandler *target_;
+    /// Destinations being looked up.
+    std::vector<Entry> pending_;
+    /// The destination for which we are allocating a buffer.
+    NodeID current_ = 0;
+    /// True if we are registered to the frame dispatcher.
+    bool registered_ = false;
+    /// Helper for timeouts.
+    StateFlowTimer timer_;
+};
+
+/** The addressed write flow of the interface. Unlike the base class, it
+ * never waits for a remote alias lookup: messages to unknown destinations are
+ * parked in a RemoteAliasResolver, and other messages keep flowing. */
+class NonBlockingAddressedCanMessageWriteFlow
+    : public AddressedCanMessageWriteFlow
+{
+public:
+    NonBlockingAddressedCanMessageWriteFlow(IfCan *if_can)
+        : AddressedCanMessageWriteFlow(if_can)
+        , resolver_(if_can, this)
+    {
+    }
+
+protected:
+    Action remote_alias_unknown() override
+    {
+        resolver_.park(transfer_message());
+        return exit();
+    }
+
+private:
+    /// Holds the messages while their destination is looked up.
+    RemoteAliasResolver resolver_;
+};
 } // namespace openlcb
 
 #endif // _OPENLCB_IFCANIMPL_HXX_
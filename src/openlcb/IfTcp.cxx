@@ -0,0 +1,488 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file IfTcp.cxx
+ *
+ * OpenLCB interface that carries complete messages over TCP.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/IfTcp.hxx"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "openlcb/IfImpl.hxx"
+#include "openlcb/TcpDefs.hxx"
+#include "utils/HubDeviceSelect.hxx"
+
+namespace openlcb
+{
+
+/// Write flow that renders outgoing messages into the TCP wire format. One
+/// instance handles global messages, another one addressed messages.
+class TcpSendFlow : public WriteFlowBase
+{
+public:
+    /// Constructor.
+    /// @param iface parent interface.
+    /// @param global true for the global write flow, false for the addressed
+    /// one.
+    TcpSendFlow(IfTcp *iface, bool global)
+        : WriteFlowBase(iface)
+        , global_(global)
+    {
+    }
+
+protected:
+    /// @return the parent interface.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(async_if());
+    }
+
+    Action entry() override
+    {
+        if (global_)
+        {
+            return send_to_hardware();
+        }
+        return call_immediately(STATE(addressed_entry));
+    }
+
+    Action send_to_hardware() override
+    {
+        if (!global_ && !nmsg()->dst.id)
+        {
+            LOG(WARNING, "IfTcp: dropping addressed message with MTI %03x "
+                         "without destination node ID.",
+                nmsg()->mti);
+            return call_immediately(STATE(send_finished));
+        }
+        if (nmsg()->payload.size() > TcpDefs::MAX_PAYLOAD)
+        {
+            LOG(WARNING, "IfTcp: dropping message with MTI %03x and %u bytes "
+                         "of payload.",
+                nmsg()->mti, (unsigned)nmsg()->payload.size());
+            return call_immediately(STATE(send_finished));
+        }
+        return allocate_and_call(if_tcp()->device(), STATE(render));
+    }
+
+    /// Renders the message into the allocated hub buffer and sends it off.
+    Action render()
+    {
+        auto *b = get_allocation_result(if_tcp()->device());
+        TcpDefs::render_tcp_message(*nmsg(), if_tcp()->gateway_node_id(),
+            os_get_time_monotonic() / 1000000, b->data());
+        b->data()->skipMember_ = if_tcp()->recvFlow_.get();
+        if_tcp()->device()->send(b, nmsg()->priority());
+        if (global_)
+        {
+            // Loops back the message to the local nodes.
+            return call_immediately(STATE(global_entry));
+        }
+        return call_immediately(STATE(send_finished));
+    }
+
+private:
+    /// True if this is the global message write flow.
+    bool global_;
+};
+
+/// Hub member that parses the incoming messages and forwards them to the
+/// interface's dispatcher.
+class TcpRecvFlow : public HubPort
+{
+public:
+    /// Constructor. @param iface parent interface.
+    TcpRecvFlow(IfTcp *iface)
+        : HubPort(iface)
+    {
+    }
+
+    /// @return the parent interface.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(service());
+    }
+
+    Action entry() override
+    {
+        return allocate_and_call(if_tcp()->dispatcher(), STATE(parse));
+    }
+
+    /// Parses the message into the allocated dispatcher buffer.
+    Action parse()
+    {
+        auto *b = get_allocation_result(if_tcp()->dispatcher());
+        GenMessage *m = b->data();
+        NodeID gateway = 0;
+        if (!TcpDefs::parse_tcp_message(*message()->data(), m, &gateway))
+        {
+            LOG(WARNING, "IfTcp: dropping malformed message of %u bytes.",
+                (unsigned)message()->data()->size());
+            b->unref();
+            return release_and_exit();
+        }
+        release();
+        if (gateway == if_tcp()->gateway_node_id())
+        {
+            // Our own message came back through a loop in the network.
+            b->unref();
+            return exit();
+        }
+        if (m->dst.id)
+        {
+            m->dstNode = if_tcp()->lookup_local_node(m->dst.id);
+            if (!m->dstNode)
+            {
+                // Not destined for us.
+                b->unref();
+                return exit();
+            }
+        }
+        if_tcp()->dispatcher()->send(b, m->priority());
+        return exit();
+    }
+};
+
+IfTcp::IfTcp(NodeID gateway_node_id, HubFlow *device, int local_nodes_count)
+    : If(device->service()->executor(), local_nodes_count)
+    , gatewayNodeId_(gateway_node_id)
+    , device_(device)
+    , recvFlow_(new TcpRecvFlow(this))
+{
+    auto *gflow = new TcpSendFlow(this, true);
+    globalWriteFlow_ = gflow;
+    add_owned_flow(gflow);
+    auto *aflow = new TcpSendFlow(this, false);
+    addressedWriteFlow_ = aflow;
+    add_owned_flow(aflow);
+    add_owned_flow(new VerifyNodeIdHandler(this));
+    device_->register_port(recvFlow_.get());
+}
+
+IfTcp::~IfTcp()
+{
+    device_->unregister_port(recvFlow_.get());
+}
+
+void IfTcp::add_owned_flow(Executable *e)
+{
+    ownedFlows_.push_back(std::unique_ptr<Executable>(e));
+}
+
+void IfTcp::delete_local_node(Node *node)
+{
+    remove_local_node_from_map(node);
+}
+
+/// Bridges a hub carrying a raw byte stream of one connection and a hub
+/// carrying one OpenLCB-TCP message per buffer.
+class TcpMessageAdapter
+{
+public:
+    /// Constructor.
+    /// @param stream_side hub of the connection's bytes.
+    /// @param message_side hub of complete messages.
+    /// @param on_error notified when the incoming bytes cannot be split into
+    /// messages. The connection should be closed then.
+    TcpMessageAdapter(
+        HubFlow *stream_side, HubFlow *message_side, Notifiable *on_error)
+        : parser_(message_side->service(), message_side, &formatter_,
+              on_error)
+        , formatter_(message_side->service(), stream_side, &parser_)
+    {
+        stream_side->register_port(&parser_);
+        message_side->register_port(&formatter_);
+        isRegistered_ = 1;
+    }
+
+    ~TcpMessageAdapter()
+    {
+        unregister();
+    }
+
+    /// Removes the members from both hubs.
+    void unregister()
+    {
+        if (isRegistered_)
+        {
+            parser_.destination()->unregister_port(&formatter_);
+            formatter_.destination()->unregister_port(&parser_);
+            isRegistered_ = 0;
+        }
+    }
+
+    /// Unregisters the members. @return true when no more processing is
+    /// pending and the object can be deleted.
+    bool shutdown()
+    {
+        unregister();
+        return parser_.is_waiting() && formatter_.is_waiting();
+    }
+
+private:
+    /// Splits the incoming bytes into messages.
+    class StreamToMessage : public HubPort
+    {
+    public:
+        /// Constructor.
+        /// @param service executor to run on.
+        /// @param destination where to send the complete messages.
+        /// @param skip_member source member of the outgoing messages.
+        /// @param on_error notified at the first malformed message header.
+        StreamToMessage(Service *service, HubFlow *destination,
+            HubPortInterface *skip, Notifiable *on_error)
+            : HubPort(service)
+            , destination_(destination)
+            , skipMember_(skip)
+            , onError_(on_error)
+        {
+        }
+
+        /// @return the hub the messages are sent to.
+        HubFlow *destination()
+        {
+            return destination_;
+        }
+
+        Action entry() override
+        {
+            if (failed_)
+            {
+                // Waiting for the connection to close.
+                return release_and_exit();
+            }
+            pending_.append(*message()->data());
+            release();
+            return call_immediately(STATE(parse_more));
+        }
+
+        /// Looks for a complete message in the pending bytes.
+        Action parse_more()
+        {
+            int len = TcpDefs::get_tcp_message_length(
+                pending_.data() + offset_, pending_.size() - offset_);
+            if (len < 0)
+            {
+                // There is no way to find the next message boundary.
+                LOG(WARNING, "IfTcp: malformed message header; closing the "
+                             "connection.");
+                pending_.clear();
+                offset_ = 0;
+                failed_ = true;
+                if (onError_)
+                {
+                    onError_->notify();
+                }
+                return exit();
+            }
+            if (len == 0)
+            {
+                pending_.erase(0, offset_);
+                offset_ = 0;
+                return exit();
+            }
+            length_ = len;
+            return allocate_and_call(destination_, STATE(send_message));
+        }
+
+        /// Copies one message to the allocated buffer.
+        Action send_message()
+        {
+            auto *b = get_allocation_result(destination_);
+            b->data()->assign(pending_, offset_, length_);
+            b->data()->skipMember_ = skipMember_;
+            destination_->send(b);
+            offset_ += length_;
+            return call_immediately(STATE(parse_more));
+        }
+
+    private:
+        /// Bytes received but not yet forwarded.
+        string pending_;
+        /// Start of the next message in pending_.
+        size_t offset_ = 0;
+        /// Length of the message being forwarded.
+        size_t length_ = 0;
+        /// Hub to send messages to.
+        HubFlow *destination_;
+        /// Source member of the outgoing messages.
+        HubPortInterface *skipMember_;
+        /// Notified when the input is malformed.
+        Notifiable *onError_;
+        /// True after malformed input; all later input is dropped.
+        bool failed_ = false;
+    };
+
+    /// Copies the outgoing messages to the connection's byte stream.
+    class MessageToStream : public HubPort
+    {
+    public:
+        /// Constructor.
+        /// @param service executor to run on.
+        /// @param destination the connection's hub.
+        /// @param skip_member source member of the outgoing data.
+        MessageToStream(
+            Service *service, HubFlow *destination, HubPortInterface *skip)
+            : HubPort(service)
+            , destination_(destination)
+            , skipMember_(skip)
+        {
+        }
+
+        /// @return the hub the bytes are sent to.
+        HubFlow *destination()
+        {
+            return destination_;
+        }
+
+        Action entry() override
+        {
+            return allocate_and_call(destination_, STATE(copy));
+        }
+
+        /// Copies the message to the allocated buffer.
+        Action copy()
+        {
+            auto *b = get_allocation_result(destination_);
+            b->data()->assign(*message()->data());
+            b->data()->skipMember_ = skipMember_;
+            destination_->send(b);
+            return release_and_exit();
+        }
+
+    private:
+        /// Hub to send bytes to.
+        HubFlow *destination_;
+        /// Source member of the outgoing data.
+        HubPortInterface *skipMember_;
+    };
+
+    /// Member on the stream side.
+    StreamToMessage parser_;
+    /// Member on the message side.
+    MessageToStream formatter_;
+    /// 1 if the members are registered.
+    unsigned isRegistered_ : 1;
+};
+
+/// Owns the structures of a connection added by
+/// create_tcp_port_for_message_hub, and deletes them when the connection
+/// fails.
+struct TcpHubPort : public Executable
+{
+    /// Constructor.
+    /// @param message_hub hub of complete messages.
+    /// @param fd connection.
+    /// @param on_exit notified when the connection is closed.
+    TcpHubPort(HubFlow *message_hub, int fd, Notifiable *on_exit)
+        : streamHub_(message_hub->service())
+        , bridge_(
+              new TcpMessageAdapter(&streamHub_, message_hub, &closer_))
+        , onExit_(on_exit)
+    {
+        device_.reset(new HubDeviceSelect<HubFlow>(&streamHub_, fd, this));
+    }
+
+    /// Hub of the connection's bytes. Members: the bridge and the device.
+    HubFlow streamHub_;
+    /// Splits and joins the messages.
+    std::unique_ptr<TcpMessageAdapter> bridge_;
+    /// Reads and writes the fd.
+    std::unique_ptr<FdHubPortInterface> device_;
+    /// If not null, notified when the connection is closed.
+    Notifiable *onExit_;
+
+    /// Closes the connection when the peer sent malformed data.
+    class Closer : public Notifiable
+    {
+    public:
+        /// Constructor. @param parent owning port.
+        Closer(TcpHubPort *parent)
+            : parent_(parent)
+        {
+        }
+
+        /// Shuts the socket down. The read flow then sees an end of file and
+        /// the port goes through the usual error path. Other fd types cannot
+        /// be shut down; their input is dropped until they close.
+        void notify() override
+        {
+            int fd = parent_->device_->fd();
+            if (fd >= 0 && ::shutdown(fd, SHUT_RDWR) < 0)
+            {
+                LOG(WARNING, "IfTcp: could not shut down fd %d: %s", fd,
+                    strerror(errno));
+            }
+        }
+
+    private:
+        /// Owning port.
+        TcpHubPort *parent_;
+    };
+
+    /// Notified by the bridge on malformed input.
+    Closer closer_{this};
+
+    /// Callback in case the connection is closed due to error.
+    void notify() override
+    {
+        // We do not know which executor this is called on, so the deletion
+        // happens on the hub's executor.
+        streamHub_.service()->executor()->add(this);
+    }
+
+    void run() override
+    {
+        if (!bridge_->shutdown() || !streamHub_.is_waiting())
+        {
+            // Yield.
+            streamHub_.service()->executor()->add(this);
+            return;
+        }
+        LOG(INFO, "IfTcp: closing connection %d.", device_->fd());
+        if (onExit_)
+        {
+            onExit_->notify();
+            onExit_ = nullptr;
+        }
+        delete this;
+    }
+};
+
+void create_tcp_port_for_message_hub(
+    HubFlow *message_hub, int fd, Notifiable *on_exit)
+{
+    new TcpHubPort(message_hub, fd, on_exit);
+}
+
+} // namespace openlcb
@@ -0,0 +1,124 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file IfTcp.hxx
+ *
+ * OpenLCB interface that carries complete messages over TCP.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_IFTCP_HXX_
+#define _OPENLCB_IFTCP_HXX_
+
+#include <memory>
+#include <vector>
+
+#include "openlcb/If.hxx"
+#include "utils/Hub.hxx"
+
+namespace openlcb
+{
+
+/// Implementation of the OpenLCB interface abstraction for the OpenLCB-TCP
+/// wire protocol (see @ref TcpDefs). Messages travel as a whole with 48-bit
+/// node IDs: there is no alias allocation, no fragmentation into frames and
+/// no size limit on datagram payloads.
+///
+/// The device is a HubFlow on which every buffer holds exactly one binary
+/// message. Byte-stream connections (sockets) can be added to such a hub
+/// with @ref create_tcp_port_for_message_hub. Traffic to a CAN segment needs
+/// to go through a gateway node.
+class IfTcp : public If
+{
+public:
+    /// Creates a TCP interface.
+    ///
+    /// @param gateway_node_id node ID of this interface, put into the
+    /// header of every outgoing message as the originating gateway.
+    /// @param device message hub. The interface adds a member to it for the
+    /// incoming traffic and sends the outgoing messages to it.
+    /// @param local_nodes_count maximum number of virtual nodes that this
+    /// interface will support.
+    IfTcp(NodeID gateway_node_id, HubFlow *device, int local_nodes_count);
+
+    ~IfTcp();
+
+    /// @return the node ID put into outgoing messages as gateway.
+    NodeID gateway_node_id()
+    {
+        return gatewayNodeId_;
+    }
+
+    /// @return the hub the messages are sent to.
+    HubFlow *device()
+    {
+        return device_;
+    }
+
+    void add_owned_flow(Executable *e) override;
+
+    void delete_local_node(Node *node) override;
+
+    /// Node handles on TCP always carry the node ID.
+    bool matching_node(NodeHandle expected, NodeHandle actual) override
+    {
+        return expected.id == actual.id;
+    }
+
+private:
+    friend class TcpSendFlow;
+
+    /// Originating gateway ID for outgoing messages.
+    NodeID gatewayNodeId_;
+    /// Message hub.
+    HubFlow *device_;
+    /// Hub member receiving the incoming messages. Outgoing messages skip
+    /// it.
+    std::unique_ptr<HubPortInterface> recvFlow_;
+    /// Various implementation control flows that this interface owns.
+    std::vector<std::unique_ptr<Executable>> ownedFlows_;
+
+    DISALLOW_COPY_AND_ASSIGN(IfTcp);
+};
+
+/// Adds a byte-stream connection (usually a TCP socket) to a hub of binary
+/// OpenLCB-TCP messages. The incoming bytes are split into messages at the
+/// message boundaries; each message is forwarded as one buffer. The port is
+/// closed, deleted and on_exit notified when the fd encounters an error.
+///
+/// @param message_hub hub carrying one message per buffer (e.g. the device
+/// of an IfTcp).
+/// @param fd select-compatible file descriptor.
+/// @param on_exit if not null, will be notified when the connection is
+/// closed.
+void create_tcp_port_for_message_hub(
+    HubFlow *message_hub, int fd, Notifiable *on_exit = nullptr);
+
+} // namespace openlcb
+
+#endif // _OPENLCB_IFTCP_HXX_
@@ -77,6 +77,8 @@ struct MemoryConfigDefs {
         COMMAND_READ_REPLY        = 0x50, /**< reply to read data from address space */
         COMMAND_READ_FAILED       = 0x58, /**< failed to read data from address space */
         COMMAND_READ_STREAM       = 0x60, /**< command to read data using a stream */
+        COMMAND_READ_STREAM_REPLY = 0x70, /**< reply to read data using a stream */
+        COMMAND_READ_STREAM_FAILED= 0x78, /**< failed to read data using a stream */
         COMMAND_MAX_FOR_RW        = 0x80, /**< command <= this value have fixed bit arrangement. */
         COMMAND_OPTIONS           = 0x80,
         COMMAND_OPTIONS_REPLY     = 0x82,
@@ -157,6 +159,13 @@ struct MemoryConfigDefs {
 
     static constexpr unsigned MAX_DATAGRAM_RW_BYTES = 64;
 
+    /// Stream buffer size (window) proposed for stream reads and writes.
+    static constexpr unsigned STREAM_BUFFER_BYTES = 256;
+
+    /// Read count value in a read stream command meaning "until the end of
+    /// the space".
+    static constexpr uint32_t READ_STREAM_UNTIL_END = 0xFFFFFFFFu;
+
     static bool is_special_space(uint8_t space) {
         return space > SPACE_SPECIAL;
     }
@@ -201,6 +210,39 @@ struct MemoryConfigDefs {
         return p;
     }
 
+    /// Creates a read stream command. The data will arrive in a stream opened
+    /// by the target node towards the stream ID given here.
+    /// @param space memory space to read from
+    /// @param offset address of the first byte to read
+    /// @param dst_stream_id stream ID on the requester that receives the data
+    /// @param length number of bytes to read, or READ_STREAM_UNTIL_END.
+    static DatagramPayload read_stream_datagram(uint8_t space,
+        uint32_t offset, uint8_t dst_stream_id, uint32_t length)
+    {
+        DatagramPayload p = read_datagram(space, offset, 0);
+        p[1] += COMMAND_READ_STREAM - COMMAND_READ;
+        p.pop_back(); // read length of the datagram command
+        p.push_back(0xff); // source stream ID is picked by the target
+        p.push_back(dst_stream_id);
+        p.push_back(0xff & (length >> 24));
+        p.push_back(0xff & (length >> 16));
+        p.push_back(0xff & (length >> 8));
+        p.push_back(0xff & (length));
+        return p;
+    }
+
+    /// Creates a write stream command. After the target node acknowledged the
+    /// datagram, the requester opens a stream towards it with the data; the
+    /// target sends a write stream reply after the stream was closed.
+    /// @param space memory space to write to
+    /// @param offset address of the first byte to write
+    static DatagramPayload write_stream_datagram(uint8_t space, uint32_t offset)
+    {
+        DatagramPayload p = write_datagram(space, offset);
+        p[1] += COMMAND_WRITE_STREAM - COMMAND_WRITE;
+        return p;
+    }
+
     /// @return true if the payload has minimum number of bytes you need in a
     /// read or write datagram message to cover for the necessary fields
     /// (command, offset, space).
@@ -346,6 +388,12 @@ public:
     virtual errorcode_t unfreeze() {
         return Defs::ERROR_INVALID_ARGS;
     }
+
+    /** Writes any data buffered in the memory space to the backing
+     * storage. Called when the configuration tool reports that a sequence of
+     * writes is complete, before the configuration update listeners run. */
+    virtual void flush() {
+    }
 };
 
 /// Memory space implementation that exports a some memory-mapped data as a
@@ -504,7 +552,7 @@ public:
     size_t read(address_t source, uint8_t *dst, size_t len, errorcode_t *error,
                 Notifiable *again) OVERRIDE;
 
-private:
+protected:
     /** Makes fd a valid parameter, and ensures fileSize is filled in. */
     void ensure_file_open();
 
@@ -582,13 +630,43 @@ public:
         return &registry_;
     }
 
+    /// Writes the data that the memory spaces have buffered to the backing
+    /// storage. Must be called on the executor of the interface, and before
+    /// anything writes the backing files directly.
+    /// @param node if not null, flushes only the spaces of this node and the
+    /// spaces registered for all nodes.
+    void flush_spaces(Node *node = nullptr)
+    {
+        for (auto it = registry_.begin(); it != registry_.end(); ++it)
+        {
+            auto e = *it;
+            if (!node || !e.first.first || e.first.first == node)
+            {
+                e.second->flush();
+            }
+        }
+    }
+
     /// Overrides the default send method in orderto decide whether the queue
     /// the incoming datagram in the server queue or the client queue.
     void send(DefaultDatagramHandler::message_type *message, unsigned priority = UINT_MAX) override
     {
         size_t len = message->data()->payload.size();
         const uint8_t *bytes = (const uint8_t *)message->data()->payload.data();
-        uint8_t cmd = ((len >= 2) && (client_ != nullptr)) ? bytes[1] : 0;
+        uint8_t cmd = (len >= 2) ? bytes[1] : 0;
+        if (streamServer_ != nullptr &&
+            ((cmd & MemoryConfigDefs::COMMAND_MASK) ==
+                    MemoryConfigDefs::COMMAND_READ_STREAM ||
+                (cmd & MemoryConfigDefs::COMMAND_MASK) ==
+                    MemoryConfigDefs::COMMAND_WRITE_STREAM))
+        {
+            streamServer_->send(message, priority);
+            return;
+        }
+        if (client_ == nullptr)
+        {
+            cmd = 0;
+        }
         bool is_client_command = false;
         // To recognize replies for read & write commands, we need to look at a
         // bit.
@@ -632,6 +710,22 @@ public:
         HASSERT(client_ == client);
         client_ = nullptr;
     }
+
+    /// Registers a handler for the read stream and write stream commands
+    /// (see @ref MemoryConfigStreamServer). Stream support is advertised in
+    /// the options reply only while such a handler is registered.
+    void set_stream_server(DatagramHandlerFlow *server)
+    {
+        HASSERT(streamServer_ == nullptr || streamServer_ == server);
+        streamServer_ = server;
+    }
+
+    /// Unregisters the previously registered stream command handler.
+    void clear_stream_server(DatagramHandlerFlow *server)
+    {
+        HASSERT(streamServer_ == server);
+        streamServer_ = nullptr;
+    }
     
 private:
     typedef MemorySpace::address_t address_t;
@@ -688,16 +782,21 @@ private:
             }
             case MemoryConfigDefs::COMMAND_ENTER_BOOTLOADER:
             {
+                flush_spaces();
                 enter_bootloader();
                 return respond_reject(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
             }
             case MemoryConfigDefs::COMMAND_UPDATE_COMPLETE:
             {
+                // The update listeners read the config file through their own
+                // fd, so they need to see all data the spaces have buffered.
+                flush_spaces(message()->data()->dst);
                 Singleton<ConfigUpdateService>::instance()->trigger_update();
                 return respond_ok(0);
             }
             case MemoryConfigDefs::COMMAND_RESET:
             {
+                flush_spaces();
 #if !defined (__MACH__)
                 reboot();
 #endif
@@ -717,6 +816,8 @@ private:
             case MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED:
             case MemoryConfigDefs::COMMAND_READ_REPLY:
             case MemoryConfigDefs::COMMAND_READ_FAILED:
+            case MemoryConfigDefs::COMMAND_READ_STREAM_REPLY:
+            case MemoryConfigDefs::COMMAND_READ_STREAM_FAILED:
             case MemoryConfigDefs::COMMAND_OPTIONS_REPLY:
             case MemoryConfigDefs::COMMAND_INFORMATION_REPLY:
             case MemoryConfigDefs::COMMAND_LOCK_REPLY:
@@ -809,9 +910,14 @@ private:
         response_.push_back(available_commands >> 8);
         response_.push_back(available_commands & 0xff);
         // Write lengths
-        response_.push_back(static_cast<char> (
-            MemoryConfigDefs::LENGTH_1 | MemoryConfigDefs::LENGTH_2 |
-            MemoryConfigDefs::LENGTH_4 | MemoryConfigDefs::LENGTH_ARBITRARY));
+        uint8_t write_lengths = MemoryConfigDefs::LENGTH_1 |
+            MemoryConfigDefs::LENGTH_2 | MemoryConfigDefs::LENGTH_4 |
+            MemoryConfigDefs::LENGTH_ARBITRARY;
+        if (streamServer_)
+        {
+            write_lengths |= MemoryConfigDefs::LENGTH_STREAM;
+        }
+        response_.push_back(static_cast<char>(write_lengths));
 
         uint8_t min_space = 0xFF;
         uint8_t max_space = 0;
@@ -1205,6 +1311,9 @@ private:
     /// If there is a memory config client, we will forward response traffic to
     /// it.
     DatagramHandlerFlow* client_{nullptr};
+    /// Handler for the read/write stream commands, if stream transfers are
+    /// supported.
+    DatagramHandlerFlow *streamServer_{nullptr};
 
     /** Offset withing the current write/read datagram. This does not include
      * the offset from the incoming datagram. */
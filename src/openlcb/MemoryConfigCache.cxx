@@ -0,0 +1,477 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MemoryConfigCache.cxx
+ *
+ * Client-side disk cache of the memory spaces of remote nodes.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/MemoryConfigCache.hxx"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "openlcb/SimpleNodeInfo.hxx"
+#include "utils/ConfigUpdateService.hxx"
+#include "utils/StringPrintf.hxx"
+
+namespace openlcb
+{
+
+/// First bytes of every cache file.
+static const char CACHE_MAGIC[] = "OMC1";
+/// Length of CACHE_MAGIC without the terminating zero.
+static constexpr unsigned CACHE_MAGIC_LEN = sizeof(CACHE_MAGIC) - 1;
+/// Matches both variants of the Initialization Complete message.
+static constexpr uint32_t MASK_SIMPLE_VARIANT = Defs::MTI_EXACT & ~1;
+
+MemoryConfigCache::MemoryConfigCache(
+    MemoryConfigClient *client, const string &directory)
+    : CallableFlow<MemoryConfigClientRequest>(client->service())
+    , client_(client)
+    , directory_(directory)
+    , staticSpaces_{MemoryConfigDefs::SPACE_CDI, MemoryConfigDefs::SPACE_FDI}
+{
+    static_cast<DatagramService *>(service())
+        ->iface()
+        ->dispatcher()
+        ->register_handler(&initCompleteHandler_,
+            Defs::MTI_INITIALIZATION_COMPLETE, MASK_SIMPLE_VARIANT);
+    register_listener();
+}
+
+MemoryConfigCache::~MemoryConfigCache()
+{
+    if (listenerRegistered_ && Singleton<ConfigUpdateService>::exists())
+    {
+        Singleton<ConfigUpdateService>::instance()->unregister_update_listener(
+            &updateListener_);
+    }
+    static_cast<DatagramService *>(service())
+        ->iface()
+        ->dispatcher()
+        ->unregister_handler_all(&initCompleteHandler_);
+}
+
+bool MemoryConfigCache::is_static_space()
+{
+    return std::find(staticSpaces_.begin(), staticSpaces_.end(),
+               request()->memory_space) != staticSpaces_.end();
+}
+
+void MemoryConfigCache::mark_verified()
+{
+    verified_[std::make_pair(request()->dst.id, request()->memory_space)] =
+        identity_;
+}
+
+void MemoryConfigCache::register_listener()
+{
+    if (!listenerRegistered_ && Singleton<ConfigUpdateService>::exists())
+    {
+        Singleton<ConfigUpdateService>::instance()->register_update_listener(
+            &updateListener_);
+        listenerRegistered_ = true;
+    }
+}
+
+void MemoryConfigCache::erase_config(NodeID node)
+{
+    configEntries_.erase(
+        configEntries_.lower_bound(std::make_pair(node, (uint8_t)0)),
+        configEntries_.upper_bound(std::make_pair(node, (uint8_t)0xFF)));
+}
+
+void MemoryConfigCache::init_complete_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    if (b->data()->payload.size() != 6)
+    {
+        return;
+    }
+    // The node may have new firmware.
+    NodeID id = buffer_to_node_id(b->data()->payload);
+    verified_.erase(verified_.lower_bound(std::make_pair(id, (uint8_t)0)),
+        verified_.upper_bound(std::make_pair(id, (uint8_t)0xFF)));
+    // It also reloaded its configuration.
+    erase_config(id);
+}
+
+string MemoryConfigCache::filename(NodeID node, uint8_t space)
+{
+    return directory_ +
+        StringPrintf("/%012" PRIx64 "-%02x.cache", node, (unsigned)space);
+}
+
+uint32_t MemoryConfigCache::request_end()
+{
+    uint32_t address = request()->address;
+    uint32_t size = request()->size;
+    return size > UINT32_MAX - address ? UINT32_MAX : address + size;
+}
+
+StateFlowBase::Action MemoryConfigCache::entry()
+{
+    request()->resultCode = MemoryConfigClient::OPERATION_PENDING;
+    register_listener();
+    if (configGeneration_ != clearedGeneration_)
+    {
+        clearedGeneration_ = configGeneration_;
+        configEntries_.clear();
+    }
+    if (!request()->dst.id)
+    {
+        return pass_through();
+    }
+    if (request()->cmd == MemoryConfigClientRequest::CMD_META_REQUEST)
+    {
+        // Update Complete and Reboot make the node apply or reload its
+        // configuration.
+        erase_config(request()->dst.id);
+        return pass_through();
+    }
+    if (!is_static_space())
+    {
+        switch (request()->cmd)
+        {
+            case MemoryConfigClientRequest::CMD_READ:
+            case MemoryConfigClientRequest::CMD_READ_PART:
+                return call_immediately(STATE(config_read));
+            default:
+                // A write may change more than the written bytes, e.g. when
+                // the node reacts to it.
+                configEntries_.erase(std::make_pair(
+                    request()->dst.id, request()->memory_space));
+                return pass_through();
+        }
+    }
+    switch (request()->cmd)
+    {
+        case MemoryConfigClientRequest::CMD_READ:
+        case MemoryConfigClientRequest::CMD_READ_PART:
+        {
+            auto it = verified_.find(
+                std::make_pair(request()->dst.id, request()->memory_space));
+            if (it != verified_.end())
+            {
+                identity_ = it->second;
+                probe_ = false;
+                return call_immediately(STATE(identity_known));
+            }
+            prepare_client(MemoryConfigClientRequest::READ_PART,
+                request()->dst, MemoryConfigDefs::SPACE_ACDI_SYS, 0,
+                sizeof(SimpleNodeStaticValues));
+            return call_client(STATE(identity_done));
+        }
+        case MemoryConfigClientRequest::CMD_WRITE:
+            prepare_client(MemoryConfigClientRequest::WRITE, request()->dst,
+                request()->memory_space, request()->address,
+                request()->payload);
+            sub_->data()->window = request()->window;
+            sub_->data()->progress = request()->progress;
+            return call_client(STATE(write_done));
+        default:
+            return pass_through();
+    }
+}
+
+StateFlowBase::Action MemoryConfigCache::config_read()
+{
+    auto it = configEntries_.find(
+        std::make_pair(request()->dst.id, request()->memory_space));
+    uint32_t start = request()->address;
+    uint32_t end = request_end();
+    if (it != configEntries_.end() && start >= it->second.base)
+    {
+        const Entry &e = it->second;
+        uint32_t cache_end = e.base + e.data.size();
+        if (start <= cache_end && (end <= cache_end || e.complete))
+        {
+            request()->payload =
+                e.data.substr(start - e.base, std::min(end, cache_end) - start);
+            return return_with_error(0);
+        }
+    }
+    prepare_client(MemoryConfigClientRequest::READ_PART, request()->dst,
+        request()->memory_space, request()->address, request()->size);
+    sub_->data()->window = request()->window;
+    sub_->data()->progress = request()->progress;
+    return call_client(STATE(config_fetch_done));
+}
+
+StateFlowBase::Action MemoryConfigCache::config_fetch_done()
+{
+    auto b = take_sub();
+    request()->payload = std::move(b->data()->payload);
+    if (b->data()->resultCode == 0)
+    {
+        Entry &e = configEntries_[std::make_pair(
+            request()->dst.id, request()->memory_space)];
+        e.base = request()->address;
+        e.complete = request()->payload.size() < request()->size;
+        e.data = request()->payload;
+    }
+    return return_with_error(b->data()->resultCode);
+}
+
+StateFlowBase::Action MemoryConfigCache::pass_through()
+{
+    client_->send(transfer_message());
+    return exit();
+}
+
+StateFlowBase::Action MemoryConfigCache::identity_done()
+{
+    auto b = take_sub();
+    if (b->data()->resultCode != 0)
+    {
+        // No identification, we cannot tell when the cache goes stale.
+        return pass_through();
+    }
+    identity_ = std::move(b->data()->payload);
+    probe_ = true;
+    return call_immediately(STATE(identity_known));
+}
+
+StateFlowBase::Action MemoryConfigCache::identity_known()
+{
+    uint32_t start = request()->address;
+    if (!load(request()->dst.id, request()->memory_space, &entry_) ||
+        entry_.identity != identity_ || start < entry_.base ||
+        start - entry_.base > entry_.data.size())
+    {
+        return fetch();
+    }
+    uint32_t cache_end = entry_.base + entry_.data.size();
+    uint32_t len = std::min(cache_end, request_end()) - start;
+    if (!len || !probe_)
+    {
+        // Nothing to compare, or the node did not reboot since it was
+        // checked.
+        request()->payload.clear();
+        return call_immediately(STATE(validate_done));
+    }
+    len = std::min(
+        len, (uint32_t)MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES);
+    prepare_client(MemoryConfigClientRequest::READ_PART, request()->dst,
+        request()->memory_space, start, len);
+    return call_client(STATE(validate_done));
+}
+
+StateFlowBase::Action MemoryConfigCache::validate_done()
+{
+    uint32_t start = request()->address;
+    uint32_t end = request_end();
+    uint32_t cache_end = entry_.base + entry_.data.size();
+    if (sub_)
+    {
+        auto b = take_sub();
+        const string &probe = b->data()->payload;
+        if (b->data()->resultCode != 0 ||
+            entry_.data.compare(
+                start - entry_.base, probe.size(), probe) != 0 ||
+            probe.empty())
+        {
+            LOG(VERBOSE, "MemoryConfigCache: stale entry for %012" PRIx64
+                         " space 0x%02x.",
+                request()->dst.id, request()->memory_space);
+            return fetch();
+        }
+    }
+    mark_verified();
+    request()->payload =
+        entry_.data.substr(start - entry_.base, std::min(end, cache_end) - start);
+    if (end <= cache_end || entry_.complete)
+    {
+        return finish_read(0);
+    }
+    // Fetches the part that is not in the cache.
+    prepare_client(MemoryConfigClientRequest::READ_PART, request()->dst,
+        request()->memory_space, cache_end, end - cache_end);
+    sub_->data()->window = request()->window;
+    if (request()->progress)
+    {
+        unsigned cached = request()->payload.size();
+        sub_->data()->progress = [this, cached](unsigned bytes) {
+            request()->progress(cached + bytes);
+        };
+    }
+    return call_client(STATE(tail_done));
+}
+
+StateFlowBase::Action MemoryConfigCache::tail_done()
+{
+    auto b = take_sub();
+    string &tail = b->data()->payload;
+    uint32_t asked =
+        request_end() - (entry_.base + (uint32_t)entry_.data.size());
+    request()->payload += tail;
+    if (b->data()->resultCode != 0)
+    {
+        return finish_read(b->data()->resultCode);
+    }
+    entry_.complete = tail.size() < asked;
+    entry_.data += tail;
+    store(request()->dst.id, request()->memory_space, entry_);
+    return finish_read(0);
+}
+
+StateFlowBase::Action MemoryConfigCache::fetch()
+{
+    prepare_client(MemoryConfigClientRequest::READ_PART, request()->dst,
+        request()->memory_space, request()->address, request()->size);
+    sub_->data()->window = request()->window;
+    sub_->data()->progress = request()->progress;
+    return call_client(STATE(fetch_done));
+}
+
+StateFlowBase::Action MemoryConfigCache::fetch_done()
+{
+    auto b = take_sub();
+    request()->payload = std::move(b->data()->payload);
+    if (b->data()->resultCode == 0)
+    {
+        entry_.identity = identity_;
+        entry_.base = request()->address;
+        entry_.complete = request()->payload.size() < request()->size;
+        entry_.data = request()->payload;
+        store(request()->dst.id, request()->memory_space, entry_);
+        mark_verified();
+    }
+    return finish_read(b->data()->resultCode);
+}
+
+StateFlowBase::Action MemoryConfigCache::finish_read(int result)
+{
+    entry_.data.clear();
+    identity_.clear();
+    return return_with_error(result);
+}
+
+StateFlowBase::Action MemoryConfigCache::write_done()
+{
+    auto b = take_sub();
+    int result = b->data()->resultCode;
+    if (result == 0 &&
+        load(request()->dst.id, request()->memory_space, &entry_))
+    {
+        // Updates the overlapping part of the cached data.
+        const string &p = request()->payload;
+        uint64_t cache_end = (uint64_t)entry_.base + entry_.data.size();
+        uint64_t from = std::max(request()->address, entry_.base);
+        uint64_t to = std::min(request()->address + (uint64_t)p.size(), cache_end);
+        if (from < to)
+        {
+            entry_.data.replace(from - entry_.base, to - from, p,
+                from - request()->address, to - from);
+            store(request()->dst.id, request()->memory_space, entry_);
+        }
+        entry_.data.clear();
+    }
+    return return_with_error(result);
+}
+
+bool MemoryConfigCache::load(NodeID node, uint8_t space, Entry *e)
+{
+    FILE *f = fopen(filename(node, space).c_str(), "rb");
+    if (!f)
+    {
+        return false;
+    }
+    string contents;
+    char buf[1024];
+    size_t nr;
+    while ((nr = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        contents.append(buf, nr);
+    }
+    fclose(f);
+    // magic, identity length, identity, base address, flags, data.
+    const uint8_t *p = (const uint8_t *)contents.data();
+    size_t len = contents.size();
+    if (len < CACHE_MAGIC_LEN + 1 ||
+        memcmp(p, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0)
+    {
+        return false;
+    }
+    size_t ofs = CACHE_MAGIC_LEN;
+    unsigned id_len = p[ofs++];
+    if (len < ofs + id_len + 5)
+    {
+        return false;
+    }
+    e->identity.assign((const char *)p + ofs, id_len);
+    ofs += id_len;
+    e->base = (p[ofs] << 24) | (p[ofs + 1] << 16) | (p[ofs + 2] << 8) |
+        p[ofs + 3];
+    ofs += 4;
+    e->complete = p[ofs++] & 1;
+    e->data = contents.substr(ofs);
+    return true;
+}
+
+void MemoryConfigCache::store(NodeID node, uint8_t space, const Entry &e)
+{
+    string contents(CACHE_MAGIC, CACHE_MAGIC_LEN);
+    HASSERT(e.identity.size() < 256);
+    contents.push_back(e.identity.size());
+    contents += e.identity;
+    contents.push_back(e.base >> 24);
+    contents.push_back(e.base >> 16);
+    contents.push_back(e.base >> 8);
+    contents.push_back(e.base);
+    contents.push_back(e.complete ? 1 : 0);
+    contents += e.data;
+
+    // Writes a new file and renames it, so that a crash does not leave a
+    // truncated entry behind.
+    string name = filename(node, space);
+    string tmp_name = name + ".tmp";
+    FILE *f = fopen(tmp_name.c_str(), "wb");
+    if (!f)
+    {
+        LOG(WARNING, "MemoryConfigCache: cannot write %s: %s",
+            tmp_name.c_str(), strerror(errno));
+        return;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_name.c_str(), name.c_str()) != 0)
+    {
+        LOG(WARNING, "MemoryConfigCache: cannot write %s: %s", name.c_str(),
+            strerror(errno));
+        unlink(tmp_name.c_str());
+    }
+}
+
+} // namespace openlcb
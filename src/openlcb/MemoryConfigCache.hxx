@@ -0,0 +1,283 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MemoryConfigCache.hxx
+ *
+ * Client-side disk cache of the memory spaces of remote nodes.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_MEMORYCONFIGCACHE_HXX_
+#define _OPENLCB_MEMORYCONFIGCACHE_HXX_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "openlcb/MemoryConfigClient.hxx"
+#include "utils/ConfigUpdateListener.hxx"
+
+namespace openlcb
+{
+
+/// Keeps the contents of memory spaces of remote nodes in files, in front of
+/// a MemoryConfigClient. Accepts the same requests as the MemoryConfigClient.
+///
+/// Static memory spaces are spaces whose contents are defined by the firmware
+/// of the node, such as the CDI and the FDI. They are cached in files that
+/// survive restarts. Every other memory space is a configuration space, which
+/// is cached in memory only: the protocol has no way to tell whether a range
+/// changed without reading all of it, so a cached configuration range is
+/// served until it is invalidated. This happens when
+/// - a write request to the same node and space goes through the cache,
+/// - a meta request (e.g. Update Complete or Reboot) is sent to the node
+///   through the cache,
+/// - the node sends Initialization Complete,
+/// - the configuration of the local node is updated via the
+///   ConfigUpdateService (e.g. by ConfigUpdateService::trigger_update()), or
+///   invalidate_config() is called. Applications that know that other nodes
+///   changed the configuration use these to drop the cached data.
+///
+/// Each static space cache entry holds one contiguous range of one memory space of one
+/// node, and is keyed by the node ID and the memory space number. The entry
+/// is tagged with the identification of the node, which is the contents of
+/// the ACDI manufacturer space (0xFC): manufacturer, model, hardware and
+/// software version, the same data as the static part of SNIP.
+///
+/// The first read request to a node reads the identification from the node.
+/// If it matches the cache entry, the first datagram of the requested range
+/// is read from the node and compared with the cached data. When that matches
+/// too, the cached part of the range is served locally, and only the bytes
+/// past the end of the cache entry are fetched from the node (and added to
+/// the entry). Otherwise the range is fetched from the node and replaces the
+/// entry. The identification stays verified until the node sends an
+/// Initialization Complete message, since new firmware needs a reboot; until
+/// then further requests are served from the cache without checking with the
+/// node. For the CDI this means that re-opening a known node costs three
+/// datagrams instead of the whole CDI download, and nothing afterwards.
+///
+/// Writes to a static space go to the node and update the overlapping part
+/// of the cache entry.
+///
+/// Requests to nodes addressed by alias only, requests to nodes that do not
+/// have an ACDI manufacturer space, and all other commands are passed to the
+/// client unchanged.
+///
+/// The files are accessed synchronously from the executor, so this class is
+/// meant for host-side tools.
+class MemoryConfigCache : public CallableFlow<MemoryConfigClientRequest>
+{
+public:
+    /// Constructor.
+    /// @param client performs the requests towards the remote nodes.
+    /// @param directory where to store the cache files. Must exist.
+    MemoryConfigCache(MemoryConfigClient *client, const string &directory);
+
+    ~MemoryConfigCache();
+
+    /// Declares that the contents of a memory space only change with the
+    /// firmware of the node, so that it can be cached. The CDI and FDI spaces
+    /// are static by default.
+    /// @param space memory space number.
+    void add_static_space(uint8_t space)
+    {
+        staticSpaces_.push_back(space);
+    }
+
+    /// Drops the cached data of all configuration spaces. May be called from
+    /// any thread; takes effect at the next request.
+    void invalidate_config()
+    {
+        ++configGeneration_;
+    }
+
+    /// @return the name of the cache file for a given memory space.
+    /// @param node node ID of the remote node.
+    /// @param space memory space number.
+    string filename(NodeID node, uint8_t space);
+
+private:
+    /// Contents of one cache file, or one cached configuration space range.
+    struct Entry
+    {
+        /// Identification of the node when the data was read. Not used for
+        /// configuration spaces.
+        string identity;
+        /// Address of the first byte of data.
+        uint32_t base;
+        /// True if the memory space ends at base + data.size().
+        bool complete;
+        /// Cached bytes.
+        string data;
+    };
+
+    Action entry() override;
+
+    /// Hands the current request to the client and exits.
+    Action pass_through();
+
+    Action identity_done();
+    /// Compares the cache entry with the identification in identity_.
+    Action identity_known();
+    Action validate_done();
+    Action tail_done();
+    Action fetch_done();
+    Action write_done();
+
+    /// Serves a read request of a configuration space from memory, or
+    /// fetches it from the node.
+    Action config_read();
+    Action config_fetch_done();
+
+    /// Invalidates the cache upon config updates.
+    class UpdateListener : public ConfigUpdateListener
+    {
+    public:
+        /// @param parent the cache to invalidate.
+        UpdateListener(MemoryConfigCache *parent)
+            : parent_(parent)
+        {
+        }
+
+        UpdateAction apply_configuration(
+            int fd, bool initial_load, BarrierNotifiable *done) override
+        {
+            AutoNotify n(done);
+            parent_->invalidate_config();
+            return UPDATED;
+        }
+
+        void factory_reset(int fd) override
+        {
+            parent_->invalidate_config();
+        }
+
+    private:
+        /// Cache to invalidate.
+        MemoryConfigCache *parent_;
+    };
+
+    /// Registers updateListener_ if there is a ConfigUpdateService and it is
+    /// not registered yet.
+    void register_listener();
+
+    /// Drops the cached configuration spaces of a node.
+    /// @param node node ID of the remote node.
+    void erase_config(NodeID node);
+
+    /// Allocates the request to send to the client into sub_.
+    /// @param args arguments to MemoryConfigClientRequest::reset().
+    template <typename... Args> void prepare_client(Args &&...args)
+    {
+        mainBufferPool->alloc(&sub_);
+        sub_->data()->reset(std::forward<Args>(args)...);
+        sub_->data()->done.reset(this);
+    }
+
+    /// Sends sub_ to the client, keeping a reference for the response.
+    /// @param c state to continue at when the client is done.
+    Action call_client(Callback c)
+    {
+        client_->send(sub_->ref());
+        return wait_and_call(c);
+    }
+
+    /// @return the result of the request sent to the client, taking
+    /// ownership.
+    BufferPtr<MemoryConfigClientRequest> take_sub()
+    {
+        BufferPtr<MemoryConfigClientRequest> b(sub_);
+        sub_ = nullptr;
+        return b;
+    }
+
+    /// @return true if the memory space of the current request is cached.
+    bool is_static_space();
+
+    /// Records that the cache entry of the current request matches the node
+    /// with identity_.
+    void mark_verified();
+
+    /// Forgets the identification of a node that rebooted.
+    /// @param b Initialization Complete message.
+    void init_complete_received(Buffer<GenMessage> *b);
+
+    /// Reads the entire range of the request from the node.
+    Action fetch();
+
+    /// Finishes the current read request.
+    /// @param result error code to return.
+    Action finish_read(int result);
+
+    /// @return the end (exclusive) of the range of the current request.
+    uint32_t request_end();
+
+    /// Loads a cache file. @return true if the file exists and is valid.
+    /// @param node remote node ID @param space memory space @param e output
+    bool load(NodeID node, uint8_t space, Entry *e);
+    /// Stores a cache file. @param node remote node ID @param space memory
+    /// space @param e contents.
+    void store(NodeID node, uint8_t space, const Entry &e);
+
+    /// Performs the remote requests.
+    MemoryConfigClient *client_;
+    /// Directory of the cache files.
+    string directory_;
+    /// Request sent to the client.
+    Buffer<MemoryConfigClientRequest> *sub_ {nullptr};
+    /// Cache entry of the current request.
+    Entry entry_;
+    /// Identification of the remote node read for the current request.
+    string identity_;
+    /// True if the cached data has to be checked against the node before it
+    /// is served.
+    bool probe_;
+    /// Memory spaces that are cached.
+    std::vector<uint8_t> staticSpaces_;
+    /// Identification of the nodes that the cache entries were checked
+    /// against since the node last booted, by node ID and memory space.
+    /// Accessed from the executor of the interface only.
+    std::map<std::pair<NodeID, uint8_t>, string> verified_;
+    /// Cached configuration space ranges by node ID and memory space.
+    /// Accessed from the executor of the interface only.
+    std::map<std::pair<NodeID, uint8_t>, Entry> configEntries_;
+    /// Incremented by invalidate_config().
+    unsigned configGeneration_ {0};
+    /// Value of configGeneration_ when configEntries_ was last cleared.
+    unsigned clearedGeneration_ {0};
+    /// True if updateListener_ is registered with the ConfigUpdateService.
+    bool listenerRegistered_ {false};
+    /// Invalidates configEntries_ upon config updates.
+    UpdateListener updateListener_ {this};
+    MessageHandler::GenericHandler initCompleteHandler_{
+        this, &MemoryConfigCache::init_complete_received};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_MEMORYCONFIGCACHE_HXX_
@@ -0,0 +1,820 @@
+/** \copyright
+ * Copyright (c) 2017, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MemoryConfigClient.cxx
+ *
+ * State machine of the flow that performs memory config requests towards a
+ * remote node.
+ *
+ * @author Balazs Racz
+ * @date 4 Feb 2017
+ */
+
+#include "openlcb/MemoryConfigClient.hxx"
+
+#include <errno.h>
+
+#include <algorithm>
+
+namespace openlcb
+{
+
+constexpr uint8_t MemoryConfigClient::READ_STREAM_ID;
+constexpr unsigned MemoryConfigClient::MAX_WINDOW;
+constexpr unsigned MemoryConfigClient::MAX_RETRIES;
+
+StateFlowBase::Action MemoryConfigClient::entry()
+{
+    request()->resultCode = OPERATION_PENDING;
+    switch (request()->cmd)
+    {
+        case MemoryConfigClientRequest::CMD_READ:
+        case MemoryConfigClientRequest::CMD_READ_PART:
+            return allocate_and_call(
+                STATE(do_read), dg_service()->client_allocator());
+        case MemoryConfigClientRequest::CMD_WRITE:
+            return allocate_and_call(
+                STATE(do_write), dg_service()->client_allocator());
+        case MemoryConfigClientRequest::CMD_META_REQUEST:
+            return allocate_and_call(
+                STATE(do_meta_request), dg_service()->client_allocator());
+        default:
+            break;
+    }
+    return return_with_error(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
+}
+
+StateFlowBase::Action MemoryConfigClient::do_read()
+{
+    dgClient_ = full_allocation_result(dg_service()->client_allocator());
+    offset_ = request()->address;
+    memoryConfigHandler_->set_client(&responseFlow_);
+    if (streamReceiver_ &&
+        request()->size > MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES)
+    {
+        return call_immediately(STATE(check_stream_support));
+    }
+    return call_immediately(STATE(send_next_read));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_next_read()
+{
+    start_segments(request()->size);
+    return call_immediately(STATE(fill_window));
+}
+
+StateFlowBase::Action MemoryConfigClient::handle_read_error(int error)
+{
+    if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
+    {
+        return finish_read();
+    }
+    cleanup_read();
+    return return_with_error(error);
+}
+
+void MemoryConfigClient::cleanup_read()
+{
+    numSegments_ = 0;
+    responsePayload_.clear();
+    dg_service()->client_allocator()->typed_insert(dgClient_);
+    memoryConfigHandler_->clear_client(&responseFlow_);
+    dgClient_ = nullptr;
+}
+
+StateFlowBase::Action MemoryConfigClient::finish_read()
+{
+    cleanup_read();
+    return return_ok();
+}
+
+StateFlowBase::Action MemoryConfigClient::do_write()
+{
+    dgClient_ = full_allocation_result(dg_service()->client_allocator());
+    offset_ = request()->address;
+    payloadOffset_ = 0;
+    memoryConfigHandler_->set_client(&responseFlow_);
+    if (streamSender_ &&
+        request()->payload.size() > MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES)
+    {
+        return call_immediately(STATE(check_stream_support));
+    }
+    return call_immediately(STATE(send_next_write));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_next_write()
+{
+    start_segments(request()->payload.size());
+    return call_immediately(STATE(fill_window));
+}
+
+StateFlowBase::Action MemoryConfigClient::handle_write_error(int error)
+{
+    if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
+    {
+        return finish_write();
+    }
+    cleanup_write();
+    return return_with_error(error);
+}
+
+void MemoryConfigClient::cleanup_write()
+{
+    numSegments_ = 0;
+    responsePayload_.clear();
+    dg_service()->client_allocator()->typed_insert(dgClient_);
+    memoryConfigHandler_->clear_client(&responseFlow_);
+    dgClient_ = nullptr;
+}
+
+StateFlowBase::Action MemoryConfigClient::finish_write()
+{
+    cleanup_write();
+    return return_ok();
+}
+
+void MemoryConfigClient::start_segments(uint32_t size)
+{
+    numSegments_ = 0;
+    segmentError_ = 0;
+    bytesDone_ = 0;
+    endAddress_ =
+        size > UINT32_MAX - offset_ ? UINT32_MAX : offset_ + size;
+}
+
+unsigned MemoryConfigClient::window()
+{
+    unsigned w = request()->window;
+    return w < 1 ? 1 : (w > MAX_WINDOW ? MAX_WINDOW : w);
+}
+
+unsigned MemoryConfigClient::max_retries()
+{
+    unsigned r = request()->retries;
+    return r > MAX_RETRIES ? MAX_RETRIES : r;
+}
+
+bool MemoryConfigClient::next_segment()
+{
+    for (unsigned i = 0; i < numSegments_; ++i)
+    {
+        if (segments_[i].needsSend)
+        {
+            segments_[i].needsSend = 0;
+            sendAddress_ = segments_[i].address;
+            sendSize_ = segments_[i].size;
+            return true;
+        }
+    }
+    if (numSegments_ >= window() || offset_ >= endAddress_)
+    {
+        return false;
+    }
+    Segment &seg = segments_[numSegments_++];
+    seg.address = offset_;
+    seg.size = std::min(endAddress_ - offset_,
+        (uint32_t)MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES);
+    seg.retries = 0;
+    seg.needsSend = 0;
+    offset_ += seg.size;
+    sendAddress_ = seg.address;
+    sendSize_ = seg.size;
+    return true;
+}
+
+StateFlowBase::Action MemoryConfigClient::fill_window()
+{
+    if (segmentError_)
+    {
+        return call_immediately(STATE(segments_done));
+    }
+    if (next_segment())
+    {
+        return allocate_and_call(
+            dg_service()->iface()->dispatcher(), STATE(send_segment));
+    }
+    if (!numSegments_)
+    {
+        return call_immediately(STATE(segments_done));
+    }
+    isWaitingForTimer_ = 1;
+    return sleep_and_call(&timer_, SEC_TO_NSEC(3), STATE(segment_wait_done));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_segment()
+{
+    auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+    b->set_done(bn_.reset(this));
+    if (request()->cmd == MemoryConfigClientRequest::CMD_WRITE)
+    {
+        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(),
+            request()->dst,
+            MemoryConfigDefs::write_datagram(request()->memory_space,
+                sendAddress_,
+                request()->payload.substr(
+                    sendAddress_ - request()->address, sendSize_)));
+    }
+    else
+    {
+        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(),
+            request()->dst,
+            MemoryConfigDefs::read_datagram(
+                request()->memory_space, sendAddress_, sendSize_));
+    }
+    isWaitingForTimer_ = 0;
+    dgClient_->write_datagram(b);
+    return wait_and_call(STATE(segment_sent));
+}
+
+StateFlowBase::Action MemoryConfigClient::segment_sent()
+{
+    if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS) &&
+        !segmentError_)
+    {
+        segmentError_ = dgClient_->result();
+    }
+    return call_immediately(STATE(fill_window));
+}
+
+StateFlowBase::Action MemoryConfigClient::segment_wait_done()
+{
+    isWaitingForTimer_ = 0;
+    if (!timer_.is_triggered())
+    {
+        for (unsigned i = 0; i < numSegments_; ++i)
+        {
+            if (segments_[i].retries >= max_retries())
+            {
+                segmentError_ = Defs::OPENMRN_TIMEOUT;
+                break;
+            }
+            ++segments_[i].retries;
+            segments_[i].needsSend = 1;
+        }
+    }
+    return call_immediately(STATE(fill_window));
+}
+
+StateFlowBase::Action MemoryConfigClient::segments_done()
+{
+    bool is_write =
+        request()->cmd == MemoryConfigClientRequest::CMD_WRITE;
+    if (segmentError_)
+    {
+        return is_write ? handle_write_error(segmentError_)
+                        : handle_read_error(segmentError_);
+    }
+    if (is_write)
+    {
+        return finish_write();
+    }
+    // The end of the space might have cut the data short.
+    size_t len = endAddress_ - request()->address;
+    if (request()->payload.size() > len)
+    {
+        request()->payload.resize(len);
+    }
+    return finish_read();
+}
+
+int MemoryConfigClient::segment_reply(const string &payload)
+{
+    if (!MemoryConfigDefs::payload_min_length_check(payload, 0))
+    {
+        LOG(INFO, "Memory Config client: response datagram payload not "
+                  "long enough");
+        return Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+    }
+    unsigned address = MemoryConfigDefs::get_address(payload);
+    if (MemoryConfigDefs::get_space(payload) != request()->memory_space)
+    {
+        return Defs::ERROR_OUT_OF_ORDER;
+    }
+    unsigned idx = 0;
+    while (idx < numSegments_ && segments_[idx].address != address)
+    {
+        ++idx;
+    }
+    if (idx >= numSegments_)
+    {
+        // Duplicate reply to a re-sent segment, or garbage.
+        return Defs::ERROR_OUT_OF_ORDER;
+    }
+    Segment &seg = segments_[idx];
+    const uint8_t *bytes = MemoryConfigDefs::payload_bytes(payload);
+    unsigned ofs = MemoryConfigDefs::get_payload_offset(payload);
+    uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
+    if (cmd == MemoryConfigDefs::COMMAND_READ_FAILED ||
+        cmd == MemoryConfigDefs::COMMAND_WRITE_FAILED)
+    {
+        uint16_t error = Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+        if (payload.size() >= ofs + 2)
+        {
+            error = (bytes[ofs] << 8) | bytes[ofs + 1];
+        }
+        if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
+        {
+            endAddress_ = std::min(endAddress_, seg.address);
+        }
+        else if ((error & Defs::ERROR_TEMPORARY) &&
+            seg.retries < max_retries())
+        {
+            ++seg.retries;
+            seg.needsSend = 1;
+            wakeup_segments();
+            return 0;
+        }
+        else if (!segmentError_)
+        {
+            segmentError_ = error;
+        }
+    }
+    else if (request()->cmd == MemoryConfigClientRequest::CMD_WRITE)
+    {
+        bytesDone_ += seg.size;
+        report_progress();
+    }
+    else
+    {
+        unsigned dlen = std::min(payload.size() - ofs, (size_t)seg.size);
+        string &p = request()->payload;
+        size_t pofs = seg.address - request()->address;
+        if (p.size() < pofs + dlen)
+        {
+            p.resize(pofs + dlen);
+        }
+        memcpy(&p[pofs], bytes + ofs, dlen);
+        if (dlen < seg.size)
+        {
+            // Short read: end of the memory space.
+            endAddress_ = std::min(endAddress_, seg.address + dlen);
+        }
+        bytesDone_ += dlen;
+        if (dlen)
+        {
+            report_progress();
+        }
+    }
+    segments_[idx] = segments_[--numSegments_];
+    wakeup_segments();
+    return 0;
+}
+
+void MemoryConfigClient::report_progress()
+{
+    if (request()->progress)
+    {
+        request()->progress(bytesDone_);
+    }
+}
+
+void MemoryConfigClient::wakeup_segments()
+{
+    if (isWaitingForTimer_)
+    {
+        isWaitingForTimer_ = 0;
+        timer_.trigger();
+    }
+}
+
+StateFlowBase::Action MemoryConfigClient::check_stream_support()
+{
+    if (probeValid_ &&
+        node_->iface()->matching_node(probedNode_, request()->dst))
+    {
+        return call_immediately(STATE(stream_support_known));
+    }
+    probeValid_ = 0;
+    return allocate_and_call(
+        dg_service()->iface()->dispatcher(), STATE(send_options_datagram));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_options_datagram()
+{
+    auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+    b->set_done(bn_.reset(this));
+    DatagramPayload p;
+    p.push_back(DatagramDefs::CONFIGURATION);
+    p.push_back(MemoryConfigDefs::COMMAND_OPTIONS);
+    b->data()->reset(
+        Defs::MTI_DATAGRAM, node_->node_id(), request()->dst, p);
+    isWaitingForTimer_ = 0;
+    isProbing_ = 1;
+    responseCode_ = DatagramClient::OPERATION_PENDING;
+    dgClient_->write_datagram(b);
+    return wait_and_call(STATE(options_datagram_complete));
+}
+
+StateFlowBase::Action MemoryConfigClient::options_datagram_complete()
+{
+    if ((dgClient_->result() & DatagramClient::OPERATION_SUCCESS) &&
+        (responseCode_ & DatagramClient::OPERATION_PENDING))
+    {
+        isWaitingForTimer_ = 1;
+        return sleep_and_call(
+            &timer_, SEC_TO_NSEC(3), STATE(options_response));
+    }
+    return call_immediately(STATE(options_response));
+}
+
+StateFlowBase::Action MemoryConfigClient::options_response()
+{
+    isProbing_ = 0;
+    isWaitingForTimer_ = 0;
+    probedNode_ = request()->dst;
+    probeValid_ = 1;
+    probeHasStreams_ = 0;
+    const uint8_t *bytes =
+        MemoryConfigDefs::payload_bytes(responsePayload_);
+    if (!(responseCode_ & DatagramClient::OPERATION_PENDING) &&
+        responsePayload_.size() >= 5 &&
+        (bytes[4] & MemoryConfigDefs::LENGTH_STREAM))
+    {
+        probeHasStreams_ = 1;
+    }
+    responsePayload_.clear();
+    return call_immediately(STATE(stream_support_known));
+}
+
+StateFlowBase::Action MemoryConfigClient::stream_support_known()
+{
+    bool is_write = request()->cmd == MemoryConfigClientRequest::CMD_WRITE;
+    if (!probeHasStreams_)
+    {
+        return call_immediately(
+            is_write ? STATE(send_next_write) : STATE(send_next_read));
+    }
+    if (is_write)
+    {
+        return allocate_and_call(dg_service()->iface()->dispatcher(),
+            STATE(send_write_stream_datagram));
+    }
+    // We have to listen before the target tries to open the stream.
+    streamReceiver_->start(node_, READ_STREAM_ID,
+        MemoryConfigDefs::STREAM_BUFFER_BYTES, nullptr);
+    return allocate_and_call(dg_service()->iface()->dispatcher(),
+        STATE(send_read_stream_datagram));
+}
+
+bool MemoryConfigClient::stream_fallback(int result)
+{
+    if ((result & Defs::ERROR_UNIMPLEMENTED) == Defs::ERROR_UNIMPLEMENTED)
+    {
+        // Do not try streams again with this node.
+        probeHasStreams_ = 0;
+        return true;
+    }
+    return (result & Defs::ERROR_TEMPORARY) != 0;
+}
+
+StateFlowBase::Action MemoryConfigClient::send_read_stream_datagram()
+{
+    auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+    b->set_done(bn_.reset(this));
+    b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
+        MemoryConfigDefs::read_stream_datagram(request()->memory_space,
+            offset_, READ_STREAM_ID, request()->size));
+    isWaitingForTimer_ = 0;
+    responseCode_ = DatagramClient::OPERATION_PENDING;
+    dgClient_->write_datagram(b);
+    return wait_and_call(STATE(read_stream_datagram_complete));
+}
+
+StateFlowBase::Action MemoryConfigClient::read_stream_datagram_complete()
+{
+    if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
+    {
+        streamReceiver_->stop();
+        if (stream_fallback(dgClient_->result()))
+        {
+            return call_immediately(STATE(send_next_read));
+        }
+        return handle_read_error(dgClient_->result());
+    }
+    if (responseCode_ & DatagramClient::OPERATION_PENDING)
+    {
+        isWaitingForTimer_ = 1;
+        return sleep_and_call(
+            &timer_, SEC_TO_NSEC(3), STATE(read_stream_response));
+    }
+    return call_immediately(STATE(read_stream_response));
+}
+
+StateFlowBase::Action MemoryConfigClient::read_stream_response()
+{
+    isWaitingForTimer_ = 0;
+    int error = check_stream_response(
+        MemoryConfigDefs::COMMAND_READ_STREAM_REPLY,
+        MemoryConfigDefs::COMMAND_READ_STREAM_FAILED);
+    if (error)
+    {
+        streamReceiver_->stop();
+        return handle_read_error(error);
+    }
+    return call_immediately(STATE(read_stream_data));
+}
+
+StateFlowBase::Action MemoryConfigClient::read_stream_data()
+{
+    string &p = request()->payload;
+    while (true)
+    {
+        size_t old_size = p.size();
+        p.resize(old_size + MemoryConfigDefs::STREAM_BUFFER_BYTES);
+        ssize_t len = streamReceiver_->read(&p[old_size],
+            MemoryConfigDefs::STREAM_BUFFER_BYTES, &streamWakeup_);
+        p.resize(old_size + (len > 0 ? len : 0));
+        if (len == 0)
+        {
+            return call_immediately(STATE(finish_read));
+        }
+        if (len < 0)
+        {
+            break;
+        }
+        offset_ += len;
+    }
+    return sleep_and_call(&timer_, STREAM_RESPONSE_TIMEOUT_NSEC,
+        STATE(read_stream_wakeup));
+}
+
+StateFlowBase::Action MemoryConfigClient::read_stream_wakeup()
+{
+    if (!timer_.is_triggered())
+    {
+        LOG(INFO, "Memory Config client: read stream timed out after %u "
+                  "bytes.",
+            (unsigned)request()->payload.size());
+        streamReceiver_->stop();
+        return handle_read_error(Defs::OPENMRN_TIMEOUT);
+    }
+    return call_immediately(STATE(read_stream_data));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_write_stream_datagram()
+{
+    auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+    b->set_done(bn_.reset(this));
+    b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
+        MemoryConfigDefs::write_stream_datagram(
+            request()->memory_space, offset_));
+    isWaitingForTimer_ = 0;
+    responseCode_ = DatagramClient::OPERATION_PENDING;
+    dgClient_->write_datagram(b);
+    return wait_and_call(STATE(write_stream_datagram_complete));
+}
+
+StateFlowBase::Action MemoryConfigClient::write_stream_datagram_complete()
+{
+    if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
+    {
+        if (stream_fallback(dgClient_->result()))
+        {
+            return call_immediately(STATE(send_next_write));
+        }
+        return handle_write_error(dgClient_->result());
+    }
+    streamSender_->start_stream(node_, request()->dst,
+        MemoryConfigDefs::STREAM_BUFFER_BYTES, this);
+    return wait_and_call(STATE(write_stream_data));
+}
+
+StateFlowBase::Action MemoryConfigClient::write_stream_data()
+{
+    const string &p = request()->payload;
+    while (payloadOffset_ < p.size())
+    {
+        ssize_t len = streamSender_->write(
+            p.data() + payloadOffset_, p.size() - payloadOffset_, this);
+        if (len < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                return wait();
+            }
+            return handle_write_error(streamSender_->error() ==
+                        Defs::ERROR_OPENLCB_TIMEOUT
+                    ? (int)Defs::OPENMRN_TIMEOUT
+                    : (int)Defs::ERROR_REJECTED);
+        }
+        payloadOffset_ += len;
+    }
+    streamSender_->close(this);
+    return wait_and_call(STATE(write_stream_closed));
+}
+
+StateFlowBase::Action MemoryConfigClient::write_stream_closed()
+{
+    if (streamSender_->state() != StreamSender::CLOSED)
+    {
+        return handle_write_error(Defs::OPENMRN_TIMEOUT);
+    }
+    if (responseCode_ & DatagramClient::OPERATION_PENDING)
+    {
+        isWaitingForTimer_ = 1;
+        return sleep_and_call(
+            &timer_, SEC_TO_NSEC(3), STATE(write_stream_response));
+    }
+    return call_immediately(STATE(write_stream_response));
+}
+
+StateFlowBase::Action MemoryConfigClient::write_stream_response()
+{
+    isWaitingForTimer_ = 0;
+    int error = check_stream_response(
+        MemoryConfigDefs::COMMAND_WRITE_STREAM_REPLY,
+        MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED);
+    if (error)
+    {
+        return handle_write_error(error);
+    }
+    return call_immediately(STATE(finish_write));
+}
+
+int MemoryConfigClient::check_stream_response(uint8_t reply_cmd, uint8_t failed_cmd)
+{
+    if (responseCode_ & DatagramClient::OPERATION_PENDING)
+    {
+        return Defs::OPENMRN_TIMEOUT;
+    }
+    size_t len = responsePayload_.size();
+    const uint8_t *bytes =
+        MemoryConfigDefs::payload_bytes(responsePayload_);
+    if (!MemoryConfigDefs::payload_min_length_check(responsePayload_, 0))
+    {
+        return Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+    }
+    unsigned ofs = MemoryConfigDefs::get_payload_offset(responsePayload_);
+    uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
+    if (MemoryConfigDefs::get_address(responsePayload_) !=
+            request()->address ||
+        MemoryConfigDefs::get_space(responsePayload_) !=
+            request()->memory_space)
+    {
+        return Defs::ERROR_OUT_OF_ORDER;
+    }
+    if (cmd == failed_cmd)
+    {
+        if (len < ofs + 2)
+        {
+            return Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+        }
+        return (bytes[ofs] << 8) | bytes[ofs + 1];
+    }
+    if (cmd != reply_cmd)
+    {
+        return Defs::ERROR_UNIMPLEMENTED;
+    }
+    return 0;
+}
+
+StateFlowBase::Action MemoryConfigClient::do_meta_request()
+{
+    dgClient_ = full_allocation_result(dg_service()->client_allocator());
+    // Meta requests do not have a response, so we are not registering the
+    // response flow here.
+    return allocate_and_call(
+        dg_service()->iface()->dispatcher(), STATE(send_meta_datagram));
+}
+
+StateFlowBase::Action MemoryConfigClient::send_meta_datagram()
+{
+    auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+    b->set_done(bn_.reset(this));
+    b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
+        std::move(request()->payload));
+    isWaitingForTimer_ = 0;
+    dgClient_->write_datagram(b);
+    return wait_and_call(STATE(meta_complete));
+}
+
+StateFlowBase::Action MemoryConfigClient::meta_complete()
+{
+    auto result = dgClient_->result();
+    dg_service()->client_allocator()->typed_insert(dgClient_);
+    dgClient_ = nullptr;
+    result &= DatagramClient::RESPONSE_CODE_MASK;
+    if (result == DatagramClient::DST_REBOOT ||
+        result == DatagramClient::OPERATION_SUCCESS)
+    {
+        return return_ok();
+    }
+    else
+    {
+        return return_with_error(result);
+    }
+}
+
+StateFlowBase::Action MemoryConfigClient::ResponseFlow::entry()
+{
+    if (!parent_->node_->iface()->matching_node(
+            parent_->request()->dst, message()->data()->src))
+    {
+        return respond_reject(Defs::ERROR_OUT_OF_ORDER);
+    }
+    if (size() < 2)
+    {
+        return respond_reject(
+            Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+    }
+    auto* bytes = payload();
+    if (bytes[1] == MemoryConfigDefs::COMMAND_OPTIONS_REPLY)
+    {
+        if (!parent_->isProbing_)
+        {
+            return respond_reject(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
+        }
+        return take_response();
+    }
+    uint8_t cmd = bytes[1] & ~3;
+    switch (cmd)
+    {
+        case MemoryConfigDefs::COMMAND_READ_REPLY:
+        case MemoryConfigDefs::COMMAND_READ_FAILED:
+            if (!is_read())
+            {
+                break;
+            }
+            return take_segment_reply();
+        case MemoryConfigDefs::COMMAND_READ_STREAM_REPLY:
+        case MemoryConfigDefs::COMMAND_READ_STREAM_FAILED:
+        {
+            if (!is_read())
+            {
+                break;
+            }
+            return take_response();
+        }
+        case MemoryConfigDefs::COMMAND_WRITE_REPLY:
+        case MemoryConfigDefs::COMMAND_WRITE_FAILED:
+            if (parent_->request()->cmd !=
+                MemoryConfigClientRequest::CMD_WRITE)
+            {
+                break;
+            }
+            return take_segment_reply();
+        case MemoryConfigDefs::COMMAND_WRITE_STREAM_REPLY:
+        case MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED:
+            if (parent_->request()->cmd !=
+                MemoryConfigClientRequest::CMD_WRITE)
+            {
+                break;
+            }
+            return take_response();
+    }
+    return respond_reject(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
+}
+
+bool MemoryConfigClient::ResponseFlow::is_read()
+{
+    return parent_->request()->cmd ==
+        MemoryConfigClientRequest::CMD_READ ||
+        parent_->request()->cmd ==
+        MemoryConfigClientRequest::CMD_READ_PART;
+}
+
+StateFlowBase::Action MemoryConfigClient::ResponseFlow::take_segment_reply()
+{
+    int error = parent_->segment_reply(message()->data()->payload);
+    if (error)
+    {
+        return respond_reject(error);
+    }
+    return respond_ok(0);
+}
+
+StateFlowBase::Action MemoryConfigClient::ResponseFlow::take_response()
+{
+    parent_->responseCode_ = 0;
+    message()->data()->payload.swap(parent_->responsePayload_);
+    if (parent_->isWaitingForTimer_)
+    {
+        parent_->timer_.trigger();
+    }
+    return respond_ok(0);
+}
+
+} // namespace openlcb
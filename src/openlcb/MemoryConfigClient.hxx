@@ -35,9 +35,13 @@
 #ifndef _OPENLCB_MEMORYCONFIGCLIENT_HXX_
 #define _OPENLCB_MEMORYCONFIGCLIENT_HXX_
 
+#include <functional>
+#include <memory>
+
 #include "executor/CallableFlow.hxx"
 #include "openlcb/MemoryConfig.hxx"
 #include "openlcb/DatagramHandlerDefault.hxx"
+#include "openlcb/StreamService.hxx"
 
 namespace openlcb
 {
@@ -92,6 +96,7 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         address = 0;
         size = 0xffffffffu;
         payload.clear();
+        reset_transfer();
     }
 
     /// Sets up a command to read a part of a memory space.
@@ -110,6 +115,7 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         this->address = offset;
         this->size = size;
         payload.clear();
+        reset_transfer();
     }
 
     /// Sets up a command to read a part of a memory space.
@@ -128,6 +134,7 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         this->address = offset;
         this->size = size;
         payload = std::move(data);
+        reset_transfer();
     }
 
     /// Sets up a command to send an Update Complete request to a remote node.
@@ -194,6 +201,14 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         payload.push_back(space);
     }
 
+    /// Sets the transfer options to their defaults.
+    void reset_transfer()
+    {
+        window = 1;
+        retries = 0;
+        progress = nullptr;
+    }
+
     enum Command : uint8_t
     {
         CMD_READ,
@@ -208,16 +223,58 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
     /// Node to send the request to.
     NodeHandle dst;
     string payload;
+    /// Number of read or write datagrams that may be outstanding at the same
+    /// time. Larger values hide the round-trip latency to the target. Set
+    /// after reset(); at most MemoryConfigClient::MAX_WINDOW.
+    uint8_t window;
+    /// How many times a read or write datagram is re-sent when its reply
+    /// times out or reports a temporary error. By default the request fails
+    /// instead; a re-sent write may be applied twice by the target. Set after
+    /// reset(); at most MemoryConfigClient::MAX_RETRIES.
+    uint8_t retries;
+    /// If set, called with the number of bytes read or written so far every
+    /// time a datagram completes. Set after reset().
+    std::function<void(unsigned)> progress;
 };
 
+/// Flow that performs memory config requests towards a remote node.
+///
+/// If a stream service is given, reads and writes longer than one datagram
+/// are performed with the read stream / write stream commands when the target
+/// node advertises stream support in its options reply. The options are
+/// queried once per target node. When the target does not support streams,
+/// or rejects the stream command temporarily, the request is performed with
+/// datagrams.
 class MemoryConfigClient : public CallableFlow<MemoryConfigClientRequest>
 {
 public:
-    MemoryConfigClient(Node *node, MemoryConfigHandler *memcfg)
+    /// Stream ID on which we receive the data of read stream commands.
+    static constexpr uint8_t READ_STREAM_ID = 0x10;
+    /// Largest number of read or write datagrams that can be outstanding at
+    /// the same time for a request.
+    static constexpr unsigned MAX_WINDOW = 8;
+    /// Largest value accepted for MemoryConfigClientRequest::retries.
+    static constexpr unsigned MAX_RETRIES = 127;
+
+    /// Constructor.
+    /// @param node local node to send the requests from
+    /// @param memcfg memory config handler of the local node
+    /// @param streams if not null, stream service of the node's interface;
+    /// enables stream transfers.
+    MemoryConfigClient(Node *node, MemoryConfigHandler *memcfg,
+        StreamService *streams = nullptr)
         : CallableFlow<MemoryConfigClientRequest>(memcfg->dg_service())
         , node_(node)
         , memoryConfigHandler_(memcfg)
+        , isProbing_(0)
+        , probeValid_(0)
+        , probeHasStreams_(0)
     {
+        if (streams)
+        {
+            streamSender_.reset(new StreamSender(streams));
+            streamReceiver_.reset(new StreamReceiver(streams));
+        }
     }
 
     /// These result codes are written into request()->resultCode during and as
@@ -232,319 +289,124 @@ public:
     };
 
 private:
-    Action entry() override
-    {
-        request()->resultCode = OPERATION_PENDING;
-        switch (request()->cmd)
-        {
-            case MemoryConfigClientRequest::CMD_READ:
-            case MemoryConfigClientRequest::CMD_READ_PART:
-                return allocate_and_call(
-                    STATE(do_read), dg_service()->client_allocator());
-            case MemoryConfigClientRequest::CMD_WRITE:
-                return allocate_and_call(
-                    STATE(do_write), dg_service()->client_allocator());
-            case MemoryConfigClientRequest::CMD_META_REQUEST:
-                return allocate_and_call(
-                    STATE(do_meta_request), dg_service()->client_allocator());
-            default:
-                break;
-        }
-        return return_with_error(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
-    }
+    Action entry() override;
 
-    Action do_read()
-    {
-        dgClient_ = full_allocation_result(dg_service()->client_allocator());
-        offset_ = request()->address;
-        memoryConfigHandler_->set_client(&responseFlow_);
-        return call_immediately(STATE(send_next_read));
-    }
+    Action do_read();
 
-    Action send_next_read()
-    {
-        return allocate_and_call(
-            dg_service()->iface()->dispatcher(), STATE(send_read_datagram));
-    }
+    Action send_next_read();
 
-    Action send_read_datagram()
-    {
-        auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
-        b->set_done(bn_.reset(this));
-        unsigned sz = request()->size > 64 ? 64 : request()->size;
-        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
-            MemoryConfigDefs::read_datagram(
-                             request()->memory_space, offset_, sz));
-        if (request()->size < 0xffffffffu)
-        {
-            request()->size -= sz;
-        }
-        isWaitingForTimer_ = 0;
-        responseCode_ = DatagramClient::OPERATION_PENDING;
-        dgClient_->write_datagram(b);
-        return wait_and_call(STATE(read_complete));
-    }
+    Action handle_read_error(int error);
 
-    Action read_complete()
-    {
-        if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
-        {
-            // some error occurred.
-            return handle_read_error(dgClient_->result());
-        }
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            isWaitingForTimer_ = 1;
-            return sleep_and_call(
-                &timer_, SEC_TO_NSEC(3), STATE(read_response_timeout));
-        }
-        else
-        {
-            return call_immediately(STATE(read_response_timeout));
-        }
-    }
+    void cleanup_read();
 
-    Action read_response_timeout()
-    {
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            return handle_read_error(Defs::OPENMRN_TIMEOUT);
-        }
-        size_t len = responsePayload_.size();
-        const uint8_t *bytes =
-            MemoryConfigDefs::payload_bytes(responsePayload_);
-        if (!MemoryConfigDefs::payload_min_length_check(responsePayload_, 0))
-        {
-            LOG(INFO, "Memory Config client: response datagram payload not "
-                      "long enough");
-            return handle_read_error(
-                Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-        }
-        unsigned ofs = MemoryConfigDefs::get_payload_offset(responsePayload_);
-        unsigned address = MemoryConfigDefs::get_address(responsePayload_);
-        uint8_t space = MemoryConfigDefs::get_space(responsePayload_);
-        uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
-        if (address != offset_)
-        {
-            return handle_read_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (space != request()->memory_space)
-        {
-            return handle_read_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (cmd == MemoryConfigDefs::COMMAND_READ_FAILED)
-        {
-            if (len < ofs + 2)
-            {
-                return handle_read_error(
-                    Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-            }
-            uint16_t error = bytes[ofs++];
-            error <<= 8;
-            error |= bytes[ofs];
-            return handle_read_error(error);
-        }
-        if (cmd != MemoryConfigDefs::COMMAND_READ_REPLY)
-        {
-            return handle_read_error(Defs::ERROR_UNIMPLEMENTED);
-        }
-        unsigned dlen = len - ofs;
-        request()->payload.append((char *)(bytes + ofs), dlen);
-        offset_ += dlen;
-        if ((dlen < 64) || (request()->size == 0))
-        {
-            return call_immediately(STATE(finish_read));
-        }
-        return call_immediately(STATE(send_next_read));
-    }
+    Action finish_read();
 
-    Action handle_read_error(int error) {
-        if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS) {
-            return finish_read();
-        }
-        cleanup_read();
-        return return_with_error(error);
-    }
+    Action do_write();
 
-    void cleanup_read() {
-        responsePayload_.clear();
-        dg_service()->client_allocator()->typed_insert(dgClient_);
-        memoryConfigHandler_->clear_client(&responseFlow_);
-        dgClient_ = nullptr;
-    }
+    Action send_next_write();
 
-    Action finish_read() {
-        cleanup_read();
-        return return_ok();
-    }
+    Action handle_write_error(int error);
 
-    Action do_write()
-    {
-        dgClient_ = full_allocation_result(dg_service()->client_allocator());
-        offset_ = request()->address;
-        payloadOffset_ = 0;
-        memoryConfigHandler_->set_client(&responseFlow_);
-        return call_immediately(STATE(send_next_write));
-    }
+    void cleanup_write();
 
-    Action send_next_write()
-    {
-        return allocate_and_call(
-            dg_service()->iface()->dispatcher(), STATE(send_write_datagram));
-    }
+    Action finish_write();
 
-    Action send_write_datagram()
-    {
-        auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
-        b->set_done(bn_.reset(this));
-        unsigned sz = request()->payload.size() - payloadOffset_;
-        if (sz > MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES)
-        {
-            sz = MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES;
-        }
-        writeLength_ = sz;
-        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
-            MemoryConfigDefs::write_datagram(request()->memory_space, offset_,
-                             request()->payload.substr(payloadOffset_, sz)));
-        isWaitingForTimer_ = 0;
-        responseCode_ = DatagramClient::OPERATION_PENDING;
-        dgClient_->write_datagram(b);
-        return wait_and_call(STATE(write_complete));
-    }
+    /// Sets up the segment table for transferring the current read or write
+    /// request with datagrams, starting at offset_.
+    /// @param size number of bytes to transfer.
+    void start_segments(uint32_t size);
 
-    Action write_complete()
-    {
-        if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
-        {
-            // some error occurred.
-            return handle_write_error(dgClient_->result());
-        }
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            isWaitingForTimer_ = 1;
-            return sleep_and_call(
-                &timer_, SEC_TO_NSEC(3), STATE(write_response_timeout));
-        }
-        else
-        {
-            return call_immediately(STATE(write_response_timeout));
-        }
-    }
+    /// @return the number of datagrams that may be outstanding for the current
+    /// request.
+    unsigned window();
 
-    Action write_response_timeout()
-    {
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            return handle_write_error(Defs::OPENMRN_TIMEOUT);
-        }
-        size_t len = responsePayload_.size();
-        const uint8_t *bytes =
-            MemoryConfigDefs::payload_bytes(responsePayload_);
-        if (!MemoryConfigDefs::payload_min_length_check(responsePayload_, 0))
-        {
-            LOG(INFO, "Memory Config client: response datagram payload not "
-                      "long enough");
-            return handle_write_error(
-                Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-        }
-        unsigned ofs = MemoryConfigDefs::get_payload_offset(responsePayload_);
-        unsigned address = MemoryConfigDefs::get_address(responsePayload_);
-        uint8_t space = MemoryConfigDefs::get_space(responsePayload_);
-        uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
-        if (address != offset_)
-        {
-            return handle_write_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (space != request()->memory_space)
-        {
-            return handle_write_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (cmd == MemoryConfigDefs::COMMAND_WRITE_FAILED)
-        {
-            if (len < ofs + 2)
-            {
-                return handle_write_error(
-                    Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-            }
-            uint16_t error = bytes[ofs++];
-            error <<= 8;
-            error |= bytes[ofs];
-            return handle_write_error(error);
-        }
-        if (cmd != MemoryConfigDefs::COMMAND_WRITE_REPLY)
-        {
-            return handle_write_error(Defs::ERROR_UNIMPLEMENTED);
-        }
-        // write success.
-        offset_ += writeLength_;
-        payloadOffset_ += writeLength_;
-        if (payloadOffset_ >= request()->payload.size())
-        {
-            return call_immediately(STATE(finish_write));
-        }
-        return call_immediately(STATE(send_next_write));
-    }
+    /// @return how many times a segment of the current request may be
+    /// re-sent.
+    unsigned max_retries();
 
-    Action handle_write_error(int error)
-    {
-        if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
-        {
-            return finish_write();
-        }
-        cleanup_write();
-        return return_with_error(error);
-    }
+    /// Picks the next segment to send: a segment that needs to be re-sent, or
+    /// a new one if the window has space. @return true if there is a segment
+    /// to send, its parameters are then in sendAddress_ and sendSize_.
+    bool next_segment();
 
-    void cleanup_write()
-    {
-        responsePayload_.clear();
-        dg_service()->client_allocator()->typed_insert(dgClient_);
-        memoryConfigHandler_->clear_client(&responseFlow_);
-        dgClient_ = nullptr;
-    }
+    /// Sends read or write datagrams until the window is full, then waits for
+    /// the replies.
+    Action fill_window();
 
-    Action finish_write()
-    {
-        cleanup_write();
-        return return_ok();
-    }
+    Action send_segment();
 
-    Action do_meta_request()
-    {
-        dgClient_ = full_allocation_result(dg_service()->client_allocator());
-        // Meta requests do not have a response, so we are not registering the
-        // response flow here.
-        return allocate_and_call(
-            dg_service()->iface()->dispatcher(), STATE(send_meta_datagram));
-    }
+    Action segment_sent();
 
-    Action send_meta_datagram()
-    {
-        auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
-        b->set_done(bn_.reset(this));
-        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
-            std::move(request()->payload));
-        isWaitingForTimer_ = 0;
-        dgClient_->write_datagram(b);
-        return wait_and_call(STATE(meta_complete));
-    }
+    /// Called when a reply arrived or no reply arrived for a while.
+    Action segment_wait_done();
 
-    Action meta_complete()
-    {
-        auto result = dgClient_->result();
-        dg_service()->client_allocator()->typed_insert(dgClient_);
-        dgClient_ = nullptr;
-        result &= DatagramClient::RESPONSE_CODE_MASK;
-        if (result == DatagramClient::DST_REBOOT ||
-            result == DatagramClient::OPERATION_SUCCESS)
-        {
-            return return_ok();
-        }
-        else
-        {
-            return return_with_error(result);
-        }
-    }
+    /// Called when all segments have their reply or the transfer failed.
+    Action segments_done();
+
+    /// Processes a read or write reply datagram for one of the outstanding
+    /// segments. Called by the response flow.
+    /// @param payload contents of the reply datagram.
+    /// @return 0 if the reply was taken, otherwise the error code with which
+    /// the reply datagram should be rejected.
+    int segment_reply(const string &payload);
+
+    /// Tells the caller how far the transfer is.
+    void report_progress();
+
+    /// Wakes up the main flow if it is waiting for segment replies.
+    void wakeup_segments();
+
+    /// Decides whether the current read or write request can go via a
+    /// stream. Queries the options of the target node if we do not know them
+    /// yet.
+    Action check_stream_support();
+
+    Action send_options_datagram();
+
+    Action options_datagram_complete();
+
+    Action options_response();
+
+    Action stream_support_known();
+
+    /// @return true if a stream command was rejected in a way that the
+    /// request should be retried with datagrams.
+    /// @param result result code of the datagram client.
+    bool stream_fallback(int result);
+
+    Action send_read_stream_datagram();
+
+    Action read_stream_datagram_complete();
+
+    Action read_stream_response();
+
+    /// Appends everything the stream has to the result.
+    Action read_stream_data();
+
+    Action read_stream_wakeup();
+
+    Action send_write_stream_datagram();
+
+    Action write_stream_datagram_complete();
+
+    /// Pushes the payload into the stream, then closes it.
+    Action write_stream_data();
+
+    Action write_stream_closed();
+
+    Action write_stream_response();
+
+    /// Parses the reply datagram of a read or write stream command.
+    /// @param reply_cmd command byte of the success reply
+    /// @param failed_cmd command byte of the failure reply
+    /// @return 0 on success, otherwise the error code.
+    int check_stream_response(uint8_t reply_cmd, uint8_t failed_cmd);
+
+    Action do_meta_request();
+
+    Action send_meta_datagram();
+
+    Action meta_complete();
 
     class ResponseFlow : public DefaultDatagramHandler
     {
@@ -556,59 +418,21 @@ private:
         }
 
     private:
-        Action entry() override
-        {
-            if (!parent_->node_->iface()->matching_node(
-                    parent_->request()->dst, message()->data()->src))
-            {
-                return respond_reject(Defs::ERROR_OUT_OF_ORDER);
-            }
-            if (size() < 2)
-            {
-                return respond_reject(
-                    Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-            }
-            auto* bytes = payload();
-            uint8_t cmd = bytes[1] & ~3;
-            switch (cmd)
-            {
-                case MemoryConfigDefs::COMMAND_READ_REPLY:
-                case MemoryConfigDefs::COMMAND_READ_FAILED:
-                {
-                    if (parent_->request()->cmd !=
-                            MemoryConfigClientRequest::CMD_READ &&
-                        parent_->request()->cmd !=
-                            MemoryConfigClientRequest::CMD_READ_PART)
-                    {
-                        break;
-                    }
-                    parent_->responseCode_ = 0;
-                    message()->data()->payload.swap(parent_->responsePayload_);
-                    if (parent_->isWaitingForTimer_)
-                    {
-                        parent_->timer_.trigger();
-                    }
-                    return respond_ok(0);
-                }
-                case MemoryConfigDefs::COMMAND_WRITE_REPLY:
-                case MemoryConfigDefs::COMMAND_WRITE_FAILED:
-                    if (parent_->request()->cmd !=
-                        MemoryConfigClientRequest::CMD_WRITE)
-                    {
-                        break;
-                    }
-                    parent_->responseCode_ = 0;
-                    message()->data()->payload.swap(parent_->responsePayload_);
-                    if (parent_->isWaitingForTimer_)
-                    {
-                        parent_->timer_.trigger();
-                    }
-                    return respond_ok(0);
-            }
-            return respond_reject(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
-        }
+        Action entry() override;
+
+        /// @return true if the parent is executing a read request.
+        bool is_read();
+
+        /// Hands over a read or write datagram reply to the segment table of
+        /// the parent flow.
+        Action take_segment_reply();
+
+        /// Hands over the response datagram to the parent flow and
+        /// acknowledges it.
+        Action take_response();
+
     private:
-        MemoryConfigClient *parent_;        
+        MemoryConfigClient *parent_;
     };
 
     DatagramService *dg_service()
@@ -627,12 +451,38 @@ private:
     ResponseFlow responseFlow_{this};
     /// Notify helper.
     BarrierNotifiable bn_;
-    /// Next byte to read from the memory space.
+    /// Next byte of the memory space to read or write.
     uint32_t offset_;
     /// Next byte in the payload to write.
     uint32_t payloadOffset_;
-    /// How many bytes we wrote in this datagram.
-    uint16_t writeLength_;
+
+    /// One read or write datagram of a request that has no reply yet.
+    struct Segment
+    {
+        /// Address of the first byte.
+        uint32_t address;
+        /// Number of bytes.
+        uint8_t size;
+        /// How many times this segment was re-sent.
+        uint8_t retries : 7;
+        /// 1 if the segment is waiting to be (re-)sent.
+        uint8_t needsSend : 1;
+    };
+    /// Outstanding segments of the current request.
+    Segment segments_[MAX_WINDOW];
+    /// Number of valid entries in segments_.
+    uint8_t numSegments_{0};
+    /// Number of bytes in the segment being sent.
+    uint8_t sendSize_;
+    /// Address of the segment being sent.
+    uint32_t sendAddress_;
+    /// End of the transfer (exclusive). Lowered when the target reports the
+    /// end of the memory space.
+    uint32_t endAddress_;
+    /// Number of bytes read or written so far.
+    uint32_t bytesDone_;
+    /// Error that terminates the current request, 0 if none.
+    int segmentError_;
     /// timing helper
     StateFlowTimer timer_{this};
     /// The data that came back from reading.
@@ -641,6 +491,43 @@ private:
     int responseCode_;
     /// 1 if we are pending on the timer.
     uint8_t isWaitingForTimer_ : 1;
+    /// 1 if we are waiting for an options reply.
+    uint8_t isProbing_ : 1;
+    /// 1 if probedNode_ and probeHasStreams_ are valid.
+    uint8_t probeValid_ : 1;
+    /// 1 if probedNode_ supports stream transfers.
+    uint8_t probeHasStreams_ : 1;
+    /// Last node whose options we queried.
+    NodeHandle probedNode_;
+
+    /// Wakes up the flow from a timed sleep when stream data arrives.
+    class StreamWakeup : public Notifiable
+    {
+    public:
+        /// @param parent flow to wake up.
+        StreamWakeup(MemoryConfigClient *parent)
+            : parent_(parent)
+        {
+        }
+
+        void notify() override
+        {
+            parent_->timer_.ensure_triggered();
+        }
+
+    private:
+        /// Flow to wake up.
+        MemoryConfigClient *parent_;
+    };
+
+    /// Notified by the stream receiver when there is data to read.
+    StreamWakeup streamWakeup_{this};
+    /// Sends the data of write stream commands. Null if streams are not
+    /// enabled.
+    std::unique_ptr<StreamSender> streamSender_;
+    /// Receives the data of read stream commands. Null if streams are not
+    /// enabled.
+    std::unique_ptr<StreamReceiver> streamReceiver_;
 };
 
 } // namespace openlcb
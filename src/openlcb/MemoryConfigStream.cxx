@@ -0,0 +1,507 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MemoryConfigStream.cxx
+ *
+ * Server side of the read stream and write stream commands of the Memory
+ * Configuration Protocol.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/MemoryConfigStream.hxx"
+
+#include <errno.h>
+
+#include <algorithm>
+
+#include "openlcb/StreamService.hxx"
+
+namespace openlcb
+{
+
+/// Runs one stream transfer at a time on behalf of the
+/// MemoryConfigStreamServer: pumps the memory space into a stream for reads,
+/// and the stream into the memory space for writes, then sends the reply
+/// datagram.
+class MemoryConfigStreamServer::Session : public StateFlowBase
+{
+public:
+    /// @param dg_service datagram service to send the replies with.
+    /// @param streams stream service to transfer the data with.
+    Session(DatagramService *dg_service, StreamService *streams)
+        : StateFlowBase(dg_service)
+        , sender_(streams)
+        , receiver_(streams)
+        , wakeup_(this)
+        , busy_(0)
+        , isRead_(0)
+    {
+    }
+
+    /// @return true if a transfer is in progress.
+    bool busy()
+    {
+        return busy_;
+    }
+
+    /// Starts sending a memory space to a remote node.
+    /// @param node local node that received the command
+    /// @param remote requester
+    /// @param space memory space to read
+    /// @param header address and space fields of the command
+    /// @param address first byte to send
+    /// @param count number of bytes to send
+    /// @param dst_stream_id stream ID on the requester
+    void start_read(Node *node, NodeHandle remote, MemorySpace *space,
+        const string &header, uint32_t address, uint32_t count,
+        uint8_t dst_stream_id)
+    {
+        start(node, remote, space, header, address);
+        remaining_ = count;
+        dstStreamId_ = dst_stream_id;
+        isRead_ = 1;
+        start_flow(STATE(open_read_stream));
+    }
+
+    /// Starts listening for a stream from the remote node and writing its
+    /// contents to a memory space.
+    /// @param node local node that received the command
+    /// @param remote requester
+    /// @param space memory space to write
+    /// @param header address and space fields of the command
+    /// @param address first byte to write
+    void start_write(Node *node, NodeHandle remote, MemorySpace *space,
+        const string &header, uint32_t address)
+    {
+        start(node, remote, space, header, address);
+        isRead_ = 0;
+        // Starts listening before the command is acknowledged, so that the
+        // initiate request of the requester finds us.
+        receiver_.start(node, WRITE_STREAM_ID,
+            MemoryConfigDefs::STREAM_BUFFER_BYTES, nullptr);
+        start_flow(STATE(read_stream));
+    }
+
+private:
+    /// Number of bytes moved between the stream and the memory space at once.
+    static constexpr unsigned CHUNK_SIZE = 64;
+
+    /// Saves the common parameters of a transfer.
+    void start(Node *node, NodeHandle remote, MemorySpace *space,
+        const string &header, uint32_t address)
+    {
+        HASSERT(!busy_);
+        busy_ = 1;
+        node_ = node;
+        remote_ = remote;
+        space_ = space;
+        reply_ = header;
+        address_ = address;
+        bufLen_ = 0;
+        bufOfs_ = 0;
+        error_ = 0;
+    }
+
+    /// Sets the command byte of the reply, keeping the space flags of the
+    /// original command.
+    /// @param cmd base command byte of the reply.
+    void set_reply_command(uint8_t cmd)
+    {
+        reply_[1] = cmd | (reply_[1] & MemoryConfigDefs::COMMAND_FLAG_MASK);
+    }
+
+    /// Appends the error code to the reply. @param cmd failure command byte.
+    void set_failed_reply(uint8_t cmd)
+    {
+        set_reply_command(cmd);
+        reply_.push_back(error_ >> 8);
+        reply_.push_back(error_ & 0xff);
+    }
+
+    Action open_read_stream()
+    {
+        sender_.start_stream(node_, remote_,
+            MemoryConfigDefs::STREAM_BUFFER_BYTES, this, dstStreamId_);
+        return wait_and_call(STATE(read_stream_open));
+    }
+
+    Action read_stream_open()
+    {
+        if (sender_.state() != StreamSender::OPEN)
+        {
+            LOG(INFO, "MemoryConfig: could not open stream to %012" PRIx64
+                      ": 0x%04x",
+                remote_.id, sender_.error());
+            switch (sender_.error())
+            {
+                case Defs::ERROR_OPENLCB_TIMEOUT:
+                case Defs::ERROR_TEMPORARY:
+                    // No reply, or no free stream ID on our side.
+                    error_ = sender_.error();
+                    break;
+                default:
+                    error_ = Defs::ERROR_PERMANENT;
+            }
+            set_failed_reply(MemoryConfigDefs::COMMAND_READ_STREAM_FAILED);
+            return call_immediately(STATE(send_reply));
+        }
+        set_reply_command(MemoryConfigDefs::COMMAND_READ_STREAM_REPLY);
+        reply_.push_back(sender_.src_stream_id());
+        reply_.push_back(sender_.dst_stream_id());
+        reply_.push_back(0xff & (remaining_ >> 24));
+        reply_.push_back(0xff & (remaining_ >> 16));
+        reply_.push_back(0xff & (remaining_ >> 8));
+        reply_.push_back(0xff & (remaining_));
+        return call_immediately(STATE(send_reply));
+    }
+
+    /// Fills the buffer from the memory space.
+    Action read_space()
+    {
+        if (!remaining_ && !bufLen_)
+        {
+            sender_.close(this);
+            return wait_and_call(STATE(finish));
+        }
+        MemorySpace::errorcode_t error = 0;
+        size_t len = std::min(remaining_, (uint32_t)(CHUNK_SIZE - bufLen_));
+        len = space_->read(address_, buf_ + bufLen_, len, &error, this);
+        address_ += len;
+        remaining_ -= len;
+        bufLen_ += len;
+        if (error == MemorySpace::ERROR_AGAIN)
+        {
+            return wait();
+        }
+        if (error || !len)
+        {
+            // Unexpected end of the space or read error. The requester will
+            // see a stream shorter than announced.
+            LOG(WARNING, "MemoryConfig: stream read error 0x%04x at %08x",
+                error, (unsigned)address_);
+            remaining_ = 0;
+        }
+        if (remaining_ && bufLen_ < CHUNK_SIZE)
+        {
+            return again();
+        }
+        bufOfs_ = 0;
+        return call_immediately(STATE(write_stream));
+    }
+
+    /// Sends the buffer to the stream.
+    Action write_stream()
+    {
+        if (bufOfs_ >= bufLen_)
+        {
+            bufLen_ = 0;
+            return call_immediately(STATE(read_space));
+        }
+        ssize_t len = sender_.write(buf_ + bufOfs_, bufLen_ - bufOfs_, this);
+        if (len < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                return wait();
+            }
+            LOG(WARNING, "MemoryConfig: stream to %012" PRIx64 " failed.",
+                remote_.id);
+            return call_immediately(STATE(finish));
+        }
+        bufOfs_ += len;
+        return again();
+    }
+
+    /// Fills the buffer from the incoming stream.
+    Action read_stream()
+    {
+        ssize_t len = receiver_.read(buf_, CHUNK_SIZE, &wakeup_);
+        if (len < 0)
+        {
+            return sleep_and_call(&timer_, STREAM_RESPONSE_TIMEOUT_NSEC,
+                STATE(read_stream_wakeup));
+        }
+        if (len == 0)
+        {
+            if (error_)
+            {
+                set_failed_reply(
+                    MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED);
+            }
+            else
+            {
+                set_reply_command(
+                    MemoryConfigDefs::COMMAND_WRITE_STREAM_REPLY);
+            }
+            return call_immediately(STATE(send_reply));
+        }
+        if (error_)
+        {
+            // Discards the rest of the stream after a write error.
+            return again();
+        }
+        bufLen_ = len;
+        bufOfs_ = 0;
+        return call_immediately(STATE(write_space));
+    }
+
+    Action read_stream_wakeup()
+    {
+        if (timer_.is_triggered())
+        {
+            return call_immediately(STATE(read_stream));
+        }
+        LOG(INFO, "MemoryConfig: write stream from %012" PRIx64 " timed out.",
+            remote_.id);
+        error_ = Defs::ERROR_OPENLCB_TIMEOUT;
+        return call_immediately(STATE(write_failed));
+    }
+
+    /// Writes the buffer to the memory space.
+    Action write_space()
+    {
+        MemorySpace::errorcode_t error = 0;
+        size_t len = space_->write(
+            address_, buf_ + bufOfs_, bufLen_ - bufOfs_, &error, this);
+        address_ += len;
+        bufOfs_ += len;
+        if (error == MemorySpace::ERROR_AGAIN)
+        {
+            return wait();
+        }
+        if (error)
+        {
+            // The stream has no way to stop the sender; we read it to the
+            // end and report the error afterwards.
+            error_ = error;
+            return call_immediately(STATE(read_stream));
+        }
+        if (bufOfs_ < bufLen_)
+        {
+            return again();
+        }
+        return call_immediately(STATE(read_stream));
+    }
+
+    Action write_failed()
+    {
+        receiver_.stop();
+        set_failed_reply(MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED);
+        return call_immediately(STATE(send_reply));
+    }
+
+    Action send_reply()
+    {
+        return allocate_and_call(
+            STATE(reply_client_allocated), dg_service()->client_allocator());
+    }
+
+    Action reply_client_allocated()
+    {
+        dgClient_ = full_allocation_result(dg_service()->client_allocator());
+        return allocate_and_call(
+            dg_service()->iface()->dispatcher(), STATE(reply_allocated));
+    }
+
+    Action reply_allocated()
+    {
+        auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
+        b->set_done(bn_.reset(this));
+        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), remote_,
+            EMPTY_PAYLOAD);
+        b->data()->payload.swap(reply_);
+        dgClient_->write_datagram(b);
+        return wait_and_call(STATE(reply_sent));
+    }
+
+    Action reply_sent()
+    {
+        if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
+        {
+            LOG(WARNING,
+                "MemoryConfig: Failed to send stream reply datagram. error "
+                "code %x",
+                (unsigned)dgClient_->result());
+        }
+        dg_service()->client_allocator()->typed_insert(dgClient_);
+        dgClient_ = nullptr;
+        if (isRead_ && !error_)
+        {
+            return call_immediately(STATE(read_space));
+        }
+        return call_immediately(STATE(finish));
+    }
+
+    Action finish()
+    {
+        busy_ = 0;
+        return exit();
+    }
+
+    DatagramService *dg_service()
+    {
+        return static_cast<DatagramService *>(service());
+    }
+
+    /// Wakes up the flow from a timed sleep when stream data arrives.
+    class Wakeup : public Notifiable
+    {
+    public:
+        /// @param parent flow to wake up.
+        Wakeup(Session *parent)
+            : parent_(parent)
+        {
+        }
+
+        void notify() override
+        {
+            parent_->timer_.ensure_triggered();
+        }
+
+    private:
+        /// Flow to wake up.
+        Session *parent_;
+    };
+
+    /// Sends the data of read stream commands.
+    StreamSender sender_;
+    /// Receives the data of write stream commands.
+    StreamReceiver receiver_;
+    /// Notified by the receiver when there is data to read.
+    Wakeup wakeup_;
+    /// Timeout helper.
+    StateFlowTimer timer_{this};
+    /// Helper for sending the reply datagram.
+    BarrierNotifiable bn_;
+    /// Datagram client for the reply.
+    DatagramClient *dgClient_ {nullptr};
+    /// Local node of the transfer.
+    Node *node_;
+    /// Requester of the transfer.
+    NodeHandle remote_;
+    /// Memory space being transferred.
+    MemorySpace *space_;
+    /// Reply datagram payload; starts with the command and address bytes.
+    string reply_;
+    /// Next address to read or write in the memory space.
+    uint32_t address_;
+    /// Number of bytes still to read from the memory space.
+    uint32_t remaining_;
+    /// Error code to send back.
+    uint16_t error_;
+    /// Number of valid bytes in buf_.
+    uint8_t bufLen_;
+    /// Number of bytes of buf_ that were already consumed.
+    uint8_t bufOfs_;
+    /// Stream ID on the requester for read transfers.
+    uint8_t dstStreamId_;
+    /// 1 while a transfer is running.
+    uint8_t busy_ : 1;
+    /// 1 if the current transfer is a read.
+    uint8_t isRead_ : 1;
+    /// Data being moved between the memory space and the stream.
+    uint8_t buf_[CHUNK_SIZE];
+};
+
+MemoryConfigStreamServer::MemoryConfigStreamServer(
+    MemoryConfigHandler *handler, StreamService *streams)
+    : DefaultDatagramHandler(handler->dg_service())
+    , handler_(handler)
+    , session_(new Session(handler->dg_service(), streams))
+{
+    handler_->set_stream_server(this);
+}
+
+MemoryConfigStreamServer::~MemoryConfigStreamServer()
+{
+    handler_->clear_stream_server(this);
+}
+
+StateFlowBase::Action MemoryConfigStreamServer::entry()
+{
+    const DatagramPayload &p = message()->data()->payload;
+    if (p.size() < 2)
+    {
+        return respond_reject(Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+    }
+    bool is_read = (payload()[1] & MemoryConfigDefs::COMMAND_MASK) ==
+        MemoryConfigDefs::COMMAND_READ_STREAM;
+    // Read stream has source and destination stream ID and the read count
+    // after the address and space.
+    if (!MemoryConfigDefs::payload_min_length_check(p, is_read ? 6 : 0))
+    {
+        return respond_reject(Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+    }
+    if (session_->busy())
+    {
+        return respond_reject(
+            Defs::ERROR_TEMPORARY | DatagramClient::BUFFER_UNAVAILABLE);
+    }
+    Node *node = message()->data()->dst;
+    uint8_t space_number = MemoryConfigDefs::get_space(p);
+    MemorySpace *space = handler_->registry()->lookup(node, space_number);
+    if (!space || !space->set_node(node))
+    {
+        return respond_reject(MemoryConfigDefs::ERROR_SPACE_NOT_KNOWN);
+    }
+    uint32_t address = MemoryConfigDefs::get_address(p);
+    unsigned ofs = MemoryConfigDefs::get_payload_offset(p);
+    string header = p.substr(0, ofs);
+    if (is_read)
+    {
+        if (address > space->max_address())
+        {
+            return respond_reject(MemoryConfigDefs::ERROR_OUT_OF_BOUNDS);
+        }
+        const uint8_t *bytes = payload() + ofs;
+        uint8_t dst_stream_id = bytes[1];
+        uint32_t count = bytes[2];
+        count = (count << 8) | bytes[3];
+        count = (count << 8) | bytes[4];
+        count = (count << 8) | bytes[5];
+        uint64_t avail = (uint64_t)space->max_address() - address + 1;
+        if (count > avail)
+        {
+            count = avail;
+        }
+        session_->start_read(node, message()->data()->src, space, header,
+            address, count, dst_stream_id);
+    }
+    else
+    {
+        if (space->read_only())
+        {
+            return respond_reject(MemoryConfigDefs::ERROR_WRITE_TO_RO);
+        }
+        session_->start_write(
+            node, message()->data()->src, space, header, address);
+    }
+    return respond_ok(DatagramDefs::REPLY_PENDING);
+}
+
+} // namespace openlcb
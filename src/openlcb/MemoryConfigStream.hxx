@@ -0,0 +1,92 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MemoryConfigStream.hxx
+ *
+ * Server side of the read stream and write stream commands of the Memory
+ * Configuration Protocol.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_MEMORYCONFIGSTREAM_HXX_
+#define _OPENLCB_MEMORYCONFIGSTREAM_HXX_
+
+#include <memory>
+
+#include "openlcb/DatagramHandlerDefault.hxx"
+#include "openlcb/MemoryConfig.hxx"
+
+namespace openlcb
+{
+
+class StreamService;
+
+/// Adds stream transfer support to a MemoryConfigHandler. The handler forwards
+/// the read stream and write stream commands to this object and advertises
+/// stream support in the options reply.
+///
+/// A read stream command opens a stream towards the requester and sends the
+/// requested bytes of the memory space in it. A write stream command makes
+/// this object listen for a stream from the requester and write its contents
+/// into the memory space. One transfer is handled at a time; stream commands
+/// arriving while a transfer is running are rejected with a temporary error,
+/// and clients are expected to fall back to datagrams.
+///
+/// Usage: create after the MemoryConfigHandler, with the stream service of
+/// the same interface.
+class MemoryConfigStreamServer : public DefaultDatagramHandler
+{
+public:
+    /// Stream ID on which we listen for the data of a write stream command.
+    static constexpr uint8_t WRITE_STREAM_ID = 0x11;
+
+    /// Constructor. Registers with the handler.
+    /// @param handler memory config handler whose memory spaces to export.
+    /// @param streams stream service of the interface the handler is on.
+    MemoryConfigStreamServer(
+        MemoryConfigHandler *handler, StreamService *streams);
+
+    /// Destructor. Unregisters from the handler. There must be no transfer in
+    /// progress.
+    ~MemoryConfigStreamServer();
+
+private:
+    class Session;
+
+    /// Handles an incoming read or write stream command datagram.
+    Action entry() override;
+
+    /// Memory config handler we are registered to.
+    MemoryConfigHandler *handler_;
+    /// Runs the actual transfers.
+    std::unique_ptr<Session> session_;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_MEMORYCONFIGSTREAM_HXX_
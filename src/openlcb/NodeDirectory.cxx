@@ -0,0 +1,521 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file NodeDirectory.cxx
+ *
+ * Shared cache of what is known about the remote nodes on an interface.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/NodeDirectory.hxx"
+
+#include <algorithm>
+
+namespace openlcb
+{
+
+/// Matches both the regular and the simple-set-sufficient variant of an MTI.
+static constexpr uint32_t MASK_SIMPLE_VARIANT = Defs::MTI_EXACT & ~1;
+/// Matches the Optional Interaction Rejected and Terminate Due To Error MTIs.
+static constexpr uint32_t MASK_REJECT = Defs::MTI_EXACT &
+    ~(Defs::MTI_OPTIONAL_INTERACTION_REJECTED ^
+        Defs::MTI_TERMINATE_DUE_TO_ERROR);
+
+/// @return true if payload contains a complete SNIP reply: the two version
+/// bytes and six strings.
+static bool is_complete_snip(const Payload &payload)
+{
+    return std::count(payload.begin(), payload.end(), 0) >= 6;
+}
+
+/// Sends the global Verify Node ID message, waits for the replies, then
+/// queries PIP and SNIP for every known node.
+class NodeDirectory::Prefetcher : public StateFlowBase
+{
+public:
+    /// @param parent the directory to fill.
+    Prefetcher(NodeDirectory *parent)
+        : StateFlowBase(parent->service())
+        , parent_(parent)
+    {
+    }
+
+    /// Starts the prefetch unless one is running.
+    /// @param settle_nsec how long to wait for the Verified Node ID replies.
+    void start(long long settle_nsec)
+    {
+        {
+            AtomicHolder h(parent_);
+            if (running_)
+            {
+                return;
+            }
+            running_ = true;
+        }
+        settleNsec_ = settle_nsec;
+        start_flow(STATE(alloc_verify));
+    }
+
+private:
+    Action alloc_verify()
+    {
+        return allocate_and_call(
+            parent_->node_->iface()->global_message_write_flow(),
+            STATE(send_verify));
+    }
+
+    Action send_verify()
+    {
+        auto *b = get_allocation_result(
+            parent_->node_->iface()->global_message_write_flow());
+        b->data()->reset(Defs::MTI_VERIFY_NODE_ID_GLOBAL,
+            parent_->node_->node_id(), EMPTY_PAYLOAD);
+        parent_->node_->iface()->global_message_write_flow()->send(b);
+        return sleep_and_call(&timer_, settleNsec_, STATE(collect));
+    }
+
+    Action collect()
+    {
+        nodes_ = parent_->known_nodes();
+        next_ = 0;
+        return call_immediately(STATE(query_pip));
+    }
+
+    Action query_pip()
+    {
+        if (next_ >= nodes_.size())
+        {
+            nodes_.clear();
+            AtomicHolder h(parent_);
+            running_ = false;
+            return exit();
+        }
+        return invoke_subflow_and_wait(parent_, STATE(query_snip),
+            NodeDirectoryRequest::PIP, current());
+    }
+
+    Action query_snip()
+    {
+        auto b = get_buffer_deleter(full_allocation_result(parent_));
+        if (b->data()->resultCode ||
+            !(b->data()->protocols & Defs::SIMPLE_NODE_INFORMATION))
+        {
+            ++next_;
+            return call_immediately(STATE(query_pip));
+        }
+        return invoke_subflow_and_wait(parent_, STATE(snip_done),
+            NodeDirectoryRequest::SNIP, current());
+    }
+
+    /// @return the node being queried, with its last known alias.
+    NodeHandle current()
+    {
+        return NodeHandle(nodes_[next_], parent_->lookup_alias(nodes_[next_]));
+    }
+
+    Action snip_done()
+    {
+        full_allocation_result(parent_)->unref();
+        ++next_;
+        return call_immediately(STATE(query_pip));
+    }
+
+    NodeDirectory *parent_;
+    /// How long to wait for the Verified Node ID replies.
+    long long settleNsec_;
+    /// Nodes to query.
+    std::vector<NodeID> nodes_;
+    /// Index of the next node to query in nodes_.
+    size_t next_;
+    /// True while the prefetch is in progress. Protected by the parent's
+    /// lock.
+    bool running_{false};
+    StateFlowTimer timer_{this};
+};
+
+NodeDirectory::NodeDirectory(Node *node, unsigned max_entries,
+    long long ttl_nsec, long long timeout_nsec)
+    : CallableFlow<NodeDirectoryRequest>(node->iface())
+    , node_(node)
+    , maxEntries_(max_entries)
+    , ttlNsec_(ttl_nsec)
+    , timeoutNsec_(timeout_nsec)
+{
+    auto *d = node_->iface()->dispatcher();
+    d->register_handler(&verifiedHandler_, Defs::MTI_VERIFIED_NODE_ID_NUMBER,
+        MASK_SIMPLE_VARIANT);
+    d->register_handler(&initCompleteHandler_,
+        Defs::MTI_INITIALIZATION_COMPLETE, MASK_SIMPLE_VARIANT);
+    d->register_handler(
+        &pipHandler_, Defs::MTI_PROTOCOL_SUPPORT_REPLY, Defs::MTI_EXACT);
+    d->register_handler(
+        &snipHandler_, Defs::MTI_IDENT_INFO_REPLY, Defs::MTI_EXACT);
+    d->register_handler(&rejectHandler_,
+        Defs::MTI_OPTIONAL_INTERACTION_REJECTED, MASK_REJECT);
+}
+
+NodeDirectory::~NodeDirectory()
+{
+    auto *d = node_->iface()->dispatcher();
+    d->unregister_handler_all(&verifiedHandler_);
+    d->unregister_handler_all(&initCompleteHandler_);
+    d->unregister_handler_all(&pipHandler_);
+    d->unregister_handler_all(&snipHandler_);
+    d->unregister_handler_all(&rejectHandler_);
+}
+
+bool NodeDirectory::lookup_pip(NodeID id, uint64_t *protocols)
+{
+    AtomicHolder h(this);
+    auto it = entries_.find(id);
+    if (it == entries_.end() || !fresh(it->second.pipNsec))
+    {
+        return false;
+    }
+    *protocols = it->second.protocols;
+    return true;
+}
+
+bool NodeDirectory::lookup_snip(NodeID id, Payload *snip)
+{
+    AtomicHolder h(this);
+    auto it = entries_.find(id);
+    if (it == entries_.end() || !fresh(it->second.snipNsec))
+    {
+        return false;
+    }
+    *snip = it->second.snip;
+    return true;
+}
+
+NodeAlias NodeDirectory::lookup_alias(NodeID id)
+{
+    AtomicHolder h(this);
+    auto it = entries_.find(id);
+    return it == entries_.end() ? 0 : it->second.alias;
+}
+
+std::vector<NodeID> NodeDirectory::known_nodes()
+{
+    AtomicHolder h(this);
+    std::vector<NodeID> ret;
+    ret.reserve(entries_.size());
+    for (const auto &e : entries_)
+    {
+        ret.push_back(e.first);
+    }
+    return ret;
+}
+
+void NodeDirectory::prefetch(long long settle_nsec)
+{
+    {
+        AtomicHolder h(this);
+        if (!prefetcher_)
+        {
+            prefetcher_.reset(new Prefetcher(this));
+        }
+    }
+    prefetcher_->start(settle_nsec);
+}
+
+NodeDirectory::Entry *NodeDirectory::touch(NodeID id, NodeAlias alias)
+{
+    auto it = entries_.find(id);
+    if (it == entries_.end())
+    {
+        if (entries_.size() >= maxEntries_)
+        {
+            // Forgets the node not seen for the longest time.
+            erase(entries_.find(lru_.back()));
+        }
+        it = entries_.emplace(id, Entry()).first;
+        it->second.lruPos = lru_.insert(lru_.begin(), id);
+    }
+    else
+    {
+        mark_seen(&it->second);
+    }
+    if (alias)
+    {
+        set_alias(id, &it->second, alias);
+    }
+    return &it->second;
+}
+
+void NodeDirectory::set_alias(NodeID id, Entry *e, NodeAlias alias)
+{
+    if (e->alias == alias)
+    {
+        return;
+    }
+    auto it = aliases_.find(e->alias);
+    if (it != aliases_.end() && it->second == id)
+    {
+        aliases_.erase(it);
+    }
+    e->alias = alias;
+    // The alias might have been released by another node, whose entry still
+    // has it; the index points to the node that used it last.
+    aliases_[alias] = id;
+}
+
+void NodeDirectory::erase(std::map<NodeID, Entry>::iterator it)
+{
+    auto jt = aliases_.find(it->second.alias);
+    if (jt != aliases_.end() && jt->second == it->first)
+    {
+        aliases_.erase(jt);
+    }
+    lru_.erase(it->second.lruPos);
+    entries_.erase(it);
+}
+
+NodeDirectory::Entry *NodeDirectory::find(NodeHandle h)
+{
+    if (h.id)
+    {
+        auto it = entries_.find(h.id);
+        return it == entries_.end() ? nullptr : &it->second;
+    }
+    if (!h.alias)
+    {
+        return nullptr;
+    }
+    auto it = aliases_.find(h.alias);
+    if (it == aliases_.end())
+    {
+        return nullptr;
+    }
+    return &entries_.find(it->second)->second;
+}
+
+NodeDirectory::Entry *NodeDirectory::find_source(GenMessage *m)
+{
+    if (m->src.id)
+    {
+        return touch(m->src.id, m->src.alias);
+    }
+    Entry *e = find(m->src);
+    if (e)
+    {
+        mark_seen(e);
+    }
+    return e;
+}
+
+void NodeDirectory::verified_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    GenMessage *m = b->data();
+    if (m->payload.size() != 6)
+    {
+        return;
+    }
+    NodeID id = buffer_to_node_id(m->payload);
+    if (node_->iface()->lookup_local_node(id))
+    {
+        return;
+    }
+    AtomicHolder h(this);
+    touch(id, m->src.alias);
+}
+
+void NodeDirectory::init_complete_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    GenMessage *m = b->data();
+    if (m->payload.size() != 6)
+    {
+        return;
+    }
+    NodeID id = buffer_to_node_id(m->payload);
+    if (node_->iface()->lookup_local_node(id))
+    {
+        return;
+    }
+    AtomicHolder h(this);
+    Entry *e = touch(id, m->src.alias);
+    // The node has (re)booted, possibly with a new firmware or settings.
+    e->pipNsec = 0;
+    e->snipNsec = 0;
+    e->snipPending.clear();
+}
+
+void NodeDirectory::pip_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    GenMessage *m = b->data();
+    {
+        AtomicHolder h(this);
+        Entry *e = find_source(m);
+        if (!e)
+        {
+            return;
+        }
+        Payload p = m->payload;
+        p.resize(6, 0);
+        e->protocols = buffer_to_node_id(p);
+        e->pipNsec = os_get_time_monotonic();
+    }
+    maybe_wakeup(m, NodeDirectoryRequest::PIP);
+}
+
+void NodeDirectory::snip_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    GenMessage *m = b->data();
+    {
+        AtomicHolder h(this);
+        Entry *e = find_source(m);
+        if (!e)
+        {
+            return;
+        }
+        e->snipPending += m->payload;
+        if (!is_complete_snip(e->snipPending))
+        {
+            // More parts to come.
+            return;
+        }
+        e->snip.swap(e->snipPending);
+        e->snipPending.clear();
+        e->snipNsec = os_get_time_monotonic();
+    }
+    maybe_wakeup(m, NodeDirectoryRequest::SNIP);
+}
+
+void NodeDirectory::reject_received(Buffer<GenMessage> *b)
+{
+    AutoReleaseBuffer<GenMessage> rb(b);
+    GenMessage *m = b->data();
+    uint16_t error_code, mti;
+    buffer_to_error(m->payload, &error_code, &mti, nullptr);
+    if (mti == Defs::MTI_PROTOCOL_SUPPORT_INQUIRY)
+    {
+        maybe_wakeup(m, NodeDirectoryRequest::PIP,
+            error_code ? error_code : Defs::ERROR_REJECTED);
+    }
+    else if (mti == Defs::MTI_IDENT_INFO_REQUEST)
+    {
+        maybe_wakeup(m, NodeDirectoryRequest::SNIP,
+            error_code ? error_code : Defs::ERROR_REJECTED);
+    }
+}
+
+void NodeDirectory::maybe_wakeup(
+    GenMessage *m, NodeDirectoryRequest::Command cmd, int error)
+{
+    // The flow and the message handlers run on the same executor.
+    if (!waiting_ || request()->cmd != cmd ||
+        !node_->iface()->matching_node(request()->dst, m->src))
+    {
+        return;
+    }
+    if (!request()->dst.id)
+    {
+        request()->dst.id = m->src.id;
+    }
+    queryError_ = error;
+    waiting_ = false;
+    timer_.trigger();
+}
+
+bool NodeDirectory::answer_from_cache()
+{
+    AtomicHolder h(this);
+    Entry *e = find(request()->dst);
+    if (!e)
+    {
+        return false;
+    }
+    switch (request()->cmd)
+    {
+        case NodeDirectoryRequest::PIP:
+            if (!fresh(e->pipNsec))
+            {
+                return false;
+            }
+            request()->protocols = e->protocols;
+            return true;
+        case NodeDirectoryRequest::SNIP:
+            if (!fresh(e->snipNsec))
+            {
+                return false;
+            }
+            request()->snip = e->snip;
+            return true;
+    }
+    return false;
+}
+
+StateFlowBase::Action NodeDirectory::entry()
+{
+    if (answer_from_cache())
+    {
+        request()->fromCache = true;
+        return return_ok();
+    }
+    if (!request()->src)
+    {
+        request()->src = node_;
+    }
+    return allocate_and_call(
+        node_->iface()->addressed_message_write_flow(), STATE(send_query));
+}
+
+StateFlowBase::Action NodeDirectory::send_query()
+{
+    auto *b =
+        get_allocation_result(node_->iface()->addressed_message_write_flow());
+    b->data()->reset(request()->cmd == NodeDirectoryRequest::PIP
+            ? Defs::MTI_PROTOCOL_SUPPORT_INQUIRY
+            : Defs::MTI_IDENT_INFO_REQUEST,
+        request()->src->node_id(), request()->dst, EMPTY_PAYLOAD);
+    node_->iface()->addressed_message_write_flow()->send(b);
+    queryError_ = Defs::OPENMRN_TIMEOUT;
+    waiting_ = true;
+    return sleep_and_call(&timer_, timeoutNsec_, STATE(query_done));
+}
+
+StateFlowBase::Action NodeDirectory::query_done()
+{
+    waiting_ = false;
+    if (queryError_)
+    {
+        return return_with_error(queryError_);
+    }
+    if (!answer_from_cache())
+    {
+        // The reply came from a node whose node ID we do not know.
+        return return_with_error(Defs::ERROR_OPENMRN_NOT_FOUND);
+    }
+    return return_ok();
+}
+
+} // namespace openlcb
@@ -0,0 +1,275 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file NodeDirectory.hxx
+ *
+ * Shared cache of what is known about the remote nodes on an interface.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_NODEDIRECTORY_HXX_
+#define _OPENLCB_NODEDIRECTORY_HXX_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "executor/CallableFlow.hxx"
+#include "openlcb/If.hxx"
+
+namespace openlcb
+{
+
+/// Request to the NodeDirectory: returns the PIP or SNIP data of a node,
+/// from the cache if possible, from the node otherwise.
+struct NodeDirectoryRequest : public CallableFlowRequestBase
+{
+    /// What to look up.
+    enum Command
+    {
+        /// Protocol Identification Protocol (supported protocols).
+        PIP,
+        /// Simple Node Identification Protocol.
+        SNIP,
+    };
+
+    /// Sets up a request.
+    /// @param cmd what to look up.
+    /// @param dst remote node. Either the node ID or the alias may be zero.
+    /// @param src local node to send the query from; nullptr for the default
+    /// node of the directory.
+    void reset(Command cmd, NodeHandle dst, Node *src = nullptr)
+    {
+        reset_base();
+        this->cmd = cmd;
+        this->dst = dst;
+        this->src = src;
+        protocols = 0;
+        snip.clear();
+        fromCache = false;
+    }
+
+    /// What to look up.
+    Command cmd;
+    /// Remote node.
+    NodeHandle dst;
+    /// Local node to send the query from.
+    Node *src;
+    /// Output: supported protocols bitmask (see Defs::Protocols) for PIP.
+    uint64_t protocols;
+    /// Output: raw SNIP reply payload for SNIP. Use decode_snip_response()
+    /// to split it into fields.
+    Payload snip;
+    /// Output: true if the answer came from the cache.
+    bool fromCache;
+};
+
+/// Keeps track of the remote nodes seen on an interface: node IDs with their
+/// aliases, supported protocols and SNIP data.
+///
+/// The directory observes the messages arriving at the interface: Verified
+/// Node ID and Initialization Complete messages (from any node), and PIP and
+/// SNIP replies (sent to any local node, so it learns from the queries of
+/// all tools and throttles running on the same interface). Initialization
+/// Complete drops the PIP and SNIP data of the node, because it might have
+/// been updated.
+///
+/// The cached data expires after a configurable time. Requests sent to the
+/// directory (see NodeDirectoryRequest) are answered from the cache when it
+/// has fresh data, and by querying the node otherwise.
+///
+/// prefetch() fills the directory for the whole bus: it sends a global
+/// Verify Node ID, then queries PIP and SNIP of every node that answered,
+/// one at a time.
+///
+/// The lookup_* functions are thread-safe.
+class NodeDirectory : public CallableFlow<NodeDirectoryRequest>
+{
+public:
+    /// Constructor.
+    /// @param node default local node to send queries from.
+    /// @param max_entries how many nodes to remember. When full, the node not
+    /// seen for the longest time is forgotten.
+    /// @param ttl_nsec how long the PIP and SNIP data is considered fresh.
+    /// @param timeout_nsec how long to wait for the reply of a node.
+    NodeDirectory(Node *node, unsigned max_entries = 512,
+        long long ttl_nsec = SEC_TO_NSEC(600),
+        long long timeout_nsec = SEC_TO_NSEC(2));
+
+    ~NodeDirectory();
+
+    /// Looks up the cached supported protocols of a node.
+    /// @param id node ID of the remote node.
+    /// @param protocols will be filled with the bitmask of Defs::Protocols.
+    /// @return true if fresh data was found.
+    bool lookup_pip(NodeID id, uint64_t *protocols);
+
+    /// Looks up the cached SNIP data of a node.
+    /// @param id node ID of the remote node.
+    /// @param snip will be filled with the raw SNIP reply payload.
+    /// @return true if fresh data was found.
+    bool lookup_snip(NodeID id, Payload *snip);
+
+    /// @param id node ID of the remote node.
+    /// @return the last alias seen for the node, or 0 if unknown.
+    NodeAlias lookup_alias(NodeID id);
+
+    /// @return the node IDs of all nodes in the directory.
+    std::vector<NodeID> known_nodes();
+
+    /// Starts discovering all nodes on the bus and fetching their PIP and
+    /// SNIP data. Does nothing if a prefetch is already running.
+    /// @param settle_nsec how long to wait for the Verified Node ID replies
+    /// before starting the queries.
+    void prefetch(long long settle_nsec = SEC_TO_NSEC(1));
+
+private:
+    /// What we know about one remote node.
+    struct Entry
+    {
+        /// Last alias seen.
+        NodeAlias alias{0};
+        /// Position of the node in lru_.
+        std::list<NodeID>::iterator lruPos;
+        /// When the PIP data arrived; 0 if none.
+        long long pipNsec{0};
+        /// Supported protocols.
+        uint64_t protocols{0};
+        /// When the SNIP data arrived; 0 if none.
+        long long snipNsec{0};
+        /// SNIP reply payload.
+        Payload snip;
+        /// SNIP reply parts arriving as separate messages (from nodes that do
+        /// not use the continuation bits).
+        Payload snipPending;
+    };
+
+    class Prefetcher;
+
+    Action entry() override;
+    Action send_query();
+    Action query_done();
+
+    /// Message handler callbacks.
+    void verified_received(Buffer<GenMessage> *b);
+    void init_complete_received(Buffer<GenMessage> *b);
+    void pip_received(Buffer<GenMessage> *b);
+    void snip_received(Buffer<GenMessage> *b);
+    void reject_received(Buffer<GenMessage> *b);
+
+    /// Finds or creates the entry for a node and records that it was seen.
+    /// Must be called with the lock held.
+    /// @param id node ID; @param alias its alias (may be 0).
+    /// @return the entry.
+    Entry *touch(NodeID id, NodeAlias alias);
+
+    /// Records that a node was seen, making it the last one to be forgotten.
+    /// Must be called with the lock held.
+    /// @param e entry of the node.
+    void mark_seen(Entry *e)
+    {
+        lru_.splice(lru_.begin(), lru_, e->lruPos);
+    }
+
+    /// Updates the alias of a node and the alias index. Must be called with
+    /// the lock held.
+    /// @param id node ID; @param e its entry; @param alias new alias.
+    void set_alias(NodeID id, Entry *e, NodeAlias alias);
+
+    /// Forgets a node. Must be called with the lock held.
+    /// @param it the node to remove.
+    void erase(std::map<NodeID, Entry>::iterator it);
+
+    /// Finds the entry of a node. Must be called with the lock held.
+    /// @param h node ID and/or alias of the node.
+    /// @return the entry or nullptr if the node is unknown.
+    Entry *find(NodeHandle h);
+
+    /// Finds the entry of the source of an incoming message, creating it if
+    /// the source node ID is known. Must be called with the lock held.
+    /// @param m incoming message.
+    /// @return the entry or nullptr.
+    Entry *find_source(GenMessage *m);
+
+    /// @param t when the data arrived (0 = never).
+    /// @return true if the data is not expired.
+    bool fresh(long long t)
+    {
+        return t && os_get_time_monotonic() - t < ttlNsec_;
+    }
+
+    /// Copies the answer of the current request from the cache if fresh.
+    /// @return true if the request was answered.
+    bool answer_from_cache();
+
+    /// Wakes up the flow if it is waiting for a reply from this source.
+    /// @param m incoming reply.
+    /// @param cmd what type of reply it is.
+    /// @param error nonzero if the node rejected the query.
+    void maybe_wakeup(
+        GenMessage *m, NodeDirectoryRequest::Command cmd, int error = 0);
+
+    /// Default local node.
+    Node *node_;
+    /// How many entries to keep at most.
+    unsigned maxEntries_;
+    /// How long the PIP and SNIP data is fresh.
+    long long ttlNsec_;
+    /// How long to wait for a reply.
+    long long timeoutNsec_;
+    /// Known nodes.
+    std::map<NodeID, Entry> entries_;
+    /// Node IDs of the known nodes, the most recently seen first.
+    std::list<NodeID> lru_;
+    /// Node ID for each alias in entries_.
+    std::map<NodeAlias, NodeID> aliases_;
+    /// Result of the current query; OPENMRN_TIMEOUT until the reply arrives.
+    int queryError_{0};
+    /// True while the flow is waiting for a reply.
+    bool waiting_{false};
+    StateFlowTimer timer_{this};
+
+    MessageHandler::GenericHandler verifiedHandler_{
+        this, &NodeDirectory::verified_received};
+    MessageHandler::GenericHandler initCompleteHandler_{
+        this, &NodeDirectory::init_complete_received};
+    MessageHandler::GenericHandler pipHandler_{
+        this, &NodeDirectory::pip_received};
+    MessageHandler::GenericHandler snipHandler_{
+        this, &NodeDirectory::snip_received};
+    MessageHandler::GenericHandler rejectHandler_{
+        this, &NodeDirectory::reject_received};
+
+    /// Runs the prefetch; created on first use.
+    std::unique_ptr<Prefetcher> prefetcher_;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_NODEDIRECTORY_HXX_
@@ -34,6 +34,8 @@
 
 #include "openlcb/NodeInitializeFlow.hxx"
 
+#include "openlcb/EventAdvertisementTable.hxx"
+
 namespace openlcb
 {
 
@@ -41,12 +43,108 @@ InitializeFlow::~InitializeFlow()
 {
 }
 
-void StartInitializationFlow(Node *node)
+StateFlowBase::Action InitializeFlow::finish_node()
+{
+    if (!queue_empty() || !batchStartNsec_)
+    {
+        return release_and_exit();
+    }
+    {
+        AtomicHolder h(this);
+        lastBatch_ = batch_;
+    }
+    LOG(INFO,
+        "Initialized %u nodes (%u messages) in %u msec, longest wait %u msec.",
+        batch_.nodes, batch_.messages,
+        (unsigned)(batch_.timeToReadyNsec / 1000000),
+        (unsigned)(batch_.maxWaitNsec / 1000000));
+    batch_ = InitializeStats();
+    batchStartNsec_ = 0;
+    return release_and_exit();
+}
+
+bool InitializeFlow::dequeue_request()
+{
+    AtomicHolder h(this);
+    InitializeRequest *r = message()->data();
+    if (r->superseded)
+    {
+        return true;
+    }
+    auto it = waiting_.find(r->node);
+    if (it != waiting_.end() && it->second == r)
+    {
+        waiting_.erase(it);
+    }
+    return false;
+}
+
+unsigned InitializeFlow::startup_cost(Node *node)
+{
+    if (!messagesPerSec_)
+    {
+        return 0;
+    }
+    // Initialization Complete.
+    unsigned cost = 1;
+    if (config_node_init_identify() == CONSTANT_TRUE &&
+        Singleton<EventRegistry>::exists())
+    {
+        cost += EventRegistry::instance()->advertisements()->count(node);
+    }
+    return cost;
+}
+
+long long InitializeFlow::reserve(unsigned messages)
 {
-    auto *g_initialize_flow = Singleton<InitializeFlow>::instance();
-    auto *b = g_initialize_flow->alloc();
+    AtomicHolder h(this);
+    if (!messagesPerSec_)
+    {
+        return 0;
+    }
+    long long now = os_get_time_monotonic();
+    long long burst_nsec = SEC_TO_NSEC(1) * burstMessages_ / messagesPerSec_;
+    if (nextFreeNsec_ < now)
+    {
+        nextFreeNsec_ = now;
+    }
+    nextFreeNsec_ += SEC_TO_NSEC(1) * messages / messagesPerSec_;
+    return nextFreeNsec_ - burst_nsec - now;
+}
+
+void InitializeFlow::queue_node(Node *node, bool urgent)
+{
+    auto *b = alloc();
     b->data()->node = node;
-    g_initialize_flow->send(b);
+    {
+        AtomicHolder h(this);
+        auto it = waiting_.find(node);
+        if (!urgent)
+        {
+            if (it == waiting_.end())
+            {
+                waiting_[node] = b->data();
+            }
+        }
+        else if (it != waiting_.end())
+        {
+            // Moves the node ahead by replacing its waiting request.
+            it->second->superseded = true;
+            b->data()->queuedNsec = it->second->queuedNsec;
+            waiting_.erase(it);
+        }
+    }
+    send(b, urgent ? PRIORITY_URGENT : PRIORITY_NORMAL);
+}
+
+void StartInitializationFlow(Node *node)
+{
+    StartInitializationFlow(node, false);
+}
+
+void StartInitializationFlow(Node *node, bool urgent)
+{
+    Singleton<InitializeFlow>::instance()->queue_node(node, urgent);
 }
 
 } // namespace openlcb
@@ -35,6 +35,9 @@
 #ifndef _OPENLCB_NODEINITIALIZEFLOW_HXX_
 #define _OPENLCB_NODEINITIALIZEFLOW_HXX_
 
+#include <algorithm>
+#include <map>
+
 #include "openlcb/DefaultNode.hxx"
 #include "openlcb/If.hxx"
 #include "nmranet_config.h"
@@ -49,29 +52,99 @@ struct InitializeRequest
 {
     InitializeRequest()
         : node(nullptr)
+        , queuedNsec(os_get_time_monotonic())
+        , superseded(false)
     {
     }
     Node *node;
+    /// When the request was allocated. Used for the time-to-ready
+    /// statistics.
+    long long queuedNsec;
+    /// Set when an urgent request of the same node was queued after this
+    /// one; the request is then dropped by the flow.
+    bool superseded;
 };
 
-typedef StateFlow<Buffer<InitializeRequest>, QList<1>> InitializeFlowBase;
+typedef StateFlow<Buffer<InitializeRequest>, QList<2>> InitializeFlowBase;
+
+/// Time-to-ready statistics of one startup batch. A batch starts when a
+/// request arrives at an idle InitializeFlow and ends when its queue becomes
+/// empty.
+struct InitializeStats
+{
+    /// How many nodes were initialized.
+    unsigned nodes{0};
+    /// How many messages the nodes were estimated to send.
+    unsigned messages{0};
+    /// Time from the first request of the batch to the last node becoming
+    /// initialized.
+    long long timeToReadyNsec{0};
+    /// Longest time a node waited from its request to being initialized.
+    long long maxWaitNsec{0};
+};
 
 /// Performs upon-startup initialization of virtual nodes.
 ///
 /// Usage: Create a global static instance of InitializeFlow. Allocate a
 /// Buffer<INitializerequest> and fill in the node pointer. Send the buffer via
 /// Singleton<InitializeFlow>::instance()->send(buffer)
+///
+/// The nodes are initialized one at a time. The messages sent (Initialization
+/// Complete and the producer / consumer identified messages of the startup
+/// identify) can be limited to a bus budget, see set_rate_limit(), so that a
+/// stack with hundreds of virtual nodes does not starve the rest of the bus
+/// at boot. Requests sent with PRIORITY_URGENT (e.g. nodes that have
+/// application traffic waiting) are initialized before the others. When
+/// going through queue_node(), an urgent request for a node that is already
+/// waiting in the queue replaces the waiting request instead of initializing
+/// the node twice.
 class InitializeFlow : public InitializeFlowBase,
                        public Singleton<InitializeFlow>
 {
 public:
+    /// Queue priorities of the initialize requests.
+    enum
+    {
+        /// Nodes that have application traffic waiting.
+        PRIORITY_URGENT = 0,
+        /// All other nodes.
+        PRIORITY_NORMAL = 1,
+    };
+
     InitializeFlow(Service *service)
         : InitializeFlowBase(service)
     {
+        set_rate_limit(config_node_init_messages_per_sec(),
+            config_node_init_burst_messages());
     }
 
     ~InitializeFlow();
 
+    /// Sets the bus budget of the node initializations.
+    /// @param messages_per_sec how many messages the initializations may
+    /// send per second on average. 0 for unlimited.
+    /// @param burst_messages how many messages may be sent back-to-back
+    /// after a quiet period.
+    void set_rate_limit(unsigned messages_per_sec, unsigned burst_messages)
+    {
+        AtomicHolder h(this);
+        messagesPerSec_ = messages_per_sec;
+        burstMessages_ = burst_messages;
+    }
+
+    /// Queues the initialization of a node.
+    /// @param node the node to initialize.
+    /// @param urgent true if the node has application traffic waiting; it
+    /// will be initialized before the other queued nodes.
+    void queue_node(Node *node, bool urgent);
+
+    /// @return the statistics of the last finished batch.
+    InitializeStats last_batch()
+    {
+        AtomicHolder h(this);
+        return lastBatch_;
+    }
+
 private:
     Node *node()
     {
@@ -81,6 +154,26 @@ private:
     Action entry() OVERRIDE
     {
         HASSERT(message()->data()->node);
+        if (dequeue_request())
+        {
+            return finish_node();
+        }
+        if (!batchStartNsec_)
+        {
+            batchStartNsec_ = message()->data()->queuedNsec;
+        }
+        unsigned cost = startup_cost(node());
+        batch_.messages += cost;
+        long long delay = reserve(cost);
+        if (delay > 0)
+        {
+            return sleep_and_call(&timer_, delay, STATE(start_node));
+        }
+        return call_immediately(STATE(start_node));
+    }
+
+    Action start_node()
+    {
         return allocate_and_call(
             node()->iface()->global_message_write_flow(),
             STATE(send_initialized));
@@ -104,6 +197,11 @@ private:
     Action initialization_complete()
     {
         node()->set_initialized();
+        long long now = os_get_time_monotonic();
+        ++batch_.nodes;
+        batch_.maxWaitNsec = std::max(
+            batch_.maxWaitNsec, now - message()->data()->queuedNsec);
+        batch_.timeToReadyNsec = now - batchStartNsec_;
         return call_immediately(STATE(identify_events));
     }
 
@@ -111,7 +209,7 @@ private:
     {
         if (config_node_init_identify() != CONSTANT_TRUE)
         {
-            return release_and_exit();
+            return finish_node();
         }
         // Get the dispatch flow.
         return allocate_and_call(
@@ -135,16 +233,58 @@ private:
 
     Action wait_for_local_identify()
     {
-        return release_and_exit();
+        return finish_node();
     }
 
+    /// Closes the statistics of the batch if this was the last queued node.
+    Action finish_node();
+
+    /// Removes the current request from the waiting requests.
+    /// @return true if the request was superseded and has to be dropped.
+    bool dequeue_request();
+
+    /// @return how many messages the initialization of a node will send. 0
+    /// if the rate is not limited.
+    /// @param node the node to initialize.
+    unsigned startup_cost(Node *node);
+
+    /// Reserves bus budget for sending some messages.
+    /// @param messages how many messages the caller is about to send.
+    /// @return how many nanoseconds the caller has to wait before sending.
+    long long reserve(unsigned messages);
+
     BarrierNotifiable done_;
+    StateFlowTimer timer_{this};
+    /// Budget in messages per second; 0 if unlimited.
+    unsigned messagesPerSec_;
+    /// How many messages may be sent back-to-back.
+    unsigned burstMessages_;
+    /// Time at which the already reserved messages will have been sent at
+    /// the budgeted rate.
+    long long nextFreeNsec_{0};
+    /// When the first request of the current batch was queued; 0 if there
+    /// is no batch in progress.
+    long long batchStartNsec_{0};
+    /// Statistics of the current batch.
+    InitializeStats batch_;
+    /// Statistics of the last finished batch.
+    InitializeStats lastBatch_;
+    /// Normal priority requests that were queued by queue_node() and are
+    /// not yet started, by node.
+    std::map<Node *, InitializeRequest *> waiting_;
 };
 
 /// Helper function that sends a local virtual node to the static
 /// InitializeFlow.
 void StartInitializationFlow(Node *node);
 
+/// Helper function that sends a local virtual node to the static
+/// InitializeFlow.
+/// @param node the node to initialize.
+/// @param urgent true if the node has application traffic waiting; it will
+/// be initialized before the other queued nodes.
+void StartInitializationFlow(Node *node, bool urgent);
+
 /// StateFlow that iterates through all local nodes and sends out node
 /// initialization complete for each of them. Used when a TCP disconnect event
 /// causes us to lose network connectivity and later the connection gets
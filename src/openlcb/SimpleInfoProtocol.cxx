@@ -0,0 +1,145 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file SimpleInfoProtocol.cxx
+ *
+ * Shared code among SNIP and similar protocols.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/SimpleInfoProtocol.hxx"
+
+#include <string.h>
+
+namespace openlcb
+{
+
+/// Reads bytes from a file. Bytes past the end of the file read as zero.
+/// @param fd file to read from.
+/// @param offset file offset to start reading at.
+/// @param buf where to put the data.
+/// @param len how many bytes to read.
+static void read_file_bytes(int fd, unsigned offset, char *buf, unsigned len)
+{
+    memset(buf, 0, len);
+    int ret = lseek(fd, offset, SEEK_SET);
+    HASSERT(ret != -1);
+    unsigned ofs = 0;
+    while (ofs < len)
+    {
+        ret = ::read(fd, buf + ofs, len - ofs);
+        HASSERT(ret >= 0);
+        if (ret == 0)
+        {
+            break;
+        }
+        ofs += ret;
+    }
+}
+
+void SimpleInfoFlow::render(const SimpleInfoDescriptor *desc, Payload *output)
+{
+    output->clear();
+    const char *file_name = nullptr;
+    int fd = -1;
+    // All descriptor arguments are single bytes, so this fits any entry.
+    char buf[256];
+    for (; desc->cmd != SimpleInfoDescriptor::END_OF_DATA; ++desc)
+    {
+        const SimpleInfoDescriptor &d = *desc;
+        switch (d.cmd)
+        {
+            case SimpleInfoDescriptor::LITERAL_BYTE:
+                if (d.data)
+                {
+                    HASSERT(d.arg == *d.data);
+                }
+                output->push_back(d.arg);
+                continue;
+            case SimpleInfoDescriptor::C_STRING:
+            {
+                size_t len = strlen(d.data);
+                if (d.arg && len >= d.arg)
+                {
+                    // Clips too long messages.
+                    len = d.arg - 1;
+                }
+                output->append(d.data, len);
+                output->push_back(0);
+                continue;
+            }
+            case SimpleInfoDescriptor::CHAR_ARRAY:
+                output->append(d.data, d.arg);
+                continue;
+            case SimpleInfoDescriptor::FILE_C_STRING:
+            case SimpleInfoDescriptor::FILE_LITERAL_BYTE:
+            case SimpleInfoDescriptor::FILE_CHAR_ARRAY:
+                break;
+            default:
+                DIE("Unexpected descriptor type.");
+        }
+        // File based entries.
+        HASSERT(d.data);
+        if (!file_name || strcmp(file_name, d.data))
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            file_name = d.data;
+            fd = ::open(file_name, O_RDONLY);
+            HASSERT(fd >= 0);
+        }
+        switch (d.cmd)
+        {
+            case SimpleInfoDescriptor::FILE_LITERAL_BYTE:
+                read_file_bytes(fd, d.arg2, buf, 1);
+                HASSERT(d.arg == (uint8_t)buf[0]);
+                output->push_back(d.arg);
+                break;
+            case SimpleInfoDescriptor::FILE_C_STRING:
+            {
+                HASSERT(d.arg);
+                read_file_bytes(fd, d.arg2, buf, d.arg - 1);
+                output->append(buf, strnlen(buf, d.arg - 1));
+                output->push_back(0);
+                break;
+            }
+            case SimpleInfoDescriptor::FILE_CHAR_ARRAY:
+                read_file_bytes(fd, d.arg2, buf, d.arg);
+                output->append(buf, d.arg);
+                break;
+        }
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+} // namespace openlcb
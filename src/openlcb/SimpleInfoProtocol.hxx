@@ -38,6 +38,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "openlcb/If.hxx"
 #include "executor/StateFlow.hxx"
 
@@ -70,14 +72,25 @@ struct SimpleInfoResponse
         descriptor = desc;
         mti = response_mti;
     }
+    /** Initializes the fields of this message to be a response to an
+     * NMRAnetMessage with an already assembled payload (see
+     * SimpleInfoFlow::render()). */
+    void reset(const GenMessage *msg_to_respond, const Payload &data,
+               Defs::MTI response_mti)
+    {
+        reset(msg_to_respond, nullptr, response_mti);
+        payload = data;
+    }
     /** Source node to send the response from. */
     Node *src;
     /** MTI of the response to be sent. */
     Defs::MTI mti;
     /** Destination node to send the response to. */
     NodeHandle dst;
-    /** Descriptor of payload to send. */
+    /** Descriptor of payload to send. If null, the payload field is sent. */
     const SimpleInfoDescriptor *descriptor;
+    /** Assembled payload to send when there is no descriptor. */
+    Payload payload;
 };
 
 /** This structure defines how to piece together a reply to a Simple Info
@@ -124,6 +137,11 @@ typedef StateFlow<Buffer<SimpleInfoResponse>, QList<1>> SimpleInfoFlowBase;
 /// pointer. The SimpleInfoFlow will assemble, fragment and send the response
 /// message.
 ///
+/// Handlers that answer many requests with the same data can instead
+/// assemble the response once using render(), and send the assembled payload
+/// in the SimpleInfoResponse. This saves the byte-by-byte walk of the
+/// descriptors and the file accesses on every request.
+///
 /// Example: see @SNIPHandler.
 class SimpleInfoFlow : public SimpleInfoFlowBase
 {
@@ -158,14 +176,25 @@ public:
         }
     }
 
+    /** Assembles the entire response defined by a descriptor array, the same
+     * bytes that the flow would send for it.
+     *
+     * @param desc descriptor array, ending with an EOF entry.
+     * @param output will be filled with the response payload. */
+    static void render(const SimpleInfoDescriptor *desc, Payload *output);
+
 private:
     Action entry() OVERRIDE
     {
         HASSERT(message()->data()->src);
-        HASSERT(message()->data()->descriptor);
+        isFirstMessage_ = 1;
+        if (!message()->data()->descriptor)
+        {
+            payloadOffset_ = 0;
+            return call_immediately(STATE(continue_send_payload));
+        }
         entryOffset_ = 0;
         byteOffset_ = 0;
-        isFirstMessage_ = 1;
         update_for_next_entry();
         return call_immediately(STATE(continue_send));
     }
@@ -366,10 +395,55 @@ private:
         {
             b->data()->payload.push_back(current_byte());
         }
+        return send_buffer(b, is_eof(), STATE(continue_send));
+    }
+
+    Action continue_send_payload()
+    {
+        if (payloadOffset_ >= message()->data()->payload.size())
+        {
+            return release_and_exit();
+        }
+        return allocate_and_call(
+            message()->data()->src->iface()->addressed_message_write_flow(),
+            STATE(fill_payload_buffer));
+    }
+
+    /** Sends the next slice of an assembled payload. */
+    Action fill_payload_buffer()
+    {
+        auto *b = get_allocation_result(message()
+                                            ->data()
+                                            ->src->iface()
+                                            ->addressed_message_write_flow());
+        SimpleInfoResponse &r = *message()->data();
+        b->data()->reset(r.mti, r.src->node_id(), r.dst, EMPTY_PAYLOAD);
+        size_t len = std::min(
+            size_t(maxBytesPerMessage_), r.payload.size() - payloadOffset_);
+        bool eof = payloadOffset_ + len >= r.payload.size();
+        if (!payloadOffset_ && eof)
+        {
+            // The entire response fits into one message.
+            b->data()->payload.swap(r.payload);
+        }
+        else
+        {
+            b->data()->payload.assign(r.payload, payloadOffset_, len);
+        }
+        payloadOffset_ += len;
+        return send_buffer(b, eof, STATE(continue_send_payload));
+    }
+
+    /** Sets the flags of an outgoing message and sends it off.
+     * @param b the outgoing message with the payload filled in.
+     * @param eof true if this is the last message of the response.
+     * @param c state to continue at when the message is sent. */
+    Action send_buffer(Buffer<GenMessage> *b, bool eof, Callback c)
+    {
         b->data()->set_flag_dst(GenMessage::WAIT_FOR_LOCAL_LOOPBACK);
         if (useContinueBits_)
         {
-            if (!is_eof())
+            if (!eof)
             {
                 b->data()->set_flag_dst(
                     GenMessage::DSTFLAG_NOT_LAST_MESSAGE);
@@ -388,7 +462,7 @@ private:
         b->set_done(n_.reset(this));
         message()->data()->src->iface()->addressed_message_write_flow()->send(
             b);
-        return wait_and_call(STATE(continue_send));
+        return wait_and_call(c);
     }
 
     /** Configuration option. See constructor. */
@@ -409,6 +483,8 @@ private:
     /** Total / max length of the current block. This is typically strlen() + 1
      * (including the terminating zero, if any). */
     unsigned currentLength_ : 8;
+    /** Offset of the next byte to send from an assembled payload. */
+    uint16_t payloadOffset_;
 
     /// Last file name we opened.
     const char* fileName_{nullptr};
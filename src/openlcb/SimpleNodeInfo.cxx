@@ -34,6 +34,8 @@
 
 #include "openlcb/SimpleNodeInfo.hxx"
 
+#include "utils/ConfigUpdateService.hxx"
+
 namespace openlcb
 {
 
@@ -51,6 +53,45 @@ const SimpleInfoDescriptor SNIPHandler::SNIP_RESPONSE[] = {
     {SimpleInfoDescriptor::FILE_C_STRING, 64, 64, SNIP_DYNAMIC_FILENAME},
     {SimpleInfoDescriptor::END_OF_DATA, 0, 0, 0}};
 
+unsigned SNIPHandler::userDataVersion_ = 0;
+
+SNIPHandler::~SNIPHandler()
+{
+    iface()->dispatcher()->unregister_handler(
+        this, Defs::MTI_IDENT_INFO_REQUEST, Defs::MTI_EXACT);
+    if (listenerRegistered_ && Singleton<ConfigUpdateService>::exists())
+    {
+        Singleton<ConfigUpdateService>::instance()->unregister_update_listener(
+            &updateListener_);
+    }
+}
+
+void SNIPHandler::register_listener()
+{
+    if (!listenerRegistered_ && Singleton<ConfigUpdateService>::exists())
+    {
+        Singleton<ConfigUpdateService>::instance()->register_update_listener(
+            &updateListener_);
+        listenerRegistered_ = true;
+    }
+}
+
+StateFlowBase::Action SNIPHandler::send_response_request()
+{
+    auto *b = get_allocation_result(responseFlow_);
+    // The config update service may be created after us.
+    register_listener();
+    if (!cacheValid_ || cacheVersion_ != userDataVersion_)
+    {
+        cacheValid_ = true;
+        cacheVersion_ = userDataVersion_;
+        SimpleInfoFlow::render(SNIP_RESPONSE, &cache_);
+    }
+    b->data()->reset(nmsg(), cache_, Defs::MTI_IDENT_INFO_REPLY);
+    responseFlow_->send(b);
+    return release_and_exit();
+}
+
 void init_snip_user_file(int fd, const char *user_name,
                          const char *user_description)
 {
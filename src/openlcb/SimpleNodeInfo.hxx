@@ -37,6 +37,7 @@
 
 #include "openlcb/If.hxx"
 #include "openlcb/SimpleInfoProtocol.hxx"
+#include "utils/ConfigUpdateListener.hxx"
 
 namespace openlcb
 {
@@ -84,6 +85,14 @@ void init_snip_user_file(int fd, const char *user_name,
 /// Uses the generic SimpleInfoProtocol handler with a specific response
 /// structure (@ref SNIPHandler::SNIP_RESPONSE) to assemble the necessary
 /// response packets.
+///
+/// The response is assembled once and kept in memory; requests are answered
+/// without touching the SNIP dynamic file. The cached response is dropped
+/// when the configuration is updated via the ConfigUpdateService (e.g. after
+/// the user name was written in the configuration space), and when
+/// user_data_changed() is called, which the ACDI user memory space of the
+/// SimpleStack does upon every write. Code that changes the dynamic file in
+/// any other way has to call user_data_changed() as well.
 class SNIPHandler : public IncomingMessageStateFlow
 {
 public:
@@ -95,12 +104,22 @@ public:
         HASSERT(SNIP_STATIC_DATA.version == 4);
         iface->dispatcher()->register_handler(
             this, Defs::MTI_IDENT_INFO_REQUEST, Defs::MTI_EXACT);
+        register_listener();
     }
 
-    ~SNIPHandler()
+    ~SNIPHandler();
+
+    /// Drops the cached response of this handler.
+    void invalidate_cache()
     {
-        iface()->dispatcher()->unregister_handler(
-            this, Defs::MTI_IDENT_INFO_REQUEST, Defs::MTI_EXACT);
+        cacheValid_ = false;
+    }
+
+    /// Drops the cached response of every SNIPHandler. Call this after
+    /// changing the contents of the SNIP dynamic file.
+    static void user_data_changed()
+    {
+        ++userDataVersion_;
     }
 
     Action entry() OVERRIDE
@@ -112,20 +131,58 @@ public:
         return allocate_and_call(responseFlow_, STATE(send_response_request));
     }
 
-    Action send_response_request()
-    {
-        auto *b = get_allocation_result(responseFlow_);
-        b->data()->reset(nmsg(), SNIP_RESPONSE, Defs::MTI_IDENT_INFO_REPLY);
-        responseFlow_->send(b);
-        return release_and_exit();
-    }
+    Action send_response_request();
 
 private:
+    /// Drops the cached response when the configuration changes.
+    class UpdateListener : public ConfigUpdateListener
+    {
+    public:
+        /// @param parent the handler whose cache to invalidate.
+        UpdateListener(SNIPHandler *parent)
+            : parent_(parent)
+        {
+        }
+
+        UpdateAction apply_configuration(
+            int fd, bool initial_load, BarrierNotifiable *done) override
+        {
+            AutoNotify n(done);
+            parent_->invalidate_cache();
+            return UPDATED;
+        }
+
+        void factory_reset(int fd) override
+        {
+            parent_->invalidate_cache();
+        }
+
+    private:
+        SNIPHandler *parent_;
+    };
+
+    /// Registers updateListener_ if there is a ConfigUpdateService and it is
+    /// not registered yet.
+    void register_listener();
+
     /** Defines the SNIP response fields. */
     static const SimpleInfoDescriptor SNIP_RESPONSE[];
 
+    /// Incremented by user_data_changed().
+    static unsigned userDataVersion_;
+
     Node* node_;
     SimpleInfoFlow *responseFlow_;
+    /// Assembled response.
+    Payload cache_;
+    /// True if cache_ was assembled and not invalidated since.
+    bool cacheValid_{false};
+    /// Value of userDataVersion_ when cache_ was assembled.
+    unsigned cacheVersion_{0};
+    /// True if updateListener_ is registered with the ConfigUpdateService.
+    bool listenerRegistered_{false};
+    /// Invalidates the cache upon config updates.
+    UpdateListener updateListener_{this};
 };
 
 /// Holds the data we decoded from a SNIP response.
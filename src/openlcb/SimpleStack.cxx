@@ -57,6 +57,25 @@
 namespace openlcb
 {
 
+/// Memory space of the ACDI user data (the SNIP dynamic file). Drops the
+/// cached SNIP responses upon every write.
+class SNIPUserMemorySpace : public FileMemorySpace
+{
+public:
+    SNIPUserMemorySpace()
+        : FileMemorySpace(
+              SNIP_DYNAMIC_FILENAME, sizeof(SimpleNodeDynamicValues))
+    {
+    }
+
+    size_t write(address_t destination, const uint8_t *data, size_t len,
+        errorcode_t *error, Notifiable *again) OVERRIDE
+    {
+        SNIPHandler::user_data_changed();
+        return FileMemorySpace::write(destination, data, len, error, again);
+    }
+};
+
 SimpleCanStackBase::SimpleCanStackBase(const openlcb::NodeID node_id)
 {
     AddAliasAllocator(node_id, &ifCan_);
@@ -77,7 +96,7 @@ void SimpleCanStackBase::start_stack(bool delay_start)
 
     if (!delay_start) {
         // Bootstraps the alias allocation process.
-        ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+        ifCan_.alias_allocator()->bootstrap();
     }
 
     // Adds memory spaces.
@@ -104,8 +123,7 @@ void SimpleCanStackBase::default_start_node()
         additionalComponents_.emplace_back(space);
     }
     {
-        auto *space = new FileMemorySpace(
-            SNIP_DYNAMIC_FILENAME, sizeof(SimpleNodeDynamicValues));
+        auto *space = new SNIPUserMemorySpace();
         memoryConfigHandler_.registry()->insert(
             node(), MemoryConfigDefs::SPACE_ACDI_USR, space);
         additionalComponents_.emplace_back(space);
@@ -149,7 +167,7 @@ void SimpleTrainCanStack::start_node()
 void SimpleCanStackBase::start_after_delay()
 {
     // Bootstraps the alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+    ifCan_.alias_allocator()->bootstrap();
 }
 
 void SimpleCanStackBase::restart_stack()
@@ -170,7 +188,7 @@ void SimpleCanStackBase::restart_stack()
     }
 
     // Bootstraps the fresh alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+    ifCan_.alias_allocator()->bootstrap();
     extern void StartInitializationFlow(Node * node);
     StartInitializationFlow(node());
 }
@@ -210,6 +228,8 @@ int SimpleCanStackBase::create_config_file_if_needed(
     if (!reset && !extend)
         return fd;
 
+    // Cached writes would overwrite the reset values later.
+    memory_config_handler()->flush_spaces();
     // Clears the file, preserving the node name and desription if any.
     if (extend && !reset) {
         lseek(fd, statbuf.st_size, SEEK_SET);
@@ -251,6 +271,8 @@ int SimpleCanStackBase::check_version_and_factory_reset(
     const InternalConfigData &cfg, uint16_t expected_version, bool force)
 {
     HASSERT(CONFIG_FILENAME);
+    // Cached writes would overwrite the reset values later.
+    memory_config_handler()->flush_spaces();
     int fd = configUpdateFlow_.open_file(CONFIG_FILENAME);
     if (cfg.version().read(fd) != expected_version)
     {
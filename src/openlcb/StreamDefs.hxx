@@ -31,6 +31,9 @@
  * @date 14 December 2014
  */
 
+#ifndef _OPENLCB_STREAMDEFS_HXX_
+#define _OPENLCB_STREAMDEFS_HXX_
+
 #include "openlcb/If.hxx"
 
 namespace openlcb
@@ -41,6 +44,11 @@ struct StreamDefs
 {
     static const uint16_t MAX_PAYLOAD = 0xffff;
 
+    /// Stream ID value that does not refer to any stream. Used in the
+    /// initiate request when the destination stream ID is left to the
+    /// receiver.
+    static const uint8_t INVALID_STREAM_ID = 0xff;
+
     enum Flags
     {
         FLAG_CARRIES_ID = 0x01,
@@ -59,9 +67,17 @@ struct StreamDefs
         REJECT_TEMPORARY_OUT_OF_ORDER = 0x40,
     };
 
+    /// Creates the payload of a stream initiate request message.
+    /// @param max_buffer_size proposed window size in bytes.
+    /// @param has_ident true if the stream will carry a content identifier.
+    /// @param src_stream_id stream ID at the sender.
+    /// @param dst_stream_id suggested stream ID at the receiver, or
+    /// INVALID_STREAM_ID to leave it out.
     static Payload create_initiate_request(uint16_t max_buffer_size,
                                            bool has_ident,
-                                           uint8_t src_stream_id)
+                                           uint8_t src_stream_id,
+                                           uint8_t dst_stream_id =
+                                               INVALID_STREAM_ID)
     {
         Payload p(5, 0);
         p[0] = max_buffer_size >> 8;
@@ -69,6 +85,46 @@ struct StreamDefs
         p[2] = has_ident ? FLAG_CARRIES_ID : 0;
         p[3] = 0;
         p[4] = src_stream_id;
+        if (dst_stream_id != INVALID_STREAM_ID)
+        {
+            p.push_back(dst_stream_id);
+        }
+        return p;
+    }
+
+    /// Creates the payload of a stream initiate reply message.
+    /// @param max_buffer_size negotiated window size in bytes (zero when
+    /// rejecting).
+    /// @param flags FLAG_ACCEPT, or the error flags of a rejection.
+    /// @param additional_flags error details of a rejection.
+    /// @param src_stream_id stream ID at the sender.
+    /// @param dst_stream_id stream ID at the receiver.
+    static Payload create_initiate_reply(uint16_t max_buffer_size,
+                                         uint8_t flags,
+                                         uint8_t additional_flags,
+                                         uint8_t src_stream_id,
+                                         uint8_t dst_stream_id)
+    {
+        Payload p(6, 0);
+        p[0] = max_buffer_size >> 8;
+        p[1] = max_buffer_size & 0xff;
+        p[2] = flags;
+        p[3] = additional_flags;
+        p[4] = src_stream_id;
+        p[5] = dst_stream_id;
+        return p;
+    }
+
+    /// Creates the payload of a stream data proceed message, which grants the
+    /// sender another window of data.
+    /// @param src_stream_id stream ID at the sender.
+    /// @param dst_stream_id stream ID at the receiver.
+    static Payload create_data_proceed(uint8_t src_stream_id,
+                                       uint8_t dst_stream_id)
+    {
+        Payload p(4, 0);
+        p[0] = src_stream_id;
+        p[1] = dst_stream_id;
         return p;
     }
 
@@ -82,3 +138,5 @@ struct StreamDefs
 };
 
 } // namespace openlcb
+
+#endif // _OPENLCB_STREAMDEFS_HXX_
@@ -0,0 +1,700 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * \file StreamService.cxx
+ *
+ * Transport-agnostic implementation of the OpenLCB stream protocol.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "openlcb/StreamService.hxx"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace openlcb
+{
+
+long long STREAM_RESPONSE_TIMEOUT_NSEC = SEC_TO_NSEC(5);
+
+/// Notifies and clears a notifiable, if set. @param n notifiable to wake up.
+static void notify_and_clear(Notifiable **n)
+{
+    if (*n)
+    {
+        Notifiable *nn = *n;
+        *n = nullptr;
+        nn->notify();
+    }
+}
+
+/// Incoming stream messages handled by the service.
+static const Defs::MTI STREAM_MTIS[] = {
+    Defs::MTI_STREAM_INITIATE_REQUEST, Defs::MTI_STREAM_INITIATE_REPLY,
+    Defs::MTI_STREAM_DATA, Defs::MTI_STREAM_PROCEED,
+    Defs::MTI_STREAM_COMPLETE};
+
+StreamService::StreamService(If *iface)
+    : Service(iface->executor())
+    , iface_(iface)
+{
+    for (auto mti : STREAM_MTIS)
+    {
+        iface_->dispatcher()->register_handler(&router_, mti, Defs::MTI_EXACT);
+    }
+}
+
+StreamService::~StreamService()
+{
+    for (auto mti : STREAM_MTIS)
+    {
+        iface_->dispatcher()->unregister_handler(
+            &router_, mti, Defs::MTI_EXACT);
+    }
+}
+
+void StreamService::route(GenMessage *m)
+{
+    if (!m->dstNode)
+    {
+        return;
+    }
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    size_t len = m->payload.size();
+    switch (m->mti)
+    {
+        case Defs::MTI_STREAM_INITIATE_REQUEST:
+        {
+            if (len < 5)
+            {
+                return;
+            }
+            uint8_t suggested = len >= 6 ? p[5] : StreamDefs::INVALID_STREAM_ID;
+            for (auto *r : receivers_)
+            {
+                if (r->state_ == StreamReceiver::LISTENING &&
+                    r->node_ == m->dstNode &&
+                    (suggested == StreamDefs::INVALID_STREAM_ID ||
+                        suggested == r->localStreamId_))
+                {
+                    return r->initiate_request(m);
+                }
+            }
+            return reject_initiate(m);
+        }
+        case Defs::MTI_STREAM_INITIATE_REPLY:
+        {
+            if (len < 6)
+            {
+                return;
+            }
+            for (auto *s : senders_)
+            {
+                if (s->state_ == StreamSender::INITIATING &&
+                    s->node_ == m->dstNode && s->srcStreamId_ == p[4] &&
+                    iface_->matching_node(s->dst_, m->src))
+                {
+                    return s->initiate_reply(m);
+                }
+            }
+            return;
+        }
+        case Defs::MTI_STREAM_PROCEED:
+        {
+            if (len < 2)
+            {
+                return;
+            }
+            for (auto *s : senders_)
+            {
+                if (s->node_ == m->dstNode && s->srcStreamId_ == p[0] &&
+                    s->dstStreamId_ == p[1] &&
+                    (s->state_ == StreamSender::OPEN ||
+                        s->state_ == StreamSender::CLOSING) &&
+                    iface_->matching_node(s->dst_, m->src))
+                {
+                    return s->proceed(m);
+                }
+            }
+            return;
+        }
+        case Defs::MTI_STREAM_DATA:
+        {
+            if (len < 1)
+            {
+                return;
+            }
+            for (auto *r : receivers_)
+            {
+                if (r->state_ == StreamReceiver::OPEN &&
+                    r->node_ == m->dstNode && r->localStreamId_ == p[0] &&
+                    iface_->matching_node(r->remote_, m->src))
+                {
+                    return r->data(m);
+                }
+            }
+            LOG(INFO, "Stream: dropping data for unknown stream %02x.", p[0]);
+            return;
+        }
+        case Defs::MTI_STREAM_COMPLETE:
+        {
+            if (len < 2)
+            {
+                return;
+            }
+            for (auto *r : receivers_)
+            {
+                if (r->state_ == StreamReceiver::OPEN &&
+                    r->node_ == m->dstNode && r->remoteStreamId_ == p[0] &&
+                    r->localStreamId_ == p[1] &&
+                    iface_->matching_node(r->remote_, m->src))
+                {
+                    return r->complete(m);
+                }
+            }
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+void StreamService::reject_initiate(GenMessage *m)
+{
+    auto *b = iface_->addressed_message_write_flow()->alloc();
+    b->data()->reset(Defs::MTI_STREAM_INITIATE_REPLY, m->dstNode->node_id(),
+        m->src,
+        StreamDefs::create_initiate_reply(0, StreamDefs::FLAG_PERMANENT_ERROR,
+            StreamDefs::REJECT_PERMANENT_STREAMS_NOT_ACCEPTED, m->payload[4],
+            StreamDefs::INVALID_STREAM_ID));
+    iface_->addressed_message_write_flow()->send(b);
+}
+
+uint8_t StreamService::allocate_sender_id(Node *node)
+{
+    // Every value once, but INVALID_STREAM_ID.
+    for (unsigned i = 0; i < 256; ++i)
+    {
+        uint8_t id = nextSenderId_++;
+        if (id == StreamDefs::INVALID_STREAM_ID)
+        {
+            continue;
+        }
+        bool used = false;
+        for (auto *s : senders_)
+        {
+            if (s->node_ == node && s->srcStreamId_ == id)
+            {
+                used = true;
+                break;
+            }
+        }
+        if (!used)
+        {
+            return id;
+        }
+    }
+    return StreamDefs::INVALID_STREAM_ID;
+}
+
+StreamSender::StreamSender(StreamService *service)
+    : StateFlowBase(service->iface())
+    , streamService_(service)
+    , hasReply_(0)
+    , isSleeping_(0)
+    , isIdle_(0)
+{
+}
+
+StreamSender::~StreamSender()
+{
+    HASSERT(state_ == CLOSED || state_ == FAILED);
+}
+
+void StreamSender::start_stream(Node *src, NodeHandle dst,
+    uint16_t max_buffer_size, Notifiable *done, uint8_t dst_stream_id)
+{
+    HASSERT(state_ == CLOSED || state_ == FAILED);
+    node_ = src;
+    dst_ = dst;
+    proposedWindow_ = max_buffer_size;
+    openDone_ = done;
+    dstStreamId_ = dst_stream_id;
+    srcStreamId_ = streamService_->allocate_sender_id(src);
+    txBuffer_.clear();
+    bytesSent_ = 0;
+    credit_ = 0;
+    windowSize_ = 0;
+    error_ = 0;
+    hasReply_ = 0;
+    state_ = INITIATING;
+    if (srcStreamId_ == StreamDefs::INVALID_STREAM_ID)
+    {
+        LOG(WARNING, "Stream: all stream IDs of %012" PRIx64 " are in use.",
+            src->node_id());
+        error_ = Defs::ERROR_TEMPORARY;
+        start_flow(STATE(no_stream_id));
+        return;
+    }
+    streamService_->senders_.push_back(this);
+    start_flow(STATE(send_initiate));
+}
+
+StateFlowBase::Action StreamSender::no_stream_id()
+{
+    finish(FAILED);
+    return exit();
+}
+
+StateFlowBase::Action StreamSender::send_initiate()
+{
+    return allocate_and_call(
+        iface()->addressed_message_write_flow(), STATE(initiate_allocated));
+}
+
+StateFlowBase::Action StreamSender::initiate_allocated()
+{
+    auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+    b->data()->reset(Defs::MTI_STREAM_INITIATE_REQUEST, node_->node_id(), dst_,
+        StreamDefs::create_initiate_request(
+            proposedWindow_, false, srcStreamId_, dstStreamId_));
+    iface()->addressed_message_write_flow()->send(b);
+    isSleeping_ = 1;
+    return sleep_and_call(&timer_, STREAM_RESPONSE_TIMEOUT_NSEC,
+        STATE(initiate_reply_or_timeout));
+}
+
+void StreamSender::initiate_reply(GenMessage *m)
+{
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    uint8_t flags = p[2];
+    windowSize_ = (p[0] << 8) | p[1];
+    if ((flags & StreamDefs::FLAG_ACCEPT) && windowSize_)
+    {
+        dstStreamId_ = p[5];
+    }
+    else
+    {
+        error_ = (flags << 8) | p[3];
+        if (!error_)
+        {
+            // Accepted with zero buffer size.
+            error_ = StreamDefs::FLAG_PERMANENT_ERROR << 8;
+        }
+    }
+    // Saves what we learned about the destination.
+    if (!dst_.id)
+    {
+        dst_.id = m->src.id;
+    }
+    if (m->src.alias)
+    {
+        dst_.alias = m->src.alias;
+    }
+    hasReply_ = 1;
+    if (isSleeping_)
+    {
+        isSleeping_ = 0;
+        timer_.trigger();
+    }
+}
+
+StateFlowBase::Action StreamSender::initiate_reply_or_timeout()
+{
+    isSleeping_ = 0;
+    if (!hasReply_)
+    {
+        LOG(INFO, "Stream: no initiate reply from %012" PRIx64 ".", dst_.id);
+        error_ = Defs::ERROR_OPENLCB_TIMEOUT;
+    }
+    if (error_)
+    {
+        finish(FAILED);
+        return exit();
+    }
+    state_ = OPEN;
+    credit_ = windowSize_;
+    notify_and_clear(&openDone_);
+    return call_immediately(STATE(send_more));
+}
+
+ssize_t StreamSender::write(const void *data, size_t len, Notifiable *n)
+{
+    if (state_ != OPEN)
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+    size_t space = windowSize_ - txBuffer_.size();
+    if (!space)
+    {
+        writeDone_ = n;
+        errno = EAGAIN;
+        return -1;
+    }
+    len = std::min(len, space);
+    txBuffer_.append((const char *)data, len);
+    wakeup();
+    return len;
+}
+
+void StreamSender::close(Notifiable *done)
+{
+    if (state_ != OPEN)
+    {
+        done->notify();
+        return;
+    }
+    state_ = CLOSING;
+    closeDone_ = done;
+    wakeup();
+}
+
+StateFlowBase::Action StreamSender::send_more()
+{
+    if (!txBuffer_.empty() && credit_)
+    {
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(data_allocated));
+    }
+    if (!txBuffer_.empty())
+    {
+        // Out of window; waits for the receiver.
+        isSleeping_ = 1;
+        return sleep_and_call(&timer_, STREAM_RESPONSE_TIMEOUT_NSEC,
+            STATE(proceed_or_timeout));
+    }
+    if (state_ == CLOSING)
+    {
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(complete_allocated));
+    }
+    isIdle_ = 1;
+    return wait_and_call(STATE(send_more));
+}
+
+StateFlowBase::Action StreamSender::data_allocated()
+{
+    auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+    size_t len = std::min(txBuffer_.size(), credit_);
+    b->data()->reset(
+        Defs::MTI_STREAM_DATA, node_->node_id(), dst_, EMPTY_PAYLOAD);
+    Payload &p = b->data()->payload;
+    p.reserve(len + 1);
+    p.push_back(dstStreamId_);
+    p.append(txBuffer_, 0, len);
+    txBuffer_.erase(0, len);
+    credit_ -= len;
+    bytesSent_ += len;
+    iface()->addressed_message_write_flow()->send(b);
+    notify_and_clear(&writeDone_);
+    return call_immediately(STATE(send_more));
+}
+
+void StreamSender::proceed(GenMessage *m)
+{
+    credit_ += windowSize_;
+    if (isSleeping_)
+    {
+        isSleeping_ = 0;
+        timer_.trigger();
+    }
+}
+
+StateFlowBase::Action StreamSender::proceed_or_timeout()
+{
+    isSleeping_ = 0;
+    if (!credit_)
+    {
+        LOG(INFO, "Stream: no proceed from %012" PRIx64 " after %u bytes.",
+            dst_.id, (unsigned)bytesSent_);
+        error_ = Defs::ERROR_OPENLCB_TIMEOUT;
+        finish(FAILED);
+        return exit();
+    }
+    return call_immediately(STATE(send_more));
+}
+
+StateFlowBase::Action StreamSender::complete_allocated()
+{
+    auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+    b->data()->reset(Defs::MTI_STREAM_COMPLETE, node_->node_id(), dst_,
+        StreamDefs::create_close_request(srcStreamId_, dstStreamId_));
+    iface()->addressed_message_write_flow()->send(b);
+    finish(CLOSED);
+    return exit();
+}
+
+void StreamSender::wakeup()
+{
+    if (isIdle_)
+    {
+        isIdle_ = 0;
+        notify();
+    }
+}
+
+void StreamSender::finish(State state)
+{
+    state_ = state;
+    auto &v = streamService_->senders_;
+    v.erase(std::remove(v.begin(), v.end(), this), v.end());
+    notify_and_clear(&openDone_);
+    notify_and_clear(&writeDone_);
+    notify_and_clear(&closeDone_);
+}
+
+StreamReceiver::InactivityTimer::InactivityTimer(StreamReceiver *parent)
+    : ::Timer(parent->service()->executor()->active_timers())
+    , parent_(parent)
+{
+}
+
+StreamReceiver::StreamReceiver(StreamService *service)
+    : StateFlowBase(service->iface())
+    , streamService_(service)
+    , isIdle_(0)
+    , replyPending_(0)
+    , timerActive_(0)
+{
+    start_flow(STATE(maybe_send));
+}
+
+StreamReceiver::~StreamReceiver()
+{
+    if (timerActive_)
+    {
+        timer_.cancel();
+    }
+    unregister();
+}
+
+void StreamReceiver::start(Node *node, uint8_t local_stream_id,
+    uint16_t max_buffer_size, Notifiable *on_open)
+{
+    HASSERT(state_ == CLOSED || state_ == COMPLETE || state_ == FAILED);
+    HASSERT(local_stream_id != StreamDefs::INVALID_STREAM_ID);
+    HASSERT(max_buffer_size);
+    node_ = node;
+    localStreamId_ = local_stream_id;
+    maxWindow_ = max_buffer_size;
+    openDone_ = on_open;
+    rxBuffer_.clear();
+    rxOffset_ = 0;
+    received_ = 0;
+    granted_ = 0;
+    state_ = LISTENING;
+    streamService_->receivers_.push_back(this);
+}
+
+void StreamReceiver::stop()
+{
+    unregister();
+    state_ = CLOSED;
+    rxBuffer_.clear();
+    rxOffset_ = 0;
+    notify_and_clear(&readDone_);
+}
+
+void StreamReceiver::initiate_request(GenMessage *m)
+{
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    uint16_t proposed = (p[0] << 8) | p[1];
+    windowSize_ = proposed ? std::min(proposed, maxWindow_) : maxWindow_;
+    remote_ = m->src;
+    remoteStreamId_ = p[4];
+    rxBuffer_.reserve(2 * windowSize_);
+    granted_ = windowSize_;
+    state_ = OPEN;
+    replyPending_ = 1;
+    touch();
+    wakeup();
+}
+
+void StreamReceiver::touch()
+{
+    lastActivity_ = os_get_time_monotonic();
+    if (!timerActive_)
+    {
+        timerActive_ = 1;
+        timer_.start(STREAM_RESPONSE_TIMEOUT_NSEC);
+    }
+}
+
+long long StreamReceiver::inactivity_timeout()
+{
+    if (state_ != OPEN)
+    {
+        timerActive_ = 0;
+        return ::Timer::NONE;
+    }
+    long long now = os_get_time_monotonic();
+    if (received_ == granted_)
+    {
+        // The sender is waiting for us to send a proceed.
+        lastActivity_ = now;
+    }
+    long long left = lastActivity_ + STREAM_RESPONSE_TIMEOUT_NSEC - now;
+    if (left > 0)
+    {
+        // Small values would be mistaken for RESTART.
+        return left > ::Timer::RESTART ? left : ::Timer::RESTART + 1;
+    }
+    LOG(INFO, "Stream: no data from %012" PRIx64 " after %u bytes.",
+        remote_.id, (unsigned)received_);
+    timerActive_ = 0;
+    state_ = FAILED;
+    unregister();
+    notify_and_clear(&readDone_);
+    return ::Timer::NONE;
+}
+
+StateFlowBase::Action StreamReceiver::maybe_send()
+{
+    if (replyPending_)
+    {
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(reply_allocated));
+    }
+    if (state_ == OPEN && received_ == granted_ &&
+        rxBuffer_.size() - rxOffset_ <= windowSize_)
+    {
+        // The sender used up its window and we have space for another one.
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(proceed_allocated));
+    }
+    isIdle_ = 1;
+    return wait_and_call(STATE(maybe_send));
+}
+
+StateFlowBase::Action StreamReceiver::reply_allocated()
+{
+    auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+    replyPending_ = 0;
+    b->data()->reset(Defs::MTI_STREAM_INITIATE_REPLY, node_->node_id(),
+        remote_,
+        StreamDefs::create_initiate_reply(windowSize_, StreamDefs::FLAG_ACCEPT,
+            0, remoteStreamId_, localStreamId_));
+    iface()->addressed_message_write_flow()->send(b);
+    notify_and_clear(&openDone_);
+    return call_immediately(STATE(maybe_send));
+}
+
+StateFlowBase::Action StreamReceiver::proceed_allocated()
+{
+    auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+    granted_ += windowSize_;
+    touch();
+    b->data()->reset(Defs::MTI_STREAM_PROCEED, node_->node_id(), remote_,
+        StreamDefs::create_data_proceed(remoteStreamId_, localStreamId_));
+    iface()->addressed_message_write_flow()->send(b);
+    return call_immediately(STATE(maybe_send));
+}
+
+void StreamReceiver::data(GenMessage *m)
+{
+    size_t len = m->payload.size() - 1;
+    if (received_ + len > granted_)
+    {
+        LOG(WARNING, "Stream: sender %012" PRIx64 " overran the window.",
+            remote_.id);
+        len = granted_ - received_;
+    }
+    rxBuffer_.append(m->payload, 1, len);
+    received_ += len;
+    touch();
+    notify_and_clear(&readDone_);
+    wakeup();
+}
+
+void StreamReceiver::complete(GenMessage *m)
+{
+    state_ = COMPLETE;
+    unregister();
+    notify_and_clear(&readDone_);
+}
+
+ssize_t StreamReceiver::read(void *buf, size_t len, Notifiable *n)
+{
+    size_t avail = rxBuffer_.size() - rxOffset_;
+    if (!avail)
+    {
+        if (state_ == COMPLETE)
+        {
+            return 0;
+        }
+        if (state_ == CLOSED)
+        {
+            errno = ENOTCONN;
+            return -1;
+        }
+        if (state_ == FAILED)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        readDone_ = n;
+        errno = EAGAIN;
+        return -1;
+    }
+    len = std::min(len, avail);
+    memcpy(buf, rxBuffer_.data() + rxOffset_, len);
+    rxOffset_ += len;
+    if (rxOffset_ == rxBuffer_.size())
+    {
+        rxBuffer_.clear();
+        rxOffset_ = 0;
+    }
+    else if (rxOffset_ >= windowSize_)
+    {
+        rxBuffer_.erase(0, rxOffset_);
+        rxOffset_ = 0;
+    }
+    wakeup();
+    return len;
+}
+
+void StreamReceiver::wakeup()
+{
+    if (isIdle_)
+    {
+        isIdle_ = 0;
+        notify();
+    }
+}
+
+void StreamReceiver::unregister()
+{
+    auto &v = streamService_->receivers_;
+    v.erase(std::remove(v.begin(), v.end(), this), v.end());
+}
+
+} // namespace openlcb
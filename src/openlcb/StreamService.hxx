@@ -0,0 +1,478 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * \file StreamService.hxx
+ *
+ * Transport-agnostic implementation of the OpenLCB stream protocol.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _OPENLCB_STREAMSERVICE_HXX_
+#define _OPENLCB_STREAMSERVICE_HXX_
+
+#include <vector>
+
+#include "executor/StateFlow.hxx"
+#include "executor/Timer.hxx"
+#include "openlcb/If.hxx"
+#include "openlcb/StreamDefs.hxx"
+
+namespace openlcb
+{
+
+/// How long a stream sender waits for the initiate reply or for the next
+/// proceed message before giving up. A stream receiver waits this long for
+/// the next data message, while the sender has window left.
+extern long long STREAM_RESPONSE_TIMEOUT_NSEC;
+
+class StreamSender;
+class StreamReceiver;
+
+/// Routes the incoming stream protocol messages of an interface to the open
+/// StreamSender and StreamReceiver objects.
+///
+/// There should be one instance of this per interface. Stream initiate
+/// requests that no receiver is listening for are rejected.
+class StreamService : public Service
+{
+public:
+    /// Constructor. @param iface is the interface to bind to.
+    StreamService(If *iface);
+    ~StreamService();
+
+    /// @return the interface the streams are running on.
+    If *iface()
+    {
+        return iface_;
+    }
+
+private:
+    friend class StreamSender;
+    friend class StreamReceiver;
+
+    /// Receives the stream messages from the interface's dispatcher.
+    class Router : public MessageHandler
+    {
+    public:
+        /// Constructor. @param parent owning service.
+        Router(StreamService *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(Buffer<GenMessage> *message, unsigned priority) override
+        {
+            parent_->route(message->data());
+            message->unref();
+        }
+
+    private:
+        /// Owning service.
+        StreamService *parent_;
+    };
+
+    /// Dispatches one incoming message to the sender or receiver it belongs
+    /// to. @param m incoming message.
+    void route(GenMessage *m);
+
+    /// Sends a reject reply to an initiate request nobody listens for.
+    /// @param m the initiate request.
+    void reject_initiate(GenMessage *m);
+
+    /// @return a stream ID not used by any open sender of node, or
+    /// StreamDefs::INVALID_STREAM_ID if all are in use. @param node local
+    /// node that will send the stream.
+    uint8_t allocate_sender_id(Node *node);
+
+    /// Interface on which we are registered.
+    If *iface_;
+    /// Incoming message handler.
+    Router router_{this};
+    /// Senders that are initiating or have an open stream.
+    std::vector<StreamSender *> senders_;
+    /// Receivers that are listening or have an open stream.
+    std::vector<StreamReceiver *> receivers_;
+    /// Next candidate for allocate_sender_id.
+    uint8_t nextSenderId_ = 0;
+};
+
+/// Sending side of one stream, with a socket-like asynchronous API.
+///
+/// Usage: start_stream(), wait for the notification, check state(); then
+/// call write() repeatedly, and finally close(). The object can be reused
+/// for another stream once it is back in the CLOSED or FAILED state.
+///
+/// Outgoing data is copied into a transmit buffer as large as the
+/// negotiated window; the flow sends it as soon as the receiver has granted
+/// the space, so the application can fill the next window while the
+/// previous one is on the wire.
+///
+/// All calls must be made on the executor of the interface.
+class StreamSender : public StateFlowBase
+{
+public:
+    /// Lifecycle of the stream.
+    enum State
+    {
+        /// No stream.
+        CLOSED,
+        /// Waiting for the initiate reply.
+        INITIATING,
+        /// Data can be written.
+        OPEN,
+        /// close() was called; flushing the remaining data.
+        CLOSING,
+        /// The stream was rejected or timed out. See error().
+        FAILED,
+    };
+
+    /// Constructor. @param service stream service of the interface.
+    StreamSender(StreamService *service);
+    ~StreamSender();
+
+    /// Opens a stream to a remote node.
+    ///
+    /// @param src local node sending the stream.
+    /// @param dst node to send the stream to.
+    /// @param max_buffer_size proposed window size. The receiver may
+    /// decrease it.
+    /// @param done notified when the stream is open, or when opening
+    /// failed. Opening fails without sending anything if src already has a
+    /// stream open with every stream ID.
+    /// @param dst_stream_id stream ID at the receiver, if agreed in advance
+    /// (e.g. by a memory configuration command).
+    void start_stream(Node *src, NodeHandle dst, uint16_t max_buffer_size,
+        Notifiable *done,
+        uint8_t dst_stream_id = StreamDefs::INVALID_STREAM_ID);
+
+    /// Queues data to send. Never blocks.
+    ///
+    /// @param data bytes to send.
+    /// @param len number of bytes in data.
+    /// @param n if the transmit buffer is full, notified when there is space
+    /// again (or the stream failed).
+    /// @return the number of bytes taken (may be less than len); -1 with
+    /// errno EAGAIN if the buffer is full; -1 with errno ENOTCONN if the
+    /// stream is not open.
+    ssize_t write(const void *data, size_t len, Notifiable *n);
+
+    /// Sends the remaining data and closes the stream.
+    /// @param done notified when the stream complete message is sent.
+    void close(Notifiable *done);
+
+    /// @return the state of the stream.
+    State state()
+    {
+        return state_;
+    }
+
+    /// @return error flags of the initiate reply in the FAILED state
+    /// (flags << 8 | additional flags), Defs::ERROR_OPENLCB_TIMEOUT, or
+    /// Defs::ERROR_TEMPORARY if there was no free source stream ID.
+    uint16_t error()
+    {
+        return error_;
+    }
+
+    /// @return the negotiated window size.
+    uint16_t window_size()
+    {
+        return windowSize_;
+    }
+
+    /// @return the total number of bytes sent in this stream.
+    size_t bytes_sent()
+    {
+        return bytesSent_;
+    }
+
+    /// @return the stream ID at the sender.
+    uint8_t src_stream_id()
+    {
+        return srcStreamId_;
+    }
+
+    /// @return the stream ID at the receiver.
+    uint8_t dst_stream_id()
+    {
+        return dstStreamId_;
+    }
+
+private:
+    friend class StreamService;
+
+    /// @return the interface.
+    If *iface()
+    {
+        return streamService_->iface();
+    }
+
+    Action send_initiate();
+    Action initiate_allocated();
+    Action initiate_reply_or_timeout();
+    /// Fails the open without sending an initiate request.
+    Action no_stream_id();
+    Action send_more();
+    Action data_allocated();
+    Action proceed_or_timeout();
+    Action complete_allocated();
+
+    /// Called by the service on an incoming initiate reply. @param m message
+    void initiate_reply(GenMessage *m);
+    /// Called by the service on an incoming proceed message. @param m
+    /// message
+    void proceed(GenMessage *m);
+
+    /// Wakes up the flow if it is idle.
+    void wakeup();
+    /// Moves to a final state and notifies everyone waiting.
+    /// @param state CLOSED or FAILED.
+    void finish(State state);
+
+    /// Parent service.
+    StreamService *streamService_;
+    /// Local node sending the data.
+    Node *node_ = nullptr;
+    /// Remote node receiving the data.
+    NodeHandle dst_;
+    /// Data accepted by write() but not sent yet.
+    string txBuffer_;
+    /// Notified when the stream is open or failed.
+    Notifiable *openDone_ = nullptr;
+    /// Notified when there is space in the transmit buffer.
+    Notifiable *writeDone_ = nullptr;
+    /// Notified when the stream is closed.
+    Notifiable *closeDone_ = nullptr;
+    /// Bytes sent.
+    size_t bytesSent_ = 0;
+    /// Bytes the receiver still accepts before the next proceed message.
+    size_t credit_ = 0;
+    /// Wakes up the flow on timeout.
+    StateFlowTimer timer_{this};
+    /// Negotiated window size.
+    uint16_t windowSize_ = 0;
+    /// Error code for the FAILED state.
+    uint16_t error_ = 0;
+    /// Lifecycle.
+    State state_ = CLOSED;
+    /// Stream ID at the sender.
+    uint8_t srcStreamId_ = StreamDefs::INVALID_STREAM_ID;
+    /// Stream ID at the receiver.
+    uint8_t dstStreamId_ = StreamDefs::INVALID_STREAM_ID;
+    /// Proposed window size for the initiate request.
+    uint16_t proposedWindow_ = 0;
+    /// 1 if the initiate reply arrived.
+    unsigned hasReply_ : 1;
+    /// 1 while sleeping on timer_.
+    unsigned isSleeping_ : 1;
+    /// 1 while waiting for wakeup().
+    unsigned isIdle_ : 1;
+};
+
+/// Receiving side of one stream, with a socket-like asynchronous API.
+///
+/// Usage: start() to listen for an incoming stream; read() the data as it
+/// arrives until read() returns 0 (end of stream). The object can be
+/// reused once the stream is closed.
+///
+/// The receive buffer holds two windows. A proceed message is sent as soon
+/// as a full window arrived and the application has left space for the next
+/// one, so the sender is only stalled when the application does not keep up
+/// with reading.
+///
+/// If the sender stops sending for STREAM_RESPONSE_TIMEOUT_NSEC while it
+/// still has window left, the stream fails. Time spent waiting for the
+/// application to read does not count.
+///
+/// All calls must be made on the executor of the interface.
+class StreamReceiver : public StateFlowBase
+{
+public:
+    /// Lifecycle of the stream.
+    enum State
+    {
+        /// No stream.
+        CLOSED,
+        /// Waiting for an initiate request.
+        LISTENING,
+        /// Data is arriving.
+        OPEN,
+        /// The sender closed the stream. The data may not have been read
+        /// completely yet.
+        COMPLETE,
+        /// The sender stopped sending data. The data received before may not
+        /// have been read completely yet.
+        FAILED,
+    };
+
+    /// Constructor. @param service stream service of the interface.
+    StreamReceiver(StreamService *service);
+    ~StreamReceiver();
+
+    /// Starts listening for an incoming stream.
+    ///
+    /// @param node local node receiving the stream.
+    /// @param local_stream_id stream ID at the receiver. An initiate request
+    /// that suggests a destination stream ID will only match if it is this
+    /// one.
+    /// @param max_buffer_size largest window size to accept.
+    /// @param on_open notified when a stream was accepted.
+    void start(Node *node, uint8_t local_stream_id, uint16_t max_buffer_size,
+        Notifiable *on_open);
+
+    /// Stops listening, or abandons an open stream.
+    void stop();
+
+    /// Takes the received data. Never blocks.
+    ///
+    /// @param buf where to copy the data.
+    /// @param len size of buf.
+    /// @param n if no data is available, notified when data arrives or the
+    /// stream ends.
+    /// @return the number of bytes copied; 0 at the end of the stream; -1
+    /// with errno EAGAIN if no data is available yet; -1 with errno ENOTCONN
+    /// if there is no stream; -1 with errno ETIMEDOUT if the stream failed.
+    ssize_t read(void *buf, size_t len, Notifiable *n);
+
+    /// @return the state of the stream.
+    State state()
+    {
+        return state_;
+    }
+
+    /// @return the node that is sending the stream.
+    NodeHandle remote()
+    {
+        return remote_;
+    }
+
+    /// @return the negotiated window size.
+    uint16_t window_size()
+    {
+        return windowSize_;
+    }
+
+    /// @return the total number of bytes received.
+    size_t bytes_received()
+    {
+        return received_;
+    }
+
+private:
+    friend class StreamService;
+
+    /// @return the interface.
+    If *iface()
+    {
+        return streamService_->iface();
+    }
+
+    Action maybe_send();
+    Action reply_allocated();
+    Action proceed_allocated();
+
+    /// Called by the service on a matching initiate request. @param m
+    /// message
+    void initiate_request(GenMessage *m);
+    /// Called by the service on incoming data. @param m message
+    void data(GenMessage *m);
+    /// Called by the service on stream complete. @param m message
+    void complete(GenMessage *m);
+
+    /// Wakes up the flow if it is idle.
+    void wakeup();
+    /// Removes this from the service.
+    void unregister();
+    /// Records that the sender is alive, and starts the inactivity timer if
+    /// needed.
+    void touch();
+    /// Called by the inactivity timer. @return the timer's next period, or
+    /// ::Timer::NONE.
+    long long inactivity_timeout();
+
+    /// Fails the stream if the sender goes silent.
+    class InactivityTimer : public ::Timer
+    {
+    public:
+        /// Constructor. @param parent owning receiver.
+        InactivityTimer(StreamReceiver *parent);
+
+        long long timeout() override
+        {
+            return parent_->inactivity_timeout();
+        }
+
+    private:
+        /// Owning receiver.
+        StreamReceiver *parent_;
+    };
+
+    /// Parent service.
+    StreamService *streamService_;
+    /// Local node receiving the data.
+    Node *node_ = nullptr;
+    /// Remote node sending the data.
+    NodeHandle remote_;
+    /// Received data not read yet, starting at rxOffset_.
+    string rxBuffer_;
+    /// Read position in rxBuffer_.
+    size_t rxOffset_ = 0;
+    /// Total bytes received.
+    size_t received_ = 0;
+    /// Total bytes the sender was allowed to send so far.
+    size_t granted_ = 0;
+    /// Time of the last message from (or proceed to) the sender.
+    long long lastActivity_ = 0;
+    /// Checks lastActivity_ while the stream is open.
+    InactivityTimer timer_{this};
+    /// Notified when the stream is open.
+    Notifiable *openDone_ = nullptr;
+    /// Notified when there is data to read.
+    Notifiable *readDone_ = nullptr;
+    /// Largest window size to accept.
+    uint16_t maxWindow_ = 0;
+    /// Negotiated window size.
+    uint16_t windowSize_ = 0;
+    /// Lifecycle.
+    State state_ = CLOSED;
+    /// Stream ID at the receiver.
+    uint8_t localStreamId_ = StreamDefs::INVALID_STREAM_ID;
+    /// Stream ID at the sender.
+    uint8_t remoteStreamId_ = StreamDefs::INVALID_STREAM_ID;
+    /// 1 while waiting for wakeup().
+    unsigned isIdle_ : 1;
+    /// 1 if the initiate reply needs to be sent.
+    unsigned replyPending_ : 1;
+    /// 1 while timer_ is scheduled.
+    unsigned timerActive_ : 1;
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_STREAMSERVICE_HXX_
@@ -35,9 +35,110 @@
 
 #include "openlcb/TcpDefs.hxx"
 
+#include <string.h>
+
 namespace openlcb {
 
 const char TcpDefs::MDNS_SERVICE_NAME_TCP[] = "_openlcb-hub._tcp";
 const char TcpDefs::MDNS_SERVICE_NAME_GRIDCONNECT_CAN[] = "_openlcb-can._tcp";
 
+/// Writes a big-endian value. @param p output @param value what to write
+/// @param bytes how many low bytes of value to write
+static void put_be(uint8_t *p, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = bytes; i > 0; --i)
+    {
+        p[i - 1] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+/// @return a big-endian value. @param p input @param bytes field length
+static uint64_t get_be(const uint8_t *p, unsigned bytes)
+{
+    uint64_t ret = 0;
+    for (unsigned i = 0; i < bytes; ++i)
+    {
+        ret = (ret << 8) | p[i];
+    }
+    return ret;
+}
+
+void TcpDefs::render_tcp_message(const GenMessage &msg,
+    NodeID gateway_node_id, long long timestamp_msec, string *tgt)
+{
+    bool addressed = msg.mti & Defs::MTI_ADDRESS_MASK;
+    unsigned ofs = addressed ? MSG_ADDRESSED_PAYLOAD_OFS
+                             : MSG_GLOBAL_PAYLOAD_OFS;
+    HASSERT(msg.payload.size() <= MAX_PAYLOAD);
+    tgt->resize(ofs + msg.payload.size());
+    uint8_t *p = (uint8_t *)&(*tgt)[0];
+    put_be(p + HDR_FLAGS_OFS, FLAGS_OPENLCB_MSG, 2);
+    put_be(p + HDR_SIZE_OFS, tgt->size() - HDR_PREFIX_LEN, 3);
+    put_be(p + HDR_GATEWAY_OFS, gateway_node_id, 6);
+    put_be(p + HDR_TIMESTAMP_OFS, timestamp_msec, 6);
+    put_be(p + MSG_MTI_OFS, msg.mti, 2);
+    put_be(p + MSG_SRC_OFS, msg.src.id, 6);
+    if (addressed)
+    {
+        put_be(p + MSG_DST_OFS, msg.dst.id, 6);
+    }
+    memcpy(p + ofs, msg.payload.data(), msg.payload.size());
+}
+
+int TcpDefs::get_tcp_message_length(const void *data, size_t len)
+{
+    if (len < HDR_PREFIX_LEN)
+    {
+        return 0;
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    unsigned size = get_be(p + HDR_SIZE_OFS, 3);
+    if (size + HDR_PREFIX_LEN < MSG_GLOBAL_PAYLOAD_OFS ||
+        size > MAX_ACCEPTED_SIZE_FIELD)
+    {
+        return -1;
+    }
+    if (len < size + HDR_PREFIX_LEN)
+    {
+        return 0;
+    }
+    return size + HDR_PREFIX_LEN;
+}
+
+bool TcpDefs::parse_tcp_message(
+    const string &src, GenMessage *tgt, NodeID *gateway_node_id)
+{
+    if (get_tcp_message_length(src.data(), src.size()) != (int)src.size())
+    {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)src.data();
+    if (!(get_be(p + HDR_FLAGS_OFS, 2) & FLAGS_OPENLCB_MSG))
+    {
+        return false;
+    }
+    if (gateway_node_id)
+    {
+        *gateway_node_id = get_be(p + HDR_GATEWAY_OFS, 6);
+    }
+    Defs::MTI mti = (Defs::MTI)get_be(p + MSG_MTI_OFS, 2);
+    NodeID src_id = get_be(p + MSG_SRC_OFS, 6);
+    if (mti & Defs::MTI_ADDRESS_MASK)
+    {
+        if (src.size() < MSG_ADDRESSED_PAYLOAD_OFS)
+        {
+            return false;
+        }
+        NodeHandle dst(get_be(p + MSG_DST_OFS, 6), 0);
+        tgt->reset(mti, src_id, dst,
+            src.substr(MSG_ADDRESSED_PAYLOAD_OFS));
+    }
+    else
+    {
+        tgt->reset(mti, src_id, src.substr(MSG_GLOBAL_PAYLOAD_OFS));
+    }
+    return true;
+}
+
 }  // namespace openlcb
@@ -36,6 +36,7 @@
 #ifndef _OPENLCB_TCPDEFS_HXX_
 #define _OPENLCB_TCPDEFS_HXX_
 
+#include "openlcb/If.hxx"
 #include "utils/macros.h"
 
 namespace openlcb {
@@ -45,6 +46,79 @@ public:
     static const char MDNS_SERVICE_NAME_TCP[];
     static const char MDNS_SERVICE_NAME_GRIDCONNECT_CAN[];
 
+    /// Layout of a message in the OpenLCB-TCP wire protocol. Every message
+    /// starts with a fixed header (flags, length, originating gateway and
+    /// capture time), followed by the OpenLCB message with full 48-bit node
+    /// IDs. All multi-byte fields are big-endian.
+    enum
+    {
+        /// Header flag set for messages carrying an OpenLCB message (as
+        /// opposed to link control messages).
+        FLAGS_OPENLCB_MSG = 0x8000,
+        /// Offset of the 2-byte flags field.
+        HDR_FLAGS_OFS = 0,
+        /// Offset of the 3-byte length field. Its value is the number of
+        /// bytes following the length field.
+        HDR_SIZE_OFS = 2,
+        /// Offset of the 6-byte node ID of the originating gateway.
+        HDR_GATEWAY_OFS = 5,
+        /// Offset of the 6-byte capture timestamp (in milliseconds).
+        HDR_TIMESTAMP_OFS = 11,
+        /// Length of the header up to and including the length field.
+        HDR_PREFIX_LEN = 5,
+        /// Offset of the 2-byte MTI.
+        MSG_MTI_OFS = 17,
+        /// Offset of the 6-byte source node ID.
+        MSG_SRC_OFS = 19,
+        /// Offset of the 6-byte destination node ID in addressed messages.
+        MSG_DST_OFS = 25,
+        /// Offset of the payload in global messages.
+        MSG_GLOBAL_PAYLOAD_OFS = 25,
+        /// Offset of the payload in addressed messages.
+        MSG_ADDRESSED_PAYLOAD_OFS = 31,
+        /// Largest value the 3-byte length field can hold.
+        MAX_SIZE_FIELD = 0xFFFFFF,
+        /// Largest payload accepted in a message. Fits a stream data message
+        /// with a full 64 KiB window. The length field would allow 16 MiB,
+        /// which a peer could use to make the receiver buffer that much.
+        MAX_PAYLOAD = 0x10000,
+        /// Largest value of the length field accepted from the wire.
+        MAX_ACCEPTED_SIZE_FIELD =
+            MSG_ADDRESSED_PAYLOAD_OFS + MAX_PAYLOAD - HDR_PREFIX_LEN,
+    };
+
+    /// Renders an OpenLCB message into the TCP wire format.
+    ///
+    /// @param msg the message to render. For addressed messages dst.id must
+    /// be filled in. The payload must be at most MAX_PAYLOAD bytes.
+    /// @param gateway_node_id node ID of the interface sending the message.
+    /// @param timestamp_msec capture time to put into the header.
+    /// @param tgt will be overwritten with the binary message.
+    static void render_tcp_message(const GenMessage &msg,
+        NodeID gateway_node_id, long long timestamp_msec, string *tgt);
+
+    /// Checks whether a complete message is at the beginning of a buffer.
+    ///
+    /// @param data received bytes.
+    /// @param len number of bytes in data.
+    /// @return the total length of the first message in data if data is at
+    /// least that long; 0 if more bytes are needed; -1 if the header is
+    /// malformed or announces a message longer than MAX_PAYLOAD allows (the
+    /// stream cannot be resynchronized).
+    static int get_tcp_message_length(const void *data, size_t len);
+
+    /// Parses a complete binary message.
+    ///
+    /// @param src one message, as delimited by get_tcp_message_length.
+    /// @param tgt will be filled with the OpenLCB message. dstNode and the
+    /// aliases are cleared.
+    /// @param gateway_node_id if not null, will be filled with the node ID
+    /// of the originating gateway.
+    /// @return true if the message was well-formed and carried an OpenLCB
+    /// message.
+    static bool parse_tcp_message(
+        const string &src, GenMessage *tgt, NodeID *gateway_node_id = nullptr);
+
 private:
     /// Nobody can construct this class.
     TcpDefs();
@@ -52,9 +52,6 @@ TrainNode::TrainNode(TrainService *service, TrainImpl *train)
 
 TrainNode::~TrainNode()
 {
-    while (!consistSlaves_.empty()) {
-        delete consistSlaves_.pop_front();
-    }
 }
 
 TrainNodeForProxy::TrainNodeForProxy(TrainService *service, TrainImpl *train)
@@ -177,7 +174,6 @@ struct TrainService::Impl
                 {
                     SpeedType sp = fp16_to_speed(payload() + 1);
                     train_node()->train()->set_speed(sp);
-                    nextConsistIndex_ = 0;
                     return call_immediately(STATE(maybe_forward_consist));
                 }
                 case TractionDefs::REQ_SET_FN:
@@ -191,7 +187,6 @@ struct TrainService::Impl
                     value <<= 8;
                     value |= payload()[5];
                     train_node()->train()->set_fn(address, value);
-                    nextConsistIndex_ = 0;
                     return call_immediately(STATE(maybe_forward_consist));
                 }
                 case TractionDefs::REQ_EMERGENCY_STOP:
@@ -408,88 +403,47 @@ struct TrainService::Impl
             }
         }
 
+        /// Sends the current speed or function command to all consist
+        /// members at once. Each forwarded message holds a child of the
+        /// incoming message's barrier, so the sender of the command is
+        /// notified when all members' messages are sent.
         Action maybe_forward_consist()
         {
-            auto* train_node = this->train_node();
-            unsigned count = train_node->query_consist_length();
-            if (count <= nextConsistIndex_)
-                return release_and_exit();
-            uint8_t flags = 0;
-            NodeID dst = train_node->query_consist(nextConsistIndex_, &flags);
-            if (iface()->matching_node(nmsg()->src, NodeHandle(dst)))
+            auto *train_node = this->train_node();
+            const auto &members = train_node->consist_members();
+            uint8_t cmd = payload()[0];
+            uint8_t link_flag = 0;
+            if (cmd == TractionDefs::REQ_SET_FN)
             {
-                ++nextConsistIndex_;
-                return again();
+                bool f0 = !payload()[1] && !payload()[2] && !payload()[3];
+                link_flag = f0 ? TractionDefs::CNSTFLAGS_LINKF0
+                               : TractionDefs::CNSTFLAGS_LINKFN;
             }
-            uint8_t cmd = payload()[0];
-            bool flip_speed = false;
-            if (cmd == TractionDefs::REQ_SET_SPEED) {
-                if (flags & TractionDefs::CNSTFLAGS_REVERSE) {
-                    flip_speed = true;
+            for (const auto &e : members)
+            {
+                NodeID dst = e.get_slave();
+                uint8_t flags = e.get_flags();
+                if (iface()->matching_node(nmsg()->src, NodeHandle(dst)))
+                {
+                    // Do not echo the command back to where it came from.
+                    continue;
                 }
-            } else if (cmd == TractionDefs::REQ_SET_FN) {
-                uint32_t address = payload()[1];
-                address <<= 8;
-                address |= payload()[2];
-                address <<= 8;
-                address |= payload()[3];
-                if (address == 0) {
-                    if ((flags & TractionDefs::CNSTFLAGS_LINKF0) == 0) {
-                        // skip
-                        ++nextConsistIndex_;
-                        return again();
-                    }
-                } else {
-                    if ((flags & TractionDefs::CNSTFLAGS_LINKFN) == 0) {
-                        // skip
-                        ++nextConsistIndex_;
-                        return again();
-                    }
+                if (link_flag && (flags & link_flag) == 0)
+                {
+                    continue;
                 }
-            }
-            if (count == nextConsistIndex_ + 1u)
-            {
-                // last node: we can transfer the message.
-                auto *b = transfer_message();
-                b->data()->src = NodeHandle(train_node->node_id());
-                b->data()->dst = NodeHandle(dst);
-                b->data()->dstNode = nullptr;
-                if (flip_speed) {
+                auto *b = iface()->addressed_message_write_flow()->alloc();
+                b->data()->reset(nmsg()->mti, train_node->node_id(),
+                    NodeHandle(dst), nmsg()->payload);
+                if (cmd == TractionDefs::REQ_SET_SPEED &&
+                    (flags & TractionDefs::CNSTFLAGS_REVERSE))
+                {
                     b->data()->payload[1] ^= 0x80;
                 }
+                b->set_done(message()->new_child());
                 iface()->addressed_message_write_flow()->send(b);
-                return exit();
             }
-            else
-            {
-                return allocate_and_call(
-                    iface()->addressed_message_write_flow(),
-                    STATE(forward_consist));
-            }
-        }
-
-        Action forward_consist()
-        {
-            auto *b =
-                get_allocation_result(iface()->addressed_message_write_flow());
-            uint8_t flags;
-            NodeID dst = train_node()->query_consist(nextConsistIndex_, &flags);
-            if (!dst)
-            {
-                // Strange. The consist destination should exist and never be
-                // zero once we got here.
-                b->unref();
-                return release_and_exit();
-            }
-            b->data()->reset(message()->data()->mti, train_node()->node_id(),
-                             NodeHandle(dst), message()->data()->payload);
-            if ((payload()[0] == TractionDefs::REQ_SET_SPEED) &&
-                (flags & TractionDefs::CNSTFLAGS_REVERSE)) {
-                b->data()->payload[1] ^= 0x80;
-            }
-            iface()->addressed_message_write_flow()->send(b);
-            ++nextConsistIndex_;
-            return call_immediately(STATE(maybe_forward_consist));
+            return release_and_exit();
         }
 
         Action handle_traction_mgmt()
@@ -589,7 +543,6 @@ struct TrainService::Impl
     private:
         /// error code for reject_permanent().
         unsigned errorCode_ : 16;
-        unsigned nextConsistIndex_ : 8;
         /// 1 if the voluntary lock protocol has set this train to be reserved.
         unsigned reserved_ : 1;
         TrainService *trainService_;
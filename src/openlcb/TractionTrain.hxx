@@ -36,6 +36,7 @@
 #define _OPENLCB_TRACTIONTRAIN_HXX_
 
 #include <set>
+#include <vector>
 
 #include "executor/Service.hxx"
 #include "openlcb/Node.hxx"
@@ -48,9 +49,8 @@ namespace openlcb
 
 class TrainService;
 
-/// Linked list entry for all registered consist clients for a given train
-/// node.
-struct ConsistEntry : public QMember {
+/// Entry in the consist member array of a given train node.
+struct ConsistEntry {
     ConsistEntry(NodeID s, uint8_t flags) : payload((s << 8) | flags) {}
     NodeID get_slave() const {
         return payload >> 8;
@@ -138,7 +138,8 @@ public:
                 return true;
             }
         }
-        consistSlaves_.push_front(new ConsistEntry(tgt, flags));
+        // The newest member is at offset zero.
+        consistSlaves_.insert(consistSlaves_.begin(), ConsistEntry(tgt, flags));
         return true;
     }
 
@@ -150,9 +151,7 @@ public:
         {
             if (it->get_slave() == tgt)
             {
-                auto* p = it.operator->();
                 consistSlaves_.erase(it);
-                delete p;
                 return true;
             }
         }
@@ -163,28 +162,24 @@ public:
      * fewer than id consist targets. id is zero-based. */
     NodeID query_consist(int id, uint8_t* flags)
     {
-        int k = 0;
-        for (auto it = consistSlaves_.begin();
-             it != consistSlaves_.end(); ++it, ++k)
+        if (id < 0 || (unsigned)id >= consistSlaves_.size())
         {
-            if (k == id)
-            {
-                if (flags) *flags = it->get_flags();
-                return it->get_slave();
-            }
+            return 0;
         }
-        return 0;
+        if (flags) *flags = consistSlaves_[id].get_flags();
+        return consistSlaves_[id].get_slave();
     }
 
     /** Returns the number of slaves in this consist. */
     int query_consist_length()
     {
-        int ret = 0;
-        for (auto it = consistSlaves_.begin(); it != consistSlaves_.end();
-             ++it, ++ret)
-        {
-        }
-        return ret;
+        return consistSlaves_.size();
+    }
+
+    /** Returns all consist targets, in the order of query_consist(). */
+    const std::vector<ConsistEntry> &consist_members()
+    {
+        return consistSlaves_;
     }
 
 protected:
@@ -196,7 +191,7 @@ private:
 
     /// Controller node that is assigned to run this train. 0 if none.
     NodeHandle controllerNodeId_;
-    TypedQueue<ConsistEntry> consistSlaves_;
+    std::vector<ConsistEntry> consistSlaves_;
 };
 
 
@@ -42,6 +42,13 @@ DEFAULT_CONST(local_alias_cache_size, 3);
 /** Maximum number of local nodes */
 DEFAULT_CONST(local_nodes_count, 2);
 
+/** How many alias reservations an AliasAllocator runs concurrently. Raise on
+ * nodes that create many virtual nodes, such as command stations. */
+DEFAULT_CONST(alias_reservation_parallel, 1);
+
+/** How many reserved aliases the stack keeps ready for new virtual nodes. */
+DEFAULT_CONST(reserved_alias_count, 1);
+
 /** Number of datagram registry entries. This is how many datagram handlers can
  * be registered (e.g. memory config protocol is one). */
 DEFAULT_CONST(num_datagram_registry_entries, 2);
@@ -63,3 +70,48 @@ DEFAULT_CONST_FALSE(enable_all_memory_space);
  * identified messages at boot time. This is required by the OpenLCB
  * standard. */
 DEFAULT_CONST_TRUE(node_init_identify);
+
+/** Bus budget of the node initialization (Initialization Complete plus the
+ * identified messages of the startup identify) in messages per second. Zero
+ * means unlimited. Limits the startup burst of a stack with many virtual
+ * nodes. */
+DEFAULT_CONST(node_init_messages_per_sec, 0);
+
+/** How many node initialization messages may be sent back-to-back before the
+ * node_init_messages_per_sec budget applies. */
+DEFAULT_CONST(node_init_burst_messages, 32);
+
+/** Number of multi-frame addressed messages that an IfCan can reassemble at
+ * the same time (at most 254). When all are in use, the oldest open message
+ * is evicted. The buffer of a slot is allocated when it is first needed. A
+ * microcontroller node rarely talks to more than a few peers at once; an
+ * application that does can raise this with OVERRIDE_CONST. A host is often
+ * a hub or gateway seeing the traffic of a whole bus, so it gets more
+ * slots. */
+#ifdef __FreeRTOS__
+DEFAULT_CONST(can_addressed_reassembly_slots, 2);
+#else
+DEFAULT_CONST(can_addressed_reassembly_slots, 64);
+#endif
+
+/** Number of multi-frame datagrams that an IfCan can reassemble at the same
+ * time (at most 254). */
+#ifdef __FreeRTOS__
+DEFAULT_CONST(can_datagram_reassembly_slots, 2);
+#else
+DEFAULT_CONST(can_datagram_reassembly_slots, 64);
+#endif
+
+/** How long (in msec) a partially received multi-frame CAN message waits for
+ * its next frame before it is dropped. */
+DEFAULT_CONST(can_reassembly_timeout_msec, 3000);
+
+/** Largest config file (in bytes) that the ConfigUpdateFlow reads into memory
+ * for the config update listeners. Larger files are read field by field. On
+ * microcontrollers the config file is usually in memory-mapped EEPROM, so the
+ * copy would only cost RAM. */
+#ifdef __FreeRTOS__
+DEFAULT_CONST(update_snapshot_max_size, 0);
+#else
+DEFAULT_CONST(update_snapshot_max_size, 65536);
+#endif
@@ -0,0 +1,263 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file Benchmark.hxx
+ *
+ * Helpers for host-side benchmark programs: latency percentiles, CPU time
+ * measurement, allocation counting and machine-readable result lines.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _UTILS_BENCHMARK_HXX_
+#define _UTILS_BENCHMARK_HXX_
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "os/os.h"
+
+/// Collects latency samples and computes percentiles.
+class LatencySamples
+{
+public:
+    /// Records one sample. @param nsec latency in nanoseconds.
+    void add(long long nsec)
+    {
+        samples_.push_back(nsec);
+        sorted_ = false;
+    }
+
+    /// Appends all samples of another collection. @param o other samples.
+    void merge(const LatencySamples &o)
+    {
+        samples_.insert(samples_.end(), o.samples_.begin(), o.samples_.end());
+        sorted_ = false;
+    }
+
+    /// @return number of samples.
+    size_t size() const
+    {
+        return samples_.size();
+    }
+
+    /// Removes all samples.
+    void clear()
+    {
+        samples_.clear();
+    }
+
+    /// @param p percentile in the range 0..1 (e.g. 0.999).
+    /// @return the latency at the given percentile, or 0 if there are no
+    /// samples.
+    long long percentile(double p)
+    {
+        if (samples_.empty())
+        {
+            return 0;
+        }
+        if (!sorted_)
+        {
+            std::sort(samples_.begin(), samples_.end());
+            sorted_ = true;
+        }
+        size_t idx = (size_t)(p * samples_.size());
+        return samples_[std::min(idx, samples_.size() - 1)];
+    }
+
+private:
+    /// Latencies in nanoseconds.
+    std::vector<long long> samples_;
+    /// True if samples_ is sorted.
+    bool sorted_ = true;
+};
+
+/// Measures the elapsed wall time and the CPU time used by the process.
+class BenchmarkTimer
+{
+public:
+    /// Constructor. Starts the timer.
+    BenchmarkTimer()
+    {
+        start();
+    }
+
+    /// (Re)starts the timer.
+    void start()
+    {
+        wallStart_ = os_get_time_monotonic();
+        cpuStart_ = cpu_now();
+    }
+
+    /// @return wall time since start() in nanoseconds.
+    long long wall_nsec()
+    {
+        return os_get_time_monotonic() - wallStart_;
+    }
+
+    /// @return CPU time (all threads of the process) since start() in
+    /// nanoseconds.
+    long long cpu_nsec()
+    {
+        return cpu_now() - cpuStart_;
+    }
+
+private:
+    /// @return the process CPU time in nanoseconds.
+    static long long cpu_now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    /// Monotonic time at start.
+    long long wallStart_;
+    /// CPU time at start.
+    long long cpuStart_;
+};
+
+/// @return the counter incremented by every operator new call, if the
+/// benchmark program used BENCHMARK_COUNT_ALLOCATIONS().
+inline std::atomic<unsigned long> &benchmark_allocation_count()
+{
+    static std::atomic<unsigned long> count(0);
+    return count;
+}
+
+/// Replaces the global operator new/delete with versions that count
+/// allocations in benchmark_allocation_count(). Use this exactly once, at
+/// file scope, in the main file of a benchmark program.
+#define BENCHMARK_COUNT_ALLOCATIONS()                                          \
+    void *operator new(size_t size)                                            \
+    {                                                                          \
+        benchmark_allocation_count().fetch_add(1, std::memory_order_relaxed); \
+        void *p = malloc(size ? size : 1);                                     \
+        if (!p)                                                                \
+        {                                                                      \
+            throw std::bad_alloc();                                            \
+        }                                                                      \
+        return p;                                                              \
+    }                                                                          \
+    void *operator new[](size_t size)                                          \
+    {                                                                          \
+        return operator new(size);                                             \
+    }                                                                          \
+    void operator delete(void *p) noexcept                                     \
+    {                                                                          \
+        free(p);                                                               \
+    }                                                                          \
+    void operator delete[](void *p) noexcept                                   \
+    {                                                                          \
+        free(p);                                                               \
+    }                                                                          \
+    void operator delete(void *p, size_t) noexcept                             \
+    {                                                                          \
+        free(p);                                                               \
+    }                                                                          \
+    void operator delete[](void *p, size_t) noexcept                           \
+    {                                                                          \
+        free(p);                                                               \
+    }
+
+/// One line of benchmark results, printed as a single-line JSON object so
+/// that result files can be diffed and parsed across commits.
+///
+/// Usage:
+///   BenchmarkReport r("hub_direct");
+///   r.add("clients", 4);
+///   r.add("frames_per_sec", 123456.7);
+///   r.print(stdout);
+class BenchmarkReport
+{
+public:
+    /// Constructor. @param name identifies the benchmark scenario.
+    BenchmarkReport(const std::string &name)
+    {
+        line_ = "{\"benchmark\":\"" + name + "\"";
+    }
+
+    /// Adds an integer field. @param key field name @param value value
+    void add(const char *key, long long value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%lld", value);
+        add_raw(key, buf);
+    }
+
+    /// Adds a numeric field. @param key field name @param value value
+    void add(const char *key, double value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", value);
+        add_raw(key, buf);
+    }
+
+    /// Adds a string field. @param key field name @param value value
+    void add(const char *key, const std::string &value)
+    {
+        add_raw(key, "\"" + value + "\"");
+    }
+
+    /// Adds the p50/p99/p999/max fields (in microseconds) of a latency
+    /// distribution. @param prefix field name prefix @param l samples
+    void add_latency(const std::string &prefix, LatencySamples *l)
+    {
+        add((prefix + "_p50_usec").c_str(), l->percentile(0.5) / 1000.0);
+        add((prefix + "_p99_usec").c_str(), l->percentile(0.99) / 1000.0);
+        add((prefix + "_p999_usec").c_str(), l->percentile(0.999) / 1000.0);
+        add((prefix + "_max_usec").c_str(), l->percentile(1) / 1000.0);
+    }
+
+    /// Writes the line. @param f output file.
+    void print(FILE *f)
+    {
+        fprintf(f, "%s}\n", line_.c_str());
+        fflush(f);
+    }
+
+private:
+    /// Appends a field. @param key field name @param value JSON value
+    void add_raw(const char *key, const std::string &value)
+    {
+        line_ += ",\"";
+        line_ += key;
+        line_ += "\":";
+        line_ += value;
+    }
+
+    /// Output rendered so far (without the closing brace).
+    std::string line_;
+};
+
+#endif // _UTILS_BENCHMARK_HXX_
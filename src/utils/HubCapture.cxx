@@ -0,0 +1,396 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubCapture.cxx
+ *
+ * Low-overhead binary traffic capture for CAN hubs.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#if defined(__linux__) || defined(__MACH__)
+
+#include "utils/HubCapture.hxx"
+
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+constexpr const char *CanCaptureDefs::MAGIC;
+constexpr uint32_t CanCaptureDefs::VERSION;
+constexpr uint32_t CanCaptureDefs::ID_EFF_FLAG;
+constexpr uint32_t CanCaptureDefs::ID_RTR_FLAG;
+constexpr uint32_t CanCaptureDefs::ID_ERR_FLAG;
+constexpr uint8_t CanCaptureDefs::PORT_NONE;
+constexpr uint8_t CanCaptureDefs::PORT_OVERFLOW;
+
+/// pcapng block types and constants.
+enum PcapngDefs
+{
+    PCAPNG_SECTION_HEADER = 0x0A0D0D0A,
+    PCAPNG_INTERFACE_DESCRIPTION = 0x00000001,
+    PCAPNG_INTERFACE_STATISTICS = 0x00000005,
+    PCAPNG_ENHANCED_PACKET = 0x00000006,
+    PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D,
+    /// Link type for frames in the SocketCAN (struct can_frame) layout.
+    LINKTYPE_CAN_SOCKETCAN = 227,
+    /// Size of a SocketCAN frame on the wire.
+    SOCKETCAN_FRAME_LEN = 16,
+    OPT_ENDOFOPT = 0,
+    OPT_COMMENT = 1,
+    OPT_IF_TSRESOL = 9,
+    OPT_ISB_IFDROP = 5,
+};
+
+CanHubCapture::CanHubCapture(CanHubFlow *hub, int fd, Format format,
+    unsigned ring_size, long long flush_period_nsec)
+    : hub_(hub)
+    , fd_(fd)
+    , format_(format)
+    , flushPeriod_(flush_period_nsec)
+    , head_(0)
+    , tail_(0)
+    , captured_(0)
+    , dropped_(0)
+    , written_(0)
+    , droppedReported_(0)
+    , numPorts_(0)
+    , writeError_(false)
+    , shutdown_(false)
+{
+    unsigned size = 2;
+    while (size < ring_size)
+    {
+        size <<= 1;
+    }
+    ring_.reset(new CanCaptureRecord[size]);
+    ringMask_ = size - 1;
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    timeOffset_ = (long long)tv.tv_sec * 1000000000LL +
+        (long long)tv.tv_usec * 1000LL - os_get_time_monotonic();
+
+    render_file_header();
+    start("capture", 0, 2048);
+    hub_->register_port(this);
+}
+
+CanHubCapture::~CanHubCapture()
+{
+    hub_->unregister_port(this);
+    // Waits for the hub to finish dispatching the current frame, which might
+    // still be handed to us.
+    hub_->service()->executor()->sync_run([]() {});
+    shutdown_.store(true);
+    wakeup_.post();
+    exited_.wait();
+}
+
+void CanHubCapture::send(Buffer<CanHubData> *message, unsigned priority)
+{
+    AutoReleaseBuffer<CanHubData> b(message);
+    uint32_t h = head_.load(std::memory_order_relaxed);
+    if (h - tail_.load(std::memory_order_acquire) > ringMask_)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    CanCaptureRecord &r = ring_[h & ringMask_];
+    const struct can_frame &f = message->data()->frame();
+    r.timestamp_nsec = os_get_time_monotonic();
+    if (IS_CAN_FRAME_EFF(f))
+    {
+        r.can_id = GET_CAN_FRAME_ID_EFF(f) | CanCaptureDefs::ID_EFF_FLAG;
+    }
+    else
+    {
+        r.can_id = GET_CAN_FRAME_ID(f);
+    }
+    if (IS_CAN_FRAME_RTR(f))
+    {
+        r.can_id |= CanCaptureDefs::ID_RTR_FLAG;
+    }
+    if (IS_CAN_FRAME_ERR(f))
+    {
+        r.can_id |= CanCaptureDefs::ID_ERR_FLAG;
+    }
+    r.can_dlc = f.can_dlc;
+    r.port = port_id(message->data()->skipMember_);
+    r.flags = CanCaptureDefs::RECORD_FRAME;
+    r.reserved = 0;
+    memset(r.data, 0, sizeof(r.data));
+    memcpy(r.data, f.data, std::min((unsigned)f.can_dlc, 8u));
+    head_.store(h + 1, std::memory_order_release);
+    captured_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint8_t CanHubCapture::port_id(const void *port)
+{
+    if (!port)
+    {
+        return CanCaptureDefs::PORT_NONE;
+    }
+    for (unsigned i = 0; i < numPorts_; ++i)
+    {
+        if (ports_[i] == port)
+        {
+            return i + 1;
+        }
+    }
+    if (numPorts_ >= PORT_TABLE_SIZE)
+    {
+        return CanCaptureDefs::PORT_OVERFLOW;
+    }
+    ports_[numPorts_++] = port;
+    return numPorts_;
+}
+
+void *CanHubCapture::entry()
+{
+    while (true)
+    {
+        wakeup_.timedwait(flushPeriod_);
+        bool last = shutdown_.load();
+        drain();
+        if (last)
+        {
+            break;
+        }
+    }
+    if (format_ == FORMAT_PCAPNG && !writeError_)
+    {
+        // Final statistics block, so that the drop count is in the file
+        // even if it is zero.
+        render_drop(os_get_time_monotonic(), 0);
+        flush_output();
+    }
+    exited_.post();
+    return nullptr;
+}
+
+void CanHubCapture::drain()
+{
+    uint32_t t = tail_.load(std::memory_order_relaxed);
+    uint32_t h = head_.load(std::memory_order_acquire);
+    unsigned count = 0;
+    for (; t != h; ++t)
+    {
+        if (writeError_)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            render_record(ring_[t & ringMask_]);
+            ++count;
+        }
+        if ((t & 255) == 255)
+        {
+            // Frees up space early for the producer on large batches.
+            tail_.store(t + 1, std::memory_order_release);
+        }
+    }
+    tail_.store(t, std::memory_order_release);
+    unsigned dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != droppedReported_ && !writeError_)
+    {
+        render_drop(os_get_time_monotonic(), dropped - droppedReported_);
+        droppedReported_ = dropped;
+    }
+    flush_output();
+    if (writeError_)
+    {
+        dropped_.fetch_add(count, std::memory_order_relaxed);
+    }
+    else
+    {
+        written_.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+/// Appends a value in host byte order to a string.
+/// @param s output string
+/// @param value what to append
+template <class T> static void append(std::string *s, T value)
+{
+    s->append((const char *)&value, sizeof(value));
+}
+
+/// Appends zero bytes until the length of a string is a multiple of 4.
+/// @param s output string
+static void pad32(std::string *s)
+{
+    while (s->size() & 3)
+    {
+        s->push_back(0);
+    }
+}
+
+/// Completes a pcapng block: fills in the total length at the beginning and
+/// appends the trailing total length.
+/// @param s output string.
+/// @param start offset of the block in s.
+static void finish_block(std::string *s, size_t start)
+{
+    pad32(s);
+    uint32_t len = s->size() - start + 4;
+    memcpy(&(*s)[start + 4], &len, 4);
+    append(s, len);
+}
+
+void CanHubCapture::render_file_header()
+{
+    if (format_ == FORMAT_BINARY)
+    {
+        CanCaptureFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        strncpy(hdr.magic, CanCaptureDefs::MAGIC, sizeof(hdr.magic));
+        hdr.version = CanCaptureDefs::VERSION;
+        hdr.record_size = sizeof(CanCaptureRecord);
+        hdr.time_offset_nsec = timeOffset_;
+        output_.append((const char *)&hdr, sizeof(hdr));
+        return;
+    }
+    // Section header block.
+    size_t start = output_.size();
+    append(&output_, (uint32_t)PCAPNG_SECTION_HEADER);
+    append(&output_, (uint32_t)0);
+    append(&output_, (uint32_t)PCAPNG_BYTE_ORDER_MAGIC);
+    append(&output_, (uint16_t)1); // major version
+    append(&output_, (uint16_t)0); // minor version
+    append(&output_, (int64_t)-1); // section length unknown
+    finish_block(&output_, start);
+    // Interface description block.
+    start = output_.size();
+    append(&output_, (uint32_t)PCAPNG_INTERFACE_DESCRIPTION);
+    append(&output_, (uint32_t)0);
+    append(&output_, (uint16_t)LINKTYPE_CAN_SOCKETCAN);
+    append(&output_, (uint16_t)0);
+    append(&output_, (uint32_t)SOCKETCAN_FRAME_LEN); // snaplen
+    append(&output_, (uint16_t)OPT_IF_TSRESOL);
+    append(&output_, (uint16_t)1);
+    append(&output_, (uint8_t)9); // nanosecond timestamps
+    pad32(&output_);
+    append(&output_, (uint32_t)OPT_ENDOFOPT);
+    finish_block(&output_, start);
+}
+
+void CanHubCapture::render_record(const CanCaptureRecord &r)
+{
+    if (format_ == FORMAT_BINARY)
+    {
+        output_.append((const char *)&r, sizeof(r));
+        return;
+    }
+    uint64_t ts = r.timestamp_nsec + timeOffset_;
+    size_t start = output_.size();
+    append(&output_, (uint32_t)PCAPNG_ENHANCED_PACKET);
+    append(&output_, (uint32_t)0);
+    append(&output_, (uint32_t)0); // interface id
+    append(&output_, (uint32_t)(ts >> 32));
+    append(&output_, (uint32_t)(ts & 0xffffffffu));
+    append(&output_, (uint32_t)SOCKETCAN_FRAME_LEN); // captured length
+    append(&output_, (uint32_t)SOCKETCAN_FRAME_LEN); // original length
+    // The SocketCAN pseudo-header has the identifier in network byte order.
+    append(&output_, (uint8_t)(r.can_id >> 24));
+    append(&output_, (uint8_t)(r.can_id >> 16));
+    append(&output_, (uint8_t)(r.can_id >> 8));
+    append(&output_, (uint8_t)(r.can_id));
+    append(&output_, r.can_dlc);
+    append(&output_, (uint8_t)0);
+    append(&output_, (uint16_t)0);
+    output_.append((const char *)r.data, sizeof(r.data));
+    if (r.port != CanCaptureDefs::PORT_NONE)
+    {
+        char comment[12];
+        int len = snprintf(comment, sizeof(comment), "port %u", r.port);
+        append(&output_, (uint16_t)OPT_COMMENT);
+        append(&output_, (uint16_t)len);
+        output_.append(comment, len);
+        pad32(&output_);
+        append(&output_, (uint32_t)OPT_ENDOFOPT);
+    }
+    finish_block(&output_, start);
+}
+
+void CanHubCapture::render_drop(long long timestamp, uint32_t count)
+{
+    if (format_ == FORMAT_BINARY)
+    {
+        CanCaptureRecord r;
+        memset(&r, 0, sizeof(r));
+        r.timestamp_nsec = timestamp;
+        r.flags = CanCaptureDefs::RECORD_DROPPED;
+        memcpy(r.data, &count, sizeof(count));
+        output_.append((const char *)&r, sizeof(r));
+        return;
+    }
+    // pcapng reports the cumulative drop count in a statistics block; count
+    // is not needed.
+    uint64_t ts = timestamp + timeOffset_;
+    size_t start = output_.size();
+    append(&output_, (uint32_t)PCAPNG_INTERFACE_STATISTICS);
+    append(&output_, (uint32_t)0);
+    append(&output_, (uint32_t)0); // interface id
+    append(&output_, (uint32_t)(ts >> 32));
+    append(&output_, (uint32_t)(ts & 0xffffffffu));
+    append(&output_, (uint16_t)OPT_ISB_IFDROP);
+    append(&output_, (uint16_t)8);
+    append(&output_, (uint64_t)dropped_.load());
+    append(&output_, (uint32_t)OPT_ENDOFOPT);
+    finish_block(&output_, start);
+}
+
+void CanHubCapture::flush_output()
+{
+    size_t ofs = 0;
+    while (ofs < output_.size() && !writeError_)
+    {
+        ssize_t ret = ::write(fd_, output_.data() + ofs, output_.size() - ofs);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            LOG_ERROR("Hub capture: write failed (%s). Stopping capture.",
+                strerror(errno));
+            writeError_ = true;
+            break;
+        }
+        ofs += ret;
+    }
+    output_.clear();
+}
+
+#endif // __linux__ || __MACH__
@@ -0,0 +1,264 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubCapture.hxx
+ *
+ * Low-overhead binary traffic capture for CAN hubs.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _UTILS_HUBCAPTURE_HXX_
+#define _UTILS_HUBCAPTURE_HXX_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "os/OS.hxx"
+#include "utils/Hub.hxx"
+
+/// Binary capture file format written by @ref CanHubCapture (in
+/// FORMAT_BINARY mode). The file is a CanCaptureFileHeader followed by a
+/// sequence of CanCaptureRecord structures. All fields are in the byte order
+/// of the capturing host; readers detect a foreign byte order from the
+/// version field.
+struct CanCaptureDefs
+{
+    /// Magic string at the beginning of the file (8 bytes, zero padded).
+    static constexpr const char *MAGIC = "OLCBCAP";
+    /// Current file format version.
+    static constexpr uint32_t VERSION = 1;
+
+    /// SocketCAN flag in the can_id field for extended frames.
+    static constexpr uint32_t ID_EFF_FLAG = 0x80000000U;
+    /// SocketCAN flag in the can_id field for remote frames.
+    static constexpr uint32_t ID_RTR_FLAG = 0x40000000U;
+    /// SocketCAN flag in the can_id field for error frames.
+    static constexpr uint32_t ID_ERR_FLAG = 0x20000000U;
+
+    /// Values for CanCaptureRecord::flags.
+    enum RecordFlags
+    {
+        /// The record is a CAN frame.
+        RECORD_FRAME = 0,
+        /// The record is not a frame but a marker that frames were lost. The
+        /// number of lost frames is in data[0..3] (host byte order).
+        RECORD_DROPPED = 1,
+    };
+
+    /// Port ID for frames that had no source port (sent by the hub owner).
+    static constexpr uint8_t PORT_NONE = 0;
+    /// Port ID for frames coming from a port after too many ports were
+    /// seen.
+    static constexpr uint8_t PORT_OVERFLOW = 255;
+};
+
+/// File header of the binary capture format.
+struct CanCaptureFileHeader
+{
+    /// @ref CanCaptureDefs::MAGIC, zero padded.
+    char magic[8];
+    /// @ref CanCaptureDefs::VERSION.
+    uint32_t version;
+    /// sizeof(CanCaptureRecord).
+    uint32_t record_size;
+    /// Add this to the timestamp of the records to get nanoseconds since the
+    /// UNIX epoch.
+    int64_t time_offset_nsec;
+};
+
+/// One captured frame (or event) in the binary capture format.
+struct CanCaptureRecord
+{
+    /// Monotonic timestamp in nanoseconds (see
+    /// CanCaptureFileHeader::time_offset_nsec).
+    uint64_t timestamp_nsec;
+    /// Identifier with the SocketCAN EFF/RTR/ERR flags.
+    uint32_t can_id;
+    /// Data length code.
+    uint8_t can_dlc;
+    /// Small integer identifying the hub port the frame came from.
+    uint8_t port;
+    /// @ref CanCaptureDefs::RecordFlags.
+    uint8_t flags;
+    /// Unused, zero.
+    uint8_t reserved;
+    /// Frame payload. Bytes beyond can_dlc are zero.
+    uint8_t data[8];
+};
+
+static_assert(sizeof(CanCaptureRecord) == 24, "unexpected capture record size");
+static_assert(
+    sizeof(CanCaptureFileHeader) == 24, "unexpected capture header size");
+
+/// A port on a CAN hub that records every frame with a timestamp and the
+/// identity of the source port. The hub executor only copies the frame into a
+/// lock-free in-memory ring buffer; a background thread spills the ring to a
+/// file descriptor periodically. If the ring is full, the frame is dropped
+/// (the hub is never blocked) and the loss is reported in the output with an
+/// explicit marker.
+///
+/// Usage:
+///   int fd = ::open("/tmp/capture.pcapng", O_WRONLY | O_CREAT | O_TRUNC,
+///                   0644);
+///   CanHubCapture capture(&can_hub0, fd, CanHubCapture::FORMAT_PCAPNG);
+class CanHubCapture : private CanHubPortInterface, private OSThread
+{
+public:
+    /// Output file formats.
+    enum Format
+    {
+        /// Compact native format, see @ref CanCaptureDefs.
+        FORMAT_BINARY,
+        /// pcapng with the LINKTYPE_CAN_SOCKETCAN link type, readable by
+        /// wireshark. Drops are reported in Interface Statistics Blocks; the
+        /// source port is reported in the packet comment.
+        FORMAT_PCAPNG,
+    };
+
+    /// Constructor. Registers the capture port to the hub and starts the
+    /// writer thread.
+    ///
+    /// @param hub the hub whose traffic to capture.
+    /// @param fd file descriptor to write the capture into. Ownership is not
+    /// transferred; the caller needs to close it after *this is destroyed.
+    /// @param format output file format.
+    /// @param ring_size how many frames the in-memory ring can hold before
+    /// frames get dropped. Rounded up to a power of two.
+    /// @param flush_period_nsec how often the writer thread spills the ring.
+    CanHubCapture(CanHubFlow *hub, int fd, Format format,
+        unsigned ring_size = 4096,
+        long long flush_period_nsec = MSEC_TO_NSEC(20));
+
+    /// Unregisters from the hub, writes all pending frames to the file and
+    /// stops the writer thread.
+    ~CanHubCapture();
+
+    /// @return the number of frames that were put into the ring.
+    unsigned captured_frames()
+    {
+        return captured_.load();
+    }
+
+    /// @return the number of frames that were lost because the ring was full
+    /// or the file could not be written.
+    unsigned dropped_frames()
+    {
+        return dropped_.load();
+    }
+
+    /// @return the number of frames written to the output file.
+    unsigned written_frames()
+    {
+        return written_.load();
+    }
+
+private:
+    /// Maximum number of distinct source ports tracked.
+    static constexpr unsigned PORT_TABLE_SIZE = 64;
+
+    /// Called on the hub's executor for every frame. Never blocks.
+    /// @param message the frame.
+    /// @param priority ignored.
+    void send(Buffer<CanHubData> *message, unsigned priority) override;
+
+    /// Writer thread.
+    void *entry() override;
+
+    /// @return the small integer ID of a source port. Called only on the hub
+    /// executor.
+    /// @param port the source port (skipMember_) of a frame.
+    uint8_t port_id(const void *port);
+
+    /// Moves everything from the ring to the output file. Called on the
+    /// writer thread.
+    void drain();
+
+    /// Renders the file header into output_.
+    void render_file_header();
+    /// Renders a single record into output_.
+    /// @param r the record to render.
+    void render_record(const CanCaptureRecord &r);
+    /// Renders a marker of lost frames into output_.
+    /// @param timestamp when the loss was detected (monotonic nsec).
+    /// @param count how many frames were lost since the last marker.
+    void render_drop(long long timestamp, uint32_t count);
+    /// Writes output_ to the file descriptor and clears it.
+    void flush_output();
+
+    /// Hub we are registered to.
+    CanHubFlow *hub_;
+    /// File descriptor of the output file.
+    int fd_;
+    /// Output file format.
+    Format format_;
+    /// How often the writer thread wakes up.
+    long long flushPeriod_;
+    /// Realtime clock minus monotonic clock at startup.
+    long long timeOffset_;
+
+    /// Ring buffer storage, ringMask_ + 1 entries.
+    std::unique_ptr<CanCaptureRecord[]> ring_;
+    /// Capacity of the ring minus one.
+    uint32_t ringMask_;
+    /// Producer index (hub executor), free running.
+    std::atomic<uint32_t> head_;
+    /// Consumer index (writer thread), free running.
+    std::atomic<uint32_t> tail_;
+
+    /// Frames put into the ring.
+    std::atomic<unsigned> captured_;
+    /// Frames lost.
+    std::atomic<unsigned> dropped_;
+    /// Frames written to the file.
+    std::atomic<unsigned> written_;
+    /// Value of dropped_ when the last drop marker was rendered.
+    unsigned droppedReported_;
+
+    /// Source port pointers seen; index + 1 is the port ID. Only accessed on
+    /// the hub executor.
+    const void *ports_[PORT_TABLE_SIZE];
+    /// Number of entries used in ports_.
+    unsigned numPorts_;
+
+    /// Rendered output waiting to be written. Only accessed by the writer
+    /// thread.
+    std::string output_;
+    /// True if writing the output file failed; all further frames are
+    /// dropped.
+    bool writeError_;
+
+    /// Wakes up the writer thread early.
+    OSSem wakeup_;
+    /// Posted by the writer thread when it exits.
+    OSSem exited_;
+    /// Tells the writer thread to exit after the next drain.
+    std::atomic<bool> shutdown_;
+};
+
+#endif // _UTILS_HUBCAPTURE_HXX_
@@ -0,0 +1,477 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubReplay.cxx
+ *
+ * Replays recorded CAN traffic into a hub for load testing.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#include "utils/HubReplay.hxx"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "openlcb/CanDefs.hxx"
+#include "openlcb/Defs.hxx"
+#include "utils/HubCapture.hxx"
+#include "utils/gc_format.h"
+
+/// Byte-swaps a 32-bit value.
+/// @param v input @return v in the opposite byte order.
+static uint32_t swap32(uint32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+/// Parses a trace in the binary capture format.
+/// @param contents the whole file. @param frames output.
+/// @return number of skipped records or -1 on bad header.
+static int parse_binary_trace(
+    const std::string &contents, std::vector<CanTraceFrame> *frames)
+{
+    CanCaptureFileHeader hdr;
+    if (contents.size() < sizeof(hdr))
+    {
+        return -1;
+    }
+    memcpy(&hdr, contents.data(), sizeof(hdr));
+    bool swap = false;
+    if (hdr.version != CanCaptureDefs::VERSION)
+    {
+        if (swap32(hdr.version) != CanCaptureDefs::VERSION)
+        {
+            return -1;
+        }
+        swap = true;
+        hdr.record_size = swap32(hdr.record_size);
+    }
+    if (hdr.record_size < sizeof(CanCaptureRecord))
+    {
+        return -1;
+    }
+    int skipped = 0;
+    for (size_t ofs = sizeof(hdr); ofs + hdr.record_size <= contents.size();
+         ofs += hdr.record_size)
+    {
+        CanCaptureRecord r;
+        memcpy(&r, contents.data() + ofs, sizeof(r));
+        if (swap)
+        {
+            r.timestamp_nsec = __builtin_bswap64(r.timestamp_nsec);
+            r.can_id = swap32(r.can_id);
+        }
+        if (r.flags != CanCaptureDefs::RECORD_FRAME)
+        {
+            continue;
+        }
+        if (r.can_dlc > 8)
+        {
+            ++skipped;
+            continue;
+        }
+        frames->emplace_back();
+        CanTraceFrame &f = frames->back();
+        memset(&f, 0, sizeof(f));
+        f.timestamp_nsec = r.timestamp_nsec;
+        if (r.can_id & CanCaptureDefs::ID_EFF_FLAG)
+        {
+            SET_CAN_FRAME_ID_EFF(f.frame, r.can_id & 0x1FFFFFFFU);
+            SET_CAN_FRAME_EFF(f.frame);
+        }
+        else
+        {
+            SET_CAN_FRAME_ID(f.frame, r.can_id & 0x7FFU);
+        }
+        if (r.can_id & CanCaptureDefs::ID_RTR_FLAG)
+        {
+            SET_CAN_FRAME_RTR(f.frame);
+        }
+        f.frame.can_dlc = r.can_dlc;
+        memcpy(f.frame.data, r.data, 8);
+    }
+    return skipped;
+}
+
+/// Parses the timestamp prefix written by GcPacketPrinter.
+/// @param line beginning of a log line.
+/// @param ts will be set to the timestamp in nanoseconds.
+/// @return true if the line had a timestamp.
+static bool parse_gc_timestamp(const char *line, long long *ts)
+{
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    long usec;
+    if (sscanf(line, "%d-%d-%d %d:%d:%d:%ld", &t.tm_year, &t.tm_mon,
+            &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec, &usec) != 7)
+    {
+        return false;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    *ts = (long long)mktime(&t) * 1000000000LL + (long long)usec * 1000;
+    return true;
+}
+
+/// Parses a GridConnect text log.
+/// @param contents the whole file. @param frames output.
+/// @return number of malformed packets.
+static int parse_gc_trace(
+    const std::string &contents, std::vector<CanTraceFrame> *frames)
+{
+    int skipped = 0;
+    long long ts = 0;
+    size_t pos = 0;
+    while (pos < contents.size())
+    {
+        size_t eol = contents.find('\n', pos);
+        if (eol == std::string::npos)
+        {
+            eol = contents.size();
+        }
+        std::string line = contents.substr(pos, eol - pos);
+        pos = eol + 1;
+        parse_gc_timestamp(line.c_str(), &ts);
+        size_t start = 0;
+        while ((start = line.find(':', start)) != std::string::npos)
+        {
+            size_t end = line.find(';', start);
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            if (start + 1 >= line.size() ||
+                (line[start + 1] != 'X' && line[start + 1] != 'S'))
+            {
+                // A colon in the timestamp.
+                ++start;
+                continue;
+            }
+            std::string packet = line.substr(start + 1, end - start - 1);
+            start = end + 1;
+            CanTraceFrame f;
+            memset(&f, 0, sizeof(f));
+            f.timestamp_nsec = ts;
+            if (gc_format_parse(packet.c_str(), &f.frame) < 0)
+            {
+                ++skipped;
+                continue;
+            }
+            frames->push_back(f);
+        }
+    }
+    return skipped;
+}
+
+int parse_can_trace(
+    const std::string &contents, std::vector<CanTraceFrame> *frames)
+{
+    if (contents.compare(0, strlen(CanCaptureDefs::MAGIC) + 1,
+            CanCaptureDefs::MAGIC, strlen(CanCaptureDefs::MAGIC) + 1) == 0)
+    {
+        return parse_binary_trace(contents, frames);
+    }
+    return parse_gc_trace(contents, frames);
+}
+
+CanTraceReplay::CanTraceReplay(CanHubFlow *target,
+    const std::vector<CanTraceFrame> *trace, const Options &opts)
+    : StateFlowBase(target->service())
+    , target_(target)
+    , trace_(trace)
+    , opts_(opts)
+    , observer_(nullptr)
+    , observerPort_(this)
+    , done_(nullptr)
+    , timer_(this)
+    , next_(0)
+    , loop_(0)
+    , loopStart_(0)
+    , firstSend_(0)
+    , lastSend_(0)
+    , sent_(0)
+    , unmatched_(0)
+    , lost_(0)
+{
+    if (opts_.window == 0)
+    {
+        opts_.window = 1;
+    }
+}
+
+CanTraceReplay::~CanTraceReplay()
+{
+    if (observer_)
+    {
+        observer_->unregister_port(&observerPort_);
+    }
+}
+
+void CanTraceReplay::set_observer(CanHubFlow *observer)
+{
+    HASSERT(!observer_);
+    observer_ = observer;
+    observer_->register_port(&observerPort_);
+}
+
+void CanTraceReplay::start(Notifiable *done)
+{
+    done_ = done;
+    next_ = 0;
+    loop_ = 0;
+    loopStart_ = os_get_time_monotonic();
+    firstSend_ = lastSend_ = loopStart_;
+    start_flow(STATE(send_batch));
+}
+
+StateFlowBase::Action CanTraceReplay::send_batch()
+{
+    if (next_ >= trace_->size())
+    {
+        if (++loop_ >= opts_.repeat || trace_->empty())
+        {
+            return call_immediately(STATE(drain));
+        }
+        next_ = 0;
+        loopStart_ = os_get_time_monotonic();
+    }
+    long long base = (*trace_)[0].timestamp_nsec;
+    long long now = os_get_time_monotonic();
+    if (opts_.speed > 0)
+    {
+        long long due = loopStart_ +
+            (long long)(((*trace_)[next_].timestamp_nsec - base) / opts_.speed);
+        if (due > now)
+        {
+            return sleep_and_call(&timer_, due - now, STATE(send_batch));
+        }
+    }
+    if (!sent_)
+    {
+        firstSend_ = now;
+    }
+    bn_.reset(this);
+    for (unsigned count = 0; count < opts_.window && next_ < trace_->size();
+         ++count, ++next_)
+    {
+        const CanTraceFrame &f = (*trace_)[next_];
+        if (count && opts_.speed > 0 &&
+            loopStart_ + (long long)((f.timestamp_nsec - base) / opts_.speed) >
+                now)
+        {
+            break;
+        }
+        Buffer<CanHubData> *b;
+        mainBufferPool->alloc(&b);
+        struct can_frame *frame = b->data()->mutable_frame();
+        *frame = f.frame;
+        if (opts_.alias_offset)
+        {
+            remap_aliases(frame, opts_.alias_offset);
+        }
+        b->data()->skipMember_ = nullptr;
+        b->set_done(bn_.new_child());
+        if (observer_)
+        {
+            FrameKey key = frame_key(*frame);
+            inFlight_[key].push_back(now);
+            sendOrder_.emplace_back(now, key);
+        }
+        ++sent_;
+        target_->send(b);
+    }
+    lastSend_ = now;
+    expire_in_flight(now);
+    bn_.notify();
+    return wait_and_call(STATE(send_batch));
+}
+
+StateFlowBase::Action CanTraceReplay::drain()
+{
+    if (observer_ && opts_.drain_nsec > 0)
+    {
+        return sleep_and_call(&timer_, opts_.drain_nsec, STATE(finish));
+    }
+    return call_immediately(STATE(finish));
+}
+
+StateFlowBase::Action CanTraceReplay::finish()
+{
+    if (done_)
+    {
+        done_->notify();
+    }
+    return exit();
+}
+
+CanTraceReplay::FrameKey CanTraceReplay::frame_key(
+    const struct can_frame &frame)
+{
+    uint64_t id = IS_CAN_FRAME_EFF(frame) ? GET_CAN_FRAME_ID_EFF(frame)
+                                          : GET_CAN_FRAME_ID(frame);
+    id = (id << 8) | (frame.can_dlc << 1) | (IS_CAN_FRAME_EFF(frame) ? 1 : 0);
+    uint64_t data = 0;
+    memcpy(&data, frame.data, std::min((unsigned)frame.can_dlc, 8u));
+    return FrameKey(id, data);
+}
+
+void CanTraceReplay::expire_in_flight(long long now)
+{
+    long long limit = now - opts_.latency_window_nsec;
+    while (!sendOrder_.empty() && sendOrder_.front().first < limit)
+    {
+        auto it = inFlight_.find(sendOrder_.front().second);
+        // Observed frames are removed from the front of the per-key queue,
+        // so if the oldest entry for this key is newer than the expiring
+        // send, that send was already matched.
+        if (it != inFlight_.end() &&
+            it->second.front() <= sendOrder_.front().first)
+        {
+            ++lost_;
+            it->second.pop_front();
+            if (it->second.empty())
+            {
+                inFlight_.erase(it);
+            }
+        }
+        sendOrder_.pop_front();
+    }
+}
+
+void CanTraceReplay::frame_observed(const struct can_frame &frame)
+{
+    long long now = os_get_time_monotonic();
+    expire_in_flight(now);
+    auto it = inFlight_.find(frame_key(frame));
+    if (it == inFlight_.end())
+    {
+        ++unmatched_;
+        return;
+    }
+    latencies_.push_back(now - it->second.front());
+    it->second.pop_front();
+    if (it->second.empty())
+    {
+        inFlight_.erase(it);
+    }
+}
+
+/// @return the value at a given percentile of a sorted vector.
+/// @param v sorted values, not empty. @param p percentile in 0..1.
+static long long percentile(const std::vector<long long> &v, double p)
+{
+    size_t idx = (size_t)(p * v.size());
+    if (idx >= v.size())
+    {
+        idx = v.size() - 1;
+    }
+    return v[idx];
+}
+
+CanTraceReplay::Stats CanTraceReplay::stats()
+{
+    Stats s;
+    memset(&s, 0, sizeof(s));
+    s.frames_sent = sent_;
+    s.frames_observed = latencies_.size();
+    s.frames_unmatched = unmatched_;
+    s.frames_lost = lost_;
+    for (const auto &f : inFlight_)
+    {
+        s.frames_lost += f.second.size();
+    }
+    s.elapsed_nsec = lastSend_ - firstSend_;
+    if (s.elapsed_nsec > 0)
+    {
+        s.frames_per_sec = sent_ * 1e9 / s.elapsed_nsec;
+    }
+    if (!latencies_.empty())
+    {
+        std::vector<long long> l(latencies_);
+        std::sort(l.begin(), l.end());
+        s.latency_p50 = percentile(l, 0.5);
+        s.latency_p90 = percentile(l, 0.9);
+        s.latency_p99 = percentile(l, 0.99);
+        s.latency_p999 = percentile(l, 0.999);
+        s.latency_max = l.back();
+    }
+    return s;
+}
+
+/// Shifts an alias.
+/// @param alias the alias to shift. @param offset how much to shift by.
+/// @return new alias in the range 1..0xFFF; zero stays zero.
+static unsigned shift_alias(unsigned alias, unsigned offset)
+{
+    if (!alias)
+    {
+        return 0;
+    }
+    return ((alias - 1 + offset) % 0xFFF) + 1;
+}
+
+void CanTraceReplay::remap_aliases(struct can_frame *frame, unsigned offset)
+{
+    using openlcb::CanDefs;
+    if (!IS_CAN_FRAME_EFF(*frame))
+    {
+        return;
+    }
+    uint32_t id = GET_CAN_FRAME_ID_EFF(*frame);
+    CanDefs::set_src(&id, shift_alias(CanDefs::get_src(id), offset));
+    if (CanDefs::get_frame_type(id) == CanDefs::NMRANET_MSG)
+    {
+        switch (CanDefs::get_can_frame_type(id))
+        {
+            case CanDefs::GLOBAL_ADDRESSED:
+                if ((CanDefs::get_mti(id) & openlcb::Defs::MTI_ADDRESS_MASK) &&
+                    frame->can_dlc >= 2)
+                {
+                    unsigned dst =
+                        ((frame->data[0] & 0x0F) << 8) | frame->data[1];
+                    dst = shift_alias(dst, offset);
+                    frame->data[0] = (frame->data[0] & 0xF0) | (dst >> 8);
+                    frame->data[1] = dst & 0xFF;
+                }
+                break;
+            case CanDefs::DATAGRAM_ONE_FRAME:
+            case CanDefs::DATAGRAM_FIRST_FRAME:
+            case CanDefs::DATAGRAM_MIDDLE_FRAME:
+            case CanDefs::DATAGRAM_FINAL_FRAME:
+            case CanDefs::STREAM_DATA:
+                CanDefs::set_dst(&id, shift_alias(CanDefs::get_dst(id), offset));
+                break;
+            default:
+                break;
+        }
+    }
+    SET_CAN_FRAME_ID_EFF(*frame, id);
+}
@@ -0,0 +1,262 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubReplay.hxx
+ *
+ * Replays recorded CAN traffic into a hub for load testing.
+ *
+ * @author agent
+ * @date 18 Oct 2026
+ */
+
+#ifndef _UTILS_HUBREPLAY_HXX_
+#define _UTILS_HUBREPLAY_HXX_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "executor/StateFlow.hxx"
+#include "utils/Hub.hxx"
+
+/// One frame of a recorded CAN trace.
+struct CanTraceFrame
+{
+    /// When the frame was recorded, in nanoseconds. Only the differences
+    /// between frames are meaningful. Zero for all frames if the trace has no
+    /// timestamps.
+    long long timestamp_nsec;
+    /// The recorded frame.
+    struct can_frame frame;
+};
+
+/// Parses a recorded CAN trace. The format is autodetected: either the binary
+/// capture format written by @ref CanHubCapture, or a GridConnect text log,
+/// optionally with the timestamp prefix that GcPacketPrinter writes (hub -t).
+///
+/// @param contents the entire trace file.
+/// @param frames the parsed frames will be appended here.
+/// @return the number of malformed frames or records that were skipped, or -1
+/// if the file is a binary capture with an unsupported header.
+int parse_can_trace(const std::string &contents,
+    std::vector<CanTraceFrame> *frames);
+
+/// Replays a recorded CAN trace into a hub. The frames can be sent at the
+/// original timing, at a scaled speed or as fast as the hub can take them.
+/// Optionally rewrites the OpenLCB aliases in the frames so that multiple
+/// copies of the same trace can be replayed onto one bus concurrently.
+///
+/// If an observer hub is set, the replay also measures end-to-end latency:
+/// every frame that shows up on the observer hub is matched against the
+/// frames sent, and the time between sending and arrival is recorded.
+///
+/// Usage:
+///   CanTraceReplay::Options opts;
+///   opts.speed = 0; // as fast as possible
+///   CanTraceReplay replay(&can_hub0, &trace, opts);
+///   SyncNotifiable n;
+///   replay.start(&n);
+///   n.wait_for_notification();
+///   auto stats = replay.stats();
+class CanTraceReplay : public StateFlowBase
+{
+public:
+    /// Settings for the replay.
+    struct Options
+    {
+        /// Playback speed relative to the recording. 1 is the original
+        /// timing, 2 is twice as fast. 0 sends the frames as fast as the
+        /// target hub takes them.
+        float speed = 1;
+        /// If nonzero, every OpenLCB alias in the frames (source, and the
+        /// destination of addressed messages, datagrams and streams) is
+        /// shifted by this much, wrapping in the 1..0xFFF range.
+        unsigned alias_offset = 0;
+        /// How many times to play the trace.
+        unsigned repeat = 1;
+        /// At most this many frames may be in flight in the target hub at a
+        /// time. Limits memory use when replaying faster than the target
+        /// can take it.
+        unsigned window = 32;
+        /// After the last frame is sent, wait this long for the observer to
+        /// see the trailing frames.
+        long long drain_nsec = MSEC_TO_NSEC(200);
+        /// A sent frame that did not show up on the observer within this
+        /// time is counted as lost and will not be matched anymore.
+        long long latency_window_nsec = SEC_TO_NSEC(1);
+    };
+
+    /// Results of a replay.
+    struct Stats
+    {
+        /// Number of frames injected into the target.
+        unsigned frames_sent;
+        /// Number of frames seen on the observer hub that matched a sent
+        /// frame.
+        unsigned frames_observed;
+        /// Number of frames seen on the observer hub that did not match any
+        /// frame sent.
+        unsigned frames_unmatched;
+        /// Number of frames sent that were not seen on the observer hub
+        /// within the latency window.
+        unsigned frames_lost;
+        /// Time between sending the first and the last frame.
+        long long elapsed_nsec;
+        /// Achieved send rate.
+        double frames_per_sec;
+        /// Latency percentiles of the observed frames, in nanoseconds. Zero
+        /// if no frames were observed.
+        long long latency_p50;
+        /// 90th percentile latency.
+        long long latency_p90;
+        /// 99th percentile latency.
+        long long latency_p99;
+        /// 99.9th percentile latency.
+        long long latency_p999;
+        /// Largest latency.
+        long long latency_max;
+    };
+
+    /// Constructor.
+    /// @param target hub to inject the frames into. The replay runs on the
+    /// service of this hub.
+    /// @param trace frames to replay. Not owned; must stay alive until the
+    /// replay is done.
+    /// @param opts replay settings.
+    CanTraceReplay(CanHubFlow *target, const std::vector<CanTraceFrame> *trace,
+        const Options &opts);
+
+    ~CanTraceReplay();
+
+    /// Enables latency measurement. Must be called before start().
+    /// @param observer a hub on which the replayed frames will eventually
+    /// show up. This may be the target hub itself, or a hub that is connected
+    /// to the far side of the target. Must run on the same executor as the
+    /// target.
+    void set_observer(CanHubFlow *observer);
+
+    /// Starts the replay.
+    /// @param done will be notified when the replay is complete.
+    void start(Notifiable *done);
+
+    /// @return the results of the replay. Call after the done notification.
+    Stats stats();
+
+    /// Rewrites the aliases in an OpenLCB CAN frame.
+    /// @param frame the frame to modify in place.
+    /// @param offset how much to shift each alias by.
+    static void remap_aliases(struct can_frame *frame, unsigned offset);
+
+private:
+    /// Sends the frames that are due, or sleeps until the next one is due.
+    Action send_batch();
+    /// Waits for trailing frames on the observer.
+    Action drain();
+    /// Notifies the caller.
+    Action finish();
+
+    /// Called by the observer port for every frame seen.
+    /// @param frame the frame that showed up.
+    void frame_observed(const struct can_frame &frame);
+
+    /// Key for matching sent frames to observed frames.
+    typedef std::pair<uint64_t, uint64_t> FrameKey;
+    /// @return the matching key for a frame.
+    /// @param frame a CAN frame.
+    static FrameKey frame_key(const struct can_frame &frame);
+
+    /// Drops the in-flight frames that were sent before the latency window.
+    /// @param now current monotonic time.
+    void expire_in_flight(long long now);
+
+    /// Hub port that forwards frames to frame_observed.
+    class ObserverPort : public CanHubPortInterface
+    {
+    public:
+        /// Constructor. @param parent the replay that owns us.
+        ObserverPort(CanTraceReplay *parent)
+            : parent_(parent)
+        {
+        }
+
+        /// Hub callback. @param message frame @param priority ignored.
+        void send(Buffer<CanHubData> *message, unsigned priority) override
+        {
+            parent_->frame_observed(message->data()->frame());
+            message->unref();
+        }
+
+    private:
+        /// Owner.
+        CanTraceReplay *parent_;
+    };
+
+    /// Where to inject frames.
+    CanHubFlow *target_;
+    /// Frames to replay.
+    const std::vector<CanTraceFrame> *trace_;
+    /// Settings.
+    Options opts_;
+    /// Hub we are observing, or nullptr.
+    CanHubFlow *observer_;
+    /// Registered on observer_.
+    ObserverPort observerPort_;
+    /// Whom to notify when done.
+    Notifiable *done_;
+    /// Used for sleeping until the next frame is due.
+    StateFlowTimer timer_;
+    /// Collects the release of the buffers sent in one batch.
+    BarrierNotifiable bn_;
+
+    /// Index of the next frame to send in trace_.
+    size_t next_;
+    /// How many times the trace was started.
+    unsigned loop_;
+    /// Monotonic time corresponding to the timestamp of the first frame in
+    /// the current loop.
+    long long loopStart_;
+    /// When the first frame was sent.
+    long long firstSend_;
+    /// When the last frame was sent.
+    long long lastSend_;
+
+    /// Number of frames sent.
+    unsigned sent_;
+    /// Number of observed frames without a match.
+    unsigned unmatched_;
+    /// Number of sent frames that expired without being observed.
+    unsigned lost_;
+    /// Send time of the frames in flight, by frame content.
+    std::map<FrameKey, std::deque<long long>> inFlight_;
+    /// Send time and key of the frames in flight, in the order of sending.
+    /// May contain frames that were already observed.
+    std::deque<std::pair<long long, FrameKey>> sendOrder_;
+    /// Measured latencies.
+    std::vector<long long> latencies_;
+};
+
+#endif // _UTILS_HUBREPLAY_HXX_